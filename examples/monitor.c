@@ -84,6 +84,10 @@ static void do_redraw_nodes() {
 			desc = "UDP working";
 			break;
 
+		case DEVTOOL_UDP_RELAYED:
+			desc = "UDP relayed";
+			break;
+
 		case DEVTOOL_UDP_UNKNOWN:
 		default:
 			desc = "unknown";
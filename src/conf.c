@@ -100,27 +100,37 @@ static bool deltree(const char *dirname) {
 	return rmdir(dirname) == 0;
 }
 
-bool sync_path(const char *pathname) {
-	assert(pathname);
-
+/// Sync a file or directory, or if filesystem is true, all data on the filesystem it is on.
+/// This does not log anything, so the persist thread can use it. On failure, errno is set.
+static bool sync_quietly(const char *pathname, bool filesystem) {
 	int fd = open(pathname, O_RDONLY);
 
 	if(fd < 0) {
-		logger(NULL, MESHLINK_ERROR, "Failed to open %s: %s\n", pathname, strerror(errno));
-		meshlink_errno = MESHLINK_ESTORAGE;
 		return false;
 	}
 
-	if(fsync(fd)) {
-		logger(NULL, MESHLINK_ERROR, "Failed to sync %s: %s\n", pathname, strerror(errno));
+#ifdef HAVE_SYNCFS
+	int result = filesystem ? syncfs(fd) : fsync(fd);
+#else
+	assert(!filesystem);
+	int result = fsync(fd);
+#endif
+
+	if(result) {
+		int saved_errno = errno;
 		close(fd);
-		meshlink_errno = MESHLINK_ESTORAGE;
+		errno = saved_errno;
 		return false;
 	}
 
-	if(close(fd)) {
-		logger(NULL, MESHLINK_ERROR, "Failed to close %s: %s\n", pathname, strerror(errno));
-		close(fd);
+	return close(fd) == 0;
+}
+
+bool sync_path(const char *pathname) {
+	assert(pathname);
+
+	if(!sync_quietly(pathname, false)) {
+		logger(NULL, MESHLINK_ERROR, "Failed to sync %s: %s\n", pathname, strerror(errno));
 		meshlink_errno = MESHLINK_ESTORAGE;
 		return false;
 	}
@@ -582,8 +592,9 @@ bool config_read_file(meshlink_handle_t *mesh, FILE *f, config_t *config, const
 	return true;
 }
 
-/// Write a configuration file to a FILE handle.
-bool config_write_file(meshlink_handle_t *mesh, FILE *f, const config_t *config, const void *key) {
+/// Write the contents of a configuration file to a FILE handle.
+/// This does not log anything, so the persist thread can use it. On failure, errno is set.
+static bool write_config_data(FILE *f, const config_t *config, const void *key, bool sync) {
 	assert(f);
 
 	if(key) {
@@ -597,35 +608,21 @@ bool config_write_file(meshlink_handle_t *mesh, FILE *f, const config_t *config,
 
 		if(chacha_poly1305_encrypt_iv96(ctx, seqbuf, config->buf, config->len, buf, &len)) {
 			success = fwrite(seqbuf, sizeof(seqbuf), 1, f) == 1 && fwrite(buf, len, 1, f) == 1;
-
-			if(!success) {
-				logger(mesh, MESHLINK_ERROR, "Cannot write config file: %s", strerror(errno));
-			}
-
-			meshlink_errno = MESHLINK_ESTORAGE;
 		} else {
-			logger(mesh, MESHLINK_ERROR, "Cannot encrypt config file\n");
-			meshlink_errno = MESHLINK_ESTORAGE;
+			errno = EINVAL;
 		}
 
 		chacha_poly1305_exit(ctx);
 		return success;
 	}
 
-	if(fwrite(config->buf, config->len, 1, f) != 1) {
-		logger(mesh, MESHLINK_ERROR, "Cannot write config file: %s", strerror(errno));
-		meshlink_errno = MESHLINK_ESTORAGE;
-		return false;
-	}
-
-	if(fflush(f)) {
-		logger(mesh, MESHLINK_ERROR, "Failed to flush file: %s", strerror(errno));
-		meshlink_errno = MESHLINK_ESTORAGE;
-		return false;
-	}
+	return fwrite(config->buf, config->len, 1, f) == 1 && !fflush(f) && !(sync && fsync(fileno(f)));
+}
 
-	if(fsync(fileno(f))) {
-		logger(mesh, MESHLINK_ERROR, "Failed to sync file: %s\n", strerror(errno));
+/// Write a configuration file to a FILE handle.
+bool config_write_file(meshlink_handle_t *mesh, FILE *f, const config_t *config, const void *key) {
+	if(!write_config_data(f, config, key, true)) {
+		logger(mesh, MESHLINK_ERROR, "Cannot write config file: %s", strerror(errno));
 		meshlink_errno = MESHLINK_ESTORAGE;
 		return false;
 	}
@@ -721,6 +718,24 @@ bool config_scan_all(meshlink_handle_t *mesh, const char *conf_subdir, const cha
 	return true;
 }
 
+/// Write a configuration file to a temporary path, without logging anything. On failure, errno is set.
+static bool write_tmp_file(const char *tmp_path, const config_t *config, void *key, bool sync) {
+	FILE *f = fopen(tmp_path, "w");
+
+	if(!f) {
+		return false;
+	}
+
+	if(!write_config_data(f, config, key, sync)) {
+		int saved_errno = errno;
+		fclose(f);
+		errno = saved_errno;
+		return false;
+	}
+
+	return fclose(f) == 0;
+}
+
 /// Write a host configuration file.
 bool config_write(meshlink_handle_t *mesh, const char *conf_subdir, const char *name, const config_t *config, void *key) {
 	assert(conf_subdir);
@@ -736,22 +751,8 @@ bool config_write(meshlink_handle_t *mesh, const char *conf_subdir, const char *
 	make_host_path(mesh, conf_subdir, name, path, sizeof(path));
 	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
 
-	FILE *f = fopen(tmp_path, "w");
-
-	if(!f) {
-		logger(mesh, MESHLINK_ERROR, "Failed to open `%s': %s", tmp_path, strerror(errno));
-		meshlink_errno = MESHLINK_ESTORAGE;
-		return false;
-	}
-
-	if(!config_write_file(mesh, f, config, key)) {
+	if(!write_tmp_file(tmp_path, config, key, true)) {
 		logger(mesh, MESHLINK_ERROR, "Failed to write `%s': %s", tmp_path, strerror(errno));
-		fclose(f);
-		return false;
-	}
-
-	if(fclose(f)) {
-		logger(mesh, MESHLINK_ERROR, "Failed to close `%s': %s", tmp_path, strerror(errno));
 		meshlink_errno = MESHLINK_ESTORAGE;
 		return false;
 	}
@@ -765,6 +766,92 @@ bool config_write(meshlink_handle_t *mesh, const char *conf_subdir, const char *
 	return true;
 }
 
+// Keep the first error of a batch, errno is not always set when a write fails
+static int first_error(int error) {
+	if(error) {
+		return error;
+	}
+
+	return errno ? errno : EIO;
+}
+
+/// Write a batch of host configuration files, and sync them and their directory.
+/// Where possible, the files are not synced one by one, instead the whole filesystem is synced once before they replace the old files.
+/// Files that cannot be written do not stop the others from being written.
+/// Nothing is logged, so the persist thread can use this. On failure, errno is set to the first error that occurred.
+bool config_write_batch(meshlink_handle_t *mesh, const char *conf_subdir, int count, const char *const *names, const config_t *configs, void *key) {
+	assert(conf_subdir);
+	assert(!count || (names && configs));
+
+	if(!mesh->confbase) {
+		return true;
+	}
+
+#ifdef HAVE_SYNCFS
+	bool sync = false;
+#else
+	bool sync = true;
+#endif
+
+	char path[PATH_MAX];
+	char tmp_path[PATH_MAX + 4];
+	bool *written = xzalloc(count * sizeof(*written));
+	int error = 0;
+
+	for(int i = 0; i < count; i++) {
+		make_host_path(mesh, conf_subdir, names[i], path, sizeof(path));
+		snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+		written[i] = write_tmp_file(tmp_path, &configs[i], key, sync);
+
+		if(!written[i]) {
+			error = first_error(error);
+		}
+	}
+
+#ifdef HAVE_SYNCFS
+	// The data of the new files must be on disk before they replace the old ones
+	snprintf(path, sizeof(path), "%s" SLASH "%s" SLASH "hosts", mesh->confbase, conf_subdir);
+
+	if(!sync_quietly(path, true)) {
+		errno = first_error(error);
+		free(written);
+		return false;
+	}
+
+#endif
+
+	for(int i = 0; i < count; i++) {
+		if(!written[i]) {
+			continue;
+		}
+
+		make_host_path(mesh, conf_subdir, names[i], path, sizeof(path));
+		snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+		if(rename(tmp_path, path)) {
+			error = first_error(error);
+		}
+	}
+
+	free(written);
+
+	// Sync the directories, like config_sync() does
+	snprintf(path, sizeof(path), "%s" SLASH "%s" SLASH "hosts", mesh->confbase, conf_subdir);
+
+	if(!sync_quietly(path, false)) {
+		error = first_error(error);
+	}
+
+	snprintf(path, sizeof(path), "%s" SLASH "%s", mesh->confbase, conf_subdir);
+
+	if(!sync_quietly(path, false)) {
+		error = first_error(error);
+	}
+
+	errno = error;
+	return !error;
+}
+
 /// Delete a host configuration file.
 bool config_delete(meshlink_handle_t *mesh, const char *conf_subdir, const char *name) {
 	assert(conf_subdir);
@@ -33,11 +33,16 @@ void init_connections(meshlink_handle_t *mesh) {
 	assert(!mesh->everyone);
 
 	mesh->connections = list_alloc((list_action_t) free_connection);
+	mesh->core_connections = list_alloc(NULL);
 	mesh->everyone = new_connection();
 	mesh->everyone->name = xstrdup("mesh->everyone");
 }
 
 void exit_connections(meshlink_handle_t *mesh) {
+	if(mesh->core_connections) {
+		list_delete_list(mesh->core_connections);
+	}
+
 	if(mesh->connections) {
 		list_delete_list(mesh->connections);
 	}
@@ -47,6 +52,7 @@ void exit_connections(meshlink_handle_t *mesh) {
 	}
 
 	mesh->connections = NULL;
+	mesh->core_connections = NULL;
 	mesh->everyone = NULL;
 }
 
@@ -89,3 +95,29 @@ void connection_del(meshlink_handle_t *mesh, connection_t *c) {
 	io_del(&mesh->loop, &c->io);
 	list_delete(mesh->connections, c);
 }
+
+/* Active connections are also kept in a list per submesh, and those with nodes in the core mesh in
+   mesh->core_connections, so a request limited to a submesh only visits the connections allowed to see it. */
+
+void connection_activate(meshlink_handle_t *mesh, connection_t *c) {
+	assert(c);
+	assert(c->node);
+	assert(!c->broadcast_node);
+
+	c->status.active = true;
+	c->broadcast_list = c->node->submesh ? c->node->submesh->connections : mesh->core_connections;
+	c->broadcast_node = list_insert_tail(c->broadcast_list, c);
+}
+
+void connection_deactivate(meshlink_handle_t *mesh, connection_t *c) {
+	(void)mesh;
+	assert(c);
+
+	c->status.active = false;
+
+	if(c->broadcast_node) {
+		list_delete_node(c->broadcast_list, c->broadcast_node);
+		c->broadcast_list = NULL;
+		c->broadcast_node = NULL;
+	}
+}
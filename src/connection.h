@@ -41,6 +41,7 @@ typedef struct connection_status_t {
 	uint16_t invitation: 1;             /* 1 if this is an invitation */
 	uint16_t invitation_used: 1;        /* 1 if the invitation has been consumed */
 	uint16_t initiator: 1;              /* 1 if we initiated this connection */
+	uint16_t binary: 1;                 /* 1 if requests can be sent to the other end in binary */
 } connection_status_t;
 
 #include "ecdsa.h"
@@ -73,6 +74,8 @@ typedef struct connection_t {
 
 	struct edge_t *edge;            /* edge associated with this connection */
 	struct submesh_t *submesh;      /* his submesh handle if available in invitation file */
+	struct list_t *broadcast_list;  /* list of active connections in the same submesh as his node */
+	struct list_node_t *broadcast_node; /* our entry in broadcast_list while active */
 
 	// Only used during authentication
 	ecdsa_t *ecdsa;                 /* his public ECDSA key */
@@ -86,5 +89,7 @@ connection_t *new_connection(void) __attribute__((__malloc__));
 void free_connection(connection_t *);
 void connection_add(struct meshlink_handle *mesh, connection_t *);
 void connection_del(struct meshlink_handle *mesh, connection_t *);
+void connection_activate(struct meshlink_handle *mesh, connection_t *);
+void connection_deactivate(struct meshlink_handle *mesh, connection_t *);
 
 #endif
@@ -291,6 +291,8 @@ void devtool_get_node_status(meshlink_handle_t *mesh, meshlink_node_t *node, dev
 		status->udp_status = DEVTOOL_UDP_UNKNOWN;
 	} else if(internal->status.udp_confirmed) {
 		status->udp_status = DEVTOOL_UDP_WORKING;
+	} else if(internal->relay_mtu) {
+		status->udp_status = DEVTOOL_UDP_RELAYED;
 	} else if(internal->mtuprobes > 30) {
 		status->udp_status = DEVTOOL_UDP_FAILED;
 	} else if(internal->mtuprobes > 0) {
@@ -367,3 +369,174 @@ void devtool_force_sptps_renewal(meshlink_handle_t *mesh, meshlink_node_t *node)
 		c->last_key_renewal = -3600;
 	}
 }
+
+bool devtool_set_channel_event_log(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size) {
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	bool result = utcp_set_event_log(channel->c, size);
+
+	if(!result) {
+		meshlink_errno = errno == ENOMEM ? MESHLINK_ENOMEM : MESHLINK_EINVAL;
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+
+	return result;
+}
+
+static const char *event_type_names[] = {
+	[UTCP_EVENT_TIMEOUT] = "timeout",
+	[UTCP_EVENT_FAST_RECOVERY] = "fast_recovery",
+	[UTCP_EVENT_RECOVERY_END] = "recovery_end",
+};
+
+// Take a snapshot of the event log, so it can be written out without holding the mesh lock.
+static struct utcp_event *get_channel_events(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t *nevents) {
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	struct utcp_event *events = NULL;
+	*nevents = utcp_get_events(channel->c, NULL, 0);
+
+	if(*nevents) {
+		events = xmalloc(*nevents * sizeof(*events));
+		*nevents = utcp_get_events(channel->c, events, *nevents);
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+
+	return events;
+}
+
+bool devtool_export_json_channel_events(meshlink_handle_t *mesh, meshlink_channel_t *channel, FILE *stream) {
+	if(!mesh || !channel || !stream) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	size_t nevents;
+	struct utcp_event *events = get_channel_events(mesh, channel, &nevents);
+	bool result = fprintf(stream, "[\n") >= 0;
+
+	for(size_t i = 0; result && i < nevents; i++) {
+		struct utcp_event *e = &events[i];
+		result = fprintf(stream, "\t{ \"time\": %ld.%06ld, \"type\": \"%s\", \"cwnd\": %u, \"ssthresh\": %u, \"flightsize\": %u, \"srtt\": %u, \"rto\": %u }%s\n",
+		                 (long)e->time.tv_sec, e->time.tv_nsec / 1000, event_type_names[e->type], e->cwnd, e->ssthresh, e->flightsize, e->srtt, e->rto,
+		                 i + 1 != nevents ? "," : "") >= 0;
+	}
+
+	result = result && fprintf(stream, "]\n") >= 0;
+	free(events);
+
+	return result;
+}
+
+bool devtool_export_csv_channel_events(meshlink_handle_t *mesh, meshlink_channel_t *channel, FILE *stream) {
+	if(!mesh || !channel || !stream) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	size_t nevents;
+	struct utcp_event *events = get_channel_events(mesh, channel, &nevents);
+	bool result = fprintf(stream, "time,type,cwnd,ssthresh,flightsize,srtt,rto\n") >= 0;
+
+	for(size_t i = 0; result && i < nevents; i++) {
+		struct utcp_event *e = &events[i];
+		result = fprintf(stream, "%ld.%06ld,%s,%u,%u,%u,%u,%u\n",
+		                 (long)e->time.tv_sec, e->time.tv_nsec / 1000, event_type_names[e->type], e->cwnd, e->ssthresh, e->flightsize, e->srtt, e->rto) >= 0;
+	}
+
+	free(events);
+
+	return result;
+}
+
+void devtool_set_graph_verification(meshlink_handle_t *mesh, bool verify) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->sssp_verify = verify;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_force_text_requests(meshlink_handle_t *mesh, bool text_only) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->text_requests_only = text_only;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_set_udp_relaying(meshlink_handle_t *mesh, bool enable) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->udp_relaying_disabled = !enable;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_get_graph_stats(meshlink_handle_t *mesh, devtool_graph_stats_t *stats) {
+	if(!mesh || !stats) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	stats->runs = mesh->graph_runs;
+	stats->edge_updates = mesh->graph_edge_updates + mesh->graph_pending;
+	stats->max_coalesced = mesh->graph_max_coalesced;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void devtool_get_topology_sync_stats(meshlink_handle_t *mesh, devtool_topology_sync_stats_t *stats) {
+	if(!mesh || !stats) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	stats->syncs = mesh->topology_syncs;
+	stats->edges_sent = mesh->topology_edges_sent;
+	stats->edges_skipped = mesh->topology_edges_skipped;
+	stats->bytes_sent = mesh->topology_bytes_sent;
+	stats->bytes_full = mesh->topology_bytes_full;
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
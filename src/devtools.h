@@ -98,6 +98,7 @@ struct devtool_node_status {
 		DEVTOOL_UDP_UNKNOWN = 0,     /// UDP status not known (never tried to communicate with the node)
 		DEVTOOL_UDP_TRYING,          /// UDP detection in progress
 		DEVTOOL_UDP_WORKING,         /// UDP communication established
+		DEVTOOL_UDP_RELAYED,         /// UDP communication established through another node
 	} udp_status;
 	uint64_t in_packets;
 	uint64_t in_bytes;
@@ -185,6 +186,117 @@ extern void (*devtool_sptps_renewal_probe)(meshlink_node_t *node);
  */
 void devtool_force_sptps_renewal(meshlink_handle_t *mesh, meshlink_node_t *node);
 
+/// Enable or disable the congestion event log of a channel.
+/** This keeps the most recent congestion events of the channel, such as retransmission timeouts
+ *  and the start and end of fast recovery, in a ring buffer. Changing the size clears the log.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param size         The maximum number of events to keep, or 0 to disable the log.
+ *
+ *  @return             True in case of success, false otherwise.
+ */
+bool devtool_set_channel_event_log(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size);
+
+/// Export the congestion event log of a channel in JSON format.
+/** @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param stream       An open file to which a JSON array of the logged events will be written, oldest first.
+ *
+ *  @return             True in case of success, false otherwise.
+ */
+bool devtool_export_json_channel_events(meshlink_handle_t *mesh, meshlink_channel_t *channel, FILE *stream);
+
+/// Export the congestion event log of a channel in CSV format.
+/** @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param stream       An open file to which a header line and one line per logged event will be written, oldest first.
+ *
+ *  @return             True in case of success, false otherwise.
+ */
+bool devtool_export_csv_channel_events(meshlink_handle_t *mesh, meshlink_channel_t *channel, FILE *stream);
+
+/// Enable or disable verification of the routing graph.
+/** Normally, the shortest path tree used for routing is updated incrementally when edges are added or removed.
+ *  When verification is enabled, every update is checked against a full breadth-first search of the graph,
+ *  and the program is aborted if the results differ.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param verify       True to check every update of the graph, false to only update it incrementally.
+ */
+void devtool_set_graph_verification(meshlink_handle_t *mesh, bool verify);
+
+/// Force the use of text requests on meta connections.
+/** Nodes normally exchange ADD_EDGE, DEL_EDGE, REQ_KEY and ANS_KEY requests in a binary encoding
+ *  if both sides support it. This forces a node to behave like a node that only supports text requests.
+ *  This only affects connections made after calling this function, so it should be called before meshlink_start().
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param text_only    True to only send and advertise text requests, false to use binary requests when possible.
+ */
+void devtool_force_text_requests(meshlink_handle_t *mesh, bool text_only);
+
+/// Enable or disable relaying of UDP packets.
+/** If direct UDP communication with a node does not work, MeshLink normally tries to send UDP packets
+ *  through a third node that has working UDP with both sides, before falling back to meta connections.
+ *  This can be disabled to compare both ways of communicating.
+ *  This only affects packets sent by this node; it still relays packets for other nodes.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param enable       True to send UDP packets through relays when possible, false to never do so.
+ */
+void devtool_set_udp_relaying(meshlink_handle_t *mesh, bool enable);
+
+/// Statistics about updates of the routing graph.
+typedef struct devtool_graph_stats devtool_graph_stats_t;
+
+/// Statistics about updates of the routing graph.
+/** The counters only ever increase, to get rates, sample them periodically.
+ */
+struct devtool_graph_stats {
+	uint64_t runs;              ///< Number of times the reachability of nodes was checked.
+	uint64_t edge_updates;      ///< Number of edge updates received from other nodes.
+	uint32_t max_coalesced;     ///< Largest number of edge updates that were handled by a single run.
+};
+
+/// Get statistics about updates of the routing graph.
+/** Edge updates received from other nodes are coalesced, so that a burst of updates only causes
+ *  the reachability of nodes to be checked once.
+ *
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param stats        A pointer to a devtool_graph_stats_t variable that has
+ *                      to be provided by the caller.
+ *                      The contents of this variable will be changed to reflect
+ *                      the current statistics.
+ */
+void devtool_get_graph_stats(meshlink_handle_t *mesh, devtool_graph_stats_t *stats);
+
+/// Statistics about the synchronization of the topology with newly connected nodes.
+typedef struct devtool_topology_sync_stats devtool_topology_sync_stats_t;
+
+/// Statistics about the synchronization of the topology with newly connected nodes.
+/** Nodes that both support it exchange a digest of the edges they know about when a connection is activated,
+ *  and then only send the edges the digests disagree about.
+ *  The number of bytes saved is bytes_full - bytes_sent, this does not include the overhead of the meta connection.
+ *  The counters only ever increase.
+ */
+struct devtool_topology_sync_stats {
+	uint64_t syncs;             ///< Number of connections that were synchronized using a topology digest.
+	uint64_t edges_sent;        ///< Number of edges sent because the digests did not match.
+	uint64_t edges_skipped;     ///< Number of edges that did not have to be sent because the digests matched.
+	uint64_t bytes_sent;        ///< Size of the digests and the edges that were sent.
+	uint64_t bytes_full;        ///< Size of all the edges, which would have been sent without digests.
+};
+
+/// Get statistics about the synchronization of the topology with newly connected nodes.
+/** @param mesh         A handle which represents an instance of MeshLink.
+ *  @param stats        A pointer to a devtool_topology_sync_stats_t variable that has
+ *                      to be provided by the caller.
+ *                      The contents of this variable will be changed to reflect
+ *                      the current statistics.
+ */
+void devtool_get_topology_sync_stats(meshlink_handle_t *mesh, devtool_topology_sync_stats_t *stats);
+
 /// Debug function pointer variable for asserting inviter/invitee committing sequence
 /** This function pointer variable is a userspace tracepoint or debugger callback which
  *  invokes either after inviter writing invitees host file into the disk
@@ -21,6 +21,7 @@
 
 #include "splay_tree.h"
 #include "edge.h"
+#include "graph.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "netutl.h"
@@ -90,12 +91,17 @@ void edge_add(meshlink_handle_t *mesh, edge_t *e) {
 
 	if(e->reverse) {
 		e->reverse->reverse = e;
+		sssp_add_edge(mesh, e);
 	}
 }
 
 void edge_del(meshlink_handle_t *mesh, edge_t *e) {
-	if(e->reverse) {
-		e->reverse->reverse = NULL;
+	edge_t *reverse = e->reverse;
+
+	if(reverse) {
+		e->reverse = NULL;
+		reverse->reverse = NULL;
+		sssp_del_edge(mesh, e, reverse);
 	}
 
 	splay_delete(mesh->edges, e);
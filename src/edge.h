@@ -34,6 +34,7 @@ typedef struct edge_t {
 	struct edge_t *reverse;                 /* edge in the opposite direction, if available */
 
 	int weight;                             /* weight of this edge */
+	uint32_t options;                       /* options of the connection, including the protocol minor of the to node */
 	uint32_t session_id;                     /* the session_id of the from node */
 } edge_t;
 
@@ -39,6 +39,14 @@
    The SSSP algorithm will also be used to determine whether nodes are
    reachable from the source. It will also set the correct destination address
    and port of a node if possible.
+
+   Edges are added and removed one at a time, and each change usually only
+   affects a small part of the SSSP tree. So once the tree has been built, it
+   is kept up to date incrementally by edge_add() and edge_del(), and only the
+   nodes whose place in the tree changed have their reachability checked.
+   The full breadth-first search is still used when starting and stopping, and
+   can be used to verify the incremental updates. It runs on a flat copy of the
+   graph, so it does not have to walk the splay trees for every node it visits.
 */
 
 #include "system.h"
@@ -56,74 +64,281 @@
 #include "xalloc.h"
 #include "graph.h"
 
+/* A flat copy of the graph for full searches.
+   Nodes are numbered in the order of mesh->nodes, and the bidirectional edges
+   of node i are stored, in the order of its edge_tree, from offset[i] up to
+   offset[i + 1]. The copy is only rebuilt when edges or nodes have been added
+   or removed since the last search, and the arrays are reused.
+*/
+
+typedef struct graph_edge_t {
+	int to;                 /* Index of the node this edge points to */
+	int weight;
+} graph_edge_t;
+
+typedef struct graph_result_t {
+	int distance;
+	int prevedge;           /* Index of the edge used to reach this node */
+	int weight;             /* Weight of that edge */
+	int nexthop;
+} graph_result_t;
+
+typedef struct graph_snapshot_t {
+	int nnodes;
+	int node_capacity;
+	int edge_capacity;
+
+	node_t **nodes;
+	int *offset;
+	graph_edge_t *adjacency;
+	edge_t **edges;
+
+	graph_result_t *result;
+	int *queue;
+} graph_snapshot_t;
+
+static void graph_snapshot_build(meshlink_handle_t *mesh) {
+	graph_snapshot_t *g = mesh->graph_snapshot;
+
+	if(!g) {
+		g = mesh->graph_snapshot = xzalloc(sizeof(*g));
+	}
+
+	int nnodes = mesh->nodes->count;
+	int max_edges = mesh->edges->count;
+
+	if(nnodes > g->node_capacity) {
+		g->node_capacity = nnodes;
+		g->nodes = xrealloc(g->nodes, nnodes * sizeof(*g->nodes));
+		g->offset = xrealloc(g->offset, (nnodes + 1) * sizeof(*g->offset));
+		g->result = xrealloc(g->result, nnodes * sizeof(*g->result));
+		g->queue = xrealloc(g->queue, nnodes * sizeof(*g->queue));
+	}
+
+	if(max_edges > g->edge_capacity) {
+		g->edge_capacity = max_edges;
+		g->adjacency = xrealloc(g->adjacency, max_edges * sizeof(*g->adjacency));
+		g->edges = xrealloc(g->edges, max_edges * sizeof(*g->edges));
+	}
+
+	int i = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		n->index = i;
+		g->nodes[i++] = n;
+	}
+
+	int nedges = 0;
+
+	for(i = 0; i < nnodes; i++) {
+		g->offset[i] = nedges;
+
+		for splay_each(edge_t, e, g->nodes[i]->edge_tree) {
+			if(!e->reverse) {
+				continue;
+			}
+
+			g->adjacency[nedges].to = e->to->index;
+			g->adjacency[nedges].weight = e->weight;
+			g->edges[nedges] = e;
+			nedges++;
+		}
+	}
+
+	g->offset[nnodes] = nedges;
+	g->nnodes = nnodes;
+	mesh->graph_snapshot_valid = true;
+}
+
+void exit_graph(meshlink_handle_t *mesh) {
+	graph_snapshot_t *g = mesh->graph_snapshot;
+
+	if(g) {
+		free(g->nodes);
+		free(g->offset);
+		free(g->adjacency);
+		free(g->edges);
+		free(g->result);
+		free(g->queue);
+		free(g);
+	}
+
+	mesh->graph_snapshot = NULL;
+	mesh->graph_snapshot_valid = false;
+}
+
 /* Implementation of a simple breadth-first search algorithm.
+   Every node is added to the queue only once, when it is first reached. Other
+   edges reaching it from the same distance can still give it a prevedge with
+   a lower weight, since all of them are examined before the node itself is.
    Running time: O(E)
 */
 
 static void sssp_bfs(meshlink_handle_t *mesh) {
-	list_t *todo_list = list_alloc(NULL);
+	if(!mesh->graph_snapshot_valid) {
+		graph_snapshot_build(mesh);
+	}
 
-	/* Clear visited status on nodes */
+	graph_snapshot_t *g = mesh->graph_snapshot;
+	const int *offset = g->offset;
+	const graph_edge_t *adjacency = g->adjacency;
+	graph_result_t *result = g->result;
+	int *queue = g->queue;
+	int self = mesh->self->index;
 
-	for splay_each(node_t, n, mesh->nodes) {
-		n->status.visited = false;
-		n->distance = -1;
+	for(int i = 0; i < g->nnodes; i++) {
+		result[i].distance = -1;
 	}
 
 	/* Begin with mesh->self */
 
-	mesh->self->status.visited = mesh->threadstarted;
-	mesh->self->nexthop = mesh->self;
-	mesh->self->prevedge = NULL;
-	mesh->self->distance = 0;
-	list_insert_head(todo_list, mesh->self);
+	result[self] = (graph_result_t) {
+		.distance = 0, .prevedge = -1, .nexthop = self
+	};
+	queue[0] = self;
 
-	/* Loop while todo_list is filled */
+	int head = 0;
+	int tail = 1;
 
-	for list_each(node_t, n, todo_list) {                   /* "n" is the node from which we start */
-		logger(mesh, MESHLINK_DEBUG, " Examining edges from %s", n->name);
+	while(head < tail) {
+		int n = queue[head++];                           /* "n" is the node from which we start */
+		int distance = result[n].distance + 1;
+		int nexthop = (n == self) ? -1 : result[n].nexthop;
+		int end = offset[n + 1];
 
-		if(n->distance < 0) {
-			abort();
-		}
+		for(int e = offset[n]; e < end; e++) {
+			int to = adjacency[e].to;
+			int weight = adjacency[e].weight;
+			graph_result_t *r = &result[to];
 
-		for splay_each(edge_t, e, n->edge_tree) {       /* "e" is the edge connected to "from" */
-			if(!e->reverse) {
+			if(to == self) {
 				continue;
 			}
 
-			/* Situation:
+			if(r->distance < 0) {
+				r->distance = distance;
+				queue[tail++] = to;
+			} else if(r->distance != distance || weight >= r->weight) {
+				continue;
+			}
 
-			           /
-			          /
-			   ----->(n)---e-->(e->to)
-			          \
-			           \
+			r->prevedge = e;
+			r->weight = weight;
+			r->nexthop = nexthop < 0 ? to : nexthop;
+		}
+	}
 
-			   Where e is an edge, (n) and (e->to) are nodes.
-			   n->address is set to the e->address of the edge left of n to n.
-			   We are currently examining the edge e right of n from n:
+	/* Copy the results back to the nodes */
 
-			   - If edge e provides for better reachability of e->to, update
-			     e->to and (re)add it to the todo_list to (re)examine the reachability
-			     of nodes behind it.
-			 */
+	for(int i = 0; i < g->nnodes; i++) {
+		node_t *n = g->nodes[i];
 
-			if(e->to->status.visited
-			                && (e->to->distance != n->distance + 1 || e->weight >= e->to->prevedge->weight)) {
-				continue;
-			}
+		n->distance = result[i].distance;
+
+		if(n->distance < 0) {
+			n->status.visited = false;
+			n->prevedge = NULL;
+			continue;
+		}
+
+		n->status.visited = true;
+		n->nexthop = g->nodes[result[i].nexthop];
+
+		if(i == self) {
+			n->status.visited = mesh->threadstarted;
+			n->prevedge = NULL;
+			continue;
+		}
+
+		edge_t *e = g->edges[result[i].prevedge];
+		n->prevedge = e;
+
+		if(!n->status.reachable || (n->address.sa.sa_family == AF_UNSPEC && e->address.sa.sa_family != AF_UNKNOWN)) {
+			update_node_udp(mesh, n, &e->address);
+		}
+	}
+}
+
+/* Remember that the reachability of a node has to be checked. */
 
-			e->to->status.visited = true;
-			e->to->nexthop = (n->nexthop == mesh->self) ? e->to : n->nexthop;
-			e->to->prevedge = e;
-			e->to->distance = n->distance + 1;
+static void sssp_changed(meshlink_handle_t *mesh, node_t *n) {
+	if(!n->status.sssp_changed) {
+		n->status.sssp_changed = true;
+		list_insert_tail(mesh->sssp_changed, n);
+	}
+}
+
+static void sssp_clear_changed(meshlink_handle_t *mesh) {
+	for list_each(node_t, n, mesh->sssp_changed) {
+		n->status.sssp_changed = false;
+		list_delete_node(mesh->sssp_changed, list_node);
+	}
+}
+
+/* Check whether edge e gives e->to a shorter path, or an equally short path with a lower weight. */
 
-			if(!e->to->status.reachable || (e->to->address.sa.sa_family == AF_UNSPEC && e->address.sa.sa_family != AF_UNKNOWN)) {
-				update_node_udp(mesh, e->to, &e->address);
+static bool sssp_improves(const edge_t *e) {
+	const node_t *to = e->to;
+
+	if(to->distance < 0 || e->from->distance + 1 < to->distance) {
+		return true;
+	}
+
+	return e->from->distance + 1 == to->distance && e->weight < to->prevedge->weight;
+}
+
+/* Make edge e the prevedge of e->to, e->from must already be part of the tree. */
+
+static void sssp_set_prevedge(meshlink_handle_t *mesh, edge_t *e) {
+	node_t *n = e->to;
+
+	n->status.visited = true;
+	n->nexthop = (e->from->nexthop == mesh->self) ? n : e->from->nexthop;
+	n->prevedge = e;
+	n->distance = e->from->distance + 1;
+
+	if(!n->status.reachable || (n->address.sa.sa_family == AF_UNSPEC && e->address.sa.sa_family != AF_UNKNOWN)) {
+		update_node_udp(mesh, n, &e->address);
+	}
+
+	sssp_changed(mesh, n);
+}
+
+/* An edge and its reverse now both exist.
+   Distances can only decrease, so starting from the endpoints of the new edge,
+   we propagate any improvements the same way sssp_bfs() does. A node whose
+   distance stays the same might still get a new nexthop, which has to be
+   propagated to the nodes behind it as well.
+   Running time: O(E) of the affected part of the tree.
+*/
+
+void sssp_add_edge(meshlink_handle_t *mesh, edge_t *e) {
+	mesh->graph_snapshot_valid = false;
+
+	if(!mesh->sssp_valid) {
+		return;
+	}
+
+	list_t *todo_list = list_alloc(NULL);
+	edge_t *edges[2] = {e, e->reverse};
+
+	for(int i = 0; i < 2; i++) {
+		if(edges[i]->from->distance >= 0 && edges[i]->to != mesh->self && sssp_improves(edges[i])) {
+			sssp_set_prevedge(mesh, edges[i]);
+			list_insert_tail(todo_list, edges[i]->to);
+		}
+	}
+
+	for list_each(node_t, n, todo_list) {
+		for splay_each(edge_t, f, n->edge_tree) {
+			if(!f->reverse || f->to == mesh->self) {
+				continue;
 			}
 
-			list_insert_tail(todo_list, e->to);
+			if(sssp_improves(f) || (f->to->prevedge == f && f->to->nexthop != ((n->nexthop == mesh->self) ? f->to : n->nexthop))) {
+				sssp_set_prevedge(mesh, f);
+				list_insert_tail(todo_list, f->to);
+			}
 		}
 
 		list_next = list_node->next; /* Because the list_insert_tail() above could have added something extra for us! */
@@ -133,66 +348,217 @@ static void sssp_bfs(meshlink_handle_t *mesh) {
 	list_free(todo_list);
 }
 
-static void check_reachability(meshlink_handle_t *mesh) {
-	/* Check reachability status. */
+static int node_distance_compare(const void *va, const void *vb) {
+	const node_t *a = *(const node_t **)va;
+	const node_t *b = *(const node_t **)vb;
 
-	int reachable = -1; /* Don't count ourself */
+	return a->distance - b->distance;
+}
 
-	for splay_each(node_t, n, mesh->nodes) {
-		if(n->status.visited) {
-			reachable++;
-		}
+/* Edge e and its reverse no longer form a bidirectional pair.
+   If one of them is part of the tree, the subtree below it is cut loose.
+   Each node in the subtree that has a neighbour outside of it gets that
+   neighbour as a tentative parent. Starting with the closest of those nodes,
+   the subtree is then rebuilt one distance at a time, just like sssp_bfs()
+   would, but without touching the rest of the tree. Nodes that cannot be
+   reached anymore are left unvisited.
+   Running time: O(E log E) of the subtree.
+*/
+
+void sssp_del_edge(meshlink_handle_t *mesh, edge_t *e, edge_t *reverse) {
+	mesh->graph_snapshot_valid = false;
+
+	if(!mesh->sssp_valid) {
+		return;
+	}
+
+	node_t *root;
 
-		/* Check for nodes that have changed session_id */
-		if(n->status.visited && n->prevedge && n->prevedge->reverse->session_id != n->session_id) {
-			n->session_id = n->prevedge->reverse->session_id;
+	if(e->to->prevedge == e) {
+		root = e->to;
+	} else if(reverse->to->prevedge == reverse) {
+		root = reverse->to;
+	} else {
+		return;
+	}
+
+	/* Collect the subtree */
 
-			if(n->utcp) {
-				utcp_abort_all_connections(n->utcp);
+	list_t *subtree = list_alloc(NULL);
+	list_insert_tail(subtree, root);
+
+	for list_each(node_t, n, subtree) {
+		for splay_each(edge_t, f, n->edge_tree) {
+			if(f->to->prevedge == f) {
+				list_insert_tail(subtree, f->to);
 			}
+		}
+
+		list_next = list_node->next;
+	}
+
+	for list_each(node_t, n, subtree) {
+		n->status.visited = false;
+		n->distance = -1;
+		n->prevedge = NULL;
+		sssp_changed(mesh, n);
+	}
+
+	/* Find the best path into the subtree for each of its nodes, if there is any */
 
-			if(n->status.visited == n->status.reachable) {
-				/* This session replaces the previous one without changing reachability status.
-				 * We still need to reset the UDP SPTPS state.
-				 */
-				n->status.validkey = false;
-				sptps_stop(&n->sptps);
-				n->status.waitingforkey = false;
-				n->last_req_key = -3600;
+	node_t **seeds = xmalloc(subtree->count * sizeof(*seeds));
+	size_t count = 0;
 
-				n->status.udp_confirmed = false;
-				n->maxmtu = MTU;
-				n->minmtu = 0;
-				n->mtuprobes = 0;
+	for list_each(node_t, n, subtree) {
+		for splay_each(edge_t, f, n->edge_tree) {
+			edge_t *in = f->reverse;
+
+			if(!in || in->from->distance < 0) {
+				continue;
+			}
 
-				timeout_del(&mesh->loop, &n->mtutimeout);
+			if(!n->prevedge || in->from->distance < n->prevedge->from->distance || (in->from->distance == n->prevedge->from->distance && in->weight < n->prevedge->weight)) {
+				n->prevedge = in;
 			}
 		}
 
-		if(n->status.visited != n->status.reachable) {
-			n->status.reachable = !n->status.reachable;
-			n->status.dirty = true;
+		if(n->prevedge) {
+			seeds[count++] = n;
+		}
+	}
 
-			if(!n->status.blacklisted) {
-				if(n->status.reachable) {
-					logger(mesh, MESHLINK_DEBUG, "Node %s became reachable", n->name);
-					bool first_time_reachable = !n->last_reachable;
-					n->last_reachable = time(NULL);
+	for(size_t i = 0; i < count; i++) {
+		seeds[i]->distance = seeds[i]->prevedge->from->distance + 1;
+	}
 
-					if(first_time_reachable) {
-						if(!node_write_config(mesh, n)) {
-							logger(mesh, MESHLINK_WARNING, "Could not write host config file for node %s!\n", n->name);
+	qsort(seeds, count, sizeof(*seeds), node_distance_compare);
 
-						}
-					}
-				} else {
-					logger(mesh, MESHLINK_DEBUG, "Node %s became unreachable", n->name);
-					n->last_unreachable = time(NULL);
+	/* Rebuild the subtree in order of increasing distance.
+	   All nodes in the todo_list have the same distance, or one more than that.
+	   Before the first node of the next distance is handled, the seeds with
+	   that distance are added, so that all its possible parents are known. */
+
+	list_t *todo_list = list_alloc(NULL);
+	size_t next_seed = 0;
+	int distance = -1;
+
+	while(true) {
+		node_t *n = list_get_head(todo_list);
+
+		if(!n || n->distance != distance) {
+			while(next_seed < count && seeds[next_seed]->status.visited) {
+				next_seed++;
+			}
+
+			if(n) {
+				distance = n->distance;
+			} else if(next_seed < count) {
+				distance = seeds[next_seed]->distance;
+			} else {
+				break;
+			}
+
+			for(; next_seed < count && (seeds[next_seed]->status.visited || seeds[next_seed]->distance <= distance); next_seed++) {
+				if(!seeds[next_seed]->status.visited) {
+					list_insert_tail(todo_list, seeds[next_seed]);
 				}
 			}
 
-			/* TODO: only clear status.validkey if node is unreachable? */
+			continue;
+		}
+
+		list_delete_head(todo_list);
 
+		if(n->status.visited) {
+			continue;
+		}
+
+		/* All possible parents have been seen, so n's prevedge is final */
+
+		sssp_set_prevedge(mesh, n->prevedge);
+
+		for splay_each(edge_t, f, n->edge_tree) {
+			node_t *to = f->to;
+
+			if(!f->reverse || to->status.visited || to == mesh->self) {
+				continue;
+			}
+
+			if(to->distance < 0 || distance + 1 < to->distance) {
+				to->distance = distance + 1;
+				to->prevedge = f;
+				list_insert_tail(todo_list, to);
+			} else if(distance + 1 == to->distance && f->weight < to->prevedge->weight) {
+				to->prevedge = f;
+			}
+		}
+	}
+
+	list_free(todo_list);
+	free(seeds);
+	list_delete_list(subtree);
+}
+
+/* Check the incrementally updated tree against the result of sssp_bfs().
+   If a node has multiple equally good prevedges, either one might have been
+   chosen, so apart from the distance we only compare the weight of the prevedge.
+*/
+
+static void sssp_verify(meshlink_handle_t *mesh) {
+	struct {
+		bool visited;
+		int distance;
+		int weight;
+	} *expected = xmalloc(mesh->nodes->count * sizeof(*expected));
+
+	size_t i = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		expected[i].visited = n->status.visited;
+		expected[i].distance = n->distance;
+		expected[i].weight = n->prevedge ? n->prevedge->weight : 0;
+
+		if(n != mesh->self && n->status.visited) {
+			node_t *parent = n->prevedge->from;
+
+			if(n->prevedge->to != n || !n->prevedge->reverse || parent->distance + 1 != n->distance || n->nexthop != ((parent->nexthop == mesh->self) ? n : parent->nexthop)) {
+				logger(mesh, MESHLINK_ERROR, "Inconsistent SSSP tree at node %s", n->name);
+				abort();
+			}
+		}
+
+		i++;
+	}
+
+	sssp_bfs(mesh);
+
+	i = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		if(n != mesh->self && (expected[i].visited != n->status.visited || expected[i].distance != n->distance || expected[i].weight != (n->prevedge ? n->prevedge->weight : 0))) {
+			logger(mesh, MESHLINK_ERROR, "Incremental SSSP result for node %s differs from full search", n->name);
+			abort();
+		}
+
+		i++;
+	}
+
+	free(expected);
+}
+
+static void check_node_reachability(meshlink_handle_t *mesh, node_t *n) {
+	/* Check for nodes that have changed session_id */
+	if(n->status.visited && n->prevedge && n->prevedge->reverse->session_id != n->session_id) {
+		n->session_id = n->prevedge->reverse->session_id;
+
+		if(n->utcp) {
+			utcp_abort_all_connections(n->utcp);
+		}
+
+		if(n->status.visited == n->status.reachable) {
+			/* This session replaces the previous one without changing reachability status.
+			 * We still need to reset the UDP SPTPS state.
+			 */
 			n->status.validkey = false;
 			sptps_stop(&n->sptps);
 			n->status.waitingforkey = false;
@@ -202,28 +568,72 @@ static void check_reachability(meshlink_handle_t *mesh) {
 			n->maxmtu = MTU;
 			n->minmtu = 0;
 			n->mtuprobes = 0;
+			n->relay = NULL;
+			n->relay_mtu = 0;
 
 			timeout_del(&mesh->loop, &n->mtutimeout);
+		}
+	}
 
-			if(!n->status.blacklisted) {
-				update_node_status(mesh, n);
-			}
+	if(n->status.visited != n->status.reachable) {
+		n->status.reachable = !n->status.reachable;
+		n->status.dirty = true;
+		node_autoconnect_changed(mesh, n);
+
+		if(!n->status.blacklisted) {
+			if(n->status.reachable) {
+				logger(mesh, MESHLINK_DEBUG, "Node %s became reachable", n->name);
+				bool first_time_reachable = !n->last_reachable;
+				n->last_reachable = time(NULL);
 
-			if(!n->status.reachable) {
-				update_node_udp(mesh, n, NULL);
-				n->status.broadcast = false;
-			} else if(n->connection) {
-				if(n->connection->status.initiator) {
-					send_req_key(mesh, n);
+				if(first_time_reachable) {
+					if(!node_write_config(mesh, n, false)) {
+						logger(mesh, MESHLINK_WARNING, "Could not write host config file for node %s!\n", n->name);
+
+					}
 				}
+			} else {
+				logger(mesh, MESHLINK_DEBUG, "Node %s became unreachable", n->name);
+				n->last_unreachable = time(NULL);
 			}
+		}
+
+		/* TODO: only clear status.validkey if node is unreachable? */
 
-			if(n->utcp) {
-				utcp_offline(n->utcp, !n->status.reachable);
+		n->status.validkey = false;
+		sptps_stop(&n->sptps);
+		n->status.waitingforkey = false;
+		n->last_req_key = -3600;
+
+		n->status.udp_confirmed = false;
+		n->maxmtu = MTU;
+		n->minmtu = 0;
+		n->mtuprobes = 0;
+		n->relay = NULL;
+		n->relay_mtu = 0;
+
+		timeout_del(&mesh->loop, &n->mtutimeout);
+
+		if(!n->status.blacklisted) {
+			update_node_status(mesh, n);
+		}
+
+		if(!n->status.reachable) {
+			update_node_udp(mesh, n, NULL);
+			n->status.broadcast = false;
+		} else if(n->connection) {
+			if(n->connection->status.initiator) {
+				send_req_key(mesh, n);
 			}
 		}
+
+		if(n->utcp) {
+			utcp_offline(n->utcp, !n->status.reachable);
+		}
 	}
+}
 
+static void update_reachable_count(meshlink_handle_t *mesh, int reachable) {
 	if(mesh->reachable != reachable) {
 		if(!reachable) {
 			mesh->last_unreachable = mesh->loop.now.tv_sec;
@@ -239,7 +649,99 @@ static void check_reachability(meshlink_handle_t *mesh) {
 	}
 }
 
+static void check_reachability(meshlink_handle_t *mesh) {
+	/* Check reachability status. */
+
+	int reachable = -1; /* Don't count ourself */
+
+	for splay_each(node_t, n, mesh->nodes) {
+		if(n->status.visited) {
+			reachable++;
+		}
+
+		check_node_reachability(mesh, n);
+	}
+
+	update_reachable_count(mesh, reachable);
+}
+
+/* Only check the nodes whose place in the tree changed since the last check.
+   Callbacks might cause more changes, so take the nodes off the list one by one. */
+
+static void check_changed_reachability(meshlink_handle_t *mesh) {
+	int reachable = mesh->reachable;
+	node_t *n;
+
+	while((n = list_get_head(mesh->sssp_changed))) {
+		list_delete_head(mesh->sssp_changed);
+		n->status.sssp_changed = false;
+
+		bool was_reachable = n->status.reachable;
+		check_node_reachability(mesh, n);
+		reachable += n->status.reachable - was_reachable;
+	}
+
+	update_reachable_count(mesh, reachable);
+}
+
 void graph(meshlink_handle_t *mesh) {
-	sssp_bfs(mesh);
+	timeout_del(&mesh->loop, &mesh->graph_timeout);
+
+	if(mesh->graph_pending > 1) {
+		logger(mesh, MESHLINK_DEBUG, "Coalesced %d edge updates", mesh->graph_pending);
+	}
+
+	if(mesh->graph_pending > mesh->graph_max_coalesced) {
+		mesh->graph_max_coalesced = mesh->graph_pending;
+	}
+
+	mesh->graph_edge_updates += mesh->graph_pending;
+	mesh->graph_pending = 0;
+	mesh->graph_runs++;
+
+	if(!mesh->sssp_valid || mesh->self->status.visited != mesh->threadstarted) {
+		sssp_bfs(mesh);
+		mesh->sssp_valid = true;
+	} else if(mesh->sssp_verify) {
+		sssp_verify(mesh);
+	} else {
+		check_changed_reachability(mesh);
+		return;
+	}
+
+	sssp_clear_changed(mesh);
 	check_reachability(mesh);
 }
+
+static void graph_handler(event_loop_t *loop, void *data) {
+	(void)loop;
+	graph(data);
+}
+
+/* Edge updates tend to come in bursts, for example when a node connects and
+   gets sent all the edges we know about. Instead of running graph() for each
+   update, run it once at the end of the current event loop iteration. The
+   SSSP tree itself is always up to date, only the reachability checks and the
+   callbacks that follow from them are delayed.
+*/
+
+void graph_schedule(meshlink_handle_t *mesh) {
+	mesh->graph_pending++;
+
+	if(!mesh->graph_timeout.cb) {
+		timeout_add(&mesh->loop, &mesh->graph_timeout, graph_handler, mesh, &(struct timespec) {
+			0, 0
+		});
+	}
+}
+
+/* Run a scheduled graph() right away. This is only done before handling a request other than an edge update,
+   since those might depend on up to date reachability information. Everything else uses the SSSP tree,
+   which is always up to date, and the reachability flags are updated at the end of the event loop iteration.
+   Callbacks should only be called from MeshLink's own thread, anywhere else we just wait for the timeout. */
+
+void graph_flush(meshlink_handle_t *mesh) {
+	if(mesh->graph_timeout.cb && mesh->threadstarted && pthread_equal(pthread_self(), mesh->thread)) {
+		graph(mesh);
+	}
+}
@@ -20,6 +20,14 @@
     51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
 */
 
+struct edge_t;
+struct meshlink_handle;
+
 void graph(struct meshlink_handle *mesh);
+void exit_graph(struct meshlink_handle *mesh);
+void graph_schedule(struct meshlink_handle *mesh);
+void graph_flush(struct meshlink_handle *mesh);
+void sssp_add_edge(struct meshlink_handle *mesh, struct edge_t *e);
+void sssp_del_edge(struct meshlink_handle *mesh, struct edge_t *e, struct edge_t *reverse);
 
 #endif
@@ -45,6 +45,31 @@ static uint32_t hash_function(const void *p, size_t len) {
 	return hash;
 }
 
+/* 64 bit hash function, for when collisions have to be unlikely enough to be ignored */
+
+uint64_t hash64(const void *p, size_t len, uint64_t seed) {
+	const uint8_t *q = p;
+	uint64_t hash = seed ^ (len * 0x9e3779b97f4a7c15ULL);
+
+	for(; len >= 8; q += 8, len -= 8) {
+		uint64_t word;
+		memcpy(&word, q, 8);
+		hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+		hash ^= hash >> 31;
+	}
+
+	if(len) {
+		uint64_t word = 0;
+		memcpy(&word, q, len);
+		hash = (hash ^ word) * 0xbf58476d1ce4e5b9ULL;
+		hash ^= hash >> 31;
+	}
+
+	hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+	return hash ^ (hash >> 31);
+}
+
 /* Map 32 bits int onto 0..n-1, without throwing away too many bits if n is 2^8 or 2^16 */
 
 static uint32_t modulo(uint32_t hash, size_t n) {
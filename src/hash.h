@@ -38,4 +38,6 @@ void *hash_search_or_insert(hash_t *, const void *key, const void *value);
 void hash_clear(hash_t *);
 void hash_resize(hash_t *, size_t n);
 
+uint64_t hash64(const void *p, size_t len, uint64_t seed) __attribute__((__warn_unused_result__));
+
 #endif
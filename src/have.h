@@ -124,6 +124,10 @@
 #include <ifaddrs.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #ifdef HAVE_MINGW
 #define SLASH "\\"
 #else
@@ -23,6 +23,13 @@
 #include <meshlink.h>
 #include <new> // for 'placement new'
 
+#if __cplusplus >= 202002L && __has_include(<coroutine>)
+#define MESHLINK_COROUTINES 1
+#include <atomic>
+#include <coroutine>
+#include <span>
+#endif
+
 namespace meshlink {
 class mesh;
 class node;
@@ -35,6 +42,18 @@ typedef meshlink_log_level_t log_level_t;
 /// Code of most recent error encountered.
 typedef meshlink_errno_t errno_t;
 
+/// Statistics about a channel.
+typedef meshlink_channel_stats_t channel_stats_t;
+
+/// A queue of completed asynchronous channel I/O requests.
+typedef meshlink_completion_queue_t completion_queue_t;
+
+/// An asynchronous channel I/O request.
+typedef meshlink_aio_request_t aio_request_t;
+
+/// A completed asynchronous channel I/O request.
+typedef meshlink_aio_completion_t aio_completion_t;
+
 /// A callback for receiving data from the mesh.
 /** @param mesh      A handle which represents an instance of MeshLink.
  *  @param source    A pointer to a meshlink::node describing the source of the data.
@@ -83,8 +102,9 @@ typedef void (*log_cb_t)(mesh *mesh, log_level_t level, const char *text);
 /** @param mesh         A handle which represents an instance of MeshLink.
  *  @param channel      A handle for the incoming channel.
  *  @param port         The port number the peer wishes to connect to.
- *  @param data         A pointer to a buffer containing data already received. (Not yet used.)
- *  @param len          The length of the data. (Not yet used.)
+ *  @param data         A pointer to a buffer containing data already received, or NULL in case no data has been received yet.
+ *                      If the application accepts the channel, it is responsible for processing this data.
+ *  @param len          The length of the data.
  *
  *  @return             This function should return true if the application accepts the incoming channel, false otherwise.
  *                      If returning false, the channel is invalid and may not be used anymore.
@@ -149,6 +169,196 @@ public:
 	static const uint32_t UDP = MESHLINK_CHANNEL_UDP;
 };
 
+#ifdef MESHLINK_COROUTINES
+/// An executor on which coroutines waiting for channel operations are resumed.
+/** MeshLink never resumes a coroutine on its own thread.
+ *  Instead, when an operation completes, the coroutine waiting for it is handed to the executor that was passed when the channel was set up.
+ */
+class executor {
+public:
+	virtual ~executor() {}
+
+	/// Schedule a suspended coroutine to be resumed.
+	/** This function is called from MeshLink's own thread while it holds its lock.
+	 *  It must not block, and must not resume the coroutine itself.
+	 *
+	 *  @param coroutine    The coroutine to resume.
+	 */
+	virtual void post(std::coroutine_handle<> coroutine) = 0;
+};
+
+/// An operation on a channel that can be awaited by a coroutine.
+/** The operation starts as soon as it is created, and must be awaited before it goes out of scope.
+ *  Its state lives in the awaiting coroutine's frame, so no memory is allocated for it.
+ *  Awaiting it returns the number of bytes transferred, or -1 if the operation could not be started.
+ */
+class [[nodiscard]] channel_operation {
+public:
+	channel_operation(const channel_operation &) = delete;
+	void operator=(const channel_operation &) = delete;
+
+	bool await_ready() const noexcept {
+		return state.load(std::memory_order_acquire) == DONE;
+	}
+
+	bool await_suspend(std::coroutine_handle<> coroutine) noexcept {
+		waiter = coroutine;
+		int expected = STARTED;
+
+		// If the operation finished in the meantime, don't suspend at all.
+		return state.compare_exchange_strong(expected, WAITING, std::memory_order_acq_rel);
+	}
+
+	ssize_t await_resume() const noexcept {
+		return result;
+	}
+
+protected:
+	explicit channel_operation(executor &exec) : resume_exec(exec) {}
+
+	void complete(ssize_t len) noexcept {
+		result = len;
+
+		if(state.exchange(DONE, std::memory_order_acq_rel) == WAITING) {
+			resume_exec.post(waiter);
+		}
+	}
+
+	static void aio_trampoline(meshlink_handle_t *handle, meshlink_channel_t *channel, const void *data, size_t len, void *priv) {
+		(void)handle;
+		(void)channel;
+		(void)data;
+		static_cast<channel_operation *>(priv)->complete(len);
+	}
+
+private:
+	enum {STARTED, WAITING, DONE};
+
+	executor &resume_exec;
+	std::coroutine_handle<> waiter;
+	std::atomic<int> state{STARTED};
+	ssize_t result = -1;
+};
+
+/// Sending data on a channel from a coroutine.
+/** This completes when MeshLink has finished using the buffer.
+ *  The buffer must not be modified until then.
+ */
+class [[nodiscard]] send_operation: public channel_operation {
+public:
+	send_operation(meshlink_handle_t *handle, channel *ch, executor &exec, const void *data, size_t len) : channel_operation(exec) {
+		if(!meshlink_channel_aio_send(handle, ch, data, len, &aio_trampoline, this)) {
+			complete(-1);
+		}
+	}
+};
+
+/// Receiving data on a channel from a coroutine.
+/** This completes when the buffer has been filled completely, or early if the channel was closed.
+ *  While no receive operation is outstanding, incoming data is passed to mesh::channel_receive() instead.
+ */
+class [[nodiscard]] receive_operation: public channel_operation {
+public:
+	receive_operation(meshlink_handle_t *handle, channel *ch, executor &exec, void *data, size_t len) : channel_operation(exec) {
+		if(!meshlink_channel_aio_receive(handle, ch, data, len, &aio_trampoline, this)) {
+			complete(-1);
+		}
+	}
+};
+
+/// A channel that can be used from coroutines.
+/** This is a lightweight handle that can be freely copied. It does not own the underlying channel.
+ */
+class async_channel {
+public:
+	async_channel() : mesh_handle(0), chan(0), resume_exec(0) {}
+	async_channel(meshlink_handle_t *handle, channel *ch, executor &exec) : mesh_handle(handle), chan(ch), resume_exec(&exec) {}
+
+	/// Check whether this refers to an open channel.
+	explicit operator bool() const {
+		return chan != 0;
+	}
+
+	/// Get the underlying channel.
+	channel *get() const {
+		return chan;
+	}
+
+	/// Send data on the channel.
+	/** This is backed by meshlink_channel_aio_send(), and has the same restrictions.
+	 *
+	 *  @param data         A pointer to a buffer containing data to send.
+	 *  @param len          The length of the data.
+	 *
+	 *  @return             An operation to co_await, which yields the number of bytes sent.
+	 */
+	send_operation send(const void *data, size_t len) {
+		return send_operation(mesh_handle, chan, *resume_exec, data, len);
+	}
+
+	template<typename T, size_t N>
+	send_operation send(std::span<T, N> data) {
+		return send(data.data(), data.size_bytes());
+	}
+
+	/// Receive data from the channel.
+	/** This is backed by meshlink_channel_aio_receive(), and has the same restrictions.
+	 *
+	 *  @param data         A pointer to a buffer that will be filled with received data.
+	 *  @param len          The length of the buffer.
+	 *
+	 *  @return             An operation to co_await, which yields the number of bytes received.
+	 */
+	receive_operation receive(void *data, size_t len) {
+		return receive_operation(mesh_handle, chan, *resume_exec, data, len);
+	}
+
+	template<typename T, size_t N>
+	receive_operation receive(std::span<T, N> data) {
+		return receive(data.data(), data.size_bytes());
+	}
+
+	/// Close the channel.
+	/** Any outstanding operations complete early.
+	 */
+	void close() {
+		meshlink_channel_close(mesh_handle, chan);
+		chan = 0;
+	}
+
+private:
+	meshlink_handle_t *mesh_handle;
+	channel *chan;
+	executor *resume_exec;
+};
+
+/// Opening a channel from a coroutine.
+/** This completes when the connection handshake with the peer has finished, or immediately for unreliable channels.
+ *  Awaiting it returns an async_channel, which is empty if the channel could not be opened.
+ *  If the peer's application rejects the channel afterwards, outstanding operations on it complete early.
+ */
+class [[nodiscard]] open_operation: public channel_operation {
+public:
+	inline open_operation(mesh &m, node *node, uint16_t port, executor &exec, uint32_t flags);
+
+	async_channel await_resume() {
+		if(channel_operation::await_resume() <= 0 && chan) {
+			meshlink_channel_close(mesh_handle, chan);
+			chan = 0;
+		}
+
+		return chan ? async_channel(mesh_handle, chan, resume_exec) : async_channel();
+	}
+
+private:
+	static void poll_trampoline(meshlink_handle_t *handle, meshlink_channel_t *channel, size_t len);
+
+	meshlink_handle_t *mesh_handle;
+	channel *chan;
+	executor &resume_exec;
+};
+#endif
+
 /// A class describing a MeshLink mesh.
 class mesh {
 public:
@@ -284,8 +494,9 @@ public:
 	 *
 	 *  @param channel      A handle for the incoming channel.
 	 *  @param port         The port number the peer wishes to connect to.
-	 *  @param data         A pointer to a buffer containing data already received. (Not yet used.)
-	 *  @param len          The length of the data. (Not yet used.)
+	 *  @param data         A pointer to a buffer containing data already received, or NULL in case no data has been received yet.
+	 *                      If the application accepts the channel, it is responsible for processing this data.
+	 *  @param len          The length of the data.
 	 *
 	 *  @return             This function should return true if the application accepts the incoming channel, false otherwise.
 	 *                      If returning false, the channel is invalid and may not be used anymore.
@@ -790,6 +1001,8 @@ public:
 	/// Set the send buffer size of a channel.
 	/** This function sets the desired size of the send buffer.
 	 *  The default size is 128 kB.
+	 *  By default, the send buffer grows automatically to match the receive window of the peer.
+	 *  Setting the size explicitly disables this.
 	 *
 	 *  @param channel   A handle for the channel.
 	 *  @param size      The desired size for the send buffer.
@@ -802,6 +1015,8 @@ public:
 	/// Set the receive buffer size of a channel.
 	/** This function sets the desired size of the receive buffer.
 	 *  The default size is 128 kB.
+	 *  By default, the receive buffer grows automatically based on the measured bandwidth-delay product.
+	 *  Setting the size explicitly disables this.
 	 *
 	 *  @param channel   A handle for the channel.
 	 *  @param size      The desired size for the send buffer.
@@ -811,6 +1026,70 @@ public:
 		meshlink_set_channel_rcvbuf(handle, channel, size);
 	}
 
+	/// Set the maximum size of automatically tuned channel buffers.
+	/** This function sets the limit up to which the send and receive buffers of a channel
+	 *  are grown automatically. Memory is only allocated when the buffers actually fill up.
+	 *  The default limit is 4 MB.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param size      The maximum size for the send and receive buffers.
+	 */
+	void set_channel_max_bufsize(channel *channel, size_t size) {
+		meshlink_set_channel_max_bufsize(handle, channel, size);
+	}
+
+	/// Set the forward error correction group size of a channel.
+	/** This function enables forward error correction for channels without MESHLINK_CHANNEL_RELIABLE.
+	 *  When a message does not fit in a single packet, an extra parity packet is sent for every group of packets.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param group     The number of packets covered by each parity packet, or 0 to disable forward error correction.
+	 */
+	void set_channel_fec(channel *channel, int group) {
+		meshlink_set_channel_fec(handle, channel, group);
+	}
+
+	/// Set the priority and weight of a channel.
+	/** Channels with a higher priority class are served first when the path to the node is congested.
+	 *  Channels in the same priority class share the path in proportion to their weights.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param priority  The priority class, from 0 up to but not including MESHLINK_CHANNEL_PRIORITIES.
+	 *  @param weight    The weight of the channel within its priority class, from 1 to 65535.
+	 */
+	void set_channel_priority(channel *channel, int priority, int weight) {
+		meshlink_set_channel_priority(handle, channel, priority, weight);
+	}
+
+	/// Set the maximum message size of a framed reliable channel.
+	/** This sets the largest message that can be sent or will be accepted on a channel
+	 *  with both meshlink::channel::RELIABLE and meshlink::channel::FRAMED.
+	 *
+	 *  @param channel   A handle for the channel.
+	 *  @param size      The maximum size of a message in bytes.
+	 */
+	void set_channel_max_message_size(channel *channel, size_t size) {
+		meshlink_set_channel_max_message_size(handle, channel, size);
+	}
+
+	/// Set the maximum amount of memory used by the buffers of all channels.
+	/** When the limit is reached, sending on a channel returns 0 as if the send buffer were full.
+	 *
+	 *  @param limit     The maximum number of bytes used by all channel buffers, or 0 to remove the limit.
+	 */
+	void set_channel_memory_limit(size_t limit) {
+		meshlink_set_channel_memory_limit(handle, limit);
+	}
+
+	/// Coalesce small channel packets into shared datagrams.
+	/** Nodes that cannot unpack such datagrams still get one packet per datagram.
+	 *
+	 *  @param coalesce  True to coalesce small packets, false to send every packet immediately.
+	 */
+	void set_channel_coalescing(bool coalesce) {
+		meshlink_set_channel_coalescing(handle, coalesce);
+	}
+
 	/// Set the connection timeout used for channels to the given node.
 	/** This sets the timeout after which unresponsive channels will be reported as closed.
 	 *  The timeout is set for all current and future channels to the given node.
@@ -834,6 +1113,9 @@ public:
 	 *  @param port         The port number the peer wishes to connect to.
 	 *  @param cb           A pointer to the function which will be called when the remote node sends data to the local node.
 	 *  @param data         A pointer to a buffer containing data to already queue for sending.
+	 *                      As much of the data as fits in a single packet is sent along with the request to open the channel.
+	 *                      Without channel::RELIABLE or with channel::FRAMED, all data has to fit in that packet,
+	 *                      otherwise no channel is opened.
 	 *  @param len          The length of the data.
 	 *                      If len is 0, the data pointer is copied into the channel's priv member.
 	 *  @param flags        A bitwise-or'd combination of flags that set the semantics for this channel.
@@ -859,6 +1141,9 @@ public:
 	 *  @param node         The node to which this channel is being initiated.
 	 *  @param port         The port number the peer wishes to connect to.
 	 *  @param data         A pointer to a buffer containing data to already queue for sending.
+	 *                      As much of the data as fits in a single packet is sent along with the request to open the channel.
+	 *                      Without channel::RELIABLE or with channel::FRAMED, all data has to fit in that packet,
+	 *                      otherwise no channel is opened.
 	 *  @param len          The length of the data.
 	 *                      If len is 0, the data pointer is copied into the channel's priv member.
 	 *  @param flags        A bitwise-or'd combination of flags that set the semantics for this channel.
@@ -871,6 +1156,35 @@ public:
 		return ch;
 	}
 
+#ifdef MESHLINK_COROUTINES
+	/// Open a channel to another node from a coroutine.
+	/** The channel's receive and poll callbacks are set as with channel_open().
+	 *  Operations on the returned async_channel resume the awaiting coroutine on the given executor.
+	 *
+	 *  @param node         The node to which this channel is being initiated.
+	 *  @param port         The port number the peer wishes to connect to.
+	 *  @param exec         The executor on which to resume coroutines waiting for this channel.
+	 *  @param flags        A bitwise-or'd combination of flags that set the semantics for this channel.
+	 *
+	 *  @return             An operation to co_await, which yields the channel once the connection is established.
+	 */
+	open_operation open_channel(node *node, uint16_t port, executor &exec, uint32_t flags = channel::TCP) {
+		return open_operation(*this, node, port, exec, flags);
+	}
+
+	/// Use an existing channel from a coroutine.
+	/** This is typically used in channel_accept() to hand an incoming channel to a coroutine.
+	 *
+	 *  @param channel      A handle for the channel.
+	 *  @param exec         The executor on which to resume coroutines waiting for this channel.
+	 *
+	 *  @return             An async_channel for the given channel.
+	 */
+	async_channel get_async_channel(channel *channel, executor &exec) {
+		return async_channel(handle, channel, exec);
+	}
+#endif
+
 	/// Partially close a reliable stream channel.
 	/** This shuts down the read or write side of a channel, or both, without closing the handle.
 	 *  It can be used to inform the remote node that the local node has finished sending all data on the channel,
@@ -909,6 +1223,21 @@ public:
 		return meshlink_channel_send(handle, channel, data, len);
 	}
 
+	/// Transmit data from multiple buffers on a channel
+	/** This queues data gathered from multiple buffers to send to the remote node.
+	 *  For UDP channels, all buffers together form a single packet.
+	 *
+	 *  @param channel      A handle for the channel.
+	 *  @param iov          A pointer to an array of iovecs describing the buffers to send.
+	 *  @param iovcnt       The number of iovecs in the array.
+	 *
+	 *  @return             The amount of data that was queued, which can be less than the total length of all buffers,
+	 *                      or a negative value in case of an error.
+	 */
+	ssize_t channel_sendv(channel *channel, const struct iovec *iov, int iovcnt) {
+		return meshlink_channel_sendv(handle, channel, iov, iovcnt);
+	}
+
 	/// Transmit data on a channel asynchronously
 	/** This registers a buffer that will be used to send data to the remote node.
 	 *  Multiple buffers can be registered, in which case data will be sent in the order the buffers were registered.
@@ -981,6 +1310,71 @@ public:
 		return meshlink_channel_aio_fd_receive(handle, channel, fd, len, cb, priv);
 	}
 
+	/// Create a completion queue for asynchronous channel I/O.
+	/** Requests submitted to a completion queue do not call back into the application,
+	 *  instead their completions are retrieved with completion_queue_reap() or completion_queue_wait().
+	 *
+	 *  @return             A handle for the completion queue, or NULL in case of an error.
+	 */
+	completion_queue_t *completion_queue_open() {
+		return meshlink_completion_queue_open(handle);
+	}
+
+	/// Destroy a completion queue.
+	/** All requests submitted to this queue must have completed before it is destroyed,
+	 *  otherwise the queue is left untouched.
+	 *
+	 *  @param cq           A handle for the completion queue.
+	 *
+	 *  @return             True if the queue was destroyed, false otherwise.
+	 */
+	bool completion_queue_close(completion_queue_t *cq) {
+		return meshlink_completion_queue_close(handle, cq);
+	}
+
+	/// Get a filedescriptor that is readable while there are pending completions.
+	/** @param cq           A handle for the completion queue.
+	 *
+	 *  @return             A filedescriptor, or -1 in case of an error.
+	 */
+	int completion_queue_get_fd(completion_queue_t *cq) {
+		return meshlink_completion_queue_get_fd(handle, cq);
+	}
+
+	/// Submit asynchronous channel I/O requests.
+	/** @param cq           A handle for the completion queue.
+	 *  @param requests     A pointer to an array of requests.
+	 *  @param count        The number of requests in the array.
+	 *
+	 *  @return             True if all requests were enqueued, false if none were.
+	 */
+	bool completion_queue_submit(completion_queue_t *cq, const aio_request_t *requests, size_t count) {
+		return meshlink_completion_queue_submit(handle, cq, requests, count);
+	}
+
+	/// Retrieve completed asynchronous channel I/O requests without blocking.
+	/** @param cq           A handle for the completion queue.
+	 *  @param completions  A pointer to an array that will be filled with completions.
+	 *  @param max          The maximum number of completions to retrieve.
+	 *
+	 *  @return             The number of completions retrieved.
+	 */
+	size_t completion_queue_reap(completion_queue_t *cq, aio_completion_t *completions, size_t max) {
+		return meshlink_completion_queue_reap(handle, cq, completions, max);
+	}
+
+	/// Wait for completed asynchronous channel I/O requests.
+	/** @param cq           A handle for the completion queue.
+	 *  @param completions  A pointer to an array that will be filled with completions.
+	 *  @param max          The maximum number of completions to retrieve.
+	 *  @param timeout      The maximum time to wait in milliseconds, or a negative value to wait indefinitely.
+	 *
+	 *  @return             The number of completions retrieved, which is 0 if the timeout expired.
+	 */
+	size_t completion_queue_wait(completion_queue_t *cq, aio_completion_t *completions, size_t max, int timeout) {
+		return meshlink_completion_queue_wait(handle, cq, completions, max, timeout);
+	}
+
 	/// Get the amount of bytes in the send buffer.
 	/** This returns the amount of bytes in the send buffer.
 	 *  These bytes have not been received by the peer yet.
@@ -1016,6 +1410,34 @@ public:
 		return meshlink_channel_get_mss(handle, channel);
 	};
 
+	/// Get the number of messages recovered using forward error correction.
+	/** @param channel      A handle for the channel.
+	 *
+	 *  @return             The number of recovered messages.
+	 */
+	size_t channel_get_fec_recovered(channel *channel) {
+		return meshlink_channel_get_fec_recovered(handle, channel);
+	}
+
+	/// Get the number of messages that could not be recovered.
+	/** @param channel      A handle for the channel.
+	 *
+	 *  @return             The number of unrecoverable messages.
+	 */
+	size_t channel_get_fec_lost(channel *channel) {
+		return meshlink_channel_get_fec_lost(handle, channel);
+	}
+
+	/// Get statistics about a channel.
+	/** @param channel      A handle for the channel.
+	 *  @param stats        A pointer to a channel_stats_t variable, with its version field set.
+	 *
+	 *  @return             True if the statistics were retrieved, false otherwise.
+	 */
+	bool channel_get_stats(channel *channel, channel_stats_t *stats) {
+		return meshlink_channel_get_stats(handle, channel, stats);
+	}
+
 	/// Enable or disable zeroconf discovery of local peers
 	/** This controls whether zeroconf discovery using the Catta library will be
 	 *  enabled to search for peers on the local network. By default, it is enabled.
@@ -1082,6 +1504,10 @@ public:
 	}
 
 private:
+#ifdef MESHLINK_COROUTINES
+	friend class open_operation;
+#endif
+
 	// non-copyable:
 	mesh(const mesh &) /* TODO: C++11: = delete */;
 	void operator=(const mesh &) /* TODO: C++11: = delete */;
@@ -1187,6 +1613,31 @@ private:
 	meshlink_handle_t *handle;
 };
 
+#ifdef MESHLINK_COROUTINES
+open_operation::open_operation(mesh &m, node *node, uint16_t port, executor &exec, uint32_t flags) : channel_operation(exec), mesh_handle(m.handle), resume_exec(exec) {
+	// Until the channel is established, its priv member points to this operation.
+	chan = static_cast<channel *>(meshlink_channel_open_ex(mesh_handle, node, port, &mesh::channel_receive_trampoline, this, 0, flags));
+
+	if(!chan) {
+		complete(-1);
+	} else if(!(flags & channel::RELIABLE)) {
+		// There is no handshake on unreliable channels.
+		chan->priv = 0;
+		meshlink_set_channel_poll_cb(mesh_handle, chan, &mesh::channel_poll_trampoline);
+		complete(1);
+	} else {
+		meshlink_set_channel_poll_cb(mesh_handle, chan, &poll_trampoline);
+	}
+}
+
+inline void open_operation::poll_trampoline(meshlink_handle_t *handle, meshlink_channel_t *channel, size_t len) {
+	open_operation *that = static_cast<open_operation *>(channel->priv);
+	channel->priv = 0;
+	meshlink_set_channel_poll_cb(handle, channel, &mesh::channel_poll_trampoline);
+	that->complete(len ? 1 : 0);
+}
+#endif
+
 static inline const char *strerror(errno_t err = meshlink_errno) {
 	return meshlink_strerror(err);
 }
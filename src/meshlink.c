@@ -30,6 +30,7 @@
 #include "node.h"
 #include "submesh.h"
 #include "packmsg.h"
+#include "persist.h"
 #include "prf.h"
 #include "protocol.h"
 #include "route.h"
@@ -640,7 +641,7 @@ static bool write_main_config_files(meshlink_handle_t *mesh) {
 	}
 
 	/* Write our own host config file */
-	if(!node_write_config(mesh, mesh->self)) {
+	if(!node_write_config(mesh, mesh->self, true)) {
 		return false;
 	}
 
@@ -774,7 +775,7 @@ static bool finalize_join(join_state_t *state, const void *buf, uint16_t len) {
 		n->last_reachable = 0;
 		n->last_unreachable = 0;
 
-		if(!node_write_config(mesh, n)) {
+		if(!node_write_config(mesh, n, false)) {
 			free_node(n);
 			return false;
 		}
@@ -783,7 +784,7 @@ static bool finalize_join(join_state_t *state, const void *buf, uint16_t len) {
 	}
 
 	/* Ensure the configuration directory metadata is on disk */
-	if(!config_sync(mesh, "current") || !sync_path(mesh->confbase)) {
+	if(!persist_sync(mesh) || !config_sync(mesh, "current") || !sync_path(mesh->confbase)) {
 		return false;
 	}
 
@@ -1235,6 +1236,15 @@ bool meshlink_encrypted_key_rotate(meshlink_handle_t *mesh, const void *new_key,
 		return false;
 	}
 
+	// Make sure all host config files have been written with the old key
+
+	if(!persist_sync(mesh)) {
+		logger(mesh, MESHLINK_ERROR, "Could not write pending host config files\n");
+		free(new_config_key);
+		pthread_mutex_unlock(&mesh->mutex);
+		return false;
+	}
+
 	// Copy contents of the "current" confbase sub-directory to "new" confbase sub-directory with the new key
 
 	if(!config_copy(mesh, "current", mesh->config_key, "new", new_config_key)) {
@@ -1484,8 +1494,18 @@ meshlink_handle_t *meshlink_open_ex(const meshlink_open_params_t *params) {
 	mesh->threadstarted = false;
 	event_loop_init(&mesh->loop);
 	mesh->loop.data = mesh;
+	init_persist(mesh);
 
 	meshlink_queue_init(&mesh->outpacketqueue);
+	meshlink_queue_init(&mesh->channelqueue);
+
+	mesh->channel_pool = utcp_pool_init();
+
+	if(!mesh->channel_pool) {
+		meshlink_errno = MESHLINK_ENOMEM;
+		meshlink_close(mesh);
+		return NULL;
+	}
 
 	// Atomically lock the configuration directory.
 	if(!main_config_lock(mesh)) {
@@ -1552,7 +1572,7 @@ meshlink_handle_t *meshlink_open_ex(const meshlink_open_params_t *params) {
 
 	add_local_addresses(mesh);
 
-	if(!node_write_config(mesh, mesh->self)) {
+	if(!node_write_config(mesh, mesh->self, true)) {
 		logger(NULL, MESHLINK_ERROR, "Cannot update configuration\n");
 		return NULL;
 	}
@@ -1775,11 +1795,15 @@ void meshlink_stop(meshlink_handle_t *mesh) {
 	if(mesh->nodes) {
 		for splay_each(node_t, n, mesh->nodes) {
 			if(n->status.dirty) {
-				n->status.dirty = !node_write_config(mesh, n);
+				n->status.dirty = !node_write_config(mesh, n, false);
 			}
 		}
 	}
 
+	if(!persist_sync(mesh)) {
+		logger(mesh, MESHLINK_WARNING, "Could not write all host config files");
+	}
+
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
@@ -1799,6 +1823,7 @@ void meshlink_close(meshlink_handle_t *mesh) {
 
 	// Close and free all resources used.
 
+	exit_persist(mesh);
 	close_network_connections(mesh);
 
 	logger(mesh, MESHLINK_INFO, "Terminating");
@@ -1825,6 +1850,15 @@ void meshlink_close(meshlink_handle_t *mesh) {
 
 	meshlink_queue_exit(&mesh->outpacketqueue);
 
+	/* Channels that are still open are the application's responsibility, just forget about staged data. */
+	while(meshlink_queue_pop(&mesh->channelqueue)) {
+	}
+
+	meshlink_queue_exit(&mesh->channelqueue);
+
+	/* The buffers of all channels have been freed together with the nodes. */
+	utcp_pool_exit(mesh->channel_pool);
+
 	free(mesh->name);
 	free(mesh->appname);
 	free(mesh->confbase);
@@ -2103,6 +2137,179 @@ bool meshlink_send(meshlink_handle_t *mesh, meshlink_node_t *destination, const
 	return true;
 }
 
+static meshlink_channel_t *new_channel(node_t *n) {
+	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
+	channel->node = n;
+	pthread_mutex_init(&channel->stage.mutex, NULL);
+	return channel;
+}
+
+static void free_channel(meshlink_channel_t *channel) {
+	pthread_mutex_destroy(&channel->stage.mutex);
+	free(channel->stage.data);
+	free(channel);
+}
+
+/* Reliable channels with message boundaries. Staging would merge messages, and AIO would split them. */
+static bool is_framed(meshlink_channel_t *channel) {
+	return channel->c && (channel->c->flags & (UTCP_RELIABLE | UTCP_FRAMED)) == (UTCP_RELIABLE | UTCP_FRAMED);
+}
+
+/* Recalculate how much the application may stage without taking the mesh mutex.
+ * Only plain sends on reliable channels are staged, anything else takes the slow path.
+ * With a channel memory limit, staged data might not fit in the send buffer anymore when it is flushed,
+ * so then nothing is staged either.
+ * Must be called with both mesh->mutex and channel->stage.mutex held. */
+static void update_stage_space(meshlink_channel_t *channel) {
+	size_t space = 0;
+
+	if(channel->c && (channel->c->flags & UTCP_RELIABLE) && !is_framed(channel) && !channel->aio_send && !utcp_pool_get_limit(channel->node->mesh->channel_pool)) {
+		space = utcp_get_sndbuf_free(channel->c);
+	}
+
+	channel->stage.space = space > channel->stage.len ? space - channel->stage.len : 0;
+}
+
+/* Move staged data into the UTCP send buffer, return false if it had to be dropped.
+ * Must be called with both mesh->mutex and channel->stage.mutex held. */
+static bool move_stage(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(!channel->stage.len) {
+		return true;
+	}
+
+	/* Space for this was reserved when staging, so it can only fail if the connection is gone. */
+	ssize_t sent = utcp_send(channel->c, channel->stage.data, channel->stage.len);
+	bool success = sent == (ssize_t)channel->stage.len;
+
+	if(!success) {
+		logger(mesh, MESHLINK_WARNING, "Dropped %lu bytes of staged channel data", (unsigned long)channel->stage.len);
+	}
+
+	channel->stage.len = 0;
+	return success;
+}
+
+/* Move staged data into the UTCP send buffer. Must be called with mesh->mutex held.
+ * The application was already told that the staged data has been sent. If it has to be dropped now,
+ * the library thread reports that later with a poll callback, just like other send errors. */
+static void flush_stage(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	bool notify = false;
+
+	if(!move_stage(mesh, channel)) {
+		channel->stage.failed = true;
+
+		if(!channel->stage.queued && meshlink_queue_push(&mesh->channelqueue, channel)) {
+			channel->stage.queued = true;
+			notify = true;
+		}
+	}
+
+	update_stage_space(channel);
+	pthread_mutex_unlock(&channel->stage.mutex);
+
+	if(notify) {
+		signal_trigger(&mesh->loop, &mesh->datafromapp);
+	}
+}
+
+/* Flush a channel taken from mesh->channelqueue, and report if any staged data was dropped.
+ * Must be called from the library thread with mesh->mutex held. */
+static void flush_queued_stage(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	channel->stage.queued = false;
+
+	if(!move_stage(mesh, channel)) {
+		channel->stage.failed = true;
+	}
+
+	bool failed = channel->stage.failed;
+	channel->stage.failed = false;
+	update_stage_space(channel);
+	pthread_mutex_unlock(&channel->stage.mutex);
+
+	if(failed && channel->poll_cb) {
+		meshlink_errno = MESHLINK_ENETWORK;
+		channel->poll_cb(mesh, channel, 0);
+	}
+}
+
+/* Unlock the mesh after changing the state of a channel's connection. */
+static void update_and_unlock(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	update_stage_space(channel);
+	pthread_mutex_unlock(&channel->stage.mutex);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+/* Try to stage data without taking the mesh mutex, return false if the caller has to take the slow path. */
+static bool stage(meshlink_handle_t *mesh, meshlink_channel_t *channel, const struct iovec *iov, int iovcnt, size_t len) {
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	if(len > channel->stage.space) {
+		pthread_mutex_unlock(&channel->stage.mutex);
+		return false;
+	}
+
+	if(channel->stage.len + len > channel->stage.size) {
+		size_t size = channel->stage.size ? channel->stage.size : 4096;
+
+		while(size < channel->stage.len + len) {
+			size *= 2;
+		}
+
+		char *data = realloc(channel->stage.data, size);
+
+		if(!data) {
+			pthread_mutex_unlock(&channel->stage.mutex);
+			return false;
+		}
+
+		channel->stage.data = data;
+		channel->stage.size = size;
+	}
+
+	for(int i = 0; i < iovcnt; i++) {
+		memcpy(channel->stage.data + channel->stage.len, iov[i].iov_base, iov[i].iov_len);
+		channel->stage.len += iov[i].iov_len;
+	}
+
+	channel->stage.space -= len;
+
+	bool notify = !channel->stage.queued;
+
+	if(notify) {
+		if(!meshlink_queue_push(&mesh->channelqueue, channel)) {
+			/* Not queued, so nobody would flush it. Undo and let the caller block instead. */
+			channel->stage.len -= len;
+			channel->stage.space += len;
+			pthread_mutex_unlock(&channel->stage.mutex);
+			return false;
+		}
+
+		channel->stage.queued = true;
+	}
+
+	pthread_mutex_unlock(&channel->stage.mutex);
+
+	if(notify) {
+		signal_trigger(&mesh->loop, &mesh->datafromapp);
+	}
+
+	return true;
+}
+
 void meshlink_send_from_queue(event_loop_t *loop, void *data) {
 	(void)loop;
 	meshlink_handle_t *mesh = data;
@@ -2116,6 +2323,10 @@ void meshlink_send_from_queue(event_loop_t *loop, void *data) {
 		route(mesh, mesh->self, packet);
 		free(packet);
 	}
+
+	for(meshlink_channel_t *channel; (channel = meshlink_queue_pop(&mesh->channelqueue));) {
+		flush_queued_stage(mesh, channel);
+	}
 }
 
 ssize_t meshlink_get_pmtu(meshlink_handle_t *mesh, meshlink_node_t *destination) {
@@ -2546,14 +2757,11 @@ bool meshlink_set_canonical_address(meshlink_handle_t *mesh, meshlink_node_t *no
 	free(n->canonical_address);
 	n->canonical_address = canonical_address;
 
-	if(!node_write_config(mesh, n)) {
-		pthread_mutex_unlock(&mesh->mutex);
-		return false;
-	}
+	bool rval = node_write_config(mesh, n, true);
 
 	pthread_mutex_unlock(&mesh->mutex);
 
-	return config_sync(mesh, "current");
+	return rval;
 }
 
 bool meshlink_add_invitation_address(struct meshlink_handle *mesh, const char *address, const char *port) {
@@ -2796,13 +3004,20 @@ char *meshlink_invite_ex(meshlink_handle_t *mesh, meshlink_submesh_t *submesh, c
 
 	// If we changed our own host config file, write it out now
 	if(mesh->self->status.dirty) {
-		if(!node_write_config(mesh, mesh->self)) {
+		if(!node_write_config(mesh, mesh->self, false)) {
 			logger(mesh, MESHLINK_ERROR, "Could not write our own host config file!\n");
 			pthread_mutex_unlock(&mesh->mutex);
 			return NULL;
 		}
 	}
 
+	// It is copied into the invitation, so wait until any pending write of it is done
+	if(!persist_sync(mesh)) {
+		logger(mesh, MESHLINK_ERROR, "Could not write our own host config file!\n");
+		pthread_mutex_unlock(&mesh->mutex);
+		return NULL;
+	}
+
 	char hash[64];
 
 	// Create a hash of the key.
@@ -3292,7 +3507,7 @@ bool meshlink_import(meshlink_handle_t *mesh, const char *data) {
 		n->last_reachable = 0;
 		n->last_unreachable = 0;
 
-		if(!node_write_config(mesh, n)) {
+		if(!node_write_config(mesh, n, false)) {
 			free_node(n);
 			return false;
 		}
@@ -3310,11 +3525,7 @@ bool meshlink_import(meshlink_handle_t *mesh, const char *data) {
 		return false;
 	}
 
-	if(!config_sync(mesh, "current")) {
-		return false;
-	}
-
-	return true;
+	return persist_sync(mesh);
 }
 
 static bool blacklist(meshlink_handle_t *mesh, node_t *n) {
@@ -3330,6 +3541,7 @@ static bool blacklist(meshlink_handle_t *mesh, node_t *n) {
 	}
 
 	n->status.blacklisted = true;
+	node_autoconnect_changed(mesh, n);
 
 	/* Immediately shut down any connections we have with the blacklisted node.
 	 * We can't call terminate_connection(), because we might be called from a callback function.
@@ -3347,6 +3559,8 @@ static bool blacklist(meshlink_handle_t *mesh, node_t *n) {
 	n->maxmtu = MTU;
 	n->mtuprobes = 0;
 	n->status.udp_confirmed = false;
+	n->relay = NULL;
+	n->relay_mtu = 0;
 
 	if(n->status.reachable) {
 		n->last_unreachable = time(NULL);
@@ -3359,7 +3573,7 @@ static bool blacklist(meshlink_handle_t *mesh, node_t *n) {
 		mesh->node_status_cb(mesh, (meshlink_node_t *)n, false);
 	}
 
-	return node_write_config(mesh, n) && config_sync(mesh, "current");
+	return node_write_config(mesh, n, true);
 }
 
 bool meshlink_blacklist(meshlink_handle_t *mesh, meshlink_node_t *node) {
@@ -3425,13 +3639,14 @@ static bool whitelist(meshlink_handle_t *mesh, node_t *n) {
 	}
 
 	n->status.blacklisted = false;
+	node_autoconnect_changed(mesh, n);
 
 	if(n->status.reachable) {
 		n->last_reachable = time(NULL);
 		update_node_status(mesh, n);
 	}
 
-	return node_write_config(mesh, n) && config_sync(mesh, "current");
+	return node_write_config(mesh, n, true);
 }
 
 bool meshlink_whitelist(meshlink_handle_t *mesh, meshlink_node_t *node) {
@@ -3532,8 +3747,8 @@ bool meshlink_forget_node(meshlink_handle_t *mesh, meshlink_node_t *node) {
 		}
 	}
 
-	/* Delete the config file for this node */
-	if(!config_delete(mesh, "current", n->name)) {
+	/* Delete the config file for this node, after any pending write of it */
+	if(!persist_sync(mesh) || !config_delete(mesh, "current", n->name)) {
 		pthread_mutex_unlock(&mesh->mutex);
 		return false;
 	}
@@ -3562,7 +3777,7 @@ void meshlink_hint_address(meshlink_handle_t *mesh, meshlink_node_t *node, const
 	node_t *n = (node_t *)node;
 
 	if(node_add_recent_address(mesh, n, (sockaddr_t *)addr)) {
-		if(!node_write_config(mesh, n)) {
+		if(!node_write_config(mesh, n, false)) {
 			logger(mesh, MESHLINK_DEBUG, "Could not update %s\n", n->name);
 		}
 	}
@@ -3578,11 +3793,89 @@ static bool channel_pre_accept(struct utcp *utcp, uint16_t port) {
 	return mesh->channel_accept_cb;
 }
 
+/* Make the completion queue's filedescriptor readable or not. The queue must be locked. */
+static void cq_signal(meshlink_completion_queue_t *cq, bool pending) {
+	uint64_t value = 1;
+	ssize_t result;
+
+	/* With an eventfd, both ends are the same, and it needs 8 bytes. A pipe just needs one byte. */
+	size_t len = cq->fd[0] == cq->fd[1] ? sizeof(value) : 1;
+
+	do {
+		result = pending ? write(cq->fd[1], &value, len) : read(cq->fd[0], &value, len);
+	} while(result < 0 && errno == EINTR);
+}
+
+/* Add a completion for a finished AIO buffer to its completion queue. */
+static void cq_push(meshlink_completion_queue_t *cq, meshlink_channel_t *channel, const meshlink_aio_buffer_t *aio, meshlink_aio_op_t op) {
+	if(pthread_mutex_lock(&cq->mutex) != 0) {
+		abort();
+	}
+
+	if(cq->count == cq->size) {
+		/* Double the ring, and move the part that wrapped around to the new space after the old end. */
+		cq->ring = xrealloc(cq->ring, 2 * cq->size * sizeof(*cq->ring));
+		memcpy(cq->ring + cq->size, cq->ring, cq->head * sizeof(*cq->ring));
+		cq->size *= 2;
+	}
+
+	meshlink_aio_completion_t *completion = &cq->ring[(cq->head + cq->count++) & (cq->size - 1)];
+	completion->channel = channel;
+	completion->op = op;
+	completion->data = aio->data;
+	completion->fd = aio->data ? -1 : aio->fd;
+	completion->len = aio->done;
+	completion->priv = aio->priv;
+	cq->outstanding--;
+
+	if(cq->count == 1) {
+		cq_signal(cq, true);
+		pthread_cond_broadcast(&cq->cond);
+	}
+
+	pthread_mutex_unlock(&cq->mutex);
+}
+
+/* Remove up to max completions from the completion queue. The queue must be locked. */
+static size_t cq_pop(meshlink_completion_queue_t *cq, meshlink_aio_completion_t *completions, size_t max) {
+	size_t count = MIN(max, cq->count);
+
+	for(size_t i = 0; i < count; i++) {
+		completions[i] = cq->ring[(cq->head + i) & (cq->size - 1)];
+	}
+
+	cq->head = (cq->head + count) & (cq->size - 1);
+	cq->count -= count;
+
+	if(count && !cq->count) {
+		cq_signal(cq, false);
+	}
+
+	return count;
+}
+
 /* Finish one AIO buffer, return true if the channel is still open. */
 static bool aio_finish_one(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_aio_buffer_t **head) {
+	bool receive = head == &channel->aio_receive;
+
 	meshlink_aio_buffer_t *aio = *head;
 	*head = aio->next;
 
+	if(!*head) {
+		if(receive) {
+			channel->aio_receive_tail = NULL;
+		} else {
+			channel->aio_send_tail = NULL;
+		}
+	}
+
+	/* Completions submitted via a queue are picked up by the application on its own thread. */
+	if(aio->cq) {
+		cq_push(aio->cq, channel, aio, receive ? MESHLINK_AIO_RECEIVE : MESHLINK_AIO_SEND);
+		free(aio);
+		return true;
+	}
+
 	if(channel->c) {
 		channel->in_callback = true;
 
@@ -3600,7 +3893,7 @@ static bool aio_finish_one(meshlink_handle_t *mesh, meshlink_channel_t *channel,
 
 		if(!channel->c) {
 			free(aio);
-			free(channel);
+			free_channel(channel);
 			return false;
 		}
 	}
@@ -3658,6 +3951,7 @@ static ssize_t channel_recv(struct utcp_connection *connection, const void *data
 		if(aio->data) {
 			memcpy((char *)aio->data + aio->done, p, todo);
 		} else {
+			/* Write straight from the receive buffer, so the data reaches the fd before this callback returns. */
 			ssize_t result = write(aio->fd, p, todo);
 
 			if(result <= 0) {
@@ -3700,7 +3994,7 @@ static ssize_t channel_recv(struct utcp_connection *connection, const void *data
 	return len;
 }
 
-static void channel_accept(struct utcp_connection *utcp_connection, uint16_t port) {
+static void channel_accept(struct utcp_connection *utcp_connection, uint16_t port, const void *data, size_t len) {
 	node_t *n = utcp_connection->utcp->priv;
 
 	if(!n) {
@@ -3713,14 +4007,13 @@ static void channel_accept(struct utcp_connection *utcp_connection, uint16_t por
 		return;
 	}
 
-	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
-	channel->node = n;
+	meshlink_channel_t *channel = new_channel(n);
 	channel->c = utcp_connection;
 
-	if(mesh->channel_accept_cb(mesh, channel, port, NULL, 0)) {
+	if(mesh->channel_accept_cb(mesh, channel, port, data, len)) {
 		utcp_accept(utcp_connection, channel_recv, channel);
 	} else {
-		free(channel);
+		free_channel(channel);
 	}
 }
 
@@ -3746,6 +4039,32 @@ static ssize_t channel_send(struct utcp *utcp, const void *data, size_t len) {
 	return meshlink_send_immediate(mesh, (meshlink_node_t *)n, data, len) ? (ssize_t)len : -1;
 }
 
+/* UTCP is holding back packets to a node, they are sent when idle() calls utcp_timeout().
+ * If this happens outside the library thread, wake it up so that does not wait until the next event. */
+static void channel_coalesce(struct utcp *utcp) {
+	node_t *n = utcp->priv;
+	meshlink_handle_t *mesh = n->mesh;
+
+	if(mesh->threadstarted && !pthread_equal(pthread_self(), mesh->thread)) {
+		signal_trigger(&mesh->loop, &mesh->datafromapp);
+	}
+}
+
+/* Create the UTCP instance that carries the channels to a node. */
+static void init_node_utcp(meshlink_handle_t *mesh, node_t *n) {
+	n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
+
+	if(n->utcp) {
+		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
+		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		utcp_set_pool(n->utcp, mesh->channel_pool);
+
+		if(mesh->channel_coalescing) {
+			utcp_set_coalesce_cb(n->utcp, channel_coalesce);
+		}
+	}
+}
+
 void meshlink_set_channel_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_channel_receive_cb_t cb) {
 	if(!mesh || !channel) {
 		meshlink_errno = MESHLINK_EINVAL;
@@ -3798,17 +4117,25 @@ static void channel_poll(struct utcp_connection *connection, size_t len) {
 		if(aio->data) {
 			sent = utcp_send(connection, (char *)aio->data + aio->done, todo);
 		} else {
-			/* Limit the amount we read at once to avoid stack overflows */
-			if(todo > 65536) {
-				todo = 65536;
-			}
+			/* Reliable channels read directly into the send buffer. Unreliable channels need the whole frame at once. */
+			ssize_t result;
 
-			char buf[todo];
-			ssize_t result = read(aio->fd, buf, todo);
+			if(connection->flags & UTCP_RELIABLE) {
+				result = utcp_send_fd(connection, aio->fd, todo);
+				sent = result;
+			} else {
+				/* Limit the amount we read at once to avoid stack overflows */
+				if(todo > 65536) {
+					todo = 65536;
+				}
+
+				char buf[todo];
+				result = read(aio->fd, buf, todo);
+				sent = result > 0 ? utcp_send(connection, buf, result) : 0;
+			}
 
 			if(result > 0) {
 				todo = result;
-				sent = utcp_send(connection, buf, todo);
 			} else {
 				if(result < 0 && errno == EINTR) {
 					continue;
@@ -3859,6 +4186,14 @@ static void channel_poll(struct utcp_connection *connection, size_t len) {
 	}
 
 	if(channel->poll_cb) {
+		/* Let the application stage as much as there is room for now, even if we are still busy. */
+		if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+			abort();
+		}
+
+		update_stage_space(channel);
+		pthread_mutex_unlock(&channel->stage.mutex);
+
 		channel->poll_cb(mesh, channel, len);
 	} else {
 		utcp_set_poll_cb(connection, NULL);
@@ -3895,9 +4230,7 @@ void meshlink_set_channel_accept_cb(meshlink_handle_t *mesh, meshlink_channel_ac
 
 	for splay_each(node_t, n, mesh->nodes) {
 		if(!n->utcp && n != mesh->self) {
-			n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-			utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-			utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+			init_node_utcp(mesh, n);
 		}
 	}
 
@@ -3916,8 +4249,9 @@ void meshlink_set_channel_sndbuf(meshlink_handle_t *mesh, meshlink_channel_t *ch
 		abort();
 	}
 
+	flush_stage(mesh, channel);
 	utcp_set_sndbuf(channel->c, size);
-	pthread_mutex_unlock(&mesh->mutex);
+	update_and_unlock(mesh, channel);
 }
 
 void meshlink_set_channel_rcvbuf(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size) {
@@ -3936,11 +4270,98 @@ void meshlink_set_channel_rcvbuf(meshlink_handle_t *mesh, meshlink_channel_t *ch
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
-meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_node_t *node, uint16_t port, meshlink_channel_receive_cb_t cb, const void *data, size_t len, uint32_t flags) {
-	if(data && len) {
-		abort();        // TODO: handle non-NULL data
+void meshlink_set_channel_max_bufsize(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size) {
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_max_bufsize(channel->c, size);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_fec(meshlink_handle_t *mesh, meshlink_channel_t *channel, int group) {
+	if(!mesh || !channel || group < 0) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_fec(channel->c, group);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_max_message_size(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t size) {
+	if(!mesh || !channel || !size || size > UINT32_MAX - sizeof(uint32_t)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_max_message_size(channel->c, size);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_coalescing(meshlink_handle_t *mesh, bool coalesce) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	mesh->channel_coalescing = coalesce;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		if(n->utcp) {
+			utcp_set_coalesce_cb(n->utcp, coalesce ? channel_coalesce : NULL);
+		}
+	}
+
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_memory_limit(meshlink_handle_t *mesh, size_t limit) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
 	}
 
+	utcp_pool_set_limit(mesh->channel_pool, limit);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+void meshlink_set_channel_priority(meshlink_handle_t *mesh, meshlink_channel_t *channel, int priority, int weight) {
+	if(!mesh || !channel || priority < 0 || priority >= MESHLINK_CHANNEL_PRIORITIES || weight < 1 || weight > UINT16_MAX) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return;
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_set_priority(channel->c, priority, weight);
+	pthread_mutex_unlock(&mesh->mutex);
+}
+
+meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_node_t *node, uint16_t port, meshlink_channel_receive_cb_t cb, const void *data, size_t len, uint32_t flags) {
 	if(!mesh || !node) {
 		meshlink_errno = MESHLINK_EINVAL;
 		return NULL;
@@ -3953,9 +4374,7 @@ meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_n
 	node_t *n = (node_t *)node;
 
 	if(!n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		init_node_utcp(mesh, n);
 		mesh->receive_cb = channel_receive;
 
 		if(!n->utcp) {
@@ -3972,21 +4391,21 @@ meshlink_channel_t *meshlink_channel_open_ex(meshlink_handle_t *mesh, meshlink_n
 		return NULL;
 	}
 
-	meshlink_channel_t *channel = xzalloc(sizeof(*channel));
-	channel->node = n;
+	meshlink_channel_t *channel = new_channel(n);
 	channel->receive_cb = cb;
 
 	if(data && !len) {
 		channel->priv = (void *)data;
 	}
 
-	channel->c = utcp_connect_ex(n->utcp, port, channel_recv, channel, flags);
+	// Any data is sent along with the request to open the channel.
+	channel->c = utcp_connect_data(n->utcp, port, channel_recv, channel, flags, len ? data : NULL, len);
 
 	pthread_mutex_unlock(&mesh->mutex);
 
 	if(!channel->c) {
-		meshlink_errno = errno == ENOMEM ? MESHLINK_ENOMEM : MESHLINK_EINTERNAL;
-		free(channel);
+		meshlink_errno = errno == ENOMEM ? MESHLINK_ENOMEM : errno == EMSGSIZE ? MESHLINK_EINVAL : MESHLINK_EINTERNAL;
+		free_channel(channel);
 		return NULL;
 	}
 
@@ -4007,8 +4426,9 @@ void meshlink_channel_shutdown(meshlink_handle_t *mesh, meshlink_channel_t *chan
 		abort();
 	}
 
+	flush_stage(mesh, channel);
 	utcp_shutdown(channel->c, direction);
-	pthread_mutex_unlock(&mesh->mutex);
+	update_and_unlock(mesh, channel);
 }
 
 void meshlink_channel_close(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
@@ -4022,6 +4442,10 @@ void meshlink_channel_close(meshlink_handle_t *mesh, meshlink_channel_t *channel
 	}
 
 	if(channel->c) {
+		/* Data staged before closing must still be sent. */
+		flush_stage(mesh, channel);
+		meshlink_queue_remove(&mesh->channelqueue, channel);
+
 		utcp_close(channel->c);
 		channel->c = NULL;
 
@@ -4031,12 +4455,29 @@ void meshlink_channel_close(meshlink_handle_t *mesh, meshlink_channel_t *channel
 	}
 
 	if(!channel->in_callback) {
-		free(channel);
+		free_channel(channel);
 	}
 
 	pthread_mutex_unlock(&mesh->mutex);
 }
 
+/* Lock the mesh for sending on a channel, and flush any staged data first.
+ * If the mesh is busy, try to stage the data instead; then false is returned and the mesh is not locked. */
+static bool lock_for_send(meshlink_handle_t *mesh, meshlink_channel_t *channel, const struct iovec *iov, int iovcnt, size_t len) {
+	if(pthread_mutex_trylock(&mesh->mutex) != 0) {
+		if(len && stage(mesh, channel, iov, iovcnt, len)) {
+			return false;
+		}
+
+		if(pthread_mutex_lock(&mesh->mutex) != 0) {
+			abort();
+		}
+	}
+
+	flush_stage(mesh, channel);
+	return true;
+}
+
 ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
 	if(!mesh || !channel) {
 		meshlink_errno = MESHLINK_EINVAL;
@@ -4052,17 +4493,15 @@ ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *chann
 		return -1;
 	}
 
-	// TODO: more finegrained locking.
-	// Ideally we want to put the data into the UTCP connection's send buffer.
-	// Then, preferably only if there is room in the receiver window,
-	// kick the meshlink thread to go send packets.
-
-	ssize_t retval;
+	/* Don't wait for the mesh mutex if the library thread is busy, stage the data instead. */
+	const struct iovec iov = {(void *)data, len};
 
-	if(pthread_mutex_lock(&mesh->mutex) != 0) {
-		abort();
+	if(!lock_for_send(mesh, channel, &iov, 1, len)) {
+		return len;
 	}
 
+	ssize_t retval;
+
 	/* Disallow direct calls to utcp_send() while we still have AIO active. */
 	if(channel->aio_send) {
 		retval = 0;
@@ -4070,7 +4509,7 @@ ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *chann
 		retval = utcp_send(channel->c, data, len);
 	}
 
-	pthread_mutex_unlock(&mesh->mutex);
+	update_and_unlock(mesh, channel);
 
 	if(retval < 0) {
 		meshlink_errno = MESHLINK_ENETWORK;
@@ -4079,13 +4518,92 @@ ssize_t meshlink_channel_send(meshlink_handle_t *mesh, meshlink_channel_t *chann
 	return retval;
 }
 
+ssize_t meshlink_channel_sendv(meshlink_handle_t *mesh, meshlink_channel_t *channel, const struct iovec *iov, int iovcnt) {
+	if(!mesh || !channel || iovcnt < 0 || (iovcnt && !iov)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return -1;
+	}
+
+	/* Only stage well-formed vectors, let utcp_sendv() report errors for anything else. */
+	size_t len = 0;
+
+	for(int i = 0; i < iovcnt; i++) {
+		if((!iov[i].iov_base && iov[i].iov_len) || iov[i].iov_len > SSIZE_MAX - len) {
+			len = 0;
+			break;
+		}
+
+		len += iov[i].iov_len;
+	}
+
+	if(!lock_for_send(mesh, channel, iov, iovcnt, len)) {
+		return len;
+	}
+
+	ssize_t retval;
+
+	/* Disallow direct calls to utcp_sendv() while we still have AIO active. */
+	if(channel->aio_send) {
+		retval = 0;
+	} else {
+		retval = utcp_sendv(channel->c, iov, iovcnt);
+	}
+
+	update_and_unlock(mesh, channel);
+
+	if(retval < 0) {
+		meshlink_errno = errno == EFAULT || errno == EINVAL ? MESHLINK_EINVAL : MESHLINK_ENETWORK;
+	}
+
+	return retval;
+}
+
+/* Append an AIO buffer descriptor to the end of a chain. */
+static void aio_append(meshlink_aio_buffer_t **head, meshlink_aio_buffer_t **tail, meshlink_aio_buffer_t *aio) {
+	if(*tail) {
+		(*tail)->next = aio;
+	} else {
+		*head = aio;
+	}
+
+	*tail = aio;
+}
+
+/* Enqueue an AIO buffer for sending, and start sending from it if possible. The mesh must be locked. */
+static void aio_enqueue_send(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_aio_buffer_t *aio) {
+	/* Staged data goes out before the AIO buffers */
+	flush_stage(mesh, channel);
+
+	aio_append(&channel->aio_send, &channel->aio_send_tail, aio);
+
+	/* No more staging until the AIO buffers are done */
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	update_stage_space(channel);
+	pthread_mutex_unlock(&channel->stage.mutex);
+
+	/* Ensure the poll callback is set, and call it right now to push data if possible */
+	utcp_set_poll_cb(channel->c, channel_poll);
+	size_t todo = utcp_get_sndbuf_free(channel->c);
+
+	if(aio->data && todo > aio->len) {
+		todo = aio->len;
+	}
+
+	if(todo) {
+		channel_poll(channel->c, todo);
+	}
+}
+
 bool meshlink_channel_aio_send(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len, meshlink_aio_cb_t cb, void *priv) {
 	if(!mesh || !channel) {
 		meshlink_errno = MESHLINK_EINVAL;
 		return false;
 	}
 
-	if(!len || !data) {
+	if(!len || !data || is_framed(channel)) {
 		meshlink_errno = MESHLINK_EINVAL;
 		return false;
 	}
@@ -4100,23 +4618,7 @@ bool meshlink_channel_aio_send(meshlink_handle_t *mesh, meshlink_channel_t *chan
 		abort();
 	}
 
-	/* Append the AIO buffer descriptor to the end of the chain */
-	meshlink_aio_buffer_t **p = &channel->aio_send;
-
-	while(*p) {
-		p = &(*p)->next;
-	}
-
-	*p = aio;
-
-	/* Ensure the poll callback is set, and call it right now to push data if possible */
-	utcp_set_poll_cb(channel->c, channel_poll);
-	size_t todo = MIN(len, utcp_get_rcvbuf_free(channel->c));
-
-	if(todo) {
-		channel_poll(channel->c, todo);
-	}
-
+	aio_enqueue_send(mesh, channel, aio);
 	pthread_mutex_unlock(&mesh->mutex);
 
 	return true;
@@ -4128,7 +4630,7 @@ bool meshlink_channel_aio_fd_send(meshlink_handle_t *mesh, meshlink_channel_t *c
 		return false;
 	}
 
-	if(!len || fd == -1) {
+	if(!len || fd == -1 || is_framed(channel)) {
 		meshlink_errno = MESHLINK_EINVAL;
 		return false;
 	}
@@ -4139,27 +4641,16 @@ bool meshlink_channel_aio_fd_send(meshlink_handle_t *mesh, meshlink_channel_t *c
 	aio->cb.fd = cb;
 	aio->priv = priv;
 
+#ifdef POSIX_FADV_SEQUENTIAL
+	/* Let the kernel read ahead aggressively, this fails harmlessly if fd is not a regular file. */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
 	if(pthread_mutex_lock(&mesh->mutex) != 0) {
 		abort();
 	}
 
-	/* Append the AIO buffer descriptor to the end of the chain */
-	meshlink_aio_buffer_t **p = &channel->aio_send;
-
-	while(*p) {
-		p = &(*p)->next;
-	}
-
-	*p = aio;
-
-	/* Ensure the poll callback is set, and call it right now to push data if possible */
-	utcp_set_poll_cb(channel->c, channel_poll);
-	size_t left = utcp_get_rcvbuf_free(channel->c);
-
-	if(left) {
-		channel_poll(channel->c, left);
-	}
-
+	aio_enqueue_send(mesh, channel, aio);
 	pthread_mutex_unlock(&mesh->mutex);
 
 	return true;
@@ -4186,14 +4677,7 @@ bool meshlink_channel_aio_receive(meshlink_handle_t *mesh, meshlink_channel_t *c
 		abort();
 	}
 
-	/* Append the AIO buffer descriptor to the end of the chain */
-	meshlink_aio_buffer_t **p = &channel->aio_receive;
-
-	while(*p) {
-		p = &(*p)->next;
-	}
-
-	*p = aio;
+	aio_append(&channel->aio_receive, &channel->aio_receive_tail, aio);
 
 	pthread_mutex_unlock(&mesh->mutex);
 
@@ -4221,20 +4705,208 @@ bool meshlink_channel_aio_fd_receive(meshlink_handle_t *mesh, meshlink_channel_t
 		abort();
 	}
 
-	/* Append the AIO buffer descriptor to the end of the chain */
-	meshlink_aio_buffer_t **p = &channel->aio_receive;
+	aio_append(&channel->aio_receive, &channel->aio_receive_tail, aio);
+
+	pthread_mutex_unlock(&mesh->mutex);
+
+	return true;
+}
 
-	while(*p) {
-		p = &(*p)->next;
+meshlink_completion_queue_t *meshlink_completion_queue_open(meshlink_handle_t *mesh) {
+	if(!mesh) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return NULL;
 	}
 
-	*p = aio;
+	meshlink_completion_queue_t *cq = xzalloc(sizeof(*cq));
+
+#ifdef HAVE_SYS_EVENTFD_H
+	cq->fd[0] = cq->fd[1] = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	bool ok = cq->fd[0] != -1;
+#else
+	bool ok = !pipe(cq->fd);
+
+#ifdef FD_CLOEXEC
+
+	if(ok) {
+		fcntl(cq->fd[0], F_SETFD, FD_CLOEXEC);
+		fcntl(cq->fd[1], F_SETFD, FD_CLOEXEC);
+	}
+
+#endif
+#endif
+
+	if(!ok) {
+		logger(mesh, MESHLINK_ERROR, "Could not create completion queue: %s", strerror(errno));
+		free(cq);
+		meshlink_errno = MESHLINK_EINTERNAL;
+		return NULL;
+	}
+
+	cq->size = 16;
+	cq->ring = xmalloc(cq->size * sizeof(*cq->ring));
+	pthread_mutex_init(&cq->mutex, NULL);
+	pthread_cond_init(&cq->cond, NULL);
+
+	return cq;
+}
+
+bool meshlink_completion_queue_close(meshlink_handle_t *mesh, meshlink_completion_queue_t *cq) {
+	if(!mesh || !cq) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	if(pthread_mutex_lock(&cq->mutex) != 0) {
+		abort();
+	}
+
+	/* MeshLink's thread would still push completions into the queue after it is freed. */
+	size_t outstanding = cq->outstanding;
+
+	pthread_mutex_unlock(&cq->mutex);
+
+	if(outstanding) {
+		logger(mesh, MESHLINK_ERROR, "Cannot close a completion queue with %zu outstanding requests", outstanding);
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	close(cq->fd[0]);
+
+	if(cq->fd[1] != cq->fd[0]) {
+		close(cq->fd[1]);
+	}
+
+	pthread_cond_destroy(&cq->cond);
+	pthread_mutex_destroy(&cq->mutex);
+	free(cq->ring);
+	free(cq);
+	return true;
+}
+
+int meshlink_completion_queue_get_fd(meshlink_handle_t *mesh, meshlink_completion_queue_t *cq) {
+	if(!mesh || !cq) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return -1;
+	}
+
+	return cq->fd[0];
+}
+
+bool meshlink_completion_queue_submit(meshlink_handle_t *mesh, meshlink_completion_queue_t *cq, const meshlink_aio_request_t *requests, size_t count) {
+	if(!mesh || !cq || (count && !requests)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	for(size_t i = 0; i < count; i++) {
+		const meshlink_aio_request_t *req = &requests[i];
+
+		if(!req->channel || !req->len || (!req->data && req->fd == -1)) {
+			meshlink_errno = MESHLINK_EINVAL;
+			return false;
+		}
+
+		if(req->op != MESHLINK_AIO_RECEIVE && (req->op != MESHLINK_AIO_SEND || is_framed(req->channel))) {
+			meshlink_errno = MESHLINK_EINVAL;
+			return false;
+		}
+
+#ifdef POSIX_FADV_SEQUENTIAL
+
+		if(req->op == MESHLINK_AIO_SEND && !req->data) {
+			posix_fadvise(req->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		}
+
+#endif
+	}
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	if(pthread_mutex_lock(&cq->mutex) != 0) {
+		abort();
+	}
+
+	cq->outstanding += count;
+
+	pthread_mutex_unlock(&cq->mutex);
+
+	for(size_t i = 0; i < count; i++) {
+		const meshlink_aio_request_t *req = &requests[i];
+		meshlink_aio_buffer_t *aio = xzalloc(sizeof(*aio));
+		aio->data = req->data;
+		aio->fd = req->data ? -1 : req->fd;
+		aio->len = req->len;
+		aio->priv = req->priv;
+		aio->cq = cq;
+
+		if(req->op == MESHLINK_AIO_SEND) {
+			aio_enqueue_send(mesh, req->channel, aio);
+		} else {
+			aio_append(&req->channel->aio_receive, &req->channel->aio_receive_tail, aio);
+		}
+	}
 
 	pthread_mutex_unlock(&mesh->mutex);
 
 	return true;
 }
 
+size_t meshlink_completion_queue_reap(meshlink_handle_t *mesh, meshlink_completion_queue_t *cq, meshlink_aio_completion_t *completions, size_t max) {
+	if(!mesh || !cq || (max && !completions)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return 0;
+	}
+
+	if(pthread_mutex_lock(&cq->mutex) != 0) {
+		abort();
+	}
+
+	size_t count = cq_pop(cq, completions, max);
+
+	pthread_mutex_unlock(&cq->mutex);
+
+	return count;
+}
+
+size_t meshlink_completion_queue_wait(meshlink_handle_t *mesh, meshlink_completion_queue_t *cq, meshlink_aio_completion_t *completions, size_t max, int timeout) {
+	if(!mesh || !cq || (max && !completions)) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return 0;
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout / 1000;
+	deadline.tv_nsec += (timeout % 1000) * 1000000;
+
+	if(deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	if(pthread_mutex_lock(&cq->mutex) != 0) {
+		abort();
+	}
+
+	while(!cq->count) {
+		int result = timeout < 0 ? pthread_cond_wait(&cq->cond, &cq->mutex) : pthread_cond_timedwait(&cq->cond, &cq->mutex, &deadline);
+
+		if(result == ETIMEDOUT) {
+			break;
+		}
+	}
+
+	size_t count = cq_pop(cq, completions, max);
+
+	pthread_mutex_unlock(&cq->mutex);
+
+	return count;
+}
+
 uint32_t meshlink_channel_get_flags(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
 	if(!mesh || !channel) {
 		meshlink_errno = MESHLINK_EINVAL;
@@ -4250,7 +4922,15 @@ size_t meshlink_channel_get_sendq(meshlink_handle_t *mesh, meshlink_channel_t *c
 		return -1;
 	}
 
-	return utcp_get_sendq(channel->c);
+	/* Data that is still staged has not reached UTCP yet, but it is queued for sending all the same. */
+	if(pthread_mutex_lock(&channel->stage.mutex) != 0) {
+		abort();
+	}
+
+	size_t staged = channel->stage.len;
+	pthread_mutex_unlock(&channel->stage.mutex);
+
+	return utcp_get_sendq(channel->c) + staged;
 }
 
 size_t meshlink_channel_get_recvq(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
@@ -4271,6 +4951,60 @@ size_t meshlink_channel_get_mss(meshlink_handle_t *mesh, meshlink_channel_t *cha
 	return utcp_get_mss(channel->node->utcp);
 }
 
+size_t meshlink_channel_get_fec_recovered(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return -1;
+	}
+
+	return utcp_get_fec_recovered(channel->c);
+}
+
+size_t meshlink_channel_get_fec_lost(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	if(!mesh || !channel) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return -1;
+	}
+
+	return utcp_get_fec_lost(channel->c);
+}
+
+bool meshlink_channel_get_stats(meshlink_handle_t *mesh, meshlink_channel_t *channel, meshlink_channel_stats_t *stats) {
+	if(!mesh || !channel || !stats || !stats->version || stats->version > MESHLINK_CHANNEL_STATS_VERSION) {
+		meshlink_errno = MESHLINK_EINVAL;
+		return false;
+	}
+
+	struct utcp_stats ustats;
+
+	if(pthread_mutex_lock(&mesh->mutex) != 0) {
+		abort();
+	}
+
+	utcp_get_stats(channel->c, &ustats);
+
+	pthread_mutex_unlock(&mesh->mutex);
+
+	// Version 1
+	stats->srtt = ustats.srtt;
+	stats->rttvar = ustats.rttvar;
+	stats->rto = ustats.rto;
+	stats->cwnd = ustats.cwnd;
+	stats->ssthresh = ustats.ssthresh;
+	stats->flightsize = ustats.flightsize;
+	stats->dupack = ustats.dupack;
+	stats->sack_holes = ustats.sack_holes;
+	stats->bytes_sent = ustats.bytes_sent;
+	stats->bytes_received = ustats.bytes_received;
+	stats->segments_sent = ustats.segments_sent;
+	stats->segments_received = ustats.segments_received;
+	stats->retransmits = ustats.retransmits;
+	stats->timeouts = ustats.timeouts;
+	stats->fast_recoveries = ustats.fast_recoveries;
+
+	return true;
+}
+
 void meshlink_set_node_channel_timeout(meshlink_handle_t *mesh, meshlink_node_t *node, int timeout) {
 	if(!mesh || !node) {
 		meshlink_errno = MESHLINK_EINVAL;
@@ -4284,9 +5018,7 @@ void meshlink_set_node_channel_timeout(meshlink_handle_t *mesh, meshlink_node_t
 	}
 
 	if(!n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		init_node_utcp(mesh, n);
 	}
 
 	utcp_set_user_timeout(n->utcp, timeout);
@@ -4296,9 +5028,7 @@ void meshlink_set_node_channel_timeout(meshlink_handle_t *mesh, meshlink_node_t
 
 void update_node_status(meshlink_handle_t *mesh, node_t *n) {
 	if(n->status.reachable && mesh->channel_accept_cb && !n->utcp) {
-		n->utcp = utcp_init(channel_accept, channel_pre_accept, channel_send, n);
-		utcp_set_mtu(n->utcp, n->mtu - sizeof(meshlink_packethdr_t));
-		utcp_set_retransmit_cb(n->utcp, channel_retransmit);
+		init_node_utcp(mesh, n);
 	}
 
 	if(mesh->node_status_cb) {
@@ -4311,7 +5041,9 @@ void update_node_status(meshlink_handle_t *mesh, node_t *n) {
 }
 
 void update_node_pmtu(meshlink_handle_t *mesh, node_t *n) {
-	utcp_set_mtu(n->utcp, (n->minmtu > MINMTU ? n->minmtu : MINMTU) - sizeof(meshlink_packethdr_t));
+	/* Packets that do not fit in the direct PMTU can still go through a relay */
+	uint16_t mtu = n->minmtu > n->relay_mtu ? n->minmtu : n->relay_mtu;
+	utcp_set_mtu(n->utcp, (mtu > MINMTU ? mtu : MINMTU) - sizeof(meshlink_packethdr_t));
 
 	if(mesh->node_pmtu_cb && !n->status.blacklisted) {
 		mesh->node_pmtu_cb(mesh, (meshlink_node_t *)n, n->minmtu);
@@ -30,6 +30,7 @@
 #else
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef __cplusplus
@@ -57,6 +58,18 @@ typedef struct meshlink_open_params meshlink_open_params_t;
 /// A handle for a MeshLink sub-mesh.
 typedef struct meshlink_submesh meshlink_submesh_t;
 
+/// A struct containing statistics about a channel.
+typedef struct meshlink_channel_stats meshlink_channel_stats_t;
+
+/// A handle for a queue of completed asynchronous channel I/O requests.
+typedef struct meshlink_completion_queue meshlink_completion_queue_t;
+
+/// A struct describing an asynchronous channel I/O request.
+typedef struct meshlink_aio_request meshlink_aio_request_t;
+
+/// A struct describing a completed asynchronous channel I/O request.
+typedef struct meshlink_aio_completion meshlink_aio_completion_t;
+
 /// Code of most recent error encountered.
 typedef enum {
 	MESHLINK_OK,           ///< Everything is fine
@@ -93,12 +106,18 @@ static const uint32_t MESHLINK_INVITE_NUMERIC = 16; // Don't look up hostnames
 /// Channel flags
 static const uint32_t MESHLINK_CHANNEL_RELIABLE = 1;   // Data is retransmitted when packets are lost.
 static const uint32_t MESHLINK_CHANNEL_ORDERED = 2;    // Data is delivered in-order to the application.
-static const uint32_t MESHLINK_CHANNEL_FRAMED = 4;     // Data is delivered in chunks of the same length as data was originally sent.
+static const uint32_t MESHLINK_CHANNEL_FRAMED = 4;     // Data is delivered in chunks of the same length as data was originally sent, also on reliable channels.
 static const uint32_t MESHLINK_CHANNEL_DROP_LATE = 8;  // When packets are reordered, late packets are ignored.
 static const uint32_t MESHLINK_CHANNEL_NO_PARTIAL = 16; // Calls to meshlink_channel_send() will either send all data or nothing.
 static const uint32_t MESHLINK_CHANNEL_TCP = 3;        // Select TCP semantics.
 static const uint32_t MESHLINK_CHANNEL_UDP = 0;        // Select UDP semantics.
 
+/// Number of channel priority classes
+static const int MESHLINK_CHANNEL_PRIORITIES = 4;
+
+/// Current version of meshlink_channel_stats_t
+static const uint32_t MESHLINK_CHANNEL_STATS_VERSION = 1;
+
 /// A variable holding the last encountered error from MeshLink.
 /** This is a thread local variable that contains the error code of the most recent error
  *  encountered by a MeshLink API function called in the current thread.
@@ -131,6 +150,60 @@ struct meshlink_channel {
 
 #endif // MESHLINK_INTERNAL_H
 
+/// Statistics about a channel.
+/** New fields are only ever added at the end, together with an increment of MESHLINK_CHANNEL_STATS_VERSION.
+ *  The application sets the version field to the version it was compiled against,
+ *  and MeshLink only writes the fields that are part of that version.
+ */
+struct meshlink_channel_stats {
+	uint32_t version;           ///< Must be set by the application to MESHLINK_CHANNEL_STATS_VERSION.
+
+	// Current state
+	uint32_t srtt;              ///< Smoothed round-trip time in microseconds.
+	uint32_t rttvar;            ///< Round-trip time variation in microseconds.
+	uint32_t rto;               ///< Retransmission timeout in microseconds.
+	uint32_t cwnd;              ///< Congestion window in bytes.
+	uint32_t ssthresh;          ///< Slow start threshold in bytes.
+	uint32_t flightsize;        ///< Bytes sent but not yet acknowledged.
+	uint32_t dupack;            ///< Number of duplicate ACKs received in a row.
+	uint32_t sack_holes;        ///< Number of out-of-order ranges waiting in the receive buffer.
+
+	// Cumulative counters
+	uint64_t bytes_sent;        ///< Payload bytes sent, including retransmissions.
+	uint64_t bytes_received;    ///< Payload bytes received, including duplicates.
+	uint64_t segments_sent;     ///< Data segments sent, including retransmissions.
+	uint64_t segments_received; ///< Data segments received, including duplicates.
+	uint64_t retransmits;       ///< Data segments retransmitted.
+	uint32_t timeouts;          ///< Number of times the retransmission timer expired.
+	uint32_t fast_recoveries;   ///< Number of times fast recovery was entered.
+};
+
+/// The direction of an asynchronous channel I/O request.
+typedef enum {
+	MESHLINK_AIO_SEND,    ///< Send data from a buffer or filedescriptor on the channel.
+	MESHLINK_AIO_RECEIVE, ///< Receive data from the channel into a buffer or filedescriptor.
+} meshlink_aio_op_t;
+
+/// An asynchronous channel I/O request, submitted with meshlink_completion_queue_submit().
+struct meshlink_aio_request {
+	struct meshlink_channel *channel; ///< The channel to send or receive data on.
+	meshlink_aio_op_t op;             ///< Whether to send or receive.
+	const void *data;                 ///< The buffer to send from or receive into, or NULL to use fd instead.
+	int fd;                           ///< The filedescriptor to read from or write to if data is NULL.
+	size_t len;                       ///< The number of bytes to send or receive.
+	void *priv;                       ///< A private pointer which is passed unchanged to the completion.
+};
+
+/// A completed asynchronous channel I/O request, retrieved with meshlink_completion_queue_reap().
+struct meshlink_aio_completion {
+	struct meshlink_channel *channel; ///< The channel the request was submitted on. This may no longer be valid if the application has closed it.
+	meshlink_aio_op_t op;             ///< Whether data was sent or received.
+	const void *data;                 ///< The buffer of the request, or NULL if a filedescriptor was used.
+	int fd;                           ///< The filedescriptor of the request, if data is NULL.
+	size_t len;                       ///< The number of bytes actually sent or received. This is less than requested if the channel was closed or an error occurred.
+	void *priv;                       ///< The private pointer of the request.
+};
+
 /// Get the text for the given MeshLink error code.
 /** This function returns a pointer to the string containing the description of the given error code.
  *
@@ -1174,10 +1247,13 @@ void meshlink_set_default_blacklist(struct meshlink_handle *mesh, bool blacklist
  *                      then this handle is invalid after the callback returns
  *                      (the callback does not need to call meshlink_channel_close() itself in this case).
  *  @param port         The port number the peer wishes to connect to.
- *  @param data         A pointer to a buffer containing data already received, or NULL in case no data has been received yet. (Not yet used.)
+ *  @param data         A pointer to a buffer containing data already received, or NULL in case no data has been received yet.
+ *                      This is the data the peer passed to meshlink_channel_open_ex(), or the part of it that fitted in the first packet.
+ *                      If the application accepts the channel, it is responsible for processing this data,
+ *                      it will not be passed to the receive callback.
  *                      The pointer is only valid during the lifetime of the callback.
  *                      The callback should mempcy() the data if it needs to be available outside the callback.
- *  @param len          The length of the data, or 0 in case no data has been received yet. (Not yet used.)
+ *  @param len          The length of the data, or 0 in case no data has been received yet.
  *
  *  @return             This function should return true if the application accepts the incoming channel, false otherwise.
  *                      If returning false, the channel is invalid and may not be used anymore.
@@ -1259,6 +1335,8 @@ void meshlink_set_channel_poll_cb(struct meshlink_handle *mesh, struct meshlink_
 /// Set the send buffer size of a channel.
 /** This function sets the desired size of the send buffer.
  *  The default size is 128 kB.
+ *  By default, the send buffer grows automatically to match the receive window of the peer.
+ *  Setting the size explicitly disables this.
  *
  *  \memberof meshlink_channel
  *  @param mesh      A handle which represents an instance of MeshLink.
@@ -1271,6 +1349,8 @@ void meshlink_set_channel_sndbuf(struct meshlink_handle *mesh, struct meshlink_c
 /// Set the receive buffer size of a channel.
 /** This function sets the desired size of the receive buffer.
  *  The default size is 128 kB.
+ *  By default, the receive buffer grows automatically based on the measured bandwidth-delay product.
+ *  Setting the size explicitly disables this.
  *
  *  \memberof meshlink_channel
  *  @param mesh      A handle which represents an instance of MeshLink.
@@ -1280,6 +1360,99 @@ void meshlink_set_channel_sndbuf(struct meshlink_handle *mesh, struct meshlink_c
  */
 void meshlink_set_channel_rcvbuf(struct meshlink_handle *mesh, struct meshlink_channel *channel, size_t size);
 
+/// Set the maximum size of automatically tuned channel buffers.
+/** This function sets the limit up to which the send and receive buffers of a channel
+ *  are grown automatically. Memory is only allocated when the buffers actually fill up.
+ *  The default limit is 4 MB.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param size      The maximum size for the send and receive buffers.
+ */
+void meshlink_set_channel_max_bufsize(struct meshlink_handle *mesh, struct meshlink_channel *channel, size_t size);
+
+/// Set the forward error correction group size of a channel.
+/** This function enables forward error correction for channels without MESHLINK_CHANNEL_RELIABLE.
+ *  When a message does not fit in a single packet, an extra parity packet is sent for every group of packets.
+ *  The receiver can then reconstruct a single lost packet per group without waiting for a retransmission.
+ *  Smaller groups give better protection, at the cost of more overhead: a group size of 4 adds 25% extra traffic
+ *  to fragmented messages. Messages that fit in a single packet are never protected.
+ *  Only the sender needs to enable this. It has no effect on reliable channels,
+ *  nor on channels to nodes running a version of MeshLink that does not support parity packets.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param group     The number of packets covered by each parity packet, or 0 to disable forward error correction.
+ */
+void meshlink_set_channel_fec(struct meshlink_handle *mesh, struct meshlink_channel *channel, int group);
+
+/// Set the priority and weight of a channel.
+/** All channels to the same node share the same network path.
+ *  When the path cannot take all the data the channels want to send, channels with a higher priority class are served first.
+ *  Channels in the same priority class share the path in proportion to their weights.
+ *  By default, channels have priority 0 and weight 1.
+ *  This only affects channels with MESHLINK_CHANNEL_RELIABLE, and only the data sent by the local node.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param priority  The priority class, from 0 up to but not including MESHLINK_CHANNEL_PRIORITIES.
+ *                   Higher values are served first.
+ *  @param weight    The weight of the channel within its priority class, from 1 to 65535.
+ */
+void meshlink_set_channel_priority(struct meshlink_handle *mesh, struct meshlink_channel *channel, int priority, int weight);
+
+/// Set the maximum message size of a framed reliable channel.
+/** Channels with both MESHLINK_CHANNEL_RELIABLE and MESHLINK_CHANNEL_FRAMED preserve the boundaries of the data
+ *  passed to meshlink_channel_send(), and call the receive callback exactly once for every message.
+ *  Messages can span many packets, the send and receive buffers grow as necessary to hold a complete message.
+ *  This sets the largest message that can be sent, and the largest message that will be accepted from the peer.
+ *  If the peer sends a larger message, the channel is closed.
+ *  The default maximum is 64 kB.
+ *
+ *  Messages can only be sent once the channel is connected, until then meshlink_channel_send() returns 0.
+ *  Peers running older versions of MeshLink do not preserve message boundaries on reliable channels.
+ *  With those, the channel carries a plain byte stream,
+ *  and meshlink_channel_get_flags() no longer includes MESHLINK_CHANNEL_FRAMED once the channel is connected.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param channel   A handle for the channel.
+ *  @param size      The maximum size of a message in bytes.
+ */
+void meshlink_set_channel_max_message_size(struct meshlink_handle *mesh, struct meshlink_channel *channel, size_t size);
+
+/// Set the maximum amount of memory used by the buffers of all channels.
+/** The send and receive buffers of all channels are allocated from a memory pool shared by the whole mesh.
+ *  Buffers only hold memory while they contain data, and return it to the pool when they are drained.
+ *  This limits the total size of all buffers. When the limit is reached, meshlink_channel_send() returns 0
+ *  as if the send buffer were full, and the poll callback is called again later when memory might be available.
+ *  Incoming data that arrives out of order is dropped and retransmitted by the peer.
+ *  While a limit is set, meshlink_channel_send() always takes the mesh's lock,
+ *  so it should be set before opening channels. By default, there is no limit.
+ *
+ *  \memberof meshlink_handle
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param limit     The maximum number of bytes used by all channel buffers, or 0 to remove the limit.
+ */
+void meshlink_set_channel_memory_limit(struct meshlink_handle *mesh, size_t limit);
+
+/// Coalesce small channel packets into shared datagrams.
+/** Normally, every packet of every channel is sent in its own datagram, with its own routing header and encryption overhead.
+ *  When coalescing is enabled, small packets of all channels to the same node are held back until the library thread
+ *  has finished handling the current event, and are then packed together into as few datagrams as the path MTU allows.
+ *  This greatly increases the throughput of many small messages, at the cost of a small delay.
+ *  Nodes running an older version of MeshLink, which cannot unpack such datagrams, still get one packet per datagram.
+ *  By default, coalescing is disabled.
+ *
+ *  \memberof meshlink_handle
+ *  @param mesh      A handle which represents an instance of MeshLink.
+ *  @param coalesce  True to coalesce small packets, false to send every packet immediately.
+ */
+void meshlink_set_channel_coalescing(struct meshlink_handle *mesh, bool coalesce);
+
 /// Open a reliable stream channel to another node.
 /** This function is called whenever a remote node wants to open a channel to the local node.
  *  The application then has to decide whether to accept or reject this channel.
@@ -1295,7 +1468,13 @@ void meshlink_set_channel_rcvbuf(struct meshlink_handle *mesh, struct meshlink_c
  *  @param cb           A pointer to the function which will be called when the remote node sends data to the local node.
  *                      The pointer may be NULL, in which case incoming data is ignored.
  *  @param data         A pointer to a buffer containing data to already queue for sending, or NULL if there is no data to send.
- *                      After meshlink_send() returns, the application is free to overwrite or free this buffer.
+ *                      As much of the data as fits in a single packet is sent along with the request to open the channel,
+ *                      and is passed to the accept callback of the remote node, saving a round trip.
+ *                      For channels without MESHLINK_CHANNEL_RELIABLE or with MESHLINK_CHANNEL_FRAMED, all data has to fit in that packet,
+ *                      and the accept callback receives it as a single message.
+ *                      That is 4 bytes less than the maximum segment size, see meshlink_channel_get_mss().
+ *                      If the data does not fit, no channel is opened and meshlink_errno is set to MESHLINK_EINVAL.
+ *                      After meshlink_channel_open_ex() returns, the application is free to overwrite or free this buffer.
  *                      If len is 0, the data pointer is copied into the channel's priv member.
  *  @param len          The length of the data, or 0 if there is no data to send.
  *  @param flags        A bitwise-or'd combination of flags that set the semantics for this channel.
@@ -1323,7 +1502,8 @@ struct meshlink_channel *meshlink_channel_open_ex(struct meshlink_handle *mesh,
  *  @param cb           A pointer to the function which will be called when the remote node sends data to the local node.
  *                      The pointer may be NULL, in which case incoming data is ignored.
  *  @param data         A pointer to a buffer containing data to already queue for sending, or NULL if there is no data to send.
- *                      After meshlink_send() returns, the application is free to overwrite or free this buffer.
+ *                      As much of the data as fits in a single packet is sent along with the request to open the channel.
+ *                      After meshlink_channel_open() returns, the application is free to overwrite or free this buffer.
  *  @param len          The length of the data, or 0 if there is no data to send.
  *                      If len is 0, the data pointer is copied into the channel's priv member.
  *
@@ -1363,6 +1543,10 @@ void meshlink_channel_close(struct meshlink_handle *mesh, struct meshlink_channe
 
 /// Transmit data on a channel
 /** This queues data to send to the remote node.
+ *
+ *  If the library thread is busy, the data may be held back briefly before it is handed to the channel.
+ *  Should the channel fail in the meantime, so that the data cannot be sent after all,
+ *  the poll callback is called with a length of 0.
  *
  *  \memberof meshlink_channel
  *  @param mesh         A handle which represents an instance of MeshLink.
@@ -1374,9 +1558,32 @@ void meshlink_channel_close(struct meshlink_handle *mesh, struct meshlink_channe
  *  @return             The amount of data that was queued, which can be less than len, or a negative value in case of an error.
  *                      If MESHLINK_CHANNEL_NO_PARTIAL is set, then the result will either be len,
  *                      0 if the buffer is currently too full, or -1 if len is too big even for an empty buffer.
+ *                      If MESHLINK_CHANNEL_FRAMED is set, the data is sent as a single message,
+ *                      and the result will either be len, 0 if the buffer is currently too full
+ *                      or a reliable channel is not connected yet, or -1 if len is larger than the maximum message size.
  */
 ssize_t meshlink_channel_send(struct meshlink_handle *mesh, struct meshlink_channel *channel, const void *data, size_t len) __attribute__((__warn_unused_result__));
 
+/// Transmit data from multiple buffers on a channel
+/** This queues data gathered from multiple buffers to send to the remote node.
+ *  The result is the same as if the buffers were concatenated and passed to meshlink_channel_send(),
+ *  but without the need to copy them into a single buffer first.
+ *  For UDP channels, all buffers together form a single packet.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param iov          A pointer to an array of iovecs describing the buffers to send.
+ *                      After meshlink_channel_sendv() returns, the application is free to overwrite or free these buffers.
+ *  @param iovcnt       The number of iovecs in the array.
+ *
+ *  @return             The amount of data that was queued, which can be less than the total length of all buffers,
+ *                      or a negative value in case of an error.
+ *                      If MESHLINK_CHANNEL_NO_PARTIAL is set, then the result will either be the total length,
+ *                      0 if the buffer is currently too full, or -1 if the total length is too big even for an empty buffer.
+ */
+ssize_t meshlink_channel_sendv(struct meshlink_handle *mesh, struct meshlink_channel *channel, const struct iovec *iov, int iovcnt) __attribute__((__warn_unused_result__));
+
 /// A callback for cleaning up buffers submitted for asynchronous I/O.
 /** This callbacks signals that MeshLink has finished using this buffer.
  *  The ownership of the buffer is now back into the application's hands.
@@ -1404,6 +1611,7 @@ typedef void (*meshlink_aio_fd_cb_t)(struct meshlink_handle *mesh, struct meshli
 /** This registers a buffer that will be used to send data to the remote node.
  *  Multiple buffers can be registered, in which case data will be sent in the order the buffers were registered.
  *  While there are still buffers with unsent data, the poll callback will not be called.
+ *  This is not supported on channels with both MESHLINK_CHANNEL_RELIABLE and MESHLINK_CHANNEL_FRAMED.
  *
  *  \memberof meshlink_channel
  *  @param mesh         A handle which represents an instance of MeshLink.
@@ -1423,6 +1631,7 @@ bool meshlink_channel_aio_send(struct meshlink_handle *mesh, struct meshlink_cha
 /** This will read up to the specified length number of bytes from the given filedescriptor, and send it over the channel.
  *  The callback may be returned early if there is an error reading from the filedescriptor.
  *  While there is still with unsent data, the poll callback will not be called.
+ *  This is not supported on channels with both MESHLINK_CHANNEL_RELIABLE and MESHLINK_CHANNEL_FRAMED.
  *
  *  \memberof meshlink_channel
  *  @param mesh         A handle which represents an instance of MeshLink.
@@ -1440,6 +1649,8 @@ bool meshlink_channel_aio_fd_send(struct meshlink_handle *mesh, struct meshlink_
 /** This registers a buffer that will be filled with incoming channel data.
  *  Multiple buffers can be registered, in which case data will be received in the order the buffers were registered.
  *  While there are still buffers that have not been filled, the receive callback will not be called.
+ *  Data that arrives in order is copied straight from the decrypted packet into the buffer,
+ *  only out-of-order data is stored in the channel's receive buffer first.
  *
  *  \memberof meshlink_channel
  *  @param mesh         A handle which represents an instance of MeshLink.
@@ -1472,6 +1683,96 @@ bool meshlink_channel_aio_receive(struct meshlink_handle *mesh, struct meshlink_
  */
 bool meshlink_channel_aio_fd_receive(struct meshlink_handle *mesh, struct meshlink_channel *channel, int fd, size_t len, meshlink_aio_fd_cb_t cb, void *priv) __attribute__((__warn_unused_result__));
 
+/// Create a completion queue for asynchronous channel I/O.
+/** A completion queue is an alternative to the callbacks of meshlink_channel_aio_send() and friends.
+ *  Requests submitted with meshlink_completion_queue_submit() are processed in the same way,
+ *  but when MeshLink has finished with a buffer or filedescriptor, it is placed in the queue instead of calling back into the application.
+ *  The application can then retrieve completions from any thread, without ever holding up MeshLink's own thread.
+ *
+ *  \memberof meshlink_handle
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *
+ *  @return             A handle for the completion queue, or NULL in case of an error.
+ *                      The handle is valid until meshlink_completion_queue_close() is called.
+ */
+meshlink_completion_queue_t *meshlink_completion_queue_open(struct meshlink_handle *mesh) __attribute__((__warn_unused_result__));
+
+/// Destroy a completion queue.
+/** All requests submitted to this queue must have completed before it is destroyed,
+ *  otherwise the queue is left untouched and meshlink_errno is set to MESHLINK_EINVAL.
+ *  Closing the channels they were submitted on completes all outstanding requests.
+ *  Completions that have not been reaped yet are discarded.
+ *
+ *  \memberof meshlink_completion_queue
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param cq           A handle for the completion queue.
+ *
+ *  @return             True if the queue was destroyed, false otherwise.
+ */
+bool meshlink_completion_queue_close(struct meshlink_handle *mesh, meshlink_completion_queue_t *cq);
+
+/// Get a filedescriptor that signals pending completions.
+/** The filedescriptor is readable whenever there are completions that have not been reaped yet,
+ *  so it can be added to the application's own poll(), select() or epoll loop.
+ *  The application must not read from or close this filedescriptor.
+ *
+ *  \memberof meshlink_completion_queue
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param cq           A handle for the completion queue.
+ *
+ *  @return             A filedescriptor, or -1 in case of an error.
+ */
+int meshlink_completion_queue_get_fd(struct meshlink_handle *mesh, meshlink_completion_queue_t *cq) __attribute__((__warn_unused_result__));
+
+/// Submit asynchronous channel I/O requests.
+/** This enqueues the requests on their channels in the given order, as if meshlink_channel_aio_send(),
+ *  meshlink_channel_aio_fd_send(), meshlink_channel_aio_receive() or meshlink_channel_aio_fd_receive() was called for each of them,
+ *  but taking MeshLink's lock only once.
+ *  When MeshLink has finished using the buffer or filedescriptor of a request, a completion is added to the queue.
+ *  No callbacks are called for these requests.
+ *  The requests are checked before any of them is enqueued, so either all or none of them are submitted.
+ *
+ *  \memberof meshlink_completion_queue
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param cq           A handle for the completion queue.
+ *  @param requests     A pointer to an array of requests.
+ *                      The array itself may be reused by the application as soon as this function returns,
+ *                      but the buffers it points to may not be modified or freed until their completions have been reaped.
+ *  @param count        The number of requests in the array.
+ *
+ *  @return             True if the requests were enqueued, false otherwise.
+ */
+bool meshlink_completion_queue_submit(struct meshlink_handle *mesh, meshlink_completion_queue_t *cq, const meshlink_aio_request_t *requests, size_t count) __attribute__((__warn_unused_result__));
+
+/// Retrieve completed asynchronous channel I/O requests.
+/** This removes completions from the queue in the order in which the requests finished, without blocking.
+ *  It never waits for MeshLink's own thread.
+ *
+ *  \memberof meshlink_completion_queue
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param cq           A handle for the completion queue.
+ *  @param completions  A pointer to an array that will be filled with completions.
+ *  @param max          The maximum number of completions to retrieve.
+ *
+ *  @return             The number of completions retrieved.
+ */
+size_t meshlink_completion_queue_reap(struct meshlink_handle *mesh, meshlink_completion_queue_t *cq, meshlink_aio_completion_t *completions, size_t max) __attribute__((__warn_unused_result__));
+
+/// Wait for completed asynchronous channel I/O requests.
+/** This waits until there is at least one completion in the queue or the timeout expires,
+ *  and then retrieves completions like meshlink_completion_queue_reap().
+ *
+ *  \memberof meshlink_completion_queue
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param cq           A handle for the completion queue.
+ *  @param completions  A pointer to an array that will be filled with completions.
+ *  @param max          The maximum number of completions to retrieve.
+ *  @param timeout      The maximum time to wait in milliseconds, or a negative value to wait indefinitely.
+ *
+ *  @return             The number of completions retrieved, which is 0 if the timeout expired.
+ */
+size_t meshlink_completion_queue_wait(struct meshlink_handle *mesh, meshlink_completion_queue_t *cq, meshlink_aio_completion_t *completions, size_t max, int timeout) __attribute__((__warn_unused_result__));
+
 /// Get channel flags.
 /** This returns the flags used when opening this channel.
  *
@@ -1518,6 +1819,44 @@ size_t meshlink_channel_get_recvq(struct meshlink_handle *mesh, struct meshlink_
  */
 size_t meshlink_channel_get_mss(struct meshlink_handle *mesh, struct meshlink_channel *channel) __attribute__((__warn_unused_result__));
 
+/// Get the number of messages recovered using forward error correction.
+/** This returns the number of messages received on this channel that were only complete
+ *  after reconstructing a lost packet from a parity packet.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *
+ *  @return             The number of recovered messages.
+ */
+size_t meshlink_channel_get_fec_recovered(struct meshlink_handle *mesh, struct meshlink_channel *channel) __attribute__((__warn_unused_result__));
+
+/// Get the number of messages that could not be recovered.
+/** This returns the number of messages on this channel of which some, but not all, packets were received,
+ *  and that could not be reconstructed using forward error correction.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *
+ *  @return             The number of unrecoverable messages.
+ */
+size_t meshlink_channel_get_fec_lost(struct meshlink_handle *mesh, struct meshlink_channel *channel) __attribute__((__warn_unused_result__));
+
+/// Get statistics about a channel.
+/** This returns a snapshot of the congestion control state of a channel,
+ *  and counters that have been accumulated since the channel was opened.
+ *
+ *  \memberof meshlink_channel
+ *  @param mesh         A handle which represents an instance of MeshLink.
+ *  @param channel      A handle for the channel.
+ *  @param stats        A pointer to a meshlink_channel_stats_t variable that has to be provided by the caller.
+ *                      Its version field must be set to MESHLINK_CHANNEL_STATS_VERSION.
+ *
+ *  @return             True if the statistics were retrieved, false otherwise.
+ */
+bool meshlink_channel_get_stats(struct meshlink_handle *mesh, struct meshlink_channel *channel, meshlink_channel_stats_t *stats) __attribute__((__warn_unused_result__));
+
 /// Set the connection timeout used for channels to the given node.
 /** This sets the timeout after which unresponsive channels will be reported as closed.
  *  The timeout is set for all current and future channels to the given node.
@@ -101,19 +101,39 @@ struct meshlink_handle {
 
 	meshlink_receive_cb_t receive_cb;
 	meshlink_queue_t outpacketqueue;
+	meshlink_queue_t channelqueue;
 	signal_t datafromapp;
 
+	struct utcp_pool *channel_pool; // Memory for the buffers of all channels
+
 	hash_t *node_udp_cache;
 
 	struct splay_tree_t *nodes;
 	struct splay_tree_t *edges;
+	struct list_t *sssp_changed; // Nodes whose reachability has to be checked by the next graph() call
+	timeout_t graph_timeout;     // Runs graph() once after a burst of edge updates
+	int graph_pending;           // Number of edge updates waiting for graph_timeout
+	int graph_max_coalesced;
+	uint64_t graph_runs;
+	uint64_t graph_edge_updates;
+	struct graph_snapshot_t *graph_snapshot; // Flat copy of the graph used by full searches
+	uint64_t topology_syncs;         // Connections synchronized with a topology digest
+	uint64_t topology_edges_sent;    // Edges sent because their topology digest bucket differed
+	uint64_t topology_edges_skipped; // Edges not sent because their topology digest bucket matched
+	uint64_t topology_bytes_sent;    // Size of topology digests and the ADD_EDGE requests sent after them
+	uint64_t topology_bytes_full;    // Size of the ADD_EDGE requests for all edges covered by topology digests
+
+	struct splay_tree_t *autoconnect_unconnected[DEV_CLASS_COUNT]; // Nodes without a connection, most recently connected first
+	struct splay_tree_t *autoconnect_unreachable[DEV_CLASS_COUNT]; // Unreachable nodes, most recently connected first
+	struct list_t *autoconnect_changed; // Nodes whose place in the autoconnect indexes has to be updated
 
 	struct list_t *connections;
+	struct list_t *core_connections; // Active connections with nodes in the core mesh
 	struct list_t *outgoings;
 	struct list_t *submeshes;
 
 	// Meta-connection-related members
-	struct splay_tree_t *past_request_tree;
+	struct past_requests_t *past_requests;
 	timeout_t past_request_timeout;
 
 	int connection_burst;
@@ -160,6 +180,12 @@ struct meshlink_handle {
 	bool default_blacklist;
 	bool discovery;         // Whether Catta is enabled or not
 	bool inviter_commits_first;
+	bool channel_coalescing; // Whether small channel packets to the same node share datagrams
+	bool sssp_valid;         // Whether the SSSP tree can be updated incrementally
+	bool sssp_verify;        // Whether incremental SSSP updates are checked against a full search
+	bool graph_snapshot_valid; // Whether graph_snapshot matches the current nodes and edges
+	bool text_requests_only; // Whether binary requests are disabled on meta connections
+	bool udp_relaying_disabled; // Whether UDP packets are never sent through relays
 
 	// Configuration
 	char *confbase;
@@ -191,6 +217,19 @@ struct meshlink_handle {
 	meshlink_queue_t adns_queue;
 	meshlink_queue_t adns_done_queue;
 	signal_t adns_signal;
+
+	// Write-behind storage of host config files
+	pthread_t persist_thread;
+	pthread_mutex_t persist_mutex;
+	pthread_cond_t persist_cond;
+	pthread_cond_t persist_idle_cond;
+	struct splay_tree_t *persist_pending;
+	signal_t persist_signal;
+	bool persist_threadstarted;
+	bool persist_stop;
+	bool persist_busy;
+	bool persist_failed;
+	int persist_errno;
 };
 
 /// A handle for a MeshLink node.
@@ -216,9 +255,22 @@ typedef struct meshlink_aio_buffer {
 		meshlink_aio_fd_cb_t fd;
 	} cb;
 	void *priv;
+	struct meshlink_completion_queue *cq; // If set, completion is signalled here instead of via cb
 	struct meshlink_aio_buffer *next;
 } meshlink_aio_buffer_t;
 
+/// A queue of completed AIO requests.
+struct meshlink_completion_queue {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	meshlink_aio_completion_t *ring;
+	size_t size;  // Capacity of the ring, always a power of two
+	size_t head;  // Index of the oldest completion
+	size_t count;
+	size_t outstanding; // Submitted requests that have not completed yet
+	int fd[2];    // Readable while count > 0, both the same if it is an eventfd
+};
+
 /// A channel.
 struct meshlink_channel {
 	struct node_t *node;
@@ -227,9 +279,22 @@ struct meshlink_channel {
 
 	struct utcp_connection *c;
 	meshlink_aio_buffer_t *aio_send;
+	meshlink_aio_buffer_t *aio_send_tail;
 	meshlink_aio_buffer_t *aio_receive;
+	meshlink_aio_buffer_t *aio_receive_tail;
 	meshlink_channel_receive_cb_t receive_cb;
 	meshlink_channel_poll_cb_t poll_cb;
+
+	// Data sent by the application while the mesh was busy, not yet moved into the UTCP send buffer.
+	struct {
+		pthread_mutex_t mutex;
+		char *data;
+		size_t len;
+		size_t size;
+		size_t space;   // Bytes that can be staged without exceeding the UTCP send buffer
+		bool queued;    // The channel is in mesh->channelqueue
+		bool failed;    // Staged data had to be dropped, the application has not been told yet
+	} stage;
 };
 
 /// Header for data packets routed between nodes
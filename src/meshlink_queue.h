@@ -92,6 +92,38 @@ static inline __attribute__((__warn_unused_result__)) void *meshlink_queue_pop(m
 	return data;
 }
 
+static inline void meshlink_queue_remove(meshlink_queue_t *queue, void *data) {
+	meshlink_queue_item_t *item = NULL;
+
+	if(pthread_mutex_lock(&queue->mutex) != 0) {
+		abort();
+	}
+
+	meshlink_queue_item_t *prev = NULL;
+
+	for(meshlink_queue_item_t *it = queue->head; it; prev = it, it = it->next) {
+		if(it->data == data) {
+			item = it;
+
+			if(prev) {
+				prev->next = it->next;
+			} else {
+				queue->head = it->next;
+			}
+
+			if(queue->tail == it) {
+				queue->tail = prev;
+			}
+
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	free(item);
+}
+
 static inline __attribute__((__warn_unused_result__)) void *meshlink_queue_pop_cond(meshlink_queue_t *queue, pthread_cond_t *cond) {
 	meshlink_queue_item_t *item;
 
@@ -60,6 +60,16 @@ bool send_meta(meshlink_handle_t *mesh, connection_t *c, const char *buffer, int
 	return sptps_send_record(&c->sptps, 0, buffer, length);
 }
 
+bool send_meta_binary(meshlink_handle_t *mesh, connection_t *c, const uint8_t *buffer, uint32_t length) {
+	assert(c);
+	assert(buffer);
+	assert(length);
+
+	logger(mesh, MESHLINK_DEBUG, "Sending %u bytes of binary metadata to %s", length, c->name);
+
+	return sptps_send_record(&c->sptps, SPTPS_BINARY_REQUEST, buffer, length);
+}
+
 void broadcast_meta(meshlink_handle_t *mesh, connection_t *from, const char *buffer, int length) {
 	assert(buffer);
 	assert(length);
@@ -74,12 +84,13 @@ void broadcast_submesh_meta(meshlink_handle_t *mesh, connection_t *from, const s
 	assert(buffer);
 	assert(length);
 
-	for list_each(connection_t, c, mesh->connections)
-		if(c != from && c->status.active) {
-			if(c->node && submesh_allows_node(s, c->node)) {
+	list_t *lists[2] = {mesh->core_connections, s->connections};
+
+	for(int i = 0; i < 2; i++)
+		for list_each(connection_t, c, lists[i])
+			if(c != from) {
 				send_meta(mesh, c, buffer, length);
 			}
-		}
 }
 
 bool receive_meta_sptps(void *handle, uint8_t type, const void *data, uint16_t length) {
@@ -113,6 +124,10 @@ bool receive_meta_sptps(void *handle, uint8_t type, const void *data, uint16_t l
 		abort(); // TODO: get rid of tcplen altogether
 	}
 
+	if(type == SPTPS_BINARY_REQUEST) {
+		return receive_binary_request(mesh, c, data, length);
+	}
+
 	/* Change newline to null byte, just like non-SPTPS requests */
 
 	if(request[length - 1] == '\n') {
@@ -23,6 +23,7 @@
 #include "connection.h"
 
 bool send_meta(struct meshlink_handle *mesh, struct connection_t *, const char *, int);
+bool send_meta_binary(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
 bool send_meta_sptps(void *, uint8_t, const void *, size_t);
 bool receive_meta_sptps(void *, uint8_t, const void *, uint16_t);
 void broadcast_meta(struct meshlink_handle *mesh, struct connection_t *, const char *, int);
@@ -54,10 +54,11 @@ static const int default_interval = 60;
 void terminate_connection(meshlink_handle_t *mesh, connection_t *c, bool report) {
 	logger(mesh, MESHLINK_INFO, "Closing connection with %s", c->name);
 
-	c->status.active = false;
+	connection_deactivate(mesh, c);
 
 	if(c->node && c->node->connection == c) {
 		c->node->connection = NULL;
+		node_autoconnect_changed(mesh, c->node);
 	}
 
 	if(c->edge) {
@@ -163,68 +164,6 @@ static void timeout_handler(event_loop_t *loop, void *data) {
 	});
 }
 
-// devclass asc, last_successfull_connection desc
-static int node_compare_devclass_asc_lsc_desc(const void *a, const void *b) {
-	const node_t *na = a, *nb = b;
-
-	if(na->devclass < nb->devclass) {
-		return -1;
-	}
-
-	if(na->devclass > nb->devclass) {
-		return 1;
-	}
-
-	if(na->last_successfull_connection == nb->last_successfull_connection) {
-		return 0;
-	}
-
-	if(na->last_successfull_connection == 0 || na->last_successfull_connection > nb->last_successfull_connection) {
-		return -1;
-	}
-
-	if(nb->last_successfull_connection == 0 || na->last_successfull_connection < nb->last_successfull_connection) {
-		return 1;
-	}
-
-	if(na < nb) {
-		return -1;
-	}
-
-	if(na > nb) {
-		return 1;
-	}
-
-	return 0;
-}
-
-// last_successfull_connection desc
-static int node_compare_lsc_desc(const void *a, const void *b) {
-	const node_t *na = a, *nb = b;
-
-	if(na->last_successfull_connection == nb->last_successfull_connection) {
-		return 0;
-	}
-
-	if(na->last_successfull_connection == 0 || na->last_successfull_connection > nb->last_successfull_connection) {
-		return -1;
-	}
-
-	if(nb->last_successfull_connection == 0 || na->last_successfull_connection < nb->last_successfull_connection) {
-		return 1;
-	}
-
-	if(na < nb) {
-		return -1;
-	}
-
-	if(na > nb) {
-		return 1;
-	}
-
-	return 0;
-}
-
 // devclass desc
 static int node_compare_devclass_desc(const void *a, const void *b) {
 	const node_t *na = a, *nb = b;
@@ -343,280 +282,268 @@ disconnect
 */
 
 
-static void periodic_handler(event_loop_t *loop, void *data) {
-	meshlink_handle_t *mesh = loop->data;
-
-	/* Check if there are too many contradicting ADD_EDGE and DEL_EDGE messages.
-	   This usually only happens when another node has the same Name as this node.
-	   If so, sleep for a short while to prevent a storm of contradicting messages.
-	*/
-
-	if(mesh->contradicting_del_edge > 100 && mesh->contradicting_add_edge > 100) {
-		logger(mesh, MESHLINK_WARNING, "Possible node with same Name as us! Sleeping %d seconds.", mesh->sleeptime);
-		struct timespec ts = {mesh->sleeptime, 0};
-		nanosleep(&ts, NULL);
-		mesh->sleeptime *= 2;
+/* Return the first node in an autoconnect index that we did not try to connect to recently.
+   At most one node is tried per run, so only a few recently tried nodes have to be skipped. */
 
-		if(mesh->sleeptime < 0) {
-			mesh->sleeptime = 3600;
-		}
-	} else {
-		mesh->sleeptime /= 2;
-
-		if(mesh->sleeptime < 10) {
-			mesh->sleeptime = 10;
+static node_t *autoconnect_candidate(meshlink_handle_t *mesh, splay_tree_t *index, int retry_timeout) {
+	for splay_each(node_t, n, index) {
+		if(n->last_connect_try == 0 || (mesh->loop.now.tv_sec - n->last_connect_try) > retry_timeout) {
+			return n;
 		}
 	}
 
-	mesh->contradicting_add_edge = 0;
-	mesh->contradicting_del_edge = 0;
+	return NULL;
+}
+
+/* Make or break connections as described above, and return the number of seconds until the next check. */
 
+int autoconnect(meshlink_handle_t *mesh) {
 	int timeout = default_timeout;
 
-	/* Check if we need to make or break connections. */
+	logger(mesh, MESHLINK_DEBUG, "--- autoconnect begin ---");
 
-	if(mesh->nodes->count > 1) {
+	int retry_timeout = min(mesh->nodes->count * default_timeout, 60);
 
-		logger(mesh, MESHLINK_DEBUG, "--- autoconnect begin ---");
+	logger(mesh, MESHLINK_DEBUG, "* devclass = %d", mesh->devclass);
+	logger(mesh, MESHLINK_DEBUG, "* nodes = %d", mesh->nodes->count);
+	logger(mesh, MESHLINK_DEBUG, "* retry_timeout = %d", retry_timeout);
 
-		int retry_timeout = min(mesh->nodes->count * default_timeout, 60);
 
-		logger(mesh, MESHLINK_DEBUG, "* devclass = %d", mesh->devclass);
-		logger(mesh, MESHLINK_DEBUG, "* nodes = %d", mesh->nodes->count);
-		logger(mesh, MESHLINK_DEBUG, "* retry_timeout = %d", retry_timeout);
+	// connect disconnect nodes
 
+	node_t *connect_to = NULL;
+	node_t *disconnect_from = NULL;
 
-		// connect disconnect nodes
 
-		node_t *connect_to = NULL;
-		node_t *disconnect_from = NULL;
+	// get cur_connects, and the number of connections per devclass
 
+	unsigned int cur_connects = 0;
+	unsigned int devclass_connects[DEV_CLASS_COUNT] = {0};
 
-		// get cur_connects
-
-		unsigned int cur_connects = 0;
+	for list_each(connection_t, c, mesh->connections) {
+		if(c->status.active) {
+			cur_connects += 1;
 
-		for list_each(connection_t, c, mesh->connections) {
-			if(c->status.active) {
-				cur_connects += 1;
+			if(c->node && c->node->devclass >= 0 && c->node->devclass < DEV_CLASS_COUNT) {
+				devclass_connects[c->node->devclass] += 1;
 			}
 		}
+	}
 
-		logger(mesh, MESHLINK_DEBUG, "* cur_connects = %d", cur_connects);
-		logger(mesh, MESHLINK_DEBUG, "* outgoings = %d", mesh->outgoings->count);
-
-		// get min_connects and max_connects
-
-		unsigned int min_connects = mesh->dev_class_traits[mesh->devclass].min_connects;
-		unsigned int max_connects = mesh->dev_class_traits[mesh->devclass].max_connects;
-
-		logger(mesh, MESHLINK_DEBUG, "* min_connects = %d", min_connects);
-		logger(mesh, MESHLINK_DEBUG, "* max_connects = %d", max_connects);
-
-		// find the best one for initial connect
+	logger(mesh, MESHLINK_DEBUG, "* cur_connects = %d", cur_connects);
+	logger(mesh, MESHLINK_DEBUG, "* outgoings = %d", mesh->outgoings->count);
 
-		if(cur_connects < min_connects) {
-			splay_tree_t *nodes = splay_alloc_tree(node_compare_devclass_asc_lsc_desc, NULL);
+	// get min_connects and max_connects
 
-			for splay_each(node_t, n, mesh->nodes) {
-				logger(mesh, MESHLINK_DEBUG, "* %s->devclass = %d", n->name, n->devclass);
+	unsigned int min_connects = mesh->dev_class_traits[mesh->devclass].min_connects;
+	unsigned int max_connects = mesh->dev_class_traits[mesh->devclass].max_connects;
 
-				if(n != mesh->self && n->devclass <= mesh->devclass && !n->connection && !n->status.blacklisted && (n->last_connect_try == 0 || (mesh->loop.now.tv_sec - n->last_connect_try) > retry_timeout)) {
-					splay_insert(nodes, n);
-				}
-			}
+	logger(mesh, MESHLINK_DEBUG, "* min_connects = %d", min_connects);
+	logger(mesh, MESHLINK_DEBUG, "* max_connects = %d", max_connects);
 
-			if(nodes->head) {
-				//timeout = 0;
-				connect_to = (node_t *)nodes->head->data;
+	// find the best one for initial connect
 
-				logger(mesh, MESHLINK_DEBUG, "* found best one for initial connect: %s", connect_to->name);
-			} else {
-				logger(mesh, MESHLINK_DEBUG, "* could not find node for initial connect");
-			}
+	update_autoconnect_indexes(mesh);
 
-			splay_delete_tree(nodes);
+	if(cur_connects < min_connects) {
+		for(dev_class_t devclass = 0; devclass <= mesh->devclass && !connect_to; ++devclass) {
+			connect_to = autoconnect_candidate(mesh, mesh->autoconnect_unconnected[devclass], retry_timeout);
 		}
 
+		if(connect_to) {
+			//timeout = 0;
+			logger(mesh, MESHLINK_DEBUG, "* found best one for initial connect: %s", connect_to->name);
+		} else {
+			logger(mesh, MESHLINK_DEBUG, "* could not find node for initial connect");
+		}
+	}
 
-		// find better nodes to connect to
-
-		if(!connect_to && min_connects <= cur_connects && cur_connects < max_connects) {
-			unsigned int connects = 0;
-
-			for(dev_class_t devclass = 0; devclass <= mesh->devclass; ++devclass) {
-				for list_each(connection_t, c, mesh->connections) {
-					if(c->status.active && c->node && c->node->devclass == devclass) {
-						connects += 1;
-					}
-				}
 
-				if(connects < min_connects) {
-					splay_tree_t *nodes = splay_alloc_tree(node_compare_lsc_desc, NULL);
+	// find better nodes to connect to
 
-					for splay_each(node_t, n, mesh->nodes) {
-						if(n != mesh->self && n->devclass == devclass && !n->connection && !n->status.blacklisted && (n->last_connect_try == 0 || (mesh->loop.now.tv_sec - n->last_connect_try) > retry_timeout)) {
-							splay_insert(nodes, n);
-						}
-					}
+	if(!connect_to && min_connects <= cur_connects && cur_connects < max_connects) {
+		unsigned int connects = 0;
 
-					if(nodes->head) {
-						logger(mesh, MESHLINK_DEBUG, "* found better node");
-						connect_to = (node_t *)nodes->head->data;
+		for(dev_class_t devclass = 0; devclass <= mesh->devclass; ++devclass) {
+			connects += devclass_connects[devclass];
 
-						splay_delete_tree(nodes);
-						break;
-					}
+			if(connects < min_connects) {
+				connect_to = autoconnect_candidate(mesh, mesh->autoconnect_unconnected[devclass], retry_timeout);
 
-					splay_delete_tree(nodes);
-				} else {
+				if(connect_to) {
+					logger(mesh, MESHLINK_DEBUG, "* found better node");
 					break;
 				}
-			}
-
-			if(!connect_to) {
-				logger(mesh, MESHLINK_DEBUG, "* could not find better nodes");
+			} else {
+				break;
 			}
 		}
 
+		if(!connect_to) {
+			logger(mesh, MESHLINK_DEBUG, "* could not find better nodes");
+		}
+	}
 
-		// heal partitions
-
-		if(!connect_to && min_connects <= cur_connects && cur_connects < max_connects) {
-			splay_tree_t *nodes = splay_alloc_tree(node_compare_devclass_asc_lsc_desc, NULL);
-
-			for splay_each(node_t, n, mesh->nodes) {
-				if(n != mesh->self && n->devclass <= mesh->devclass && !n->status.reachable && !n->status.blacklisted && (n->last_connect_try == 0 || (mesh->loop.now.tv_sec - n->last_connect_try) > retry_timeout)) {
-					splay_insert(nodes, n);
-				}
-			}
 
-			if(nodes->head) {
-				logger(mesh, MESHLINK_DEBUG, "* try to heal partition");
-				connect_to = (node_t *)nodes->head->data;
-			} else {
-				logger(mesh, MESHLINK_DEBUG, "* could not find nodes for partition healing");
-			}
+	// heal partitions
 
-			splay_delete_tree(nodes);
+	if(!connect_to && min_connects <= cur_connects && cur_connects < max_connects) {
+		for(dev_class_t devclass = 0; devclass <= mesh->devclass && !connect_to; ++devclass) {
+			connect_to = autoconnect_candidate(mesh, mesh->autoconnect_unreachable[devclass], retry_timeout);
 		}
 
+		if(connect_to) {
+			logger(mesh, MESHLINK_DEBUG, "* try to heal partition");
+		} else {
+			logger(mesh, MESHLINK_DEBUG, "* could not find nodes for partition healing");
+		}
+	}
 
-		// perform connect
 
-		if(connect_to && !connect_to->connection) {
-			connect_to->last_connect_try = mesh->loop.now.tv_sec;
-			logger(mesh, MESHLINK_DEBUG, "Autoconnect trying to connect to %s", connect_to->name);
+	// perform connect
 
-			/* check if there is already a connection attempt to this node */
-			bool skip = false;
+	if(connect_to && !connect_to->connection) {
+		connect_to->last_connect_try = mesh->loop.now.tv_sec;
+		logger(mesh, MESHLINK_DEBUG, "Autoconnect trying to connect to %s", connect_to->name);
 
-			for list_each(outgoing_t, outgoing, mesh->outgoings) {
-				if(outgoing->node == connect_to) {
-					logger(mesh, MESHLINK_DEBUG, "* skip autoconnect since it is an outgoing connection already");
-					skip = true;
-					break;
-				}
-			}
+		/* check if there is already a connection attempt to this node */
+		bool skip = false;
 
-			if(!connect_to->status.reachable && !node_read_public_key(mesh, connect_to)) {
-				logger(mesh, MESHLINK_DEBUG, "* skip autoconnect since we don't know this node's public key");
+		for list_each(outgoing_t, outgoing, mesh->outgoings) {
+			if(outgoing->node == connect_to) {
+				logger(mesh, MESHLINK_DEBUG, "* skip autoconnect since it is an outgoing connection already");
 				skip = true;
+				break;
 			}
+		}
 
-			if(!skip) {
-				logger(mesh, MESHLINK_DEBUG, "Autoconnecting to %s", connect_to->name);
-				outgoing_t *outgoing = xzalloc(sizeof(outgoing_t));
-				outgoing->node = connect_to;
-				list_insert_tail(mesh->outgoings, outgoing);
-				setup_outgoing_connection(mesh, outgoing);
-			}
+		if(!connect_to->status.reachable && !node_read_public_key(mesh, connect_to)) {
+			logger(mesh, MESHLINK_DEBUG, "* skip autoconnect since we don't know this node's public key");
+			skip = true;
 		}
 
+		if(!skip) {
+			logger(mesh, MESHLINK_DEBUG, "Autoconnecting to %s", connect_to->name);
+			outgoing_t *outgoing = xzalloc(sizeof(outgoing_t));
+			outgoing->node = connect_to;
+			list_insert_tail(mesh->outgoings, outgoing);
+			setup_outgoing_connection(mesh, outgoing);
+		}
+	}
 
-		// disconnect suboptimal outgoing connections
 
-		if(min_connects < cur_connects /*&& cur_connects <= max_connects*/) {
-			unsigned int connects = 0;
+	// disconnect suboptimal outgoing connections
 
-			for(dev_class_t devclass = 0; devclass <= mesh->devclass; ++devclass) {
-				for list_each(connection_t, c, mesh->connections) {
-					if(c->status.active && c->node && c->node->devclass == devclass) {
-						connects += 1;
-					}
-				}
+	if(min_connects < cur_connects /*&& cur_connects <= max_connects*/) {
+		unsigned int connects = 0;
 
-				if(min_connects < connects) {
-					splay_tree_t *nodes = splay_alloc_tree(node_compare_devclass_desc, NULL);
+		for(dev_class_t devclass = 0; devclass <= mesh->devclass; ++devclass) {
+			connects += devclass_connects[devclass];
 
-					for list_each(connection_t, c, mesh->connections) {
-						if(c->outgoing && c->node && c->node->devclass >= devclass) {
-							splay_insert(nodes, c->node);
+			if(min_connects < connects) {
+				for list_each(connection_t, c, mesh->connections) {
+					if(c->outgoing && c->node && c->node->devclass >= devclass) {
+						if(!disconnect_from || node_compare_devclass_desc(c->node, disconnect_from) < 0) {
+							disconnect_from = c->node;
 						}
 					}
+				}
 
-					if(nodes->head) {
-						logger(mesh, MESHLINK_DEBUG, "* disconnect suboptimal outgoing connection");
-						disconnect_from = (node_t *)nodes->head->data;
-					}
-
-					splay_delete_tree(nodes);
-					break;
+				if(disconnect_from) {
+					logger(mesh, MESHLINK_DEBUG, "* disconnect suboptimal outgoing connection");
 				}
-			}
 
-			if(!disconnect_from) {
-				logger(mesh, MESHLINK_DEBUG, "* no suboptimal outgoing connections");
+				break;
 			}
 		}
 
+		if(!disconnect_from) {
+			logger(mesh, MESHLINK_DEBUG, "* no suboptimal outgoing connections");
+		}
+	}
 
-		// disconnect connections (too many connections)
 
-		if(!disconnect_from && max_connects < cur_connects) {
-			splay_tree_t *nodes = splay_alloc_tree(node_compare_devclass_desc, NULL);
+	// disconnect connections (too many connections)
 
-			for list_each(connection_t, c, mesh->connections) {
-				if(c->status.active && c->node) {
-					splay_insert(nodes, c->node);
+	if(!disconnect_from && max_connects < cur_connects) {
+		for list_each(connection_t, c, mesh->connections) {
+			if(c->status.active && c->node) {
+				if(!disconnect_from || node_compare_devclass_desc(c->node, disconnect_from) < 0) {
+					disconnect_from = c->node;
 				}
 			}
+		}
 
-			if(nodes->head) {
-				logger(mesh, MESHLINK_DEBUG, "* disconnect connection (too many connections)");
-
-				//timeout = 0;
-				disconnect_from = (node_t *)nodes->head->data;
-			} else {
-				logger(mesh, MESHLINK_DEBUG, "* no node we want to disconnect, even though we have too many connections");
-			}
+		if(disconnect_from) {
+			logger(mesh, MESHLINK_DEBUG, "* disconnect connection (too many connections)");
 
-			splay_delete_tree(nodes);
+			//timeout = 0;
+		} else {
+			logger(mesh, MESHLINK_DEBUG, "* no node we want to disconnect, even though we have too many connections");
 		}
+	}
+
+
+	// perform disconnect
+
+	if(disconnect_from && disconnect_from->connection) {
+		logger(mesh, MESHLINK_DEBUG, "Autodisconnecting from %s", disconnect_from->connection->name);
+		list_delete(mesh->outgoings, disconnect_from->connection->outgoing);
+		disconnect_from->connection->outgoing = NULL;
+		terminate_connection(mesh, disconnect_from->connection, disconnect_from->connection->status.active);
+	}
 
+	// reduce timeout if we don't have enough connections + outgoings
+	if(cur_connects + mesh->outgoings->count < 3) {
+		timeout = 1;
+	}
+
+	// done!
+
+	logger(mesh, MESHLINK_DEBUG, "--- autoconnect end ---");
 
-		// perform disconnect
+	return timeout;
+}
 
-		if(disconnect_from && disconnect_from->connection) {
-			logger(mesh, MESHLINK_DEBUG, "Autodisconnecting from %s", disconnect_from->connection->name);
-			list_delete(mesh->outgoings, disconnect_from->connection->outgoing);
-			disconnect_from->connection->outgoing = NULL;
-			terminate_connection(mesh, disconnect_from->connection, disconnect_from->connection->status.active);
+static void periodic_handler(event_loop_t *loop, void *data) {
+	meshlink_handle_t *mesh = loop->data;
+
+	/* Check if there are too many contradicting ADD_EDGE and DEL_EDGE messages.
+	   This usually only happens when another node has the same Name as this node.
+	   If so, sleep for a short while to prevent a storm of contradicting messages.
+	*/
+
+	if(mesh->contradicting_del_edge > 100 && mesh->contradicting_add_edge > 100) {
+		logger(mesh, MESHLINK_WARNING, "Possible node with same Name as us! Sleeping %d seconds.", mesh->sleeptime);
+		struct timespec ts = {mesh->sleeptime, 0};
+		nanosleep(&ts, NULL);
+		mesh->sleeptime *= 2;
+
+		if(mesh->sleeptime < 0) {
+			mesh->sleeptime = 3600;
 		}
+	} else {
+		mesh->sleeptime /= 2;
 
-		// reduce timeout if we don't have enough connections + outgoings
-		if(cur_connects + mesh->outgoings->count < 3) {
-			timeout = 1;
+		if(mesh->sleeptime < 10) {
+			mesh->sleeptime = 10;
 		}
+	}
+
+	mesh->contradicting_add_edge = 0;
+	mesh->contradicting_del_edge = 0;
 
-		// done!
+	int timeout = default_timeout;
 
-		logger(mesh, MESHLINK_DEBUG, "--- autoconnect end ---");
+	/* Check if we need to make or break connections. */
+
+	if(mesh->nodes->count > 1) {
+		timeout = autoconnect(mesh);
 	}
 
 	for splay_each(node_t, n, mesh->nodes) {
 		if(n->status.dirty) {
-			if(!node_write_config(mesh, n)) {
+			if(!node_write_config(mesh, n, false)) {
 				logger(mesh, MESHLINK_DEBUG, "Could not update %s", n->name);
 			}
 
@@ -49,6 +49,8 @@ typedef struct vpn_packet_t {
 
 #define PKT_COMPRESSED 1
 #define PKT_PROBE 4
+#define PKT_RELAY 8             /* Datagram to be passed on to the named node */
+#define PKT_RELAYED 16          /* Datagram passed on from the named node */
 
 typedef enum packet_type_t {
 	PACKET_NORMAL,
@@ -106,10 +108,11 @@ bool node_read_public_key(struct meshlink_handle *mesh, struct node_t *) __attri
 bool node_read_from_config(struct meshlink_handle *mesh, struct node_t *, const config_t *config) __attribute__((__warn_unused_result__));
 bool read_ecdsa_public_key(struct meshlink_handle *mesh, struct connection_t *) __attribute__((__warn_unused_result__));
 bool read_ecdsa_private_key(struct meshlink_handle *mesh) __attribute__((__warn_unused_result__));
-bool node_write_config(struct meshlink_handle *mesh, struct node_t *) __attribute__((__warn_unused_result__));
+bool node_write_config(struct meshlink_handle *mesh, struct node_t *, bool sync) __attribute__((__warn_unused_result__));
 void send_mtu_probe(struct meshlink_handle *mesh, struct node_t *);
 void handle_meta_connection_data(struct meshlink_handle *mesh, struct connection_t *);
 void retry(struct meshlink_handle *mesh);
+int autoconnect(struct meshlink_handle *mesh);
 int check_port(struct meshlink_handle *mesh);
 
 #ifndef HAVE_MINGW
@@ -35,6 +35,7 @@
 int keylifetime = 0;
 
 static void send_udppacket(meshlink_handle_t *mesh, node_t *, vpn_packet_t *);
+static void send_relay_probes(meshlink_handle_t *mesh, node_t *);
 
 #define MAX_SEQNO 1073741824
 
@@ -52,6 +53,9 @@ static void send_udppacket(meshlink_handle_t *mesh, node_t *, vpn_packet_t *);
    In case local discovery is enabled, another packet is added to each batch,
    which will be broadcast to the local network.
 
+   As long as no probe has been answered directly, every batch is followed by
+   relayed probes, see send_relay_probes().
+
 */
 
 static void send_mtu_probe_handler(event_loop_t *loop, void *data) {
@@ -104,7 +108,7 @@ static void send_mtu_probe_handler(event_loop_t *loop, void *data) {
 	if(n->mtuprobes == 31) {
 		if(!n->minmtu && n->status.want_udp) {
 			/* Send a dummy ANS_KEY to try to update the reflexive UDP address */
-			send_request(mesh, n->nexthop->connection, NULL, "%d %s %s . -1 -1 -1 0", ANS_KEY, mesh->self->name, n->name);
+			send_ans_key(mesh, n->nexthop->connection, mesh->self, n, NULL, 0, NULL);
 			n->status.want_udp = false;
 		}
 
@@ -146,6 +150,7 @@ static void send_mtu_probe_handler(event_loop_t *loop, void *data) {
 	}
 
 	n->status.broadcast = false;
+	send_relay_probes(mesh, n);
 
 end:
 	timeout_set(&mesh->loop, &n->mtutimeout, &(struct timespec) {
@@ -173,6 +178,14 @@ static void mtu_probe_h(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet
 
 		packet->data[0] = 1;
 
+		/* If it came in through a relay, n->via is still set,
+		   and the reply goes back through the same relay. */
+
+		if(n->via) {
+			send_udppacket(mesh, n, packet);
+			return;
+		}
+
 		/* Temporarily set udp_confirmed, so that the reply is sent
 		   back exactly the way it came in. */
 
@@ -180,17 +193,30 @@ static void mtu_probe_h(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet
 		n->status.udp_confirmed = true;
 		send_udppacket(mesh, n, packet);
 		n->status.udp_confirmed = udp_confirmed;
+	} else if(n->via) {
+		/* It's a reply that came back through a relay, this says nothing about direct UDP. */
+
+		if(n->via != n->relay) {
+			return;
+		}
+
+		n->relay_probes = 0;
+
+		if(n->relay_mtu < len) {
+			if(!n->relay_mtu) {
+				logger(mesh, MESHLINK_INFO, "Relaying UDP packets to %s through %s", n->name, n->relay->name);
+			}
+
+			n->relay_mtu = len;
+			update_node_pmtu(mesh, n);
+		}
 	} else {
 		/* It's a valid reply: now we know bidirectional communication
 		   is possible using the address and socket that the reply
 		   packet used. */
 
 		if(!n->status.udp_confirmed) {
-			char *address, *port;
-			sockaddr2str(&n->address, &address, &port);
-			send_request(mesh, n->nexthop->connection, NULL, "%d %s %s . -1 -1 -1 0 %s %s", ANS_KEY, n->name, n->name, address, port);
-			free(address);
-			free(port);
+			send_ans_key(mesh, n->nexthop->connection, n, n, NULL, 0, &n->address);
 			n->status.udp_confirmed = true;
 		}
 
@@ -226,16 +252,16 @@ static void mtu_probe_h(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet
 
 /* VPN packet I/O */
 
-static void receive_packet(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet) {
-	logger(mesh, MESHLINK_DEBUG, "Received packet of %d bytes from %s", packet->len, n->name);
+static void receive_packet(meshlink_handle_t *mesh, node_t *n, const void *data, uint16_t len) {
+	logger(mesh, MESHLINK_DEBUG, "Received packet of %d bytes from %s", len, n->name);
 
 	if(n->status.blacklisted) {
 		logger(mesh, MESHLINK_WARNING, "Dropping packet from blacklisted node %s", n->name);
 	} else {
 		n->in_packets++;
-		n->in_bytes += packet->len;
+		n->in_bytes += len;
 
-		route(mesh, n, packet);
+		route_received(mesh, n, data, len);
 	}
 }
 
@@ -362,6 +388,132 @@ static void choose_broadcast_address(meshlink_handle_t *mesh, const node_t *n, c
 	*sa = broadcast_sa;
 }
 
+/* UDP relaying
+
+   If two nodes cannot send UDP packets to each other directly, they can still use UDP if a third node
+   has working UDP with both of them. The sender wraps the SPTPS datagram for the destination in a PKT_RELAY
+   record with the destination's name prepended, and sends it to the relay. The relay passes the datagram on
+   in a PKT_RELAYED record with the sender's name prepended. The end-to-end SPTPS session is not affected,
+   the relay cannot read or forge the datagrams it passes on.
+*/
+
+static bool node_relays(const node_t *n) {
+	return n->prevedge && OPTION_VERSION(n->prevedge->options) >= PROT_MINOR_RELAY;
+}
+
+/* Pick a node that might relay UDP packets to n. Candidates are the node that has a meta-connection with n
+   on our shortest path to it, and our nexthop towards n. We need working UDP with the relay ourself,
+   the relay only passes packets on if it has working UDP with n. */
+
+static node_t *choose_relay(meshlink_handle_t *mesh, node_t *n) {
+	if(mesh->udp_relaying_disabled || !node_relays(n)) {
+		return NULL;
+	}
+
+	node_t *candidates[2] = {n->prevedge->from, n->nexthop};
+
+	for(int i = 0; i < 2; i++) {
+		node_t *relay = candidates[i];
+
+		if(!relay || relay == mesh->self || relay == n || relay->status.blacklisted || !node_relays(relay)) {
+			continue;
+		}
+
+		if(!relay->status.validkey) {
+			/* Once the key exchange is done, PMTU discovery will start for the relay as well */
+			if(!relay->status.waitingforkey) {
+				send_req_key(mesh, relay);
+			}
+
+			continue;
+		}
+
+		if(relay->minmtu) {
+			return relay;
+		}
+	}
+
+	return NULL;
+}
+
+/* Send a datagram to or from the named node through the relay. This only uses UDP,
+   if the datagram does not fit in the PMTU of the relay, it is not sent at all. */
+
+static bool relay_datagram(meshlink_handle_t *mesh, node_t *relay, uint8_t type, const node_t *named, const void *data, size_t len) {
+	size_t namelen = strlen(named->name) + 1;
+
+	if(!relay->status.reachable || !relay->status.validkey || relay->via || namelen + len > relay->minmtu) {
+		logger(mesh, MESHLINK_DEBUG, "Cannot relay packet of %lu bytes through %s", (unsigned long)len, relay->name);
+		return false;
+	}
+
+	uint8_t buf[namelen + len];
+	memcpy(buf, named->name, namelen);
+	memcpy(buf + namelen, data, len);
+	return sptps_send_record(&relay->sptps, type, buf, namelen + len);
+}
+
+/* As long as direct UDP to n does not work, find out whether UDP packets get through a relay, and how large they can be.
+   The probes are sent as regular MTU probes, but through the relay, and the other side replies through the same relay. */
+
+static void send_relay_probes(meshlink_handle_t *mesh, node_t *n) {
+	node_t *relay = n->minmtu ? NULL : choose_relay(mesh, n);
+
+	if(relay != n->relay) {
+		n->relay = relay;
+		n->relay_probes = 0;
+
+		if(n->relay_mtu) {
+			n->relay_mtu = 0;
+			update_node_pmtu(mesh, n);
+		}
+	} else if(n->relay_mtu && ++n->relay_probes > 1) {
+		logger(mesh, MESHLINK_INFO, "%s did not respond to relayed UDP ping, no longer relaying through %s", n->name, relay->name);
+		n->relay_probes = 0;
+		n->relay_mtu = 0;
+		update_node_pmtu(mesh, n);
+	}
+
+	if(!relay) {
+		return;
+	}
+
+	/* The reply has to fit through the relay as well, with the other name prepended */
+
+	size_t namelen = strlen(n->name) > strlen(mesh->self->name) ? strlen(n->name) : strlen(mesh->self->name);
+	int maxlen = relay->minmtu - (int)namelen - 1 - 21;
+
+	if(maxlen > MTU) {
+		maxlen = MTU;
+	}
+
+	if(maxlen < 64) {
+		return;
+	}
+
+	int lens[3] = {
+		maxlen,
+		MINMTU < maxlen ? MINMTU : 64,
+		n->relay_mtu < maxlen ? n->relay_mtu + 1 + prng(mesh, maxlen - n->relay_mtu) : maxlen,
+	};
+
+	for(int i = 0; i < 3; i++) {
+		int len = lens[i] < 64 ? 64 : lens[i];
+
+		vpn_packet_t packet;
+		packet.probe = true;
+		memset(packet.data, 0, 14);
+		randomize(packet.data + 14, len - 14);
+		packet.len = len;
+
+		logger(mesh, MESHLINK_DEBUG, "Sending MTU probe length %d to %s through %s", len, n->name, relay->name);
+
+		n->via = relay;
+		send_udppacket(mesh, n, &packet);
+		n->via = NULL;
+	}
+}
+
 static void send_udppacket(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *origpkt) {
 	if(!n->status.reachable) {
 		logger(mesh, MESHLINK_INFO, "Trying to send UDP packet to unreachable node %s", n->name);
@@ -379,18 +531,29 @@ bool send_sptps_data(void *handle, uint8_t type, const void *data, size_t len) {
 	node_t *to = handle;
 	meshlink_handle_t *mesh = to->mesh;
 
-	/* Send it via TCP if it is a handshake packet, TCPOnly is in use, or this packet is larger than the MTU. */
+	/* Send it through a relay if it is a relayed probe, or a reply to something that came in through a relay.
+	   Probes must not take another path, other packets can if they do not fit. */
+
+	if(to->via && type < SPTPS_HANDSHAKE) {
+		if(relay_datagram(mesh, to->via, PKT_RELAY, to, data, len) || type == PKT_PROBE) {
+			return true;
+		}
+	}
+
+	/* Send it via TCP if it is a handshake packet, TCPOnly is in use, or this packet is larger than the MTU,
+	   unless it fits through a relay. */
 
 	if(type >= SPTPS_HANDSHAKE || (type != PKT_PROBE && (len - 21) > to->minmtu)) {
-		char buf[len * 4 / 3 + 5];
-		b64encode(data, buf, len);
+		if(type < SPTPS_HANDSHAKE && to->relay && (len - 21) <= to->relay_mtu && relay_datagram(mesh, to->relay, PKT_RELAY, to, data, len)) {
+			return true;
+		}
 
 		/* If no valid key is known yet, send the packets using ANS_KEY requests,
 		   to ensure we get to learn the reflexive UDP address. */
 		if(!to->status.validkey) {
-			return send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %s -1 -1 -1 %d", ANS_KEY, mesh->self->name, to->name, buf, 0);
+			return send_ans_key(mesh, to->nexthop->connection, mesh->self, to, data, len, NULL);
 		} else {
-			return send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %d %s", REQ_KEY, mesh->self->name, to->name, REQ_SPTPS, buf);
+			return send_key_request(mesh, to, REQ_SPTPS, data, len);
 		}
 	}
 
@@ -423,6 +586,61 @@ bool send_sptps_data(void *handle, uint8_t type, const void *data, size_t len) {
 	return true;
 }
 
+static bool relay_h(meshlink_handle_t *mesh, node_t *from, uint8_t type, const uint8_t *data, uint16_t len) {
+	const uint8_t *datagram = memchr(data, 0, len);
+
+	if(!datagram || datagram == data || ++datagram == data + len) {
+		logger(mesh, MESHLINK_ERROR, "Got bad relayed packet from %s", from->name);
+		return false;
+	}
+
+	/* Relayed packets are never relayed any further */
+
+	if(from->via) {
+		logger(mesh, MESHLINK_WARNING, "Got relayed packet from %s through %s", from->name, from->via->name);
+		return true;
+	}
+
+	node_t *n = lookup_node(mesh, (const char *)data);
+	len -= datagram - data;
+
+	if(!n || n == from || n == mesh->self || !n->status.reachable || n->status.blacklisted) {
+		logger(mesh, MESHLINK_DEBUG, "Dropping packet relayed by %s for unknown or unreachable node %s", from->name, (const char *)data);
+		return true;
+	}
+
+	if(type == PKT_RELAY) {
+		/* The sender wants us to pass the datagram on to n */
+
+		if(!n->status.validkey) {
+			if(!n->status.waitingforkey) {
+				send_req_key(mesh, n);
+			}
+
+			return true;
+		}
+
+		relay_datagram(mesh, n, PKT_RELAYED, from, datagram, len);
+		return true;
+	}
+
+	/* The sender is a relay passing on a datagram from n */
+
+	if(!n->sptps.state) {
+		logger(mesh, MESHLINK_DEBUG, "Got packet from %s through %s but we haven't exchanged keys yet", n->name, from->name);
+		return true;
+	}
+
+	n->via = from;
+
+	if(!sptps_receive_data(&n->sptps, datagram, len)) {
+		logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", n->name, strerror(errno));
+	}
+
+	n->via = NULL;
+	return true;
+}
+
 bool receive_sptps_record(void *handle, uint8_t type, const void *data, uint16_t len) {
 	assert(handle);
 	assert(!data || len);
@@ -449,16 +667,17 @@ bool receive_sptps_record(void *handle, uint8_t type, const void *data, uint16_t
 		return false;
 	}
 
-	vpn_packet_t inpkt;
-
 	if(type == PKT_PROBE) {
+		vpn_packet_t inpkt;
 		inpkt.len = len;
 		inpkt.probe = true;
 		memcpy(inpkt.data, data, len);
 		mtu_probe_h(mesh, from, &inpkt, len);
 		return true;
-	} else {
-		inpkt.probe = false;
+	}
+
+	if(type == PKT_RELAY || type == PKT_RELAYED) {
+		return relay_h(mesh, from, type, data, len);
 	}
 
 	if(type & ~(PKT_COMPRESSED)) {
@@ -471,10 +690,8 @@ bool receive_sptps_record(void *handle, uint8_t type, const void *data, uint16_t
 		return false;
 	}
 
-	memcpy(inpkt.data, data, len); // TODO: get rid of memcpy
-	inpkt.len = len;
-
-	receive_packet(mesh, from, &inpkt);
+	// Pass the decrypted record on without copying it.
+	receive_packet(mesh, from, data, len);
 	return true;
 }
 
@@ -491,7 +708,8 @@ void send_packet(meshlink_handle_t *mesh, node_t *n, vpn_packet_t *packet) {
 
 	logger(mesh, MESHLINK_DEBUG, "Sending packet of %d bytes to %s", packet->len, n->name);
 
-	if(!n->status.reachable) {
+	/* The reachability check of pending edge updates might not have run yet, but the SSSP tree is up to date */
+	if(!n->status.reachable || !n->status.visited) {
 		logger(mesh, MESHLINK_WARNING, "Node %s is not reachable", n->name);
 		return;
 	}
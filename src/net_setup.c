@@ -28,6 +28,7 @@
 #include "net.h"
 #include "netutl.h"
 #include "packmsg.h"
+#include "persist.h"
 #include "protocol.h"
 #include "route.h"
 #include "utils.h"
@@ -207,7 +208,8 @@ bool node_read_from_config(meshlink_handle_t *mesh, node_t *n, const config_t *c
 	return packmsg_done(&in);
 }
 
-bool node_write_config(meshlink_handle_t *mesh, node_t *n) {
+/// Write a node's host config file in the background. If sync is true, wait until it is on disk.
+bool node_write_config(meshlink_handle_t *mesh, node_t *n, bool sync) {
 	if(!mesh->confbase) {
 		return true;
 	}
@@ -255,12 +257,9 @@ bool node_write_config(meshlink_handle_t *mesh, node_t *n) {
 
 	config_t config = {buf, packmsg_output_size(&out, buf)};
 
-	if(!config_write(mesh, "current", n->name, &config, mesh->config_key)) {
-		call_error_cb(mesh, MESHLINK_ESTORAGE);
-		return false;
-	}
+	persist_queue(mesh, n->name, &config);
 
-	return true;
+	return !sync || persist_sync(mesh);
 }
 
 static bool load_node(meshlink_handle_t *mesh, const char *name, void *priv) {
@@ -604,6 +603,7 @@ void close_network_connections(meshlink_handle_t *mesh) {
 	exit_requests(mesh);
 	exit_edges(mesh);
 	exit_nodes(mesh);
+	exit_graph(mesh);
 	exit_submeshes(mesh);
 	exit_connections(mesh);
 
@@ -319,3 +319,33 @@ sockaddr_t packmsg_get_sockaddr(packmsg_input_t *in) {
 
 	return sa;
 }
+
+/* Like packmsg_add_sockaddr(), but addresses that could not be resolved are sent as two strings,
+   the same way sockaddr2str() would return them. */
+
+void packmsg_add_address(packmsg_output_t *out, const sockaddr_t *sa) {
+	if(sa->sa.sa_family == AF_UNKNOWN) {
+		packmsg_add_str(out, sa->unknown.address);
+		packmsg_add_str(out, sa->unknown.port);
+	} else {
+		packmsg_add_sockaddr(out, sa);
+	}
+}
+
+sockaddr_t packmsg_get_address(packmsg_input_t *in) {
+	if(!packmsg_is_str(in)) {
+		return packmsg_get_sockaddr(in);
+	}
+
+	char address[NI_MAXHOST];
+	char port[NI_MAXSERV];
+
+	if(!packmsg_get_str_copy(in, address, sizeof(address)) || !packmsg_get_str_copy(in, port, sizeof(port))) {
+		sockaddr_t sa;
+		memset(&sa, 0, sizeof(sa));
+		packmsg_input_invalidate(in);
+		return sa;
+	}
+
+	return str2sockaddr(address, port);
+}
@@ -36,5 +36,7 @@ void sockaddrcpy_setport(sockaddr_t *, const sockaddr_t *, uint16_t port);
 
 void packmsg_add_sockaddr(struct packmsg_output *out, const sockaddr_t *);
 sockaddr_t packmsg_get_sockaddr(struct packmsg_input *in) __attribute__((__warn_unused_result__));
+void packmsg_add_address(struct packmsg_output *out, const sockaddr_t *);
+sockaddr_t packmsg_get_address(struct packmsg_input *in) __attribute__((__warn_unused_result__));
 
 #endif
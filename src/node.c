@@ -20,6 +20,7 @@
 #include "system.h"
 
 #include "hash.h"
+#include "list.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "net.h"
@@ -33,9 +34,26 @@ static int node_compare(const node_t *a, const node_t *b) {
 	return strcmp(a->name, b->name);
 }
 
+// autoconnect_lsc desc, name asc
+static int node_compare_autoconnect(const node_t *a, const node_t *b) {
+	if(a->autoconnect_lsc != b->autoconnect_lsc) {
+		return a->autoconnect_lsc > b->autoconnect_lsc ? -1 : 1;
+	}
+
+	return strcmp(a->name, b->name);
+}
+
 void init_nodes(meshlink_handle_t *mesh) {
 	mesh->nodes = splay_alloc_tree((splay_compare_t) node_compare, (splay_action_t) free_node);
 	mesh->node_udp_cache = hash_alloc(0x100, sizeof(sockaddr_t));
+	mesh->sssp_changed = list_alloc(NULL);
+
+	for(int i = 0; i < DEV_CLASS_COUNT; i++) {
+		mesh->autoconnect_unconnected[i] = splay_alloc_tree((splay_compare_t) node_compare_autoconnect, NULL);
+		mesh->autoconnect_unreachable[i] = splay_alloc_tree((splay_compare_t) node_compare_autoconnect, NULL);
+	}
+
+	mesh->autoconnect_changed = list_alloc(NULL);
 }
 
 void exit_nodes(meshlink_handle_t *mesh) {
@@ -47,8 +65,32 @@ void exit_nodes(meshlink_handle_t *mesh) {
 		splay_delete_tree(mesh->nodes);
 	}
 
+	if(mesh->sssp_changed) {
+		list_free(mesh->sssp_changed);
+	}
+
+	for(int i = 0; i < DEV_CLASS_COUNT; i++) {
+		if(mesh->autoconnect_unconnected[i]) {
+			splay_delete_tree(mesh->autoconnect_unconnected[i]);
+		}
+
+		if(mesh->autoconnect_unreachable[i]) {
+			splay_delete_tree(mesh->autoconnect_unreachable[i]);
+		}
+
+		mesh->autoconnect_unconnected[i] = NULL;
+		mesh->autoconnect_unreachable[i] = NULL;
+	}
+
+	if(mesh->autoconnect_changed) {
+		list_delete_list(mesh->autoconnect_changed);
+	}
+
+	mesh->autoconnect_changed = NULL;
 	mesh->node_udp_cache = NULL;
 	mesh->nodes = NULL;
+	mesh->sssp_changed = NULL;
+	mesh->sssp_valid = false;
 }
 
 node_t *new_node(void) {
@@ -58,6 +100,7 @@ node_t *new_node(void) {
 	n->mtu = MTU;
 	n->maxmtu = MTU;
 	n->devclass = DEV_CLASS_UNKNOWN;
+	n->distance = -1;
 
 	return n;
 }
@@ -89,6 +132,59 @@ void free_node(node_t *n) {
 void node_add(meshlink_handle_t *mesh, node_t *n) {
 	n->mesh = mesh;
 	splay_insert(mesh->nodes, n);
+	mesh->graph_snapshot_valid = false;
+	node_autoconnect_changed(mesh, n);
+}
+
+/* Autoconnect keeps indexes per device class of the nodes it might want to connect to,
+   ordered by their last successful connection. Instead of updating them everywhere a node's
+   connection, reachability, blacklisting, devclass or last successful connection changes,
+   the node is marked, and all marked nodes are refiled before autoconnect looks at the indexes.
+   The indexes are ordered by a copy of the values the node was filed under, so they stay
+   consistent even if those values change in the mean time. */
+
+static void autoconnect_unfile(meshlink_handle_t *mesh, node_t *n) {
+	if(n->status.autoconnect_unconnected) {
+		splay_delete(mesh->autoconnect_unconnected[n->autoconnect_devclass], n);
+		n->status.autoconnect_unconnected = false;
+	}
+
+	if(n->status.autoconnect_unreachable) {
+		splay_delete(mesh->autoconnect_unreachable[n->autoconnect_devclass], n);
+		n->status.autoconnect_unreachable = false;
+	}
+}
+
+void node_autoconnect_changed(meshlink_handle_t *mesh, node_t *n) {
+	if(!n->status.autoconnect_changed) {
+		n->status.autoconnect_changed = true;
+		list_insert_tail(mesh->autoconnect_changed, n);
+	}
+}
+
+void update_autoconnect_indexes(meshlink_handle_t *mesh) {
+	for list_each(node_t, n, mesh->autoconnect_changed) {
+		list_delete_node(mesh->autoconnect_changed, list_node);
+		n->status.autoconnect_changed = false;
+		autoconnect_unfile(mesh, n);
+
+		if(n == mesh->self || n->status.blacklisted || n->devclass < 0 || n->devclass >= DEV_CLASS_COUNT) {
+			continue;
+		}
+
+		n->autoconnect_devclass = n->devclass;
+		n->autoconnect_lsc = n->last_successfull_connection;
+
+		if(!n->connection) {
+			splay_insert(mesh->autoconnect_unconnected[n->devclass], n);
+			n->status.autoconnect_unconnected = true;
+		}
+
+		if(!n->status.reachable) {
+			splay_insert(mesh->autoconnect_unreachable[n->devclass], n);
+			n->status.autoconnect_unreachable = true;
+		}
+	}
 }
 
 void node_del(meshlink_handle_t *mesh, node_t *n) {
@@ -98,7 +194,25 @@ void node_del(meshlink_handle_t *mesh, node_t *n) {
 		edge_del(mesh, e);
 	}
 
+	if(n->status.sssp_changed) {
+		list_delete(mesh->sssp_changed, n);
+	}
+
+	if(n->status.autoconnect_changed) {
+		list_delete(mesh->autoconnect_changed, n);
+	}
+
+	autoconnect_unfile(mesh, n);
+
+	for splay_each(node_t, other, mesh->nodes) {
+		if(other->relay == n) {
+			other->relay = NULL;
+			other->relay_mtu = 0;
+		}
+	}
+
 	splay_delete(mesh->nodes, n);
+	mesh->graph_snapshot_valid = false;
 }
 
 node_t *lookup_node(meshlink_handle_t *mesh, const char *name) {
@@ -38,6 +38,10 @@ typedef struct node_status_t {
 	uint16_t duplicate: 1;              /* 1 if the node is duplicate, ie. multiple nodes using the same Name are online */
 	uint16_t dirty: 1;                  /* 1 if the configuration of the node is dirty and needs to be written out */
 	uint16_t want_udp: 1;               /* 1 if we want working UDP because we have data to send */
+	uint16_t sssp_changed: 1;           /* 1 if the node's place in the SSSP tree changed since its reachability was last checked */
+	uint16_t autoconnect_changed: 1;    /* 1 if the node has to be refiled in the autoconnect indexes */
+	uint16_t autoconnect_unconnected: 1; /* 1 if the node is in the autoconnect index of nodes without a connection */
+	uint16_t autoconnect_unreachable: 1; /* 1 if the node is in the autoconnect index of unreachable nodes */
 } node_status_t;
 
 #define MAX_RECENT 5
@@ -72,6 +76,12 @@ typedef struct node_t {
 	uint16_t mtu;                           /* Maximum size of packets to send to this node */
 	uint16_t maxmtu;                        /* Probed maximum MTU */
 
+	// UDP relaying
+	struct node_t *relay;                   /* node through which UDP packets are relayed if direct UDP does not work */
+	struct node_t *via;                     /* relay the datagram currently being sent or received goes through */
+	uint16_t relay_mtu;                     /* Largest probe that got through the relay */
+	int relay_probes;                       /* Number of relayed probe bursts since the last reply */
+
 	// Used for meta-connection I/O, timeouts
 	struct meshlink_handle *mesh;           /* The mesh this node belongs to */
 	struct submesh_t *submesh;              /* Nodes Sub-Mesh Handle*/
@@ -83,6 +93,8 @@ typedef struct node_t {
 	struct connection_t *connection;        /* Connection associated with this node (if a direct connection exists) */
 	time_t last_connect_try;
 	time_t last_successfull_connection;
+	dev_class_t autoconnect_devclass;       /* devclass the node is filed under in the autoconnect indexes */
+	time_t autoconnect_lsc;                 /* last_successfull_connection the node is filed under in the autoconnect indexes */
 
 	char *canonical_address;                /* The canonical address of this node, if known */
 	sockaddr_t recent[MAX_RECENT];          /* Recently seen addresses */
@@ -93,6 +105,7 @@ typedef struct node_t {
 	time_t last_unreachable;
 
 	int distance;
+	int index;                              /* position in the graph snapshot */
 	struct node_t *nexthop;                 /* nearest node from us to him */
 	struct edge_t *prevedge;                /* nearest node from him to us */
 
@@ -109,5 +122,7 @@ node_t *lookup_node(struct meshlink_handle *mesh, const char *name) __attribute_
 node_t *lookup_node_udp(struct meshlink_handle *mesh, const sockaddr_t *sa) __attribute__((__warn_unused_result__));
 void update_node_udp(struct meshlink_handle *mesh, node_t *n, const sockaddr_t *sa);
 bool node_add_recent_address(struct meshlink_handle *mesh, node_t *n, const sockaddr_t *addr);
+void node_autoconnect_changed(struct meshlink_handle *mesh, node_t *n);
+void update_autoconnect_indexes(struct meshlink_handle *mesh);
 
 #endif
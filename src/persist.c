@@ -0,0 +1,237 @@
+/*
+    persist.c -- write-behind storage of host configuration files
+    Copyright (C) 2019 Guus Sliepen <guus@meshlink.io>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "system.h"
+
+#include <pthread.h>
+
+#include "logger.h"
+#include "persist.h"
+#include "splay_tree.h"
+#include "xalloc.h"
+
+/* Host config files are written by a separate thread, so the library thread never waits for the storage.
+ * Pending writes are kept in a tree indexed by node name, a newer write of the same file replaces an older one.
+ * The thread takes all pending writes at once, and syncs their data and the directory only once for the whole batch.
+ * Callers that need the files to be on disk wait for all pending writes with persist_sync().
+ * The thread does not log anything itself, failures are reported by the library thread or by persist_sync().
+ */
+
+typedef struct persist_item {
+	char *name;
+	size_t len;
+	uint8_t buf[];
+} persist_item_t;
+
+static int persist_item_compare(const persist_item_t *a, const persist_item_t *b) {
+	return strcmp(a->name, b->name);
+}
+
+static void free_persist_item(persist_item_t *item) {
+	free(item->name);
+	free(item);
+}
+
+static splay_tree_t *new_persist_tree(void) {
+	return splay_alloc_tree((splay_compare_t)persist_item_compare, (splay_action_t)free_persist_item);
+}
+
+static bool persist_write_batch(meshlink_handle_t *mesh, splay_tree_t *batch) {
+	const char **names = xzalloc(batch->count * sizeof(*names));
+	config_t *configs = xzalloc(batch->count * sizeof(*configs));
+	int count = 0;
+
+	for splay_each(persist_item_t, item, batch) {
+		names[count] = item->name;
+		configs[count].buf = item->buf;
+		configs[count].len = item->len;
+		count++;
+	}
+
+	bool success = config_write_batch(mesh, "current", count, names, configs, mesh->config_key);
+	int saved_errno = errno;
+
+	free(names);
+	free(configs);
+
+	errno = saved_errno;
+	return success;
+}
+
+static void *persist_loop(void *data) {
+	meshlink_handle_t *mesh = data;
+
+	if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+		abort();
+	}
+
+	while(true) {
+		while(!mesh->persist_pending->count && !mesh->persist_stop) {
+			pthread_cond_wait(&mesh->persist_cond, &mesh->persist_mutex);
+		}
+
+		if(!mesh->persist_pending->count) {
+			break;
+		}
+
+		splay_tree_t *batch = mesh->persist_pending;
+		mesh->persist_pending = new_persist_tree();
+		mesh->persist_busy = true;
+		pthread_mutex_unlock(&mesh->persist_mutex);
+
+		bool success = persist_write_batch(mesh, batch);
+		int error = errno;
+		splay_delete_tree(batch);
+
+		if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+			abort();
+		}
+
+		mesh->persist_busy = false;
+
+		if(!success) {
+			// Only the first error since it was last reported is kept
+			if(!mesh->persist_failed) {
+				mesh->persist_failed = true;
+				mesh->persist_errno = error;
+			}
+
+			signal_trigger(&mesh->loop, &mesh->persist_signal);
+		}
+
+		pthread_cond_broadcast(&mesh->persist_idle_cond);
+	}
+
+	pthread_mutex_unlock(&mesh->persist_mutex);
+
+	return NULL;
+}
+
+static void persist_error_handler(event_loop_t *loop, void *data) {
+	(void)loop;
+	meshlink_handle_t *mesh = data;
+
+	if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+		abort();
+	}
+
+	bool failed = mesh->persist_failed;
+	int error = mesh->persist_errno;
+	mesh->persist_failed = false;
+	pthread_mutex_unlock(&mesh->persist_mutex);
+
+	if(failed) {
+		logger(mesh, MESHLINK_ERROR, "Could not write host config files: %s", strerror(error));
+		call_error_cb(mesh, MESHLINK_ESTORAGE);
+	}
+}
+
+void init_persist(meshlink_handle_t *mesh) {
+	pthread_mutex_init(&mesh->persist_mutex, NULL);
+	pthread_cond_init(&mesh->persist_cond, NULL);
+	pthread_cond_init(&mesh->persist_idle_cond, NULL);
+	mesh->persist_pending = new_persist_tree();
+	signal_add(&mesh->loop, &mesh->persist_signal, persist_error_handler, mesh, 2);
+}
+
+void exit_persist(meshlink_handle_t *mesh) {
+	if(!mesh->persist_signal.cb) {
+		return;
+	}
+
+	/* Let the thread write out any remaining files before it stops */
+	if(mesh->persist_threadstarted) {
+		if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+			abort();
+		}
+
+		mesh->persist_stop = true;
+		pthread_cond_signal(&mesh->persist_cond);
+		pthread_mutex_unlock(&mesh->persist_mutex);
+
+		pthread_join(mesh->persist_thread, NULL);
+		mesh->persist_threadstarted = false;
+	}
+
+	splay_delete_tree(mesh->persist_pending);
+	mesh->persist_pending = NULL;
+	signal_del(&mesh->loop, &mesh->persist_signal);
+
+	pthread_cond_destroy(&mesh->persist_idle_cond);
+	pthread_cond_destroy(&mesh->persist_cond);
+	pthread_mutex_destroy(&mesh->persist_mutex);
+}
+
+void persist_queue(meshlink_handle_t *mesh, const char *name, const config_t *config) {
+	persist_item_t *item = xmalloc(sizeof(*item) + config->len);
+	item->name = xstrdup(name);
+	item->len = config->len;
+	memcpy(item->buf, config->buf, config->len);
+
+	if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+		abort();
+	}
+
+	splay_node_t *node = splay_search_node(mesh->persist_pending, item);
+
+	if(node) {
+		free_persist_item(node->data);
+		node->data = item;
+	} else {
+		splay_insert(mesh->persist_pending, item);
+	}
+
+	if(!mesh->persist_threadstarted) {
+		if(pthread_create(&mesh->persist_thread, NULL, persist_loop, mesh)) {
+			abort();
+		}
+
+		mesh->persist_threadstarted = true;
+	}
+
+	pthread_cond_signal(&mesh->persist_cond);
+	pthread_mutex_unlock(&mesh->persist_mutex);
+}
+
+bool persist_sync(meshlink_handle_t *mesh) {
+	if(!mesh->persist_signal.cb) {
+		return true;
+	}
+
+	if(pthread_mutex_lock(&mesh->persist_mutex) != 0) {
+		abort();
+	}
+
+	while(mesh->persist_pending->count || mesh->persist_busy) {
+		pthread_cond_wait(&mesh->persist_idle_cond, &mesh->persist_mutex);
+	}
+
+	bool failed = mesh->persist_failed;
+	int error = mesh->persist_errno;
+	mesh->persist_failed = false;
+	pthread_mutex_unlock(&mesh->persist_mutex);
+
+	if(failed) {
+		logger(mesh, MESHLINK_ERROR, "Could not write host config files: %s", strerror(error));
+		meshlink_errno = MESHLINK_ESTORAGE;
+		call_error_cb(mesh, MESHLINK_ESTORAGE);
+	}
+
+	return !failed;
+}
@@ -0,0 +1,31 @@
+#ifndef MESHLINK_PERSIST_H
+#define MESHLINK_PERSIST_H
+
+/*
+    persist.h -- header file for persist.c
+    Copyright (C) 2019 Guus Sliepen <guus@meshlink.io>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+#include "meshlink_internal.h"
+#include "conf.h"
+
+void init_persist(meshlink_handle_t *mesh);
+void exit_persist(meshlink_handle_t *mesh);
+void persist_queue(meshlink_handle_t *mesh, const char *name, const config_t *config);
+bool persist_sync(meshlink_handle_t *mesh) __attribute__((__warn_unused_result__));
+
+#endif
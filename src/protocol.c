@@ -21,9 +21,12 @@
 
 #include "conf.h"
 #include "connection.h"
+#include "crypto.h"
+#include "graph.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "meta.h"
+#include "packmsg.h"
 #include "protocol.h"
 #include "utils.h"
 #include "xalloc.h"
@@ -31,7 +34,7 @@
 
 /* Jumptable for the request handlers */
 
-static bool (*request_handlers[])(meshlink_handle_t *, connection_t *, const char *) = {
+static bool (*request_handlers[LAST])(meshlink_handle_t *, connection_t *, const char *) = {
 	id_h, NULL, NULL, NULL /* metakey_h, challenge_h, chal_reply_h */, ack_h,
 	status_h, error_h, termreq_h,
 	ping_h, pong_h,
@@ -40,6 +43,16 @@ static bool (*request_handlers[])(meshlink_handle_t *, connection_t *, const cha
 	key_changed_h, req_key_h, ans_key_h, tcppacket_h, NULL, //control_h,
 };
 
+/* Requests that can also be received in binary */
+
+static bool (*binary_request_handlers[LAST])(meshlink_handle_t *, connection_t *, const uint8_t *, uint32_t) = {
+	[ADD_EDGE] = add_edge_binary_h,
+	[DEL_EDGE] = del_edge_binary_h,
+	[REQ_KEY] = req_key_binary_h,
+	[ANS_KEY] = ans_key_binary_h,
+	[TOPOLOGY_DIGEST] = topology_digest_binary_h,
+};
+
 /* Request names */
 
 static const char *request_name[] = {
@@ -48,6 +61,8 @@ static const char *request_name[] = {
 	"PING", "PONG",
 	"ADD_SUBNET", "DEL_SUBNET",
 	"ADD_EDGE", "DEL_EDGE", "KEY_CHANGED", "REQ_KEY", "ANS_KEY", "PACKET", "CONTROL",
+	"REQ_PUBKEY", "ANS_PUBKEY", "REQ_SPTPS",
+	"TOPOLOGY_DIGEST",
 };
 
 bool check_id(const char *id) {
@@ -127,6 +142,106 @@ void forward_request(meshlink_handle_t *mesh, connection_t *from, const submesh_
 	}
 }
 
+/* The encodings of a dual request that have been used so far */
+
+typedef struct request_encodings_t {
+	char *text;
+	int text_len;
+	const uint8_t *binary;
+	uint32_t binary_len;
+	char text_buf[MAXBUFSIZE];
+	uint8_t binary_buf[MAXBUFSIZE];
+} request_encodings_t;
+
+static bool send_encoded_request(meshlink_handle_t *mesh, connection_t *c, const dual_request_t *r, request_encodings_t *enc) {
+	if(c->status.binary) {
+		if(!enc->binary) {
+			if(r->binary) {
+				enc->binary_len = r->binary_len;
+				enc->binary = r->binary;
+			} else if((enc->binary_len = r->format_binary(r->fields, enc->binary_buf, sizeof(enc->binary_buf)))) {
+				enc->binary = enc->binary_buf;
+			} else {
+				logger(mesh, MESHLINK_ERROR, "Output buffer overflow while sending request to %s", c->name);
+				return false;
+			}
+		}
+
+		logger(mesh, MESHLINK_DEBUG, "Sending %s to %s: %u bytes binary", request_name[r->reqno], c->name, enc->binary_len);
+		return send_meta_binary(mesh, c, enc->binary, enc->binary_len);
+	}
+
+	if(!enc->text) {
+		if(r->text) {
+			enc->text_len = snprintf(enc->text_buf, sizeof(enc->text_buf), "%s", r->text);
+		} else {
+			enc->text_len = r->format_text(r->fields, enc->text_buf, sizeof(enc->text_buf));
+		}
+
+		if(enc->text_len < 0 || enc->text_len > MAXBUFSIZE - 1) {
+			logger(mesh, MESHLINK_ERROR, "Output buffer overflow while sending request to %s", c->name);
+			return false;
+		}
+
+		enc->text = enc->text_buf;
+		enc->text[enc->text_len++] = '\n';
+	}
+
+	logger(mesh, MESHLINK_DEBUG, "Sending %s to %s: %.*s", request_name[r->reqno], c->name, enc->text_len - 1, enc->text);
+	return send_meta(mesh, c, enc->text, enc->text_len);
+}
+
+/* Send a request to c, or if c is mesh->everyone, to all active connections
+   except from that are allowed in submesh s, each in the encoding it supports. */
+
+static bool send_dual_request_to(meshlink_handle_t *mesh, connection_t *c, connection_t *from, const submesh_t *s, const dual_request_t *r) {
+	request_encodings_t enc;
+	enc.text = NULL;
+	enc.binary = NULL;
+
+	if(c != mesh->everyone) {
+		return send_encoded_request(mesh, c, r, &enc);
+	}
+
+	if(!s) {
+		for list_each(connection_t, other, mesh->connections) {
+			if(other != from && other->status.active) {
+				send_encoded_request(mesh, other, r, &enc);
+			}
+		}
+
+		return true;
+	}
+
+	/* Only connections with nodes in the core mesh or in s itself are allowed to see this request */
+
+	list_t *lists[2] = {mesh->core_connections, s->connections};
+
+	for(int i = 0; i < 2; i++) {
+		for list_each(connection_t, other, lists[i]) {
+			if(other != from) {
+				send_encoded_request(mesh, other, r, &enc);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool send_dual_request(meshlink_handle_t *mesh, connection_t *c, const submesh_t *s, const dual_request_t *r) {
+	assert(c);
+	assert(r);
+
+	return send_dual_request_to(mesh, c, NULL, s, r);
+}
+
+void forward_dual_request(meshlink_handle_t *mesh, connection_t *from, const submesh_t *s, const dual_request_t *r) {
+	assert(from);
+	assert(r);
+
+	send_dual_request_to(mesh, mesh->everyone, from, s, r);
+}
+
 bool receive_request(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	assert(request);
 
@@ -145,6 +260,12 @@ bool receive_request(meshlink_handle_t *mesh, connection_t *c, const char *reque
 			return false;
 		}
 
+		/* Only edge updates may leave the reachability of nodes out of date */
+
+		if(reqno != ADD_EDGE && reqno != DEL_EDGE) {
+			graph_flush(mesh);
+		}
+
 		if(!request_handlers[reqno](mesh, c, request)) {
 			/* Something went wrong. Probably scriptkiddies. Terminate. */
 
@@ -159,84 +280,212 @@ bool receive_request(meshlink_handle_t *mesh, connection_t *c, const char *reque
 	return true;
 }
 
-static int past_request_compare(const past_request_t *a, const past_request_t *b) {
-	return strcmp(a->request, b->request);
+bool receive_binary_request(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	packmsg_input_t in = {data, len};
+	int reqno = packmsg_get_uint8(&in);
+
+	if(!packmsg_input_ok(&in) || reqno >= LAST || !binary_request_handlers[reqno]) {
+		logger(mesh, MESHLINK_ERROR, "Bogus binary data received from %s", c->name);
+		return false;
+	}
+
+	logger(mesh, MESHLINK_DEBUG, "Got %s from %s: %u bytes binary", request_name[reqno], c->name, len);
+
+	if(c->allow_request != ALL) {
+		logger(mesh, MESHLINK_ERROR, "Unauthorized request from %s", c->name);
+		return false;
+	}
+
+	if(reqno != ADD_EDGE && reqno != DEL_EDGE) {
+		graph_flush(mesh);
+	}
+
+	if(!binary_request_handlers[reqno](mesh, c, data, len)) {
+		logger(mesh, MESHLINK_ERROR, "Error while processing %s from %s", request_name[reqno], c->name);
+		return false;
+	}
+
+	return true;
+}
+
+/* Requests that have been seen recently are remembered by a 64 bit keyed digest, made with hash64().
+   The digests are kept in a number of generations, each an open addressing hash table,
+   which are rotated every request_interval seconds. A request is therefore remembered
+   for 60 to 70 seconds, and expiring old requests is just clearing the oldest table.
+   Tables only grow when they become too full, so no request is ever forgotten early.
+   Two different requests are only mistaken for each other if their digests collide. */
+
+#define PAST_REQUEST_GENERATIONS (60 / 10 + 1)
+#define PAST_REQUEST_MIN_SIZE 64
+
+static const int request_interval = 10;
+
+typedef struct past_requests_t {
+	uint64_t key;
+	uint64_t *digests[PAST_REQUEST_GENERATIONS];
+	uint32_t size[PAST_REQUEST_GENERATIONS];        /* Always a power of two */
+	uint32_t count[PAST_REQUEST_GENERATIONS];
+	uint32_t total;
+	int current;
+} past_requests_t;
+
+static uint64_t request_digest(const past_requests_t *p, const void *request, size_t len) {
+	uint64_t hash = hash64(request, len, p->key);
+
+	/* Zero marks an empty slot */
+	return hash ? hash : 1;
 }
 
-static void free_past_request(past_request_t *r) {
-	if(r->request) {
-		free((void *)r->request);
+static bool past_requests_contains(const past_requests_t *p, int generation, uint64_t digest) {
+	const uint64_t *digests = p->digests[generation];
+	uint32_t mask = p->size[generation] - 1;
+
+	for(uint32_t i = digest & mask; digests[i]; i = (i + 1) & mask) {
+		if(digests[i] == digest) {
+			return true;
+		}
 	}
 
-	free(r);
+	return false;
 }
 
-static const int request_timeout = 60;
+static void past_requests_insert(past_requests_t *p, int generation, uint64_t digest) {
+	uint64_t *digests = p->digests[generation];
+	uint32_t mask = p->size[generation] - 1;
+	uint32_t i = digest & mask;
+
+	while(digests[i]) {
+		i = (i + 1) & mask;
+	}
+
+	digests[i] = digest;
+	p->count[generation]++;
+}
+
+static void past_requests_resize(past_requests_t *p, int generation, uint32_t size) {
+	uint64_t *old = p->digests[generation];
+	uint32_t oldsize = p->size[generation];
+
+	p->digests[generation] = xzalloc(size * sizeof(*old));
+	p->size[generation] = size;
+	p->count[generation] = 0;
+
+	for(uint32_t i = 0; i < oldsize; i++) {
+		if(old[i]) {
+			past_requests_insert(p, generation, old[i]);
+		}
+	}
+
+	free(old);
+}
 
 static void age_past_requests(event_loop_t *loop, void *data) {
 	(void)data;
 	meshlink_handle_t *mesh = loop->data;
-	int left = 0, deleted = 0;
+	past_requests_t *p = mesh->past_requests;
 
-	for splay_each(past_request_t, p, mesh->past_request_tree) {
-		if(p->firstseen + request_timeout <= mesh->loop.now.tv_sec) {
-			splay_delete_node(mesh->past_request_tree, splay_node), deleted++;
-		} else {
-			left++;
-		}
+	/* The oldest generation becomes the new current one */
+
+	int oldest = (p->current + 1) % PAST_REQUEST_GENERATIONS;
+	uint32_t deleted = p->count[oldest];
+	p->total -= deleted;
+
+	if(p->size[oldest] > PAST_REQUEST_MIN_SIZE && deleted < p->size[oldest] / 8) {
+		free(p->digests[oldest]);
+		p->size[oldest] /= 2;
+		p->digests[oldest] = xzalloc(p->size[oldest] * sizeof(*p->digests[oldest]));
+	} else {
+		memset(p->digests[oldest], 0, p->size[oldest] * sizeof(*p->digests[oldest]));
 	}
 
-	if(left || deleted) {
-		logger(mesh, MESHLINK_DEBUG, "Aging past requests: deleted %d, left %d", deleted, left);
+	p->count[oldest] = 0;
+	p->current = oldest;
+
+	if(p->total || deleted) {
+		logger(mesh, MESHLINK_DEBUG, "Aging past requests: deleted %u, left %u", deleted, p->total);
 	}
 
-	if(left) {
+	if(p->total) {
 		timeout_set(&mesh->loop, &mesh->past_request_timeout, &(struct timespec) {
-			10, prng(mesh, TIMER_FUDGE)
+			request_interval, prng(mesh, TIMER_FUDGE)
 		});
 	}
 }
 
-bool seen_request(meshlink_handle_t *mesh, const char *request) {
+/* Text and binary requests never compare equal, since only the latter start with a control character. */
+
+bool seen_request(meshlink_handle_t *mesh, const void *request, size_t len) {
 	assert(request);
-	assert(*request);
+	assert(len);
 
-	past_request_t *new, p = {.request = request};
+	past_requests_t *p = mesh->past_requests;
+	uint64_t digest = request_digest(p, request, len);
 
-	if(splay_search(mesh->past_request_tree, &p)) {
-		logger(mesh, MESHLINK_DEBUG, "Already seen request");
-		return true;
-	} else {
-		new = xmalloc(sizeof(*new));
-		new->request = xstrdup(request);
-		new->firstseen = mesh->loop.now.tv_sec;
-
-		if(!mesh->past_request_tree->head) {
-			timeout_set(&mesh->loop, &mesh->past_request_timeout, &(struct timespec) {
-				10, prng(mesh, TIMER_FUDGE)
-			});
+	for(int i = 0; i < PAST_REQUEST_GENERATIONS; i++) {
+		if(p->count[i] && past_requests_contains(p, i, digest)) {
+			logger(mesh, MESHLINK_DEBUG, "Already seen request");
+			return true;
 		}
+	}
 
-		splay_insert(mesh->past_request_tree, new);
-		return false;
+	if(!p->total) {
+		timeout_set(&mesh->loop, &mesh->past_request_timeout, &(struct timespec) {
+			request_interval, prng(mesh, TIMER_FUDGE)
+		});
+	}
+
+	/* Keep the load factor of the current generation below 1/2 */
+
+	int current = p->current;
+
+	if(2 * (p->count[current] + 1) > p->size[current]) {
+		past_requests_resize(p, current, 2 * p->size[current]);
+	}
+
+	past_requests_insert(p, current, digest);
+	p->total++;
+	return false;
+}
+
+bool seen_dual_request(meshlink_handle_t *mesh, const dual_request_t *r) {
+	if(r->binary) {
+		return seen_request(mesh, r->binary, r->binary_len);
+	} else {
+		return seen_request(mesh, r->text, strlen(r->text));
 	}
 }
 
 void init_requests(meshlink_handle_t *mesh) {
-	assert(!mesh->past_request_tree);
+	assert(!mesh->past_requests);
 
-	mesh->past_request_tree = splay_alloc_tree((splay_compare_t) past_request_compare, (splay_action_t) free_past_request);
+	past_requests_t *p = xzalloc(sizeof(*p));
+	randomize(&p->key, sizeof(p->key));
+
+	for(int i = 0; i < PAST_REQUEST_GENERATIONS; i++) {
+		p->size[i] = PAST_REQUEST_MIN_SIZE;
+		p->digests[i] = xzalloc(p->size[i] * sizeof(*p->digests[i]));
+	}
+
+	mesh->past_requests = p;
 	timeout_add(&mesh->loop, &mesh->past_request_timeout, age_past_requests, NULL, &(struct timespec) {
 		0, 0
 	});
 }
 
 void exit_requests(meshlink_handle_t *mesh) {
-	if(mesh->past_request_tree) {
-		splay_delete_tree(mesh->past_request_tree);
+	past_requests_t *p = mesh->past_requests;
+
+	if(p) {
+		for(int i = 0; i < PAST_REQUEST_GENERATIONS; i++) {
+			free(p->digests[i]);
+		}
+
+		free(p);
 	}
 
-	mesh->past_request_tree = NULL;
+	mesh->past_requests = NULL;
 
 	timeout_del(&mesh->loop, &mesh->past_request_timeout);
 }
@@ -25,7 +25,24 @@
 /* Protocol version. Different major versions are incompatible. */
 
 #define PROT_MAJOR 17
-#define PROT_MINOR 3 /* Should not exceed 255! */
+#define PROT_MINOR 6 /* Should not exceed 255! */
+
+/* From this minor version on, ADD_EDGE, DEL_EDGE, REQ_KEY and ANS_KEY requests
+   are sent as packmsg encoded SPTPS records of type SPTPS_BINARY_REQUEST to
+   peers that support it. Text requests are still accepted from all peers. */
+
+#define PROT_MINOR_BINARY 4
+#define SPTPS_BINARY_REQUEST 1
+
+/* From this minor version on, nodes exchange a TOPOLOGY_DIGEST when a connection is activated,
+   and then only send the edges the digests disagree about, instead of all known edges. */
+
+#define PROT_MINOR_TOPOLOGY_DIGEST 5
+
+/* From this minor version on, nodes pass UDP datagrams between two other nodes that cannot reach each other directly.
+   The protocol minor of a node is advertised in the options of the edges towards it. */
+
+#define PROT_MINOR_RELAY 6
 
 /* Silly Windows */
 
@@ -48,13 +65,25 @@ typedef enum request_t {
 	CONTROL,
 	REQ_PUBKEY, ANS_PUBKEY,
 	REQ_SPTPS,
+	/* MeshLink requests */
+	TOPOLOGY_DIGEST,
 	LAST                                            /* Guardian for the highest request number */
 } request_t;
 
-typedef struct past_request_t {
-	const char *request;
-	time_t firstseen;
-} past_request_t;
+/* A request that can be sent both as text and in binary.
+   The encoding a connection needs is only generated when it is not known yet,
+   so a received request is forwarded as is to peers that use the same encoding. */
+
+typedef struct dual_request_t {
+	request_t reqno;
+	const void *fields;                     /* The parsed request */
+	int (*format_text)(const void *fields, char *buf, size_t size);
+	uint32_t (*format_binary)(const void *fields, uint8_t *buf, uint32_t size);
+
+	const char *text;                       /* Text encoding without newline, if known */
+	const uint8_t *binary;                  /* Binary encoding, if known */
+	uint32_t binary_len;
+} dual_request_t;
 
 /* Maximum size of strings in a request.
  * scanf terminates %2048s with a NUL character,
@@ -73,11 +102,15 @@ typedef struct past_request_t {
 bool send_request(struct meshlink_handle *mesh, struct connection_t *, const struct submesh_t *s, const char *, ...) __attribute__((__format__(printf, 4, 5)));
 void forward_request(struct meshlink_handle *mesh, struct connection_t *, const struct submesh_t *, const char *);
 bool receive_request(struct meshlink_handle *mesh, struct connection_t *, const char *);
+bool send_dual_request(struct meshlink_handle *mesh, struct connection_t *, const struct submesh_t *, const dual_request_t *);
+void forward_dual_request(struct meshlink_handle *mesh, struct connection_t *, const struct submesh_t *, const dual_request_t *);
+bool receive_binary_request(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
 bool check_id(const char *);
 
 void init_requests(struct meshlink_handle *mesh);
 void exit_requests(struct meshlink_handle *mesh);
-bool seen_request(struct meshlink_handle *mesh, const char *);
+bool seen_request(struct meshlink_handle *mesh, const void *, size_t);
+bool seen_dual_request(struct meshlink_handle *mesh, const dual_request_t *);
 
 /* Requests */
 
@@ -88,6 +121,9 @@ bool send_pong(struct meshlink_handle *mesh, struct connection_t *);
 bool send_add_edge(struct meshlink_handle *mesh, struct connection_t *, const struct edge_t *, int contradictions);
 bool send_del_edge(struct meshlink_handle *mesh, struct connection_t *, const struct edge_t *, int contradictions);
 bool send_req_key(struct meshlink_handle *mesh, struct node_t *);
+bool send_key_request(struct meshlink_handle *mesh, struct node_t *, int reqno, const void *, uint32_t);
+bool send_topology_digest(struct meshlink_handle *mesh, struct connection_t *);
+bool send_ans_key(struct meshlink_handle *mesh, struct connection_t *, const struct node_t *from, const struct node_t *to, const void *, uint32_t, const sockaddr_t *);
 
 /* Request handlers  */
 
@@ -105,4 +141,12 @@ bool req_key_h(struct meshlink_handle *mesh, struct connection_t *, const char *
 bool ans_key_h(struct meshlink_handle *mesh, struct connection_t *, const char *);
 bool tcppacket_h(struct meshlink_handle *mesh, struct connection_t *, const char *);
 
+/* Binary request handlers */
+
+bool add_edge_binary_h(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
+bool del_edge_binary_h(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
+bool req_key_binary_h(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
+bool ans_key_binary_h(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
+bool topology_digest_binary_h(struct meshlink_handle *mesh, struct connection_t *, const uint8_t *, uint32_t);
+
 #endif
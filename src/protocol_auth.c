@@ -43,8 +43,14 @@
 
 extern bool node_write_devclass(meshlink_handle_t *mesh, node_t *n);
 
+/* The minor protocol version we advertise, which is lowered if binary requests are disabled */
+
+static int protocol_minor(meshlink_handle_t *mesh) {
+	return mesh->text_requests_only ? PROT_MINOR_BINARY - 1 : PROT_MINOR;
+}
+
 bool send_id(meshlink_handle_t *mesh, connection_t *c) {
-	return send_request(mesh, c, NULL, "%d %s %d.%d %s", ID, mesh->self->name, PROT_MAJOR, PROT_MINOR, mesh->appname);
+	return send_request(mesh, c, NULL, "%d %s %d.%d %s", ID, mesh->self->name, PROT_MAJOR, protocol_minor(mesh), mesh->appname);
 }
 
 static bool commit_invitation(meshlink_handle_t *mesh, connection_t *c, const void *data) {
@@ -58,7 +64,7 @@ static bool commit_invitation(meshlink_handle_t *mesh, connection_t *c, const vo
 	// Remember its current address
 	node_add_recent_address(mesh, n, &c->address);
 
-	if(!node_write_config(mesh, n) || !config_sync(mesh, "current")) {
+	if(!node_write_config(mesh, n, true)) {
 		logger(mesh, MESHLINK_ERROR, "Error writing configuration file for invited node %s!\n", c->name);
 		free_node(n);
 		return false;
@@ -291,7 +297,7 @@ bool id_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 }
 
 bool send_ack(meshlink_handle_t *mesh, connection_t *c) {
-	return send_request(mesh, c, NULL, "%d %s %d %x", ACK, mesh->myport, mesh->devclass, OPTION_PMTU_DISCOVERY | (PROT_MINOR << 24));
+	return send_request(mesh, c, NULL, "%d %s %d %x", ACK, mesh->myport, mesh->devclass, OPTION_PMTU_DISCOVERY | (protocol_minor(mesh) << 24));
 }
 
 static void send_everything(meshlink_handle_t *mesh, connection_t *c) {
@@ -361,18 +367,24 @@ bool ack_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	n->connection = c;
 	c->node = n;
+	node_autoconnect_changed(mesh, n);
 
 	/* Activate this connection */
 
 	c->allow_request = ALL;
 	c->last_key_renewal = mesh->loop.now.tv_sec;
-	c->status.active = true;
+	connection_activate(mesh, c);
+	c->status.binary = !mesh->text_requests_only && c->protocol_minor >= PROT_MINOR_BINARY;
 
 	logger(mesh, MESHLINK_INFO, "Connection with %s activated", c->name);
 
-	/* Send him everything we know */
+	/* Send him everything we know, or if he supports it, a digest so only what differs has to be sent */
 
-	send_everything(mesh, c);
+	if(c->status.binary && c->protocol_minor >= PROT_MINOR_TOPOLOGY_DIGEST) {
+		send_topology_digest(mesh, c);
+	} else {
+		send_everything(mesh, c);
+	}
 
 	/* Create an edge_t for this connection */
 
@@ -383,6 +395,7 @@ bool ack_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	c->edge->to = n;
 	sockaddrcpy_setport(&c->edge->address, &c->address, atoi(hisport));
 	c->edge->weight = mesh->dev_class_traits[devclass].edge_weight;
+	c->edge->options = options;
 	c->edge->connection = c;
 
 	edge_add(mesh, c->edge);
@@ -29,129 +29,157 @@
 #include "net.h"
 #include "netutl.h"
 #include "node.h"
+#include "packmsg.h"
 #include "protocol.h"
 #include "utils.h"
 #include "xalloc.h"
 #include "submesh.h"
 
-bool send_add_edge(meshlink_handle_t *mesh, connection_t *c, const edge_t *e, int contradictions) {
-	bool x;
+/* The fields of an ADD_EDGE request */
+
+typedef struct add_edge_request_t {
+	uint32_t nonce;
+	const char *from_name;
+	int from_devclass;
+	const char *from_submesh;
+	const char *to_name;
+	sockaddr_t address;
+	int to_devclass;
+	const char *to_submesh;
+	uint32_t options;
+	int weight;
+	int contradictions;
+	uint32_t session_id;
+} add_edge_request_t;
+
+static int format_add_edge(const void *fields, char *buf, size_t size) {
+	const add_edge_request_t *r = fields;
 	char *address, *port;
-	const char *from_submesh, *to_submesh;
-	const submesh_t *s = NULL;
 
-	if(c->node && c->node->submesh) {
-		if(!submesh_allows_node(e->from->submesh, c->node)) {
-			return true;
-		}
+	sockaddr2str(&r->address, &address, &port);
 
-		if(!submesh_allows_node(e->to->submesh, c->node)) {
-			return true;
-		}
-	}
+	int len = snprintf(buf, size, "%d %x %s %d %s %s %s %s %d %s %x %d %d %x", ADD_EDGE, r->nonce,
+	                   r->from_name, r->from_devclass, r->from_submesh, r->to_name, address, port,
+	                   r->to_devclass, r->to_submesh, r->options, r->weight, r->contradictions, r->session_id);
+	free(address);
+	free(port);
 
-	if(e->from->submesh && e->to->submesh && (e->from->submesh != e->to->submesh)) {
-		return true;
-	}
+	return len;
+}
 
-	sockaddr2str(&e->address, &address, &port);
+static uint32_t pack_add_edge(const void *fields, uint8_t *buf, uint32_t size) {
+	const add_edge_request_t *r = fields;
+	packmsg_output_t out = {buf, size};
+
+	packmsg_add_uint8(&out, ADD_EDGE);
+	packmsg_add_uint32(&out, r->nonce);
+	packmsg_add_str(&out, r->from_name);
+	packmsg_add_int32(&out, r->from_devclass);
+	packmsg_add_str(&out, r->from_submesh);
+	packmsg_add_str(&out, r->to_name);
+	packmsg_add_address(&out, &r->address);
+	packmsg_add_int32(&out, r->to_devclass);
+	packmsg_add_str(&out, r->to_submesh);
+	packmsg_add_uint32(&out, r->options);
+	packmsg_add_int32(&out, r->weight);
+	packmsg_add_int32(&out, r->contradictions);
+	packmsg_add_uint32(&out, r->session_id);
+
+	return packmsg_output_ok(&out) ? packmsg_output_size(&out, buf) : 0;
+}
 
-	if(e->from->submesh) {
-		from_submesh = e->from->submesh->name;
-	} else {
-		from_submesh = CORE_MESH;
-	}
+/* Find the submesh an edge belongs to, or return false if it connects two different submeshes
+   and must not be told to anyone */
 
-	if(e->to->submesh) {
-		to_submesh = e->to->submesh->name;
-	} else {
-		to_submesh = CORE_MESH;
+static bool edge_submesh(const edge_t *e, const submesh_t **s) {
+	if(e->from->submesh && e->to->submesh && (e->from->submesh != e->to->submesh)) {
+		return false;
 	}
 
-	if(e->from->submesh) {
-		s = e->from->submesh;
-	} else {
-		s = e->to->submesh;
-	}
+	*s = e->from->submesh ? e->from->submesh : e->to->submesh;
+	return true;
+}
 
-	x = send_request(mesh, c, s, "%d %x %s %d %s %s %s %s %d %s %x %d %d %x", ADD_EDGE, prng(mesh, UINT_MAX),
-	                 e->from->name, e->from->devclass, from_submesh, e->to->name, address, port,
-	                 e->to->devclass, to_submesh, OPTION_PMTU_DISCOVERY, e->weight, contradictions, e->from->session_id);
-	free(address);
-	free(port);
+/* Check whether an edge may be told to the given node, or to everyone if n is NULL */
 
-	return x;
+static bool edge_visible_to(const edge_t *e, const node_t *n) {
+	const submesh_t *s;
+	return edge_submesh(e, &s) && (!n || submesh_allows_node(s, n));
 }
 
-bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
-	assert(request);
-	assert(*request);
+bool send_add_edge(meshlink_handle_t *mesh, connection_t *c, const edge_t *e, int contradictions) {
+	const submesh_t *s;
+
+	if(!edge_submesh(e, &s) || (c->node && !submesh_allows_node(s, c->node))) {
+		return true;
+	}
+
+	add_edge_request_t r = {
+		.nonce = prng(mesh, UINT_MAX),
+		.from_name = e->from->name,
+		.from_devclass = e->from->devclass,
+		.from_submesh = e->from->submesh ? e->from->submesh->name : CORE_MESH,
+		.to_name = e->to->name,
+		.address = e->address,
+		.to_devclass = e->to->devclass,
+		.to_submesh = e->to->submesh ? e->to->submesh->name : CORE_MESH,
+		.options = e->options,
+		.weight = e->weight,
+		.contradictions = contradictions,
+		.session_id = e->from->session_id,
+	};
+
+	dual_request_t request = {.reqno = ADD_EDGE, .fields = &r, .format_text = format_add_edge, .format_binary = pack_add_edge};
+	return send_dual_request(mesh, c, s, &request);
+}
 
+static bool add_edge(meshlink_handle_t *mesh, connection_t *c, const add_edge_request_t *r, const dual_request_t *request) {
 	edge_t *e;
 	node_t *from, *to;
-	char from_name[MAX_STRING_SIZE];
-	int from_devclass;
-	char from_submesh_name[MAX_STRING_SIZE] = "";
-	char to_name[MAX_STRING_SIZE];
-	char to_address[MAX_STRING_SIZE];
-	char to_port[MAX_STRING_SIZE];
-	int to_devclass;
-	char to_submesh_name[MAX_STRING_SIZE] = "";
-	sockaddr_t address;
-	int weight;
-	int contradictions = 0;
-	uint32_t session_id = 0;
 	submesh_t *s = NULL;
 
-	if(sscanf(request, "%*d %*x "MAX_STRING" %d "MAX_STRING" "MAX_STRING" "MAX_STRING" "MAX_STRING" %d "MAX_STRING" %*x %d %d %x",
-	                from_name, &from_devclass, from_submesh_name, to_name, to_address, to_port, &to_devclass, to_submesh_name,
-	                &weight, &contradictions, &session_id) < 9) {
-		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ADD_EDGE", c->name);
-		return false;
-	}
-
 	// Check if devclasses are valid
 
-	if(from_devclass < 0 || from_devclass >= DEV_CLASS_COUNT) {
+	if(r->from_devclass < 0 || r->from_devclass >= DEV_CLASS_COUNT) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ADD_EDGE", c->name, "from devclass invalid");
 		return false;
 	}
 
-	if(to_devclass < 0 || to_devclass >= DEV_CLASS_COUNT) {
+	if(r->to_devclass < 0 || r->to_devclass >= DEV_CLASS_COUNT) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ADD_EDGE", c->name, "to devclass invalid");
 		return false;
 	}
 
-	if(0 == strcmp(from_submesh_name, "")) {
+	if(0 == strcmp(r->from_submesh, "")) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ADD_EDGE", c->name, "invalid submesh id");
 		return false;
 	}
 
-	if(0 == strcmp(to_submesh_name, "")) {
+	if(0 == strcmp(r->to_submesh, "")) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ADD_EDGE", c->name, "invalid submesh id");
 		return false;
 	}
 
-	if(seen_request(mesh, request)) {
+	if(seen_dual_request(mesh, request)) {
 		return true;
 	}
 
 	/* Lookup nodes */
 
-	from = lookup_node(mesh, from_name);
-	to = lookup_node(mesh, to_name);
+	from = lookup_node(mesh, r->from_name);
+	to = lookup_node(mesh, r->to_name);
 
 	if(!from) {
 		from = new_node();
 		from->status.dirty = true;
 		from->status.blacklisted = mesh->default_blacklist;
-		from->name = xstrdup(from_name);
-		from->devclass = from_devclass;
+		from->name = xstrdup(r->from_name);
+		from->devclass = r->from_devclass;
 
 		from->submesh = NULL;
 
-		if(0 != strcmp(from_submesh_name, CORE_MESH)) {
-			if(!(from->submesh = lookup_or_create_submesh(mesh, from_submesh_name))) {
+		if(0 != strcmp(r->from_submesh, CORE_MESH)) {
+			if(!(from->submesh = lookup_or_create_submesh(mesh, r->from_submesh))) {
 				return false;
 			}
 		}
@@ -159,27 +187,30 @@ bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		node_add(mesh, from);
 	}
 
-	if(contradictions > 50) {
+	if(r->contradictions > 50) {
 		handle_duplicate_node(mesh, from);
 	}
 
-	from->devclass = from_devclass;
+	if(from->devclass != (dev_class_t)r->from_devclass) {
+		from->devclass = r->from_devclass;
+		node_autoconnect_changed(mesh, from);
+	}
 
 	if(!from->session_id) {
-		from->session_id = session_id;
+		from->session_id = r->session_id;
 	}
 
 	if(!to) {
 		to = new_node();
 		to->status.dirty = true;
 		to->status.blacklisted = mesh->default_blacklist;
-		to->name = xstrdup(to_name);
-		to->devclass = to_devclass;
+		to->name = xstrdup(r->to_name);
+		to->devclass = r->to_devclass;
 
 		to->submesh = NULL;
 
-		if(0 != strcmp(to_submesh_name, CORE_MESH)) {
-			if(!(to->submesh = lookup_or_create_submesh(mesh, to_submesh_name))) {
+		if(0 != strcmp(r->to_submesh, CORE_MESH)) {
+			if(!(to->submesh = lookup_or_create_submesh(mesh, r->to_submesh))) {
 				return false;
 
 			}
@@ -188,18 +219,17 @@ bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		node_add(mesh, to);
 	}
 
-	to->devclass = to_devclass;
-
-	/* Convert addresses */
-
-	address = str2sockaddr(to_address, to_port);
+	if(to->devclass != (dev_class_t)r->to_devclass) {
+		to->devclass = r->to_devclass;
+		node_autoconnect_changed(mesh, to);
+	}
 
 	/* Check if edge already exists */
 
 	e = lookup_edge(from, to);
 
 	if(e) {
-		if(e->weight != weight || e->session_id != session_id || sockaddrcmp(&e->address, &address)) {
+		if(e->weight != r->weight || e->session_id != r->session_id || sockaddrcmp(&e->address, &r->address)) {
 			if(from == mesh->self) {
 				logger(mesh, MESHLINK_DEBUG, "Got %s from %s for ourself which does not match existing entry", "ADD_EDGE", c->name);
 				send_add_edge(mesh, c, e, 0);
@@ -217,7 +247,7 @@ bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		e = new_edge();
 		e->from = from;
 		e->to = to;
-		e->session_id = session_id;
+		e->session_id = r->session_id;
 		send_del_edge(mesh, c, e, mesh->contradicting_add_edge);
 		free_edge(e);
 		return true;
@@ -226,14 +256,15 @@ bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	e = new_edge();
 	e->from = from;
 	e->to = to;
-	e->address = address;
-	e->weight = weight;
-	e->session_id = session_id;
+	e->address = r->address;
+	e->weight = r->weight;
+	e->options = r->options;
+	e->session_id = r->session_id;
 	edge_add(mesh, e);
 
 	/* Run MST before or after we tell the rest? */
 
-	graph(mesh);
+	graph_schedule(mesh);
 
 	if(e->from->submesh && e->to->submesh && (e->from->submesh != e->to->submesh)) {
 		logger(mesh, MESHLINK_ERROR, "Dropping add edge ( %s to %s )", e->from->submesh->name, e->to->submesh->name);
@@ -248,64 +279,143 @@ bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	/* Tell the rest about the new edge */
 
-	forward_request(mesh, c, s, request);
+	forward_dual_request(mesh, c, s, request);
 
 	return true;
 }
 
-bool send_del_edge(meshlink_handle_t *mesh, connection_t *c, const edge_t *e, int contradictions) {
-	submesh_t *s = NULL;
-
-	if(c->node && c->node->submesh) {
-		if(!submesh_allows_node(e->from->submesh, c->node)) {
-			return true;
-		}
+bool add_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
+	assert(request);
+	assert(*request);
 
-		if(!submesh_allows_node(e->to->submesh, c->node)) {
-			return true;
-		}
+	char from_name[MAX_STRING_SIZE];
+	char from_submesh_name[MAX_STRING_SIZE] = "";
+	char to_name[MAX_STRING_SIZE];
+	char to_address[MAX_STRING_SIZE];
+	char to_port[MAX_STRING_SIZE];
+	char to_submesh_name[MAX_STRING_SIZE] = "";
+	add_edge_request_t r = {
+		.from_name = from_name,
+		.from_submesh = from_submesh_name,
+		.to_name = to_name,
+		.to_submesh = to_submesh_name,
+	};
+
+	if(sscanf(request, "%*d %x "MAX_STRING" %d "MAX_STRING" "MAX_STRING" "MAX_STRING" "MAX_STRING" %d "MAX_STRING" %x %d %d %x",
+	                &r.nonce, from_name, &r.from_devclass, from_submesh_name, to_name, to_address, to_port, &r.to_devclass, to_submesh_name,
+	                &r.options, &r.weight, &r.contradictions, &r.session_id) < 11) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ADD_EDGE", c->name);
+		return false;
 	}
 
-	if(e->from->submesh && e->to->submesh && (e->from->submesh != e->to->submesh)) {
-		return true;
-	}
+	/* Convert addresses */
 
+	r.address = str2sockaddr(to_address, to_port);
 
-	if(e->from->submesh) {
-		s = e->from->submesh;
-	} else {
-		s = e->to->submesh;
+	dual_request_t dual = {.reqno = ADD_EDGE, .fields = &r, .format_text = format_add_edge, .format_binary = pack_add_edge, .text = request};
+	return add_edge(mesh, c, &r, &dual);
+}
+
+bool add_edge_binary_h(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	char from_name[MAX_STRING_SIZE];
+	char from_submesh_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	char to_submesh_name[MAX_STRING_SIZE];
+	add_edge_request_t r = {
+		.from_name = from_name,
+		.from_submesh = from_submesh_name,
+		.to_name = to_name,
+		.to_submesh = to_submesh_name,
+	};
+
+	packmsg_input_t in = {data, len};
+	packmsg_skip_element(&in);
+	r.nonce = packmsg_get_uint32(&in);
+	packmsg_get_str_copy(&in, from_name, sizeof(from_name));
+	r.from_devclass = packmsg_get_int32(&in);
+	packmsg_get_str_copy(&in, from_submesh_name, sizeof(from_submesh_name));
+	packmsg_get_str_copy(&in, to_name, sizeof(to_name));
+	r.address = packmsg_get_address(&in);
+	r.to_devclass = packmsg_get_int32(&in);
+	packmsg_get_str_copy(&in, to_submesh_name, sizeof(to_submesh_name));
+	r.options = packmsg_get_uint32(&in);
+	r.weight = packmsg_get_int32(&in);
+	r.contradictions = packmsg_get_int32(&in);
+	r.session_id = packmsg_get_uint32(&in);
+
+	if(!packmsg_input_ok(&in) || !*from_name || !*to_name) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ADD_EDGE", c->name);
+		return false;
 	}
 
-	return send_request(mesh, c, s, "%d %x %s %s %d %x", DEL_EDGE, prng(mesh, UINT_MAX),
-	                    e->from->name, e->to->name, contradictions, e->session_id);
+	dual_request_t dual = {.reqno = ADD_EDGE, .fields = &r, .format_text = format_add_edge, .format_binary = pack_add_edge, .binary = data, .binary_len = len};
+	return add_edge(mesh, c, &r, &dual);
 }
 
-bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
-	assert(request);
-	assert(*request);
+/* The fields of a DEL_EDGE request */
+
+typedef struct del_edge_request_t {
+	uint32_t nonce;
+	const char *from_name;
+	const char *to_name;
+	int contradictions;
+	uint32_t session_id;
+} del_edge_request_t;
+
+static int format_del_edge(const void *fields, char *buf, size_t size) {
+	const del_edge_request_t *r = fields;
+
+	return snprintf(buf, size, "%d %x %s %s %d %x", DEL_EDGE, r->nonce, r->from_name, r->to_name, r->contradictions, r->session_id);
+}
+
+static uint32_t pack_del_edge(const void *fields, uint8_t *buf, uint32_t size) {
+	const del_edge_request_t *r = fields;
+	packmsg_output_t out = {buf, size};
+
+	packmsg_add_uint8(&out, DEL_EDGE);
+	packmsg_add_uint32(&out, r->nonce);
+	packmsg_add_str(&out, r->from_name);
+	packmsg_add_str(&out, r->to_name);
+	packmsg_add_int32(&out, r->contradictions);
+	packmsg_add_uint32(&out, r->session_id);
 
+	return packmsg_output_ok(&out) ? packmsg_output_size(&out, buf) : 0;
+}
+
+bool send_del_edge(meshlink_handle_t *mesh, connection_t *c, const edge_t *e, int contradictions) {
+	const submesh_t *s;
+
+	if(!edge_submesh(e, &s) || (c->node && !submesh_allows_node(s, c->node))) {
+		return true;
+	}
+
+	del_edge_request_t r = {
+		.nonce = prng(mesh, UINT_MAX),
+		.from_name = e->from->name,
+		.to_name = e->to->name,
+		.contradictions = contradictions,
+		.session_id = e->session_id,
+	};
+
+	dual_request_t request = {.reqno = DEL_EDGE, .fields = &r, .format_text = format_del_edge, .format_binary = pack_del_edge};
+	return send_dual_request(mesh, c, s, &request);
+}
+
+static bool del_edge(meshlink_handle_t *mesh, connection_t *c, const del_edge_request_t *r, const dual_request_t *request) {
 	edge_t *e;
-	char from_name[MAX_STRING_SIZE];
-	char to_name[MAX_STRING_SIZE];
 	node_t *from, *to;
-	int contradictions = 0;
-	uint32_t session_id = 0;
 	submesh_t *s = NULL;
 
-	if(sscanf(request, "%*d %*x "MAX_STRING" "MAX_STRING" %d %x", from_name, to_name, &contradictions, &session_id) < 2) {
-		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "DEL_EDGE", c->name);
-		return false;
-	}
-
-	if(seen_request(mesh, request)) {
+	if(seen_dual_request(mesh, request)) {
 		return true;
 	}
 
 	/* Lookup nodes */
 
-	from = lookup_node(mesh, from_name);
-	to = lookup_node(mesh, to_name);
+	from = lookup_node(mesh, r->from_name);
+	to = lookup_node(mesh, r->to_name);
 
 	if(!from) {
 		logger(mesh, MESHLINK_WARNING, "Got %s from %s which does not appear in the edge tree", "DEL_EDGE", c->name);
@@ -317,7 +427,7 @@ bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		return true;
 	}
 
-	if(contradictions > 50) {
+	if(r->contradictions > 50) {
 		handle_duplicate_node(mesh, from);
 	}
 
@@ -348,7 +458,7 @@ bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 		}
 
 		/* Tell the rest about the deleted edge */
-		forward_request(mesh, c, s, request);
+		forward_dual_request(mesh, c, s, request);
 
 	} else {
 		logger(mesh, MESHLINK_ERROR, "Dropping del edge ( %s to %s )", e->from->submesh->name, e->to->submesh->name);
@@ -361,11 +471,12 @@ bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	/* Run MST before or after we tell the rest? */
 
-	graph(mesh);
+	graph_schedule(mesh);
 
-	/* If the node is not reachable anymore but we remember it had an edge to us, clean it up */
+	/* If the node is not reachable anymore but we remember it had an edge to us, clean it up.
+	   The reachability check has not run yet, but the SSSP tree is already up to date. */
 
-	if(!to->status.reachable) {
+	if(!to->status.visited) {
 		e = lookup_edge(to, mesh->self);
 
 		if(e) {
@@ -376,3 +487,227 @@ bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	return true;
 }
+
+bool del_edge_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
+	assert(request);
+	assert(*request);
+
+	char from_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	del_edge_request_t r = {
+		.from_name = from_name,
+		.to_name = to_name,
+	};
+
+	if(sscanf(request, "%*d %x "MAX_STRING" "MAX_STRING" %d %x", &r.nonce, from_name, to_name, &r.contradictions, &r.session_id) < 3) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "DEL_EDGE", c->name);
+		return false;
+	}
+
+	dual_request_t dual = {.reqno = DEL_EDGE, .fields = &r, .format_text = format_del_edge, .format_binary = pack_del_edge, .text = request};
+	return del_edge(mesh, c, &r, &dual);
+}
+
+bool del_edge_binary_h(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	char from_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	del_edge_request_t r = {
+		.from_name = from_name,
+		.to_name = to_name,
+	};
+
+	packmsg_input_t in = {data, len};
+	packmsg_skip_element(&in);
+	r.nonce = packmsg_get_uint32(&in);
+	packmsg_get_str_copy(&in, from_name, sizeof(from_name));
+	packmsg_get_str_copy(&in, to_name, sizeof(to_name));
+	r.contradictions = packmsg_get_int32(&in);
+	r.session_id = packmsg_get_uint32(&in);
+
+	if(!packmsg_input_ok(&in) || !*from_name || !*to_name) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "DEL_EDGE", c->name);
+		return false;
+	}
+
+	dual_request_t dual = {.reqno = DEL_EDGE, .fields = &r, .format_text = format_del_edge, .format_binary = pack_del_edge, .binary = data, .binary_len = len};
+	return del_edge(mesh, c, &r, &dual);
+}
+
+/* Topology digests.
+   When a connection is activated, both sides send a digest of the edges they know about, instead of the edges themselves.
+   The edges are divided into buckets by the name of the node they start from, and the digest of a bucket is the sum
+   of the hashes of its edges. Only edges that both ends of the connection may know about are included, except for the
+   edges between them, since those are announced separately. Each side then only sends the edges of the buckets that
+   differ, which the other side handles exactly as it would if all edges had been sent. */
+
+#define TOPOLOGY_DIGEST_MIN_BUCKETS 16
+#define TOPOLOGY_DIGEST_MAX_BUCKETS 1024
+
+typedef struct topology_bucket_t {
+	uint64_t digest;
+	uint32_t edges;
+	uint32_t bytes;         /* Size of the ADD_EDGE requests for the edges in this bucket */
+} topology_bucket_t;
+
+static uint32_t topology_digest_buckets(meshlink_handle_t *mesh) {
+	uint32_t nbuckets = TOPOLOGY_DIGEST_MIN_BUCKETS;
+
+	while(nbuckets < TOPOLOGY_DIGEST_MAX_BUCKETS && nbuckets * 4 < mesh->nodes->count) {
+		nbuckets *= 2;
+	}
+
+	return nbuckets;
+}
+
+static uint32_t topology_bucket(const node_t *n, uint32_t nbuckets) {
+	return hash64(n->name, strlen(n->name), 0) & (nbuckets - 1);
+}
+
+static bool topology_digest_includes(meshlink_handle_t *mesh, const connection_t *c, const edge_t *e) {
+	if((e->from == mesh->self && e->to == c->node) || (e->from == c->node && e->to == mesh->self)) {
+		return false;
+	}
+
+	return edge_visible_to(e, c->node);
+}
+
+/* The hash of an edge covers everything an ADD_EDGE request for it would tell the other side,
+   except for the options, since nodes before PROT_MINOR_RELAY do not keep track of them */
+
+static uint64_t edge_digest(meshlink_handle_t *mesh, const edge_t *e, uint32_t *len) {
+	add_edge_request_t r = {
+		.from_name = e->from->name,
+		.from_devclass = e->from->devclass,
+		.from_submesh = e->from->submesh ? e->from->submesh->name : CORE_MESH,
+		.to_name = e->to->name,
+		.address = e->address,
+		.to_devclass = e->to->devclass,
+		.to_submesh = e->to->submesh ? e->to->submesh->name : CORE_MESH,
+		.options = OPTION_PMTU_DISCOVERY,
+		.weight = e->weight,
+		.session_id = e->from == mesh->self ? mesh->self->session_id : e->session_id,
+	};
+
+	uint8_t buf[MAXBUFSIZE];
+	*len = pack_add_edge(&r, buf, sizeof(buf));
+	return hash64(buf, *len, 0);
+}
+
+static void topology_digest(meshlink_handle_t *mesh, const connection_t *c, topology_bucket_t *buckets, uint32_t nbuckets) {
+	memset(buckets, 0, nbuckets * sizeof(*buckets));
+
+	for splay_each(node_t, n, mesh->nodes) {
+		topology_bucket_t *bucket = &buckets[topology_bucket(n, nbuckets)];
+
+		for inner_splay_each(edge_t, e, n->edge_tree) {
+			if(!topology_digest_includes(mesh, c, e)) {
+				continue;
+			}
+
+			uint32_t len;
+			bucket->digest += edge_digest(mesh, e, &len);
+			bucket->edges++;
+			bucket->bytes += len;
+		}
+	}
+}
+
+bool send_topology_digest(meshlink_handle_t *mesh, connection_t *c) {
+	uint32_t nbuckets = topology_digest_buckets(mesh);
+	topology_bucket_t *buckets = xmalloc(nbuckets * sizeof(*buckets));
+	topology_digest(mesh, c, buckets, nbuckets);
+
+	uint32_t size = 16 + nbuckets * 9;
+	uint8_t *buf = xmalloc(size);
+	packmsg_output_t out = {buf, size};
+
+	packmsg_add_uint8(&out, TOPOLOGY_DIGEST);
+	packmsg_add_array(&out, nbuckets);
+
+	for(uint32_t i = 0; i < nbuckets; i++) {
+		packmsg_add_uint64(&out, buckets[i].digest);
+	}
+
+	bool result = false;
+
+	if(packmsg_output_ok(&out)) {
+		uint32_t len = packmsg_output_size(&out, buf);
+		logger(mesh, MESHLINK_DEBUG, "Sending %s to %s: %u buckets", "TOPOLOGY_DIGEST", c->name, nbuckets);
+		mesh->topology_bytes_sent += len;
+		result = send_meta_binary(mesh, c, buf, len);
+	}
+
+	free(buf);
+	free(buckets);
+	return result;
+}
+
+bool topology_digest_binary_h(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	packmsg_input_t in = {data, len};
+	packmsg_skip_element(&in);
+	uint32_t nbuckets = packmsg_get_array(&in);
+
+	if(!packmsg_input_ok(&in) || nbuckets < TOPOLOGY_DIGEST_MIN_BUCKETS || nbuckets > TOPOLOGY_DIGEST_MAX_BUCKETS || (nbuckets & (nbuckets - 1))) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "TOPOLOGY_DIGEST", c->name);
+		return false;
+	}
+
+	uint64_t *theirs = xmalloc(nbuckets * sizeof(*theirs));
+
+	for(uint32_t i = 0; i < nbuckets; i++) {
+		theirs[i] = packmsg_get_uint64(&in);
+	}
+
+	if(!packmsg_input_ok(&in)) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "TOPOLOGY_DIGEST", c->name);
+		free(theirs);
+		return false;
+	}
+
+	topology_bucket_t *ours = xmalloc(nbuckets * sizeof(*ours));
+	topology_digest(mesh, c, ours, nbuckets);
+
+	/* Send him the edges of all buckets that differ */
+
+	uint32_t differing = 0;
+
+	for(uint32_t i = 0; i < nbuckets; i++) {
+		mesh->topology_bytes_full += ours[i].bytes;
+
+		if(ours[i].digest == theirs[i]) {
+			mesh->topology_edges_skipped += ours[i].edges;
+		} else {
+			mesh->topology_edges_sent += ours[i].edges;
+			mesh->topology_bytes_sent += ours[i].bytes;
+			differing++;
+		}
+	}
+
+	logger(mesh, MESHLINK_DEBUG, "Topology digest from %s differs in %u of %u buckets", c->name, differing, nbuckets);
+
+	if(differing) {
+		for splay_each(node_t, n, mesh->nodes) {
+			uint32_t i = topology_bucket(n, nbuckets);
+
+			if(ours[i].digest == theirs[i]) {
+				continue;
+			}
+
+			for inner_splay_each(edge_t, e, n->edge_tree) {
+				if(topology_digest_includes(mesh, c, e)) {
+					send_add_edge(mesh, c, e, 0);
+				}
+			}
+		}
+	}
+
+	mesh->topology_syncs++;
+
+	free(ours);
+	free(theirs);
+	return true;
+}
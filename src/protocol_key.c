@@ -25,6 +25,7 @@
 #include "net.h"
 #include "netutl.h"
 #include "node.h"
+#include "packmsg.h"
 #include "prf.h"
 #include "protocol.h"
 #include "sptps.h"
@@ -45,7 +46,7 @@ bool key_changed_h(meshlink_handle_t *mesh, connection_t *c, const char *request
 		return false;
 	}
 
-	if(seen_request(mesh, request)) {
+	if(seen_request(mesh, request, strlen(request))) {
 		return true;
 	}
 
@@ -63,6 +64,75 @@ bool key_changed_h(meshlink_handle_t *mesh, connection_t *c, const char *request
 	return true;
 }
 
+/* The fields of a REQ_KEY request.
+   REQ_KEY is overloaded to allow arbitrary requests to be routed between two nodes,
+   these have an extended request number and an optional payload. */
+
+typedef struct key_request_t {
+	const char *from_name;
+	const char *to_name;
+	int reqno;
+	const void *data;
+	uint32_t len;
+} key_request_t;
+
+/* SPTPS records are base64 encoded in text requests, but sent as is in binary requests.
+   Other payloads are always sent as strings. */
+
+static bool key_request_has_sptps_data(int reqno) {
+	return reqno == REQ_KEY || reqno == REQ_SPTPS;
+}
+
+static int format_key_request(const void *fields, char *buf, size_t size) {
+	const key_request_t *r = fields;
+	int len = snprintf(buf, size, "%d %s %s %d", REQ_KEY, r->from_name, r->to_name, r->reqno);
+
+	if(len < 0 || (size_t)len + 2 + r->len * 4 / 3 + 4 > size) {
+		return -1;
+	}
+
+	if(!r->len) {
+		return len;
+	}
+
+	buf[len++] = ' ';
+
+	if(key_request_has_sptps_data(r->reqno)) {
+		b64encode(r->data, buf + len, r->len);
+		len += strlen(buf + len);
+	} else {
+		memcpy(buf + len, r->data, r->len);
+		len += r->len;
+		buf[len] = 0;
+	}
+
+	return len;
+}
+
+static uint32_t pack_key_request(const void *fields, uint8_t *buf, uint32_t size) {
+	const key_request_t *r = fields;
+	packmsg_output_t out = {buf, size};
+
+	packmsg_add_uint8(&out, REQ_KEY);
+	packmsg_add_str(&out, r->from_name);
+	packmsg_add_str(&out, r->to_name);
+	packmsg_add_int32(&out, r->reqno);
+
+	if(r->len) {
+		packmsg_add_bin(&out, r->data, r->len);
+	}
+
+	return packmsg_output_ok(&out) ? packmsg_output_size(&out, buf) : 0;
+}
+
+/* Send an extended REQ_KEY request to the given node */
+
+bool send_key_request(meshlink_handle_t *mesh, node_t *to, int reqno, const void *data, uint32_t len) {
+	key_request_t r = {mesh->self->name, to->name, reqno, data, len};
+	dual_request_t request = {.reqno = REQ_KEY, .fields = &r, .format_text = format_key_request, .format_binary = pack_key_request};
+	return send_dual_request(mesh, to->nexthop->connection, NULL, &request);
+}
+
 static bool send_initial_sptps_data(void *handle, uint8_t type, const void *data, size_t len) {
 	(void)type;
 
@@ -72,16 +142,19 @@ static bool send_initial_sptps_data(void *handle, uint8_t type, const void *data
 	node_t *to = handle;
 	meshlink_handle_t *mesh = to->mesh;
 	to->sptps.send_data = send_sptps_data;
-	char buf[len * 4 / 3 + 5];
-	b64encode(data, buf, len);
-	return send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %d %s", REQ_KEY, mesh->self->name, to->name, REQ_KEY, buf);
+	return send_key_request(mesh, to, REQ_KEY, data, len);
 }
 
 bool send_req_key(meshlink_handle_t *mesh, node_t *to) {
+	/* The reachability check of pending edge updates might not have run yet, but the SSSP tree is up to date */
+	if(!to->status.reachable || !to->status.visited) {
+		return true;
+	}
+
 	if(!node_read_public_key(mesh, to)) {
 		logger(mesh, MESHLINK_DEBUG, "No ECDSA key known for %s", to->name);
 		char *pubkey = ecdsa_get_base64_public_key(mesh->private_key);
-		send_request(mesh, to->nexthop->connection, NULL, "%d %s %s %d %s", REQ_KEY, mesh->self->name, to->name, REQ_PUBKEY, pubkey);
+		send_key_request(mesh, to, REQ_PUBKEY, pubkey, strlen(pubkey));
 		free(pubkey);
 		return true;
 	}
@@ -99,33 +172,40 @@ bool send_req_key(meshlink_handle_t *mesh, node_t *to) {
 	return sptps_start(&to->sptps, to, true, true, mesh->private_key, to->ecdsa, label, sizeof(label) - 1, send_initial_sptps_data, receive_sptps_record);
 }
 
-/* REQ_KEY is overloaded to allow arbitrary requests to be routed between two nodes. */
+/* Get a public key sent as the payload of an extended REQ_KEY request */
+
+static ecdsa_t *get_public_key(const key_request_t *r) {
+	char pubkey[MAX_STRING_SIZE];
+
+	if(!r->len || r->len >= sizeof(pubkey)) {
+		return NULL;
+	}
+
+	memcpy(pubkey, r->data, r->len);
+	pubkey[r->len] = 0;
+	return ecdsa_set_base64_public_key(pubkey);
+}
 
-static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *request, node_t *from, int reqno) {
+static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const key_request_t *r, node_t *from) {
 	(void)c;
 
-	switch(reqno) {
+	switch(r->reqno) {
 	case REQ_PUBKEY: {
-		char *pubkey = ecdsa_get_base64_public_key(mesh->private_key);
-
 		if(!from->nexthop || !from->nexthop->connection) {
 			return false;
 		}
 
-		if(!node_read_public_key(mesh, from)) {
-			char hiskey[MAX_STRING_SIZE];
-
-			if(sscanf(request, "%*d %*s %*s %*d " MAX_STRING, hiskey) == 1) {
-				from->ecdsa = ecdsa_set_base64_public_key(hiskey);
+		if(!node_read_public_key(mesh, from) && r->len) {
+			from->ecdsa = get_public_key(r);
 
-				if(!from->ecdsa) {
-					logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_PUBKEY", from->name, "invalid pubkey");
-					return true;
-				}
+			if(!from->ecdsa) {
+				logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_PUBKEY", from->name, "invalid pubkey");
+				return true;
 			}
 		}
 
-		send_request(mesh, from->nexthop->connection, NULL, "%d %s %s %d %s", REQ_KEY, mesh->self->name, from->name, ANS_PUBKEY, pubkey);
+		char *pubkey = ecdsa_get_base64_public_key(mesh->private_key);
+		send_key_request(mesh, from, ANS_PUBKEY, pubkey, strlen(pubkey));
 		free(pubkey);
 		return true;
 	}
@@ -136,9 +216,7 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 			return true;
 		}
 
-		char pubkey[MAX_STRING_SIZE];
-
-		if(sscanf(request, "%*d %*s %*s %*d " MAX_STRING, pubkey) != 1 || !(from->ecdsa = ecdsa_set_base64_public_key(pubkey))) {
+		if(!(from->ecdsa = get_public_key(r))) {
 			logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ANS_PUBKEY", from->name, "invalid pubkey");
 			return true;
 		}
@@ -165,7 +243,7 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 	case REQ_KEY: {
 		if(!node_read_public_key(mesh, from)) {
 			logger(mesh, MESHLINK_DEBUG, "No ECDSA key known for %s", from->name);
-			send_request(mesh, from->nexthop->connection, NULL, "%d %s %s %d", REQ_KEY, mesh->self->name, from->name, REQ_PUBKEY);
+			send_key_request(mesh, from, REQ_PUBKEY, NULL, 0);
 			return true;
 		}
 
@@ -178,10 +256,7 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 			}
 		}
 
-		char buf[MAX_STRING_SIZE];
-		int len;
-
-		if(sscanf(request, "%*d %*s %*s %*d " MAX_STRING, buf) != 1 || !(len = b64decode(buf, buf, strlen(buf)))) {
+		if(!r->len) {
 			logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_SPTPS_START", from->name, "invalid SPTPS data");
 			return true;
 		}
@@ -198,7 +273,7 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 			return true;
 		}
 
-		if(!sptps_receive_data(&from->sptps, buf, len)) {
+		if(!sptps_receive_data(&from->sptps, r->data, r->len)) {
 			logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", from->name, strerror(errno));
 			return true;
 		}
@@ -212,15 +287,12 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 			return true;
 		}
 
-		char buf[MAX_STRING_SIZE];
-		int len;
-
-		if(sscanf(request, "%*d %*s %*s %*d " MAX_STRING, buf) != 1 || !(len = b64decode(buf, buf, strlen(buf)))) {
+		if(!r->len) {
 			logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_SPTPS", from->name, "invalid SPTPS data");
 			return true;
 		}
 
-		if(!sptps_receive_data(&from->sptps, buf, len)) {
+		if(!sptps_receive_data(&from->sptps, r->data, r->len)) {
 			logger(mesh, MESHLINK_ERROR, "Could not process SPTPS data from %s: %s", from->name, strerror(errno));
 			return true;
 		}
@@ -229,43 +301,32 @@ static bool req_key_ext_h(meshlink_handle_t *mesh, connection_t *c, const char *
 	}
 
 	default:
-		logger(mesh, MESHLINK_ERROR, "Unknown extended REQ_KEY request from %s: %s", from->name, request);
+		logger(mesh, MESHLINK_ERROR, "Unknown extended REQ_KEY request %d from %s", r->reqno, from->name);
 		return true;
 	}
 }
 
-bool req_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
-	assert(request);
-	assert(*request);
-
-	char from_name[MAX_STRING_SIZE];
-	char to_name[MAX_STRING_SIZE];
+static bool req_key(meshlink_handle_t *mesh, connection_t *c, const key_request_t *r, const dual_request_t *request) {
 	node_t *from, *to;
-	int reqno = 0;
-
-	if(sscanf(request, "%*d " MAX_STRING " " MAX_STRING " %d", from_name, to_name, &reqno) < 2) {
-		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "REQ_KEY", c->name);
-		return false;
-	}
 
-	if(!check_id(from_name) || !check_id(to_name)) {
+	if(!check_id(r->from_name) || !check_id(r->to_name)) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "REQ_KEY", c->name, "invalid name");
 		return false;
 	}
 
-	from = lookup_node(mesh, from_name);
+	from = lookup_node(mesh, r->from_name);
 
 	if(!from) {
 		logger(mesh, MESHLINK_ERROR, "Got %s from %s origin %s which does not exist in our connection list",
-		       "REQ_KEY", c->name, from_name);
+		       "REQ_KEY", c->name, r->from_name);
 		return true;
 	}
 
-	to = lookup_node(mesh, to_name);
+	to = lookup_node(mesh, r->to_name);
 
 	if(!to) {
 		logger(mesh, MESHLINK_ERROR, "Got %s from %s destination %s which does not exist in our connection list",
-		       "REQ_KEY", c->name, to_name);
+		       "REQ_KEY", c->name, r->to_name);
 		return true;
 	}
 
@@ -273,8 +334,8 @@ bool req_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	if(to == mesh->self) {                      /* Yes */
 		/* Is this an extended REQ_KEY message? */
-		if(reqno) {
-			return req_key_ext_h(mesh, c, request, from, reqno);
+		if(r->reqno) {
+			return req_key_ext_h(mesh, c, r, from);
 		}
 
 		/* This should never happen. Ignore it, unless it came directly from the connected peer, in which case we disconnect. */
@@ -282,53 +343,174 @@ bool req_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	} else {
 		if(!to->status.reachable) {
 			logger(mesh, MESHLINK_WARNING, "Got %s from %s destination %s which is not reachable",
-			       "REQ_KEY", c->name, to_name);
+			       "REQ_KEY", c->name, r->to_name);
 			return true;
 		}
 
-		send_request(mesh, to->nexthop->connection, NULL, "%s", request);
+		send_dual_request(mesh, to->nexthop->connection, NULL, request);
 	}
 
 	return true;
 }
 
-bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
+bool req_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	assert(request);
 	assert(*request);
 
 	char from_name[MAX_STRING_SIZE];
 	char to_name[MAX_STRING_SIZE];
-	char key[MAX_STRING_SIZE];
-	char address[MAX_STRING_SIZE] = "";
-	char port[MAX_STRING_SIZE] = "";
-	int cipher, digest, maclength, compression;
-	node_t *from, *to;
+	uint8_t data[MAXBUFSIZE];
+	key_request_t r = {.from_name = from_name, .to_name = to_name};
+	int offset = 0;
 
-	if(sscanf(request, "%*d "MAX_STRING" "MAX_STRING" "MAX_STRING" %d %d %d %d "MAX_STRING" "MAX_STRING,
-	                from_name, to_name, key, &cipher, &digest, &maclength,
-	                &compression, address, port) < 7) {
-		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ANS_KEY", c->name);
+	if(sscanf(request, "%*d " MAX_STRING " " MAX_STRING " %d %n", from_name, to_name, &r.reqno, &offset) < 2) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "REQ_KEY", c->name);
+		return false;
+	}
+
+	/* An invalid payload is left out, and reported by the destination */
+
+	if(offset && request[offset]) {
+		const char *payload = request + offset;
+		size_t len = strcspn(payload, " ");
+
+		if(!key_request_has_sptps_data(r.reqno)) {
+			r.data = payload;
+			r.len = len;
+		} else if(len * 3 / 4 <= sizeof(data)) {
+			r.data = data;
+			r.len = b64decode(payload, data, len);
+		}
+	}
+
+	dual_request_t dual = {.reqno = REQ_KEY, .fields = &r, .format_text = format_key_request, .format_binary = pack_key_request, .text = request};
+	return req_key(mesh, c, &r, &dual);
+}
+
+bool req_key_binary_h(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	char from_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	key_request_t r = {.from_name = from_name, .to_name = to_name};
+
+	packmsg_input_t in = {data, len};
+	packmsg_skip_element(&in);
+	packmsg_get_str_copy(&in, from_name, sizeof(from_name));
+	packmsg_get_str_copy(&in, to_name, sizeof(to_name));
+	r.reqno = packmsg_get_int32(&in);
+
+	if(packmsg_input_ok(&in) && !packmsg_done(&in)) {
+		r.len = packmsg_get_bin_raw(&in, &r.data);
+	}
+
+	if(!packmsg_input_ok(&in)) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "REQ_KEY", c->name);
 		return false;
 	}
 
-	if(!check_id(from_name) || !check_id(to_name)) {
+	dual_request_t dual = {.reqno = REQ_KEY, .fields = &r, .format_text = format_key_request, .format_binary = pack_key_request, .binary = data, .binary_len = len};
+	return req_key(mesh, c, &r, &dual);
+}
+
+/* The fields of an ANS_KEY request */
+
+typedef struct ans_key_request_t {
+	const char *from_name;
+	const char *to_name;
+	const void *key;        /* SPTPS data, if any */
+	uint32_t keylen;
+	int compression;
+	sockaddr_t address;     /* Reflexive UDP address of the from node, AF_UNSPEC if not known */
+} ans_key_request_t;
+
+static int format_ans_key(const void *fields, char *buf, size_t size) {
+	const ans_key_request_t *r = fields;
+	int len = snprintf(buf, size, "%d %s %s ", ANS_KEY, r->from_name, r->to_name);
+
+	if(len < 0 || (size_t)len + r->keylen * 4 / 3 + 4 > size) {
+		return -1;
+	}
+
+	if(r->keylen) {
+		b64encode(r->key, buf + len, r->keylen);
+		len += strlen(buf + len);
+	} else {
+		buf[len++] = '.';
+	}
+
+	int extra = snprintf(buf + len, size - len, " -1 -1 -1 %d", r->compression);
+
+	if(extra < 0 || (size_t)(len += extra) >= size) {
+		return -1;
+	}
+
+	if(r->address.sa.sa_family != AF_UNSPEC) {
+		char *address, *port;
+		sockaddr2str(&r->address, &address, &port);
+		extra = snprintf(buf + len, size - len, " %s %s", address, port);
+		free(address);
+		free(port);
+
+		if(extra < 0) {
+			return -1;
+		}
+
+		len += extra;
+	}
+
+	return len;
+}
+
+static uint32_t pack_ans_key(const void *fields, uint8_t *buf, uint32_t size) {
+	const ans_key_request_t *r = fields;
+	packmsg_output_t out = {buf, size};
+
+	packmsg_add_uint8(&out, ANS_KEY);
+	packmsg_add_str(&out, r->from_name);
+	packmsg_add_str(&out, r->to_name);
+	packmsg_add_bin(&out, r->keylen ? r->key : "", r->keylen);
+	packmsg_add_int32(&out, r->compression);
+
+	if(r->address.sa.sa_family != AF_UNSPEC) {
+		packmsg_add_address(&out, &r->address);
+	}
+
+	return packmsg_output_ok(&out) ? packmsg_output_size(&out, buf) : 0;
+}
+
+bool send_ans_key(meshlink_handle_t *mesh, connection_t *c, const node_t *from, const node_t *to, const void *key, uint32_t keylen, const sockaddr_t *address) {
+	ans_key_request_t r = {.from_name = from->name, .to_name = to->name, .key = key, .keylen = keylen};
+
+	if(address) {
+		r.address = *address;
+	}
+
+	dual_request_t request = {.reqno = ANS_KEY, .fields = &r, .format_text = format_ans_key, .format_binary = pack_ans_key};
+	return send_dual_request(mesh, c, NULL, &request);
+}
+
+static bool ans_key(meshlink_handle_t *mesh, connection_t *c, const ans_key_request_t *r, const dual_request_t *request) {
+	node_t *from, *to;
+
+	if(!check_id(r->from_name) || !check_id(r->to_name)) {
 		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ANS_KEY", c->name, "invalid name");
 		return false;
 	}
 
-	from = lookup_node(mesh, from_name);
+	from = lookup_node(mesh, r->from_name);
 
 	if(!from) {
 		logger(mesh, MESHLINK_ERROR, "Got %s from %s origin %s which does not exist in our connection list",
-		       "ANS_KEY", c->name, from_name);
+		       "ANS_KEY", c->name, r->from_name);
 		return true;
 	}
 
-	to = lookup_node(mesh, to_name);
+	to = lookup_node(mesh, r->to_name);
 
 	if(!to) {
 		logger(mesh, MESHLINK_ERROR, "Got %s from %s destination %s which does not exist in our connection list",
-		       "ANS_KEY", c->name, to_name);
+		       "ANS_KEY", c->name, r->to_name);
 		return true;
 	}
 
@@ -337,35 +519,38 @@ bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 	if(to != mesh->self) {
 		if(!to->status.reachable) {
 			logger(mesh, MESHLINK_WARNING, "Got %s from %s destination %s which is not reachable",
-			       "ANS_KEY", c->name, to_name);
+			       "ANS_KEY", c->name, r->to_name);
 			return true;
 		}
 
 		if(from == to) {
 			logger(mesh, MESHLINK_WARNING, "Got %s from %s from %s to %s",
-			       "ANS_KEY", c->name, from_name, to_name);
+			       "ANS_KEY", c->name, r->from_name, r->to_name);
 			return true;
 		}
 
 		/* Append the known UDP address of the from node, if we have a confirmed one */
-		if(!*address && from->status.udp_confirmed && from->address.sa.sa_family != AF_UNSPEC) {
-			char *reflexive_address, *reflexive_port;
+		if(r->address.sa.sa_family == AF_UNSPEC && from->status.udp_confirmed && from->address.sa.sa_family != AF_UNSPEC) {
 			logger(mesh, MESHLINK_DEBUG, "Appending reflexive UDP address to ANS_KEY from %s to %s", from->name, to->name);
-			sockaddr2str(&from->address, &reflexive_address, &reflexive_port);
-			send_request(mesh, to->nexthop->connection, NULL, "%s %s %s", request, reflexive_address, reflexive_port);
-			free(reflexive_address);
-			free(reflexive_port);
+			ans_key_request_t reflexive = *r;
+			reflexive.address = from->address;
+			dual_request_t reflexive_request = {.reqno = ANS_KEY, .fields = &reflexive, .format_text = format_ans_key, .format_binary = pack_ans_key};
+			send_dual_request(mesh, to->nexthop->connection, NULL, &reflexive_request);
 			return true;
 		}
 
-		return send_request(mesh, to->nexthop->connection, NULL, "%s", request);
+		return send_dual_request(mesh, to->nexthop->connection, NULL, request);
 	}
 
 	/* Is this an ANS_KEY informing us of our own reflexive UDP address? */
 
 	if(from == mesh->self) {
-		if(*key == '.' && *address && *port) {
-			logger(mesh, MESHLINK_DEBUG, "Learned our own reflexive UDP address from %s: %s port %s", c->name, address, port);
+		if(!r->keylen && r->address.sa.sa_family != AF_UNSPEC) {
+			if(mesh->log_level <= MESHLINK_DEBUG) {
+				char *hostname = sockaddr2hostname(&r->address);
+				logger(mesh, MESHLINK_DEBUG, "Learned our own reflexive UDP address from %s: %s", c->name, hostname);
+				free(hostname);
+			}
 
 			/* Inform all other nodes we want to communicate with and which are reachable via this connection */
 			for splay_each(node_t, n, mesh->nodes) {
@@ -382,11 +567,11 @@ bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 				}
 
 				logger(mesh, MESHLINK_DEBUG, "Forwarding our own reflexive UDP address to %s", n->name);
-				send_request(mesh, c, NULL, "%d %s %s . -1 -1 -1 0 %s %s", ANS_KEY, mesh->self->name, n->name, address, port);
+				send_ans_key(mesh, c, mesh->self, n, NULL, 0, &r->address);
 			}
 		} else {
 			logger(mesh, MESHLINK_WARNING, "Got %s from %s from %s to %s",
-			       "ANS_KEY", c->name, from_name, to_name);
+			       "ANS_KEY", c->name, r->from_name, r->to_name);
 		}
 
 		return true;
@@ -394,29 +579,30 @@ bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	/* Process SPTPS data if present */
 
-	if(*key != '.') {
+	if(r->keylen) {
 		/* Don't use key material until every check has passed. */
 		from->status.validkey = false;
 
 		/* Compression is not supported. */
-		if(compression != 0) {
+		if(r->compression != 0) {
 			logger(mesh, MESHLINK_ERROR, "Node %s uses bogus compression level!", from->name);
 			return true;
 		}
 
-		char buf[strlen(key)];
-		int len = b64decode(key, buf, strlen(key));
-
-		if(!len || !sptps_receive_data(&from->sptps, buf, len)) {
+		if(!sptps_receive_data(&from->sptps, r->key, r->keylen)) {
 			logger(mesh, MESHLINK_ERROR, "Error processing SPTPS data from %s", from->name);
 		}
 	}
 
 	if(from->status.validkey) {
-		if(*address && *port) {
-			logger(mesh, MESHLINK_DEBUG, "Using reflexive UDP address from %s: %s port %s", from->name, address, port);
-			sockaddr_t sa = str2sockaddr(address, port);
-			update_node_udp(mesh, from, &sa);
+		if(r->address.sa.sa_family != AF_UNSPEC) {
+			if(mesh->log_level <= MESHLINK_DEBUG) {
+				char *hostname = sockaddr2hostname(&r->address);
+				logger(mesh, MESHLINK_DEBUG, "Using reflexive UDP address from %s: %s", from->name, hostname);
+				free(hostname);
+			}
+
+			update_node_udp(mesh, from, &r->address);
 		}
 
 		send_mtu_probe(mesh, from);
@@ -424,3 +610,68 @@ bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
 
 	return true;
 }
+
+bool ans_key_h(meshlink_handle_t *mesh, connection_t *c, const char *request) {
+	assert(request);
+	assert(*request);
+
+	char from_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	char key[MAX_STRING_SIZE];
+	char address[MAX_STRING_SIZE] = "";
+	char port[MAX_STRING_SIZE] = "";
+	uint8_t buf[MAX_STRING_SIZE];
+	int cipher, digest, maclength;
+	ans_key_request_t r = {.from_name = from_name, .to_name = to_name};
+
+	if(sscanf(request, "%*d "MAX_STRING" "MAX_STRING" "MAX_STRING" %d %d %d %d "MAX_STRING" "MAX_STRING,
+	                from_name, to_name, key, &cipher, &digest, &maclength,
+	                &r.compression, address, port) < 7) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ANS_KEY", c->name);
+		return false;
+	}
+
+	if(*key != '.') {
+		r.key = buf;
+		r.keylen = b64decode(key, buf, strlen(key));
+
+		if(!r.keylen) {
+			logger(mesh, MESHLINK_ERROR, "Got bad %s from %s: %s", "ANS_KEY", c->name, "invalid SPTPS data");
+			return true;
+		}
+	}
+
+	if(*address && *port) {
+		r.address = str2sockaddr(address, port);
+	}
+
+	dual_request_t dual = {.reqno = ANS_KEY, .fields = &r, .format_text = format_ans_key, .format_binary = pack_ans_key, .text = request};
+	return ans_key(mesh, c, &r, &dual);
+}
+
+bool ans_key_binary_h(meshlink_handle_t *mesh, connection_t *c, const uint8_t *data, uint32_t len) {
+	assert(data);
+
+	char from_name[MAX_STRING_SIZE];
+	char to_name[MAX_STRING_SIZE];
+	ans_key_request_t r = {.from_name = from_name, .to_name = to_name};
+
+	packmsg_input_t in = {data, len};
+	packmsg_skip_element(&in);
+	packmsg_get_str_copy(&in, from_name, sizeof(from_name));
+	packmsg_get_str_copy(&in, to_name, sizeof(to_name));
+	r.keylen = packmsg_get_bin_raw(&in, &r.key);
+	r.compression = packmsg_get_int32(&in);
+
+	if(packmsg_input_ok(&in) && !packmsg_done(&in)) {
+		r.address = packmsg_get_address(&in);
+	}
+
+	if(!packmsg_input_ok(&in)) {
+		logger(mesh, MESHLINK_ERROR, "Got bad %s from %s", "ANS_KEY", c->name);
+		return false;
+	}
+
+	dual_request_t dual = {.reqno = ANS_KEY, .fields = &r, .format_text = format_ans_key, .format_binary = pack_ans_key, .binary = data, .binary_len = len};
+	return ans_key(mesh, c, &r, &dual);
+}
@@ -25,10 +25,10 @@
 #include "route.h"
 #include "utils.h"
 
-static bool checklength(node_t *source, vpn_packet_t *packet, uint16_t length) {
+static bool checklength(node_t *source, uint16_t len, uint16_t length) {
 	assert(length);
 
-	if(packet->len < length) {
+	if(len < length) {
 		logger(source->mesh, MESHLINK_WARNING, "Got too short packet from %s", source->name);
 		return false;
 	} else {
@@ -36,46 +36,44 @@ static bool checklength(node_t *source, vpn_packet_t *packet, uint16_t length) {
 	}
 }
 
-void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
-	assert(source);
+static node_t *lookup_destination(meshlink_handle_t *mesh, node_t *source, const void *data, uint16_t len) {
+	//Check Length
+	if(!checklength(source, len, sizeof(meshlink_packethdr_t))) {
+		return NULL;
+	}
 
 	// TODO: route on name or key
 
-	meshlink_packethdr_t *hdr = (meshlink_packethdr_t *) packet->data;
+	const meshlink_packethdr_t *hdr = data;
 	node_t *dest = lookup_node(mesh, (char *)hdr->destination);
 	logger(mesh, MESHLINK_DEBUG, "Routing packet from \"%s\" to \"%s\"\n", hdr->source, hdr->destination);
 
-	//Check Length
-	if(!checklength(source, packet, sizeof(*hdr))) {
-		return;
-	}
-
 	if(dest == NULL) {
 		//Lookup failed
 		logger(mesh, MESHLINK_WARNING, "Can't lookup the destination of a packet in the route() function. This should never happen!\n");
 		logger(mesh, MESHLINK_WARNING, "Destination was: %s\n", hdr->destination);
-		return;
+		return NULL;
 	}
 
-	if(dest == mesh->self) {
-		const void *payload = packet->data + sizeof(*hdr);
-		size_t len = packet->len - sizeof(*hdr);
-
-		char hex[len * 2 + 1];
+	return dest;
+}
 
-		if(mesh->log_level <= MESHLINK_DEBUG) {
-			bin2hex(payload, hex, len);        // don't do this unless it's going to be logged
-		}
+static void receive_local(meshlink_handle_t *mesh, node_t *source, const void *data, uint16_t len) {
+	const void *payload = (const uint8_t *)data + sizeof(meshlink_packethdr_t);
+	len -= sizeof(meshlink_packethdr_t);
 
+	if(mesh->log_level <= MESHLINK_DEBUG) {
+		char hex[len * 2 + 1];
+		bin2hex(payload, hex, len);        // don't do this unless it's going to be logged
 		logger(mesh, MESHLINK_DEBUG, "I received a packet for me with payload: %s\n", hex);
+	}
 
-		if(mesh->receive_cb) {
-			mesh->receive_cb(mesh, (meshlink_node_t *)source, payload, len);
-		}
-
-		return;
+	if(mesh->receive_cb) {
+		mesh->receive_cb(mesh, (meshlink_node_t *)source, payload, len);
 	}
+}
 
+static void forward(meshlink_handle_t *mesh, node_t *source, node_t *dest, vpn_packet_t *packet) {
 	if(!dest->status.reachable) {
 		//TODO: check what to do here, not just print a warning
 		logger(mesh, MESHLINK_WARNING, "The destination of a packet in the route() function is unreachable. Dropping packet.\n");
@@ -88,5 +86,45 @@ void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
 	}
 
 	send_packet(mesh, dest, packet);
-	return;
+}
+
+void route(meshlink_handle_t *mesh, node_t *source, vpn_packet_t *packet) {
+	assert(source);
+
+	node_t *dest = lookup_destination(mesh, source, packet->data, packet->len);
+
+	if(!dest) {
+		return;
+	}
+
+	if(dest == mesh->self) {
+		receive_local(mesh, source, packet->data, packet->len);
+		return;
+	}
+
+	forward(mesh, source, dest, packet);
+}
+
+void route_received(meshlink_handle_t *mesh, node_t *source, const void *data, uint16_t len) {
+	assert(source);
+
+	node_t *dest = lookup_destination(mesh, source, data, len);
+
+	if(!dest) {
+		return;
+	}
+
+	if(dest == mesh->self) {
+		receive_local(mesh, source, data, len);
+		return;
+	}
+
+	// Only packets that have to be forwarded need to be copied.
+	vpn_packet_t packet;
+	packet.probe = false;
+	packet.tcp = false;
+	packet.len = len;
+	memcpy(packet.data, data, len);
+
+	forward(mesh, source, dest, &packet);
 }
@@ -25,4 +25,9 @@
 
 void route(struct meshlink_handle *mesh, struct node_t *, struct vpn_packet_t *);
 
+/* Route a packet received from another node without copying it first.
+ * The data only has to remain valid until this function returns.
+ */
+void route_received(struct meshlink_handle *mesh, struct node_t *, const void *data, uint16_t len);
+
 #endif
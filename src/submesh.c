@@ -20,6 +20,7 @@
 #include "system.h"
 
 #include "hash.h"
+#include "list.h"
 #include "logger.h"
 #include "meshlink_internal.h"
 #include "net.h"
@@ -31,10 +32,13 @@
 #include "protocol.h"
 
 static submesh_t *new_submesh(void) {
-	return xzalloc(sizeof(submesh_t));
+	submesh_t *s = xzalloc(sizeof(submesh_t));
+	s->connections = list_alloc(NULL);
+	return s;
 }
 
 static void free_submesh(submesh_t *s) {
+	list_delete_list(s->connections);
 	free(s->name);
 	free(s);
 }
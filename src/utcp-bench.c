@@ -0,0 +1,644 @@
+/*
+    utcp-bench.c -- Benchmark for UTCP connection management
+    Copyright (C) 2014-2020 Guus Sliepen <guus@tinc-vpn.org>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License along
+    with this program; if not, write to the Free Software Foundation, Inc.,
+    51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+*/
+
+/* Two UTCP instances are connected back to back in memory.
+ *
+ * In connections mode, the client opens a batch of connections, waits until they are all established,
+ * and then aborts them again, until the requested total number of connections has been reached.
+ *
+ * In throughput mode, packets are delayed by the given amount of milliseconds in each direction,
+ * and the client sends the given number of bytes to the server over a single connection.
+ *
+ * In fec mode, the client sends frames over an unreliable connection, packets are dropped with the given probability,
+ * and the server checks how many frames arrive intact, with forward error correction using the given group size.
+ *
+ * In priority mode, packets go over a link with the given rate in kB/s and delay in milliseconds,
+ * with a drop-tail queue of 64 kB. The client runs a bulk transfer on one connection,
+ * and at the same time sends requests of the given size on another connection, which the server echoes back.
+ * This is done once with both connections in the same priority class, and once with the requests in a higher class.
+ *
+ * Usage: utcp-bench connections [total [batch]]
+ *        utcp-bench throughput [size [delay]]
+ *        utcp-bench fec [loss [group [frames [size]]]]
+ *        utcp-bench priority [requests [size [rate [delay]]]]
+ */
+
+#include "system.h"
+#include <time.h>
+
+#include "utcp.h"
+
+struct packet {
+	struct packet *next;
+	struct utcp *to;
+	struct timespec due;
+	size_t len;
+	char data[];
+};
+
+static struct packet *head;
+static struct packet **tail = &head;
+static struct utcp *client;
+static struct utcp *server;
+static long established;
+static long accepted;
+static long packets;
+static long delay; // usec
+static size_t sent;
+static size_t received;
+static size_t total_size;
+static double loss;
+static long frames;
+static struct utcp_connection *receiver;
+static long rate; // bytes per second, 0 if unlimited
+static double link_busy[2]; // Until when the link in each direction is busy sending earlier packets
+static long dropped;
+static long requests;
+static size_t request_size;
+static size_t response_received;
+static double request_start;
+static double request_total;
+static double request_max;
+
+#define QUEUE_LIMIT 65536
+
+static bool before(const struct timespec *a, const struct timespec *b) {
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static ssize_t do_send(struct utcp *utcp, const void *data, size_t len) {
+	if(loss && drand48() < loss) {
+		return len;
+	}
+
+	struct packet *pkt = malloc(sizeof(*pkt) + len);
+
+	if(!pkt) {
+		return -1;
+	}
+
+	pkt->to = utcp == client ? server : client;
+	clock_gettime(CLOCK_MONOTONIC, &pkt->due);
+
+	if(rate) {
+		// Packets have to wait until the link has sent the ones before it.
+		double t = pkt->due.tv_sec + pkt->due.tv_nsec * 1e-9;
+		double *busy = &link_busy[utcp == client];
+
+		if(*busy < t) {
+			*busy = t;
+		}
+
+		if((*busy - t) * rate > QUEUE_LIMIT) {
+			free(pkt);
+			dropped++;
+			return len;
+		}
+
+		*busy += (double)len / rate;
+		pkt->due.tv_sec = *busy;
+		pkt->due.tv_nsec = (*busy - pkt->due.tv_sec) * 1e9;
+	}
+
+	pkt->due.tv_nsec += delay * 1000;
+
+	while(pkt->due.tv_nsec >= 1000000000) {
+		pkt->due.tv_sec++;
+		pkt->due.tv_nsec -= 1000000000;
+	}
+
+	pkt->len = len;
+	memcpy(pkt->data, data, len);
+
+	// With a rate limit, packets in one direction can overtake those in the other direction.
+	struct packet **p = tail;
+
+	if(rate) {
+		for(p = &head; *p && !before(&pkt->due, &(*p)->due); p = &(*p)->next) {}
+	}
+
+	pkt->next = *p;
+	*p = pkt;
+
+	if(!pkt->next) {
+		tail = &pkt->next;
+	}
+
+	packets++;
+
+	return len;
+}
+
+static bool due(const struct packet *pkt) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec > pkt->due.tv_sec || (now.tv_sec == pkt->due.tv_sec && now.tv_nsec >= pkt->due.tv_nsec);
+}
+
+static void deliver(void) {
+	while(head && ((!delay && !rate) || due(head))) {
+		struct packet *pkt = head;
+		head = pkt->next;
+
+		if(!head) {
+			tail = &head;
+		}
+
+		utcp_recv(pkt->to, pkt->data, pkt->len);
+		free(pkt);
+	}
+}
+
+static ssize_t server_recv(struct utcp_connection *c, const void *data, size_t len) {
+	if(!data && !len) {
+		utcp_close(c);
+	}
+
+	return len;
+}
+
+static ssize_t client_recv(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+	(void)data;
+	return len;
+}
+
+static void client_poll(struct utcp_connection *c, size_t len) {
+	(void)len;
+
+	// The poll callback is called once the connection is established.
+	if(c->priv) {
+		established++;
+		c->priv = NULL;
+	}
+
+	utcp_set_poll_cb(c, NULL);
+}
+
+static void do_accept(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+	accepted++;
+	utcp_accept(c, server_recv, NULL);
+}
+
+static ssize_t sink_recv(struct utcp_connection *c, const void *data, size_t len) {
+	(void)data;
+
+	if(!len) {
+		utcp_close(c);
+	}
+
+	received += len;
+	return len;
+}
+
+static void sink_accept(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+	utcp_accept(c, sink_recv, NULL);
+}
+
+static void source_poll(struct utcp_connection *c, size_t len) {
+	static const char buf[65536];
+
+	while(len && sent < total_size) {
+		size_t todo = len;
+
+		if(todo > sizeof(buf)) {
+			todo = sizeof(buf);
+		}
+
+		if(todo > total_size - sent) {
+			todo = total_size - sent;
+		}
+
+		ssize_t result = utcp_send(c, buf, todo);
+
+		if(result <= 0) {
+			break;
+		}
+
+		sent += result;
+		len -= result;
+	}
+}
+
+static void fill_frame(char *buf, size_t len, uint32_t n) {
+	for(size_t i = 0; i < len; i++) {
+		buf[i] = n * 31 + i;
+	}
+}
+
+static ssize_t frame_recv(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(!data) {
+		return len;
+	}
+
+	char buf[len];
+	fill_frame(buf, len, ((const uint8_t *)data)[0] - 1);
+
+	if(len != total_size || memcmp((const char *)data + 1, buf + 1, len - 1)) {
+		fprintf(stderr, "Received corrupted frame\n");
+		abort();
+	}
+
+	frames++;
+	return len;
+}
+
+static void frame_accept(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+	utcp_accept(c, frame_recv, NULL);
+	receiver = c;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void send_request(struct utcp_connection *c) {
+	static const char buf[65536];
+
+	response_received = 0;
+	request_start = now();
+
+	if(utcp_send(c, buf, request_size) != (ssize_t)request_size) {
+		fprintf(stderr, "Could not send request: %s\n", strerror(errno));
+		abort();
+	}
+}
+
+static ssize_t response_recv(struct utcp_connection *c, const void *data, size_t len) {
+	(void)data;
+
+	if(!len) {
+		return 0;
+	}
+
+	response_received += len;
+
+	if(response_received == request_size) {
+		double elapsed = now() - request_start;
+		request_total += elapsed;
+
+		if(elapsed > request_max) {
+			request_max = elapsed;
+		}
+
+		if(--requests) {
+			send_request(c);
+		}
+	}
+
+	return len;
+}
+
+static ssize_t echo_recv(struct utcp_connection *c, const void *data, size_t len) {
+	if(!len) {
+		utcp_close(c);
+		return 0;
+	}
+
+	if(utcp_send(c, data, len) != (ssize_t)len) {
+		fprintf(stderr, "Could not echo request: %s\n", strerror(errno));
+		abort();
+	}
+
+	return len;
+}
+
+static void mixed_accept(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+	utcp_accept(c, port == 1 ? sink_recv : echo_recv, NULL);
+}
+
+static int throughput(size_t size) {
+	total_size = size;
+	client = utcp_init(NULL, NULL, do_send, NULL);
+	server = utcp_init(sink_accept, NULL, do_send, NULL);
+
+	if(!client || !server) {
+		fprintf(stderr, "Could not initialize UTCP\n");
+		return 1;
+	}
+
+	struct utcp_connection *c = utcp_connect(client, 1, client_recv, NULL);
+
+	if(!c) {
+		fprintf(stderr, "Could not open connection: %s\n", strerror(errno));
+		return 1;
+	}
+
+	utcp_set_poll_cb(c, source_poll);
+
+	double start = now();
+
+	while(received < size) {
+		deliver();
+		utcp_timeout(client);
+		utcp_timeout(server);
+
+		if(!utcp_is_active(client)) {
+			fprintf(stderr, "Connection closed prematurely\n");
+			return 1;
+		}
+
+		if(head && !due(head)) {
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &head->due, NULL);
+		}
+	}
+
+	double elapsed = now() - start;
+
+	printf("%lu bytes, delay %ld ms, sndbuf %lu, %ld packets\n", (unsigned long)size, delay / 1000, (unsigned long)utcp_get_sndbuf(c), packets);
+	printf("%.3f s, %.3f MB/s\n", elapsed, size / elapsed / 1e6);
+
+	utcp_close(c);
+	utcp_exit(client);
+	utcp_exit(server);
+
+	return 0;
+}
+
+static int fec(double p, uint32_t group, long count, size_t size) {
+	total_size = size;
+	client = utcp_init(NULL, NULL, do_send, NULL);
+	server = utcp_init(frame_accept, NULL, do_send, NULL);
+
+	if(!client || !server) {
+		fprintf(stderr, "Could not initialize UTCP\n");
+		return 1;
+	}
+
+	struct utcp_connection *c = utcp_connect_ex(client, 1, client_recv, NULL, UTCP_UDP);
+
+	if(!c) {
+		fprintf(stderr, "Could not open connection: %s\n", strerror(errno));
+		return 1;
+	}
+
+	utcp_set_fec(c, group);
+	deliver();
+	utcp_timeout(client);
+	deliver();
+
+	// Only start dropping packets once the connection is established.
+	srand48(1);
+	loss = p;
+
+	char buf[size];
+
+	for(long i = 0; i < count; i++) {
+		// The first byte tells the receiver which frame this is.
+		fill_frame(buf, size, i);
+		buf[0] = i + 1;
+
+		if(utcp_send(c, buf, size) != (ssize_t)size) {
+			fprintf(stderr, "Could not send frame %ld: %s\n", i, strerror(errno));
+			return 1;
+		}
+
+		deliver();
+	}
+
+	// Send one more frame, so the receiver gives up on the last one if it is incomplete.
+	fill_frame(buf, size, count);
+	buf[0] = count + 1;
+	loss = 0;
+
+	if(utcp_send(c, buf, size) != (ssize_t)size) {
+		return 1;
+	}
+
+	deliver();
+
+	printf("%ld frames of %lu bytes, %.2f%% loss, group size %u, %ld packets\n", count, (unsigned long)size, p * 100, group, packets);
+	printf("%ld delivered, %u recovered, %u lost\n", frames - 1, utcp_get_fec_recovered(receiver), utcp_get_fec_lost(receiver));
+
+	utcp_close(c);
+	utcp_exit(client);
+	utcp_exit(server);
+
+	return 0;
+}
+
+static int prioritize(long count, size_t size, int priority) {
+	total_size = SIZE_MAX;
+	sent = 0;
+	received = 0;
+	requests = count;
+	request_size = size;
+	request_total = 0;
+	request_max = 0;
+	link_busy[0] = link_busy[1] = 0;
+	dropped = 0;
+	packets = 0;
+
+	client = utcp_init(NULL, NULL, do_send, NULL);
+	server = utcp_init(mixed_accept, NULL, do_send, NULL);
+
+	if(!client || !server) {
+		fprintf(stderr, "Could not initialize UTCP\n");
+		return 1;
+	}
+
+	struct utcp_connection *bulk = utcp_connect(client, 1, client_recv, NULL);
+	struct utcp_connection *c = utcp_connect(client, 2, response_recv, NULL);
+
+	if(!bulk || !c) {
+		fprintf(stderr, "Could not open connection: %s\n", strerror(errno));
+		return 1;
+	}
+
+	utcp_set_priority(c, priority, 1);
+	utcp_set_poll_cb(bulk, source_poll);
+
+	// Give the bulk transfer some time to fill up the link before sending requests.
+	double start = now();
+	bool started = false;
+
+	while(requests) {
+		deliver();
+		utcp_timeout(client);
+		utcp_timeout(server);
+
+		if(!started && now() - start > 1) {
+			send_request(c);
+			started = true;
+		}
+
+		if(!utcp_is_active(client)) {
+			fprintf(stderr, "Connection closed prematurely\n");
+			return 1;
+		}
+
+		if(head && !due(head)) {
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &head->due, NULL);
+		}
+	}
+
+	double elapsed = now() - start;
+
+	printf("request priority %d: %ld requests of %lu bytes, %ld packets, %ld dropped\n", priority, count, (unsigned long)size, packets, dropped);
+	printf("response time avg %.3f ms, max %.3f ms, bulk %.3f MB/s\n", request_total / count * 1e3, request_max * 1e3, received / elapsed / 1e6);
+
+	utcp_exit(client);
+	utcp_exit(server);
+
+	// Throw away packets still in flight.
+	while(head) {
+		struct packet *pkt = head;
+		head = pkt->next;
+		free(pkt);
+	}
+
+	tail = &head;
+
+	return 0;
+}
+
+static int connections(long total, long batch) {
+	client = utcp_init(NULL, NULL, do_send, NULL);
+	server = utcp_init(do_accept, NULL, do_send, NULL);
+
+	if(!client || !server) {
+		fprintf(stderr, "Could not initialize UTCP\n");
+		return 1;
+	}
+
+	struct utcp_connection **c = calloc(batch, sizeof(*c));
+
+	if(!c) {
+		return 1;
+	}
+
+	double open_time = 0;
+	double close_time = 0;
+
+	for(long done = 0; done < total; done += batch) {
+		long n = total - done < batch ? total - done : batch;
+		long expected = established + n;
+
+		double start = now();
+
+		for(long i = 0; i < n; i++) {
+			// Spread connections over several destination ports, since there are only 32768 source ports.
+			c[i] = utcp_connect(client, 1 + i % 16, client_recv, &c[i]);
+
+			if(!c[i]) {
+				fprintf(stderr, "Could not open connection %ld: %s\n", done + i, strerror(errno));
+				return 1;
+			}
+
+			utcp_set_poll_cb(c[i], client_poll);
+			deliver();
+		}
+
+		utcp_timeout(client);
+		utcp_timeout(server);
+
+		if(established != expected) {
+			fprintf(stderr, "Only %ld out of %ld connections established\n", established, expected);
+			return 1;
+		}
+
+		double mid = now();
+
+		for(long i = 0; i < n; i++) {
+			utcp_abort(c[i]);
+			deliver();
+		}
+
+		// Reap closed connections
+		utcp_timeout(client);
+		utcp_timeout(server);
+
+		if(utcp_is_active(client) || utcp_is_active(server)) {
+			fprintf(stderr, "Connections still active after closing\n");
+			return 1;
+		}
+
+		double end = now();
+
+		open_time += mid - start;
+		close_time += end - mid;
+	}
+
+	printf("%ld connections (batch size %ld), %ld accepted, %ld packets\n", total, batch, accepted, packets);
+	printf("open:  %.3f s, %.0f connections/s\n", open_time, total / open_time);
+	printf("close: %.3f s, %.0f connections/s\n", close_time, total / close_time);
+
+	free(c);
+	utcp_exit(client);
+	utcp_exit(server);
+
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	if(argc > 1 && !strcmp(argv[1], "connections")) {
+		long total = argc > 2 ? atol(argv[2]) : 100000;
+		long batch = argc > 3 ? atol(argv[3]) : 10000;
+
+		if(total > 0 && batch > 0) {
+			return connections(total, batch);
+		}
+	} else if(argc > 1 && !strcmp(argv[1], "throughput")) {
+		long size = argc > 2 ? atol(argv[2]) : 100000000;
+		delay = (argc > 3 ? atol(argv[3]) : 10) * 1000;
+
+		if(size > 0 && delay > 0) {
+			return throughput(size);
+		}
+	} else if(argc > 1 && !strcmp(argv[1], "fec")) {
+		double p = argc > 2 ? atof(argv[2]) : 0.01;
+		long group = argc > 3 ? atol(argv[3]) : 4;
+		long count = argc > 4 ? atol(argv[4]) : 10000;
+		long size = argc > 5 ? atol(argv[5]) : 8000;
+
+		if(p >= 0 && p < 1 && group >= 0 && count > 0 && size > 1 && size <= 65536) {
+			return fec(p, group, count, size);
+		}
+	} else if(argc > 1 && !strcmp(argv[1], "priority")) {
+		long count = argc > 2 ? atol(argv[2]) : 100;
+		long size = argc > 3 ? atol(argv[3]) : 16384;
+		rate = (argc > 4 ? atol(argv[4]) : 10000) * 1000;
+		delay = (argc > 5 ? atol(argv[5]) : 10) * 1000;
+
+		if(count > 0 && size > 0 && size <= 65536 && rate > 0 && delay >= 0) {
+			return prioritize(count, size, 0) || prioritize(count, size, 1);
+		}
+	}
+
+	fprintf(stderr, "Usage: %s connections [total [batch]]\n", argv[0]);
+	fprintf(stderr, "       %s throughput [size [delay]]\n", argv[0]);
+	fprintf(stderr, "       %s fec [loss [group [frames [size]]]]\n", argv[0]);
+	fprintf(stderr, "       %s priority [requests [size [rate [delay]]]]\n", argv[0]);
+	return 1;
+}
@@ -99,11 +99,15 @@ static ssize_t do_recv(struct utcp_connection *rc, const void *data, size_t len)
 	return write(1, data, len);
 }
 
-static void do_accept(struct utcp_connection *nc, uint16_t port) {
+static void do_accept(struct utcp_connection *nc, uint16_t port, const void *data, size_t len) {
 	(void)port;
 	utcp_accept(nc, do_recv, NULL);
 	c = nc;
 
+	if(len) {
+		do_recv(nc, data, len);
+	}
+
 	if(bufsize) {
 		utcp_set_sndbuf(c, bufsize);
 		utcp_set_rcvbuf(c, bufsize);
@@ -136,13 +136,14 @@ static void print_packet(struct utcp_connection *c, const char *dir, const void
 
 	*p = 0;
 
-	debug(c, "%s: len %lu src %u dst %u seq %u ack %u wnd %u aux %x ctl %s%s%s%s%s data %s\n",
+	debug(c, "%s: len %lu src %u dst %u seq %u ack %u wnd %u aux %x ctl %s%s%s%s%s%s data %s\n",
 	      dir, (unsigned long)len, hdr.src, hdr.dst, hdr.seq, hdr.ack, hdr.wnd, hdr.aux,
 	      hdr.ctl & SYN ? "SYN" : "",
 	      hdr.ctl & RST ? "RST" : "",
 	      hdr.ctl & FIN ? "FIN" : "",
 	      hdr.ctl & ACK ? "ACK" : "",
 	      hdr.ctl & MF ? "MF" : "",
+	      hdr.ctl & PAR ? "PAR" : "",
 	      str
 	     );
 }
@@ -156,8 +157,85 @@ static void debug_cwnd(struct utcp_connection *c) {
 #define debug_cwnd(...) do {} while(0)
 #endif
 
+// Keep track of the total amount of data in flight over all reliable connections.
+static void update_inflight(struct utcp_connection *c) {
+	int32_t inflight = 0;
+
+	if(c->flags & UTCP_RELIABLE) {
+		switch(c->state) {
+		case ESTABLISHED:
+		case CLOSE_WAIT:
+		case FIN_WAIT_1:
+		case CLOSING:
+		case LAST_ACK:
+			inflight = (int32_t)(c->snd.nxt - c->snd.una);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if(inflight < 0) {
+		inflight = 0;
+	}
+
+	c->utcp->sched.inflight += inflight - c->sched.inflight;
+	c->sched.inflight = inflight;
+}
+
+static void sched_enqueue(struct utcp_connection *c) {
+	if(c->sched.queued) {
+		return;
+	}
+
+	struct utcp *utcp = c->utcp;
+	int p = c->sched.priority;
+
+	c->sched.next = NULL;
+
+	if(utcp->sched.tail[p]) {
+		utcp->sched.tail[p]->sched.next = c;
+	} else {
+		utcp->sched.head[p] = c;
+	}
+
+	utcp->sched.tail[p] = c;
+	c->sched.queued = true;
+}
+
+static void sched_dequeue(struct utcp_connection *c) {
+	if(!c->sched.queued) {
+		return;
+	}
+
+	struct utcp *utcp = c->utcp;
+	int p = c->sched.priority;
+	struct utcp_connection *prev = NULL;
+
+	for(struct utcp_connection *i = utcp->sched.head[p]; i != c; i = i->sched.next) {
+		prev = i;
+	}
+
+	if(prev) {
+		prev->sched.next = c->sched.next;
+	} else {
+		utcp->sched.head[p] = c->sched.next;
+	}
+
+	if(utcp->sched.tail[p] == c) {
+		utcp->sched.tail[p] = prev;
+	}
+
+	c->sched.next = NULL;
+	c->sched.queued = false;
+	c->sched.turn = false;
+	c->sched.deficit = 0;
+}
+
 static void set_state(struct utcp_connection *c, enum state state) {
 	c->state = state;
+	update_inflight(c);
 
 	if(state == ESTABLISHED) {
 		timespec_clear(&c->conn_timeout);
@@ -186,75 +264,258 @@ static bool is_reliable(struct utcp_connection *c) {
 	return c->flags & UTCP_RELIABLE;
 }
 
+// Reliable connections that preserve message boundaries
+static bool is_framed(struct utcp_connection *c) {
+	return (c->flags & (UTCP_RELIABLE | UTCP_FRAMED)) == (UTCP_RELIABLE | UTCP_FRAMED);
+}
+
+// Set the features both sides support. Peers that do not keep message boundaries on reliable connections
+// treat them as a plain byte stream, so then we do the same.
+// All connections of a UTCP instance go to the same peer, so whether it understands batches is kept for the whole instance.
+static void set_features(struct utcp_connection *c, uint8_t features) {
+	c->features = features & FEATURES;
+	c->utcp->batch.peer = c->features & FEATURE_BATCH;
+
+	if(is_framed(c) && !(c->features & FEATURE_FRAMED)) {
+		debug(c, "peer does not support framed reliable connections\n");
+		c->flags &= ~UTCP_FRAMED;
+	}
+}
+
 static int32_t seqdiff(uint32_t a, uint32_t b) {
 	return a - b;
 }
 
+// Record a change in congestion state in the event log, if enabled.
+static void log_event(struct utcp_connection *c, enum utcp_event_type type) {
+	if(!c->events.ring) {
+		return;
+	}
+
+	struct utcp_event *event = &c->events.ring[c->events.count++ % c->events.size];
+	clock_gettime(CLOCK_REALTIME, &event->time);
+	event->type = type;
+	event->cwnd = c->snd.cwnd;
+	event->ssthresh = c->snd.ssthresh;
+	event->flightsize = seqdiff(c->snd.nxt, c->snd.una);
+	event->srtt = c->srtt;
+	event->rto = c->rto;
+}
+
+// Send a packet. If coalescing is enabled and the peer understands batches, small packets are held back
+// and sent together in one datagram, as a batch header followed by each packet prefixed with its 16-bit length.
+static void send_packet(struct utcp *utcp, const void *data, size_t len) {
+	if(!utcp->batch.cb || !utcp->batch.peer || BATCH_HDR_SIZE + sizeof(uint16_t) + len > utcp->mtu) {
+		// Keep the order in which packets were sent
+		utcp_flush(utcp);
+		utcp->send(utcp, data, len);
+		return;
+	}
+
+	if(utcp->batch.len + sizeof(uint16_t) + len > utcp->mtu) {
+		utcp_flush(utcp);
+	}
+
+	bool first = !utcp->batch.count;
+
+	if(first) {
+		memset(utcp->batch.buf, 0, BATCH_HDR_SIZE);
+		utcp->batch.len = BATCH_HDR_SIZE;
+	}
+
+	uint16_t seglen = len;
+	memcpy(utcp->batch.buf + utcp->batch.len, &seglen, sizeof(seglen));
+	memcpy(utcp->batch.buf + utcp->batch.len + sizeof(seglen), data, len);
+	utcp->batch.len += sizeof(seglen) + len;
+	utcp->batch.count++;
+
+	// Let the application know it has to call utcp_flush() or utcp_timeout() soon
+	if(first) {
+		utcp->batch.cb(utcp);
+	}
+}
+
+// Memory pool functions
+// Buffers get their memory in power of two sized blocks. Blocks that are freed are kept on a free list per size,
+// so they can be reused by other connections without going through malloc(). Larger blocks are not cached.
+
+static uint32_t pool_block_size(uint32_t size) {
+	if(size > POOL_MIN_BLOCK << (POOL_CLASSES - 1)) {
+		return size;
+	}
+
+	uint32_t block = POOL_MIN_BLOCK;
+
+	while(block < size) {
+		block *= 2;
+	}
+
+	return block;
+}
+
+static int pool_class(uint32_t size) {
+	uint32_t block = POOL_MIN_BLOCK;
+
+	for(int class = 0; class < POOL_CLASSES; class++, block *= 2) {
+		if(block == size) {
+			return class;
+		}
+	}
+
+	return -1;
+}
+
+static char *pool_alloc(struct utcp_pool *pool, uint32_t size) {
+	if(!pool) {
+		return malloc(size);
+	}
+
+	if(pool->limit && pool->used + size > pool->limit) {
+		errno = ENOBUFS;
+		return NULL;
+	}
+
+	int class = pool_class(size);
+	char *block;
+
+	if(class >= 0 && pool->free[class]) {
+		block = pool->free[class];
+		pool->free[class] = *(void **)block;
+		pool->cached -= size;
+	} else {
+		block = malloc(size);
+
+		if(!block) {
+			return NULL;
+		}
+	}
+
+	pool->used += size;
+	return block;
+}
+
+static void pool_free(struct utcp_pool *pool, char *block, uint32_t size) {
+	if(!pool) {
+		free(block);
+		return;
+	}
+
+	if(!block) {
+		return;
+	}
+
+	pool->used -= size;
+	int class = pool_class(size);
+
+	if(class >= 0 && pool->cached + size <= POOL_MAX_CACHED) {
+		*(void **)block = pool->free[class];
+		pool->free[class] = block;
+		pool->cached += size;
+	} else {
+		free(block);
+	}
+}
+
 // Buffer functions
 static bool buffer_wraps(struct buffer *buf) {
 	return buf->size - buf->offset < buf->used;
 }
 
+// Move the data to a new block of at least newsize bytes. The data no longer wraps afterwards.
 static bool buffer_resize(struct buffer *buf, uint32_t newsize) {
-	char *newdata = realloc(buf->data, newsize);
+	newsize = pool_block_size(newsize);
+	char *newdata = pool_alloc(buf->pool, newsize);
 
 	if(!newdata) {
 		return false;
 	}
 
-	buf->data = newdata;
-
 	if(buffer_wraps(buf)) {
-		// Shift the right part of the buffer until it hits the end of the new buffer.
 		// Old situation:
 		// [345......012]
 		// New situation:
-		// [345.........|........012]
+		// [012345.....................]
 		uint32_t tailsize = buf->size - buf->offset;
-		uint32_t newoffset = newsize - tailsize;
-		memmove(buf->data + newoffset, buf->data + buf->offset, tailsize);
-		buf->offset = newoffset;
+		memcpy(newdata, buf->data + buf->offset, tailsize);
+		memcpy(newdata + tailsize, buf->data, buf->used - tailsize);
+	} else if(buf->used) {
+		memcpy(newdata, buf->data + buf->offset, buf->used);
 	}
 
+	pool_free(buf->pool, buf->data, buf->size);
+	buf->data = newdata;
+	buf->offset = 0;
 	buf->size = newsize;
 	return true;
 }
 
-// Store data into the buffer
-static ssize_t buffer_put_at(struct buffer *buf, size_t offset, const void *data, size_t len) {
-	debug(NULL, "buffer_put_at %lu %lu %lu\n", (unsigned long)buf->used, (unsigned long)offset, (unsigned long)len);
+// Return the memory of an empty buffer to the pool.
+static void buffer_release(struct buffer *buf) {
+	pool_free(buf->pool, buf->data, buf->size);
+	buf->data = NULL;
+	buf->offset = 0;
+	buf->size = 0;
+}
 
-	// Ensure we don't store more than maxsize bytes in total
-	size_t required = offset + len;
+// Make sure the buffer can hold the required amount of data, which must not exceed maxsize.
+static bool buffer_reserve(struct buffer *buf, size_t required) {
+	if(required <= buf->size) {
+		return true;
+	}
 
-	if(required > buf->maxsize) {
-		if(offset >= buf->maxsize) {
-			return 0;
-		}
+	size_t newsize = buf->size ? 2 * buf->size : POOL_MIN_BLOCK;
+
+	while(newsize < required) {
+		newsize *= 2;
+	}
 
-		len = buf->maxsize - offset;
-		required = buf->maxsize;
+	if(newsize > buf->maxsize) {
+		newsize = buf->maxsize;
 	}
 
-	// Check if we need to resize the buffer
-	if(required > buf->size) {
-		size_t newsize = buf->size;
+	return buffer_resize(buf, newsize);
+}
+
+// The most data the buffer can hold, which is less than maxsize if the pool cannot provide a large enough block.
+static uint32_t buffer_capacity(const struct buffer *buf) {
+	const struct utcp_pool *pool = buf->pool;
 
-		if(!newsize) {
-			newsize = 4096;
-		}
+	if(!pool || !pool->limit) {
+		return buf->maxsize;
+	}
 
-		do {
-			newsize *= 2;
-		} while(newsize < required);
+	// Growing the buffer needs a new block while the old one is still in use.
+	size_t avail = pool->limit > pool->used ? pool->limit - pool->used : 0;
+	size_t block = buf->size;
 
-		if(newsize > buf->maxsize) {
-			newsize = buf->maxsize;
+	for(size_t size = POOL_MIN_BLOCK; size <= avail; size *= 2) {
+		if(size > block) {
+			block = size;
 		}
+	}
 
-		if(!buffer_resize(buf, newsize)) {
-			return -1;
+	return min(block, buf->maxsize);
+}
+
+// Store data into the buffer
+static ssize_t buffer_put_at(struct buffer *buf, size_t offset, const void *data, size_t len) {
+	debug(NULL, "buffer_put_at %lu %lu %lu\n", (unsigned long)buf->used, (unsigned long)offset, (unsigned long)len);
+
+	// Ensure we don't store more than maxsize bytes in total, or more than the pool can hold
+	size_t required = offset + len;
+	uint32_t capacity = buffer_capacity(buf);
+
+	if(required > capacity) {
+		if(offset >= capacity) {
+			return 0;
 		}
+
+		len = capacity - offset;
+		required = capacity;
+	}
+
+	if(!buffer_reserve(buf, required)) {
+		return -1;
 	}
 
 	uint32_t realoffset = buf->offset + offset;
@@ -283,6 +544,77 @@ static ssize_t buffer_put(struct buffer *buf, const void *data, size_t len) {
 	return buffer_put_at(buf, buf->used, data, len);
 }
 
+// Store as much data from the iovecs as possible, returns the total amount stored.
+static size_t buffer_putv(struct buffer *buf, const struct iovec *iov, int iovcnt) {
+	size_t total = 0;
+
+	for(int i = 0; i < iovcnt; i++) {
+		if(!iov[i].iov_len) {
+			continue;
+		}
+
+		ssize_t result = buffer_put(buf, iov[i].iov_base, iov[i].iov_len);
+
+		if(result <= 0) {
+			break;
+		}
+
+		total += result;
+
+		if((size_t)result < iov[i].iov_len) {
+			break;
+		}
+	}
+
+	return total;
+}
+
+// Read data from a file descriptor directly into the free space at the end of the buffer.
+static ssize_t buffer_read(struct buffer *buf, int fd, size_t len) {
+	uint32_t capacity = buffer_capacity(buf);
+	size_t avail = capacity > buf->used ? capacity - buf->used : 0;
+
+	if(len > avail) {
+		len = avail;
+	}
+
+	if(!len) {
+		return 0;
+	}
+
+	if(!buffer_reserve(buf, buf->used + len)) {
+		return -1;
+	}
+
+	// The free space might wrap around the end of the buffer.
+	struct iovec iov[2];
+	int iovcnt = 1;
+	uint32_t realoffset = buf->offset + buf->used;
+
+	if(realoffset >= buf->size) {
+		realoffset -= buf->size;
+	}
+
+	iov[0].iov_base = buf->data + realoffset;
+
+	if(buf->size - realoffset < len) {
+		iov[0].iov_len = buf->size - realoffset;
+		iov[1].iov_base = buf->data;
+		iov[1].iov_len = len - iov[0].iov_len;
+		iovcnt = 2;
+	} else {
+		iov[0].iov_len = len;
+	}
+
+	ssize_t result = readv(fd, iov, iovcnt);
+
+	if(result > 0) {
+		buf->used += result;
+	}
+
+	return result;
+}
+
 // Copy data from the buffer without removing it.
 static ssize_t buffer_copy(struct buffer *buf, void *data, size_t offset, size_t len) {
 	// Ensure we don't copy more than is actually stored in the buffer
@@ -312,6 +644,27 @@ static ssize_t buffer_copy(struct buffer *buf, void *data, size_t offset, size_t
 	return len;
 }
 
+// Get a pointer to data in the buffer, if it is stored contiguously.
+static const void *buffer_peek(const struct buffer *buf, size_t offset, size_t len) {
+	if(offset + len > buf->used) {
+		return NULL;
+	}
+
+	uint32_t realoffset = buf->offset + offset;
+
+	if(buf->size - buf->offset <= offset) {
+		// The offset wrapped
+		realoffset -= buf->size;
+	}
+
+	if(buf->size - realoffset < len) {
+		// The data is wrapped
+		return NULL;
+	}
+
+	return buf->data + realoffset;
+}
+
 // Copy data from the buffer without removing it.
 static ssize_t buffer_call(struct utcp_connection *c, struct buffer *buf, size_t offset, size_t len) {
 	if(!c->recv) {
@@ -369,34 +722,28 @@ static ssize_t buffer_discard(struct buffer *buf, size_t len) {
 		buf->offset -= buf->size;
 	}
 
-	if(buf->used == len) {
-		buf->offset = 0;
-	} else {
-		buf->offset += len;
-	}
-
+	buf->offset += len;
 	buf->used -= len;
 
+	if(!buf->used) {
+		buffer_release(buf);
+	}
+
 	return len;
 }
 
 static void buffer_clear(struct buffer *buf) {
 	buf->used = 0;
-	buf->offset = 0;
+	buffer_release(buf);
 }
 
-static bool buffer_set_size(struct buffer *buf, uint32_t minsize, uint32_t maxsize) {
-	if(maxsize < minsize) {
-		maxsize = minsize;
-	}
-
+static void buffer_init(struct buffer *buf, struct utcp_pool *pool, uint32_t maxsize) {
+	buf->pool = pool;
 	buf->maxsize = maxsize;
-
-	return buf->size >= minsize || buffer_resize(buf, minsize);
 }
 
 static void buffer_exit(struct buffer *buf) {
-	free(buf->data);
+	buffer_release(buf);
 	memset(buf, 0, sizeof(*buf));
 }
 
@@ -404,25 +751,33 @@ static uint32_t buffer_free(const struct buffer *buf) {
 	return buf->maxsize > buf->used ? buf->maxsize - buf->used : 0;
 }
 
-// Connections are stored in a sorted list.
-// This gives O(log(N)) lookup time, O(N log(N)) insertion time and O(N) deletion time.
+// How much data can be added right now, taking into account the memory left in the pool.
+static uint32_t buffer_room(const struct buffer *buf) {
+	uint32_t capacity = buffer_capacity(buf);
+	return capacity > buf->used ? capacity - buf->used : 0;
+}
 
-static int compare(const void *va, const void *vb) {
-	assert(va && vb);
+// Connections are stored in a dense array, which is used to iterate over all connections,
+// and are indexed by an open addressing hash table with linear probing, keyed on (src, dst).
+// This gives O(1) lookup, insertion and deletion time.
+// Deleting a connection moves the last connection of the array into its place.
 
-	const struct utcp_connection *a = *(struct utcp_connection **)va;
-	const struct utcp_connection *b = *(struct utcp_connection **)vb;
+static uint32_t connection_hash(uint16_t src, uint16_t dst) {
+	uint32_t hash = ((uint32_t)src << 16 | dst) * 0x9e3779b1UL;
+	return hash ^ (hash >> 16);
+}
 
-	assert(a && b);
+// Return the slot containing the matching connection, or the empty slot where it should be inserted.
+static struct utcp_connection **find_slot(const struct utcp *utcp, uint16_t src, uint16_t dst) {
+	uint32_t mask = utcp->tablesize - 1;
 
-	int c = (int)a->src - (int)b->src;
+	for(uint32_t i = connection_hash(src, dst) & mask;; i = (i + 1) & mask) {
+		struct utcp_connection *c = utcp->table[i];
 
-	if(c) {
-		return c;
+		if(!c || (c->src == src && c->dst == dst)) {
+			return &utcp->table[i];
+		}
 	}
-
-	c = (int)a->dst - (int)b->dst;
-	return c;
 }
 
 static struct utcp_connection *find_connection(const struct utcp *utcp, uint16_t src, uint16_t dst) {
@@ -430,26 +785,68 @@ static struct utcp_connection *find_connection(const struct utcp *utcp, uint16_t
 		return NULL;
 	}
 
-	struct utcp_connection key = {
-		.src = src,
-		.dst = dst,
-	}, *keyp = &key;
-	struct utcp_connection **match = bsearch(&keyp, utcp->connections, utcp->nconnections, sizeof(*utcp->connections), compare);
-	return match ? *match : NULL;
+	return *find_slot(utcp, src, dst);
+}
+
+static bool table_resize(struct utcp *utcp, uint32_t newsize) {
+	struct utcp_connection **newtable = calloc(newsize, sizeof(*newtable));
+
+	if(!newtable) {
+		return false;
+	}
+
+	free(utcp->table);
+	utcp->table = newtable;
+	utcp->tablesize = newsize;
+
+	for(int i = 0; i < utcp->nconnections; i++) {
+		struct utcp_connection *c = utcp->connections[i];
+		*find_slot(utcp, c->src, c->dst) = c;
+	}
+
+	return true;
+}
+
+// Remove an entry from the hash table by shifting back any entries that follow it in the same cluster.
+static void table_delete(struct utcp *utcp, struct utcp_connection **slot) {
+	uint32_t mask = utcp->tablesize - 1;
+	uint32_t hole = slot - utcp->table;
+
+	for(uint32_t i = (hole + 1) & mask; utcp->table[i]; i = (i + 1) & mask) {
+		struct utcp_connection *c = utcp->table[i];
+		uint32_t home = connection_hash(c->src, c->dst) & mask;
+
+		// Leave the entry alone if its home slot lies cyclically in (hole, i]
+		if(hole <= i ? (hole < home && home <= i) : (hole < home || home <= i)) {
+			continue;
+		}
+
+		utcp->table[hole] = c;
+		hole = i;
+	}
+
+	utcp->table[hole] = NULL;
 }
 
 static void free_connection(struct utcp_connection *c) {
 	struct utcp *utcp = c->utcp;
-	struct utcp_connection **cp = bsearch(&c, utcp->connections, utcp->nconnections, sizeof(*utcp->connections), compare);
+	struct utcp_connection **slot = find_slot(utcp, c->src, c->dst);
 
-	assert(cp);
+	assert(*slot == c);
+	assert(utcp->connections[c->index] == c);
 
-	int i = cp - utcp->connections;
-	memmove(cp, cp + 1, (utcp->nconnections - i - 1) * sizeof(*cp));
-	utcp->nconnections--;
+	table_delete(utcp, slot);
+
+	sched_dequeue(c);
+	utcp->sched.inflight -= c->sched.inflight;
+
+	struct utcp_connection *last = utcp->connections[--utcp->nconnections];
+	utcp->connections[c->index] = last;
+	last->index = c->index;
 
 	buffer_exit(&c->rcvbuf);
 	buffer_exit(&c->sndbuf);
+	free(c->events.ring);
 	free(c);
 }
 
@@ -470,7 +867,15 @@ static struct utcp_connection *allocate_connection(struct utcp *utcp, uint16_t s
 		src = rand() | 0x8000;
 
 		while(find_connection(utcp, src, dst)) {
-			src++;
+			src = (src + 1) | 0x8000;
+		}
+	}
+
+	// Keep the load factor of the hash table below 50%
+
+	if((uint32_t)(utcp->nconnections + 1) * 2 > utcp->tablesize) {
+		if(!table_resize(utcp, utcp->tablesize ? utcp->tablesize * 2 : 16)) {
+			return NULL;
 		}
 	}
 
@@ -498,16 +903,10 @@ static struct utcp_connection *allocate_connection(struct utcp *utcp, uint16_t s
 		return NULL;
 	}
 
-	if(!buffer_set_size(&c->sndbuf, DEFAULT_SNDBUFSIZE, DEFAULT_MAXSNDBUFSIZE)) {
-		free(c);
-		return NULL;
-	}
+	// Buffer memory is only allocated when there is data to store
 
-	if(!buffer_set_size(&c->rcvbuf, DEFAULT_RCVBUFSIZE, DEFAULT_MAXRCVBUFSIZE)) {
-		buffer_exit(&c->sndbuf);
-		free(c);
-		return NULL;
-	}
+	buffer_init(&c->sndbuf, utcp->pool, DEFAULT_MAXSNDBUFSIZE);
+	buffer_init(&c->rcvbuf, utcp->pool, DEFAULT_MAXRCVBUFSIZE);
 
 	// Fill in the details
 
@@ -527,12 +926,18 @@ static struct utcp_connection *allocate_connection(struct utcp *utcp, uint16_t s
 	c->srtt = 0;
 	c->rttvar = 0;
 	c->rto = START_RTO;
+	c->autotune_sndbuf = true;
+	c->autotune_rcvbuf = true;
+	c->max_bufsize = DEFAULT_MAXBUFSIZE;
+	c->msg.max = DEFAULT_MAX_MESSAGE_SIZE;
+	c->sched.weight = 1;
 	c->utcp = utcp;
 
-	// Add it to the sorted list of connections
+	// Add it to the array and the hash table
 
+	c->index = utcp->nconnections;
 	utcp->connections[utcp->nconnections++] = c;
-	qsort(utcp->connections, utcp->nconnections, sizeof(*utcp->connections), compare);
+	*find_slot(utcp, src, dst) = c;
 
 	return c;
 }
@@ -594,19 +999,29 @@ static void stop_retransmit_timer(struct utcp_connection *c) {
 	debug(c, "rtrx_timeout cleared\n");
 }
 
-struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv, uint32_t flags) {
-	struct utcp_connection *c = allocate_connection(utcp, 0, dst);
+// Send a SYN+ACK, with our own initialization parameters if the peer sent them along with its SYN.
+// The receive window to advertise. It is clamped to what the memory pool can still provide,
+// so the peer does not keep sending data that would have to be dropped.
+// It is at least one segment though, so the peer keeps probing until memory becomes available again.
+static uint32_t receive_window(const struct utcp_connection *c) {
+	uint32_t capacity = buffer_capacity(&c->rcvbuf);
 
-	if(!c) {
-		return NULL;
+	if(capacity >= c->rcvbuf.maxsize) {
+		return c->rcvbuf.maxsize;
 	}
 
-	assert((flags & ~0x1f) == 0);
+	// An incomplete message of a framed connection is stored in front of rcv.nxt.
+	uint32_t wnd = capacity > c->msg.buffered ? capacity - c->msg.buffered : 0;
+	return max(wnd, c->utcp->mss);
+}
 
-	c->flags = flags;
-	c->recv = recv;
-	c->priv = priv;
+static uint32_t advertise_window(struct utcp_connection *c) {
+	c->rcv.wnd = receive_window(c);
+	c->rcv.wnd_clamped = c->rcv.wnd < c->rcvbuf.maxsize;
+	return c->rcv.wnd;
+}
 
+static void send_synack(struct utcp_connection *c, bool init) {
 	struct {
 		struct hdr hdr;
 		uint8_t init[4];
@@ -615,19 +1030,98 @@ struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_re
 	pkt.hdr.src = c->src;
 	pkt.hdr.dst = c->dst;
 	pkt.hdr.seq = c->snd.iss;
-	pkt.hdr.ack = 0;
-	pkt.hdr.wnd = c->rcvbuf.maxsize;
-	pkt.hdr.ctl = SYN;
-	pkt.hdr.aux = 0x0101;
-	pkt.init[0] = 1;
-	pkt.init[1] = 0;
-	pkt.init[2] = 0;
-	pkt.init[3] = flags & 0x7;
+	pkt.hdr.ack = c->rcv.nxt;
+	pkt.hdr.wnd = advertise_window(c);
+	pkt.hdr.ctl = SYN | ACK;
+
+	if(init) {
+		pkt.hdr.aux = 0x0101;
+		pkt.init[0] = 1;
+		pkt.init[1] = 0;
+		pkt.init[2] = c->features;
+		pkt.init[3] = c->flags & 0x7;
+		print_packet(c, "send", &pkt, sizeof(pkt));
+		send_packet(c->utcp, &pkt, sizeof(pkt));
+	} else {
+		pkt.hdr.aux = 0;
+		print_packet(c, "send", &pkt, sizeof(pkt.hdr));
+		send_packet(c->utcp, &pkt, sizeof(pkt.hdr));
+	}
+}
 
-	set_state(c, SYN_SENT);
+// Send a SYN, along with as much of the initial data as fits in the packet.
+static void send_syn(struct utcp_connection *c) {
+	struct {
+		struct hdr hdr;
+		uint8_t init[4];
+		uint8_t data[];
+	} *pkt = c->utcp->pkt;
+
+	uint32_t len = c->snd.syn;
+
+	pkt->hdr.src = c->src;
+	pkt->hdr.dst = c->dst;
+	pkt->hdr.seq = c->snd.iss;
+	pkt->hdr.ack = 0;
+	pkt->hdr.wnd = advertise_window(c);
+	pkt->hdr.ctl = SYN;
+	pkt->hdr.aux = 0x0101;
+	pkt->init[0] = 1;
+	pkt->init[1] = 0;
+	pkt->init[2] = FEATURES;
+	pkt->init[3] = c->flags & 0x7;
+
+	buffer_copy(&c->sndbuf, pkt->data, 0, len);
+	c->snd.nxt = c->snd.iss + 1 + len;
+
+	print_packet(c, "send", pkt, sizeof(*pkt) + len);
+	send_packet(c->utcp, pkt, sizeof(*pkt) + len);
+}
+
+struct utcp_connection *utcp_connect_data(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv, uint32_t flags, const void *data, size_t len) {
+	if(len && !data) {
+		errno = EFAULT;
+		return NULL;
+	}
+
+	struct utcp_connection *c = allocate_connection(utcp, 0, dst);
+
+	if(!c) {
+		return NULL;
+	}
+
+	assert((flags & ~0x1f) == 0);
+
+	c->flags = flags;
+	c->recv = recv;
+	c->priv = priv;
 
-	print_packet(c, "send", &pkt, sizeof(pkt));
-	utcp->send(utcp, &pkt, sizeof(pkt));
+	// Initial data is queued as if it was sent right after the SYN,
+	// and as much of it as fits is carried in the SYN itself.
+	// Unreliable and framed connections can only send it if it fits entirely,
+	// the accept callback then receives it as a single message.
+
+	if(len) {
+		size_t max = is_reliable(c) && !is_framed(c) ? c->sndbuf.maxsize : utcp->mss - 4u;
+
+		if(len > max) {
+			free_connection(c);
+			errno = EMSGSIZE;
+			return NULL;
+		}
+
+		if(buffer_put(&c->sndbuf, data, len) != (ssize_t)len) {
+			free_connection(c);
+			errno = ENOMEM;
+			return NULL;
+		}
+
+		c->snd.last += len;
+		c->snd.syn = min(len, utcp->mss - 4u);
+	}
+
+	set_state(c, SYN_SENT);
+	send_syn(c);
 
 	clock_gettime(UTCP_CLOCK, &c->conn_timeout);
 	c->conn_timeout.tv_sec += utcp->timeout;
@@ -637,6 +1131,10 @@ struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_re
 	return c;
 }
 
+struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv, uint32_t flags) {
+	return utcp_connect_data(utcp, dst, recv, priv, flags, NULL, 0);
+}
+
 struct utcp_connection *utcp_connect(struct utcp *utcp, uint16_t dst, utcp_recv_t recv, void *priv) {
 	return utcp_connect_ex(utcp, dst, recv, priv, UTCP_TCP);
 }
@@ -653,12 +1151,32 @@ void utcp_accept(struct utcp_connection *c, utcp_recv_t recv, void *priv) {
 	set_state(c, ESTABLISHED);
 }
 
-static void ack(struct utcp_connection *c, bool sendatleastone) {
+static void *get_parity_buffer(struct utcp *utcp) {
+	if(utcp->parity_size < utcp->mtu) {
+		void *new = realloc(utcp->parity, utcp->mtu);
+
+		if(!new) {
+			return NULL;
+		}
+
+		utcp->parity = new;
+		utcp->parity_size = utcp->mtu;
+	}
+
+	return utcp->parity;
+}
+
+// Send as much data as the windows and the given limit allow.
+static void transmit(struct utcp_connection *c, bool sendatleastone, uint32_t limit) {
 	int32_t left = seqdiff(c->snd.last, c->snd.nxt);
 	int32_t cwndleft = is_reliable(c) ? min(c->snd.cwnd, c->snd.wnd) - seqdiff(c->snd.nxt, c->snd.una) : MAX_UNRELIABLE_SIZE;
 
 	assert(left >= 0);
 
+	if(cwndleft > 0 && (uint32_t)cwndleft > limit) {
+		cwndleft = limit;
+	}
+
 	if(cwndleft <= 0) {
 		left = 0;
 	} else if(cwndleft < left) {
@@ -683,10 +1201,23 @@ static void ack(struct utcp_connection *c, bool sendatleastone) {
 	pkt->hdr.src = c->src;
 	pkt->hdr.dst = c->dst;
 	pkt->hdr.ack = c->rcv.nxt;
-	pkt->hdr.wnd = is_reliable(c) ? c->rcvbuf.maxsize : 0;
+	pkt->hdr.wnd = is_reliable(c) ? advertise_window(c) : 0;
 	pkt->hdr.ctl = ACK;
 	pkt->hdr.aux = 0;
 
+	// Only fragmented unreliable frames are protected by parity packets.
+	struct {
+		struct hdr hdr;
+		uint8_t data[];
+	} *parity = NULL;
+
+	if(!is_reliable(c) && c->fec.group && c->features & FEATURE_PARITY && left > c->utcp->mss && !fin_wanted(c, c->snd.last)) {
+		parity = get_parity_buffer(c->utcp);
+	}
+
+	uint32_t grouplen = 0;
+	uint32_t groupcount = 0;
+
 	do {
 		uint32_t seglen = left > c->utcp->mss ? c->utcp->mss : left;
 		pkt->hdr.seq = c->snd.nxt;
@@ -709,6 +1240,22 @@ static void ack(struct utcp_connection *c, bool sendatleastone) {
 			pkt->hdr.ctl |= FIN;
 		}
 
+		if(parity) {
+			if(!groupcount) {
+				parity->hdr.seq = pkt->hdr.seq;
+				parity->hdr.wnd = pkt->hdr.wnd;
+				memset(parity->data, 0, c->utcp->mss);
+				grouplen = 0;
+			}
+
+			for(uint32_t i = 0; i < seglen; i++) {
+				parity->data[i] ^= pkt->data[i];
+			}
+
+			grouplen += seglen;
+			groupcount++;
+		}
+
 		if(!c->rtt_start.tv_sec) {
 			// Start RTT measurement
 			clock_gettime(UTCP_CLOCK, &c->rtt_start);
@@ -717,19 +1264,159 @@ static void ack(struct utcp_connection *c, bool sendatleastone) {
 		}
 
 		print_packet(c, "send", pkt, sizeof(pkt->hdr) + seglen);
-		c->utcp->send(c->utcp, pkt, sizeof(pkt->hdr) + seglen);
+		send_packet(c->utcp, pkt, sizeof(pkt->hdr) + seglen);
+		c->stats.segments_sent++;
+		c->stats.bytes_sent += seglen;
+
+		if(parity && (groupcount == c->fec.group || !left)) {
+			// The parity is always padded to the full fragment size.
+			// The ack field carries the amount of data covered by it.
+			parity->hdr.src = c->src;
+			parity->hdr.dst = c->dst;
+			parity->hdr.ack = grouplen;
+			parity->hdr.ctl = left ? PAR | MF : PAR;
+			parity->hdr.aux = 0;
+
+			print_packet(c, "send", parity, sizeof(parity->hdr) + c->utcp->mss);
+			send_packet(c->utcp, parity, sizeof(parity->hdr) + c->utcp->mss);
+			groupcount = 0;
+		}
 
 		if(left && !is_reliable(c)) {
 			pkt->hdr.wnd += seglen;
 		}
 	} while(left);
+
+	update_inflight(c);
+}
+
+// Amount of data a connection could send right now, as far as its own windows are concerned.
+static uint32_t sched_ready(struct utcp_connection *c) {
+	switch(c->state) {
+	case ESTABLISHED:
+	case CLOSE_WAIT:
+	case FIN_WAIT_1:
+	case CLOSING:
+	case LAST_ACK:
+		break;
+
+	default:
+		return 0;
+	}
+
+	int32_t left = seqdiff(c->snd.last, c->snd.nxt);
+	int32_t room = min(c->snd.cwnd, c->snd.wnd) - seqdiff(c->snd.nxt, c->snd.una);
+
+	if(left <= 0 || room <= 0) {
+		return 0;
+	}
+
+	return min(left, room);
+}
+
+static bool sched_busy(const struct utcp *utcp) {
+	for(int p = 0; p < UTCP_PRIORITIES; p++) {
+		if(utcp->sched.head[p]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// The path is shared by all connections, so together they should not have more data in flight
+// than the largest congestion window of the connections that want to send.
+static uint32_t sched_window(const struct utcp *utcp, const struct utcp_connection *c) {
+	uint32_t window = c ? c->snd.cwnd : 0;
+
+	for(int p = 0; p < UTCP_PRIORITIES; p++) {
+		for(struct utcp_connection *i = utcp->sched.head[p]; i; i = i->sched.next) {
+			window = max(window, i->snd.cwnd);
+		}
+	}
+
+	return window;
+}
+
+// Deficit round robin over the waiting connections, higher priority classes first.
+static void schedule(struct utcp *utcp, uint32_t window) {
+	for(int p = UTCP_PRIORITIES - 1; p >= 0; p--) {
+		struct utcp_connection *c;
+
+		while((c = utcp->sched.head[p])) {
+			if(utcp->sched.inflight >= window) {
+				return;
+			}
+
+			if(!sched_ready(c)) {
+				sched_dequeue(c);
+				continue;
+			}
+
+			if(!c->sched.turn) {
+				c->sched.deficit += c->sched.weight * utcp->mss;
+				c->sched.turn = true;
+			}
+
+			uint32_t room = window - utcp->sched.inflight;
+			bool path_limited = room <= c->sched.deficit;
+			uint32_t nxt = c->snd.nxt;
+
+			transmit(c, false, min(room, c->sched.deficit));
+
+			uint32_t sent = seqdiff(c->snd.nxt, nxt);
+			c->sched.deficit -= min(sent, c->sched.deficit);
+
+			if(!sched_ready(c) || (!sent && !path_limited)) {
+				// Nothing left to send, or limited by its own windows.
+				sched_dequeue(c);
+			} else if(path_limited) {
+				// Continue this turn when more of the path becomes available.
+				return;
+			} else {
+				// Used up its quantum, move to the back of the queue.
+				uint32_t deficit = c->sched.deficit;
+				sched_dequeue(c);
+				c->sched.deficit = deficit;
+				sched_enqueue(c);
+			}
+		}
+	}
+}
+
+static void ack(struct utcp_connection *c, bool sendatleastone) {
+	struct utcp *utcp = c->utcp;
+
+	// Send directly if no other connection is competing for the path.
+	if(!is_reliable(c) || (!sched_busy(utcp) && utcp->sched.inflight == c->sched.inflight)) {
+		transmit(c, sendatleastone, UINT32_MAX);
+		return;
+	}
+
+	uint32_t nxt = c->snd.nxt;
+
+	if(sched_ready(c)) {
+		sched_enqueue(c);
+	}
+
+	schedule(utcp, sched_window(utcp, c));
+
+	// Make sure an ACK goes out if one is needed, even if the scheduler held back our data.
+	if(sendatleastone && c->snd.nxt == nxt) {
+		transmit(c, true, 0);
+	}
 }
 
 ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
+	struct iovec iov = {.iov_base = (void *)data, .iov_len = len};
+	return utcp_sendv(c, &iov, 1);
+}
+
+static bool can_send(struct utcp_connection *c) {
 	if(c->reapable) {
 		debug(c, "send() called on closed connection\n");
 		errno = EBADF;
-		return -1;
+		return false;
 	}
 
 	switch(c->state) {
@@ -737,7 +1424,7 @@ ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
 	case LISTEN:
 		debug(c, "send() called on unconnected connection\n");
 		errno = ENOTCONN;
-		return -1;
+		return false;
 
 	case SYN_SENT:
 	case SYN_RECEIVED:
@@ -752,18 +1439,121 @@ ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
 	case TIME_WAIT:
 		debug(c, "send() called on closed connection\n");
 		errno = EPIPE;
+		return false;
+	}
+
+	return true;
+}
+
+// Start sending data that was just added to the send buffer.
+static ssize_t send_queued(struct utcp_connection *c, size_t len) {
+	c->snd.last += len;
+
+	// Don't send anything yet if the connection has not fully established yet
+
+	if(c->state == SYN_SENT || c->state == SYN_RECEIVED) {
+		return len;
+	}
+
+	ack(c, false);
+
+	if(!is_reliable(c)) {
+		c->snd.una = c->snd.nxt = c->snd.last;
+		buffer_discard(&c->sndbuf, c->sndbuf.used);
+	}
+
+	if(is_reliable(c) && !timespec_isset(&c->rtrx_timeout)) {
+		start_retransmit_timer(c);
+	}
+
+	if(is_reliable(c) && !timespec_isset(&c->conn_timeout)) {
+		clock_gettime(UTCP_CLOCK, &c->conn_timeout);
+		c->conn_timeout.tv_sec += c->utcp->timeout;
+	}
+
+	return len;
+}
+
+// The send buffer could not grow. If the memory pool is full, report it like a full buffer,
+// and poll the application again later, since other connections will return memory to the pool.
+static ssize_t sndbuf_exhausted(struct utcp_connection *c) {
+	if(errno != ENOBUFS) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	c->do_poll = true;
+	errno = EWOULDBLOCK;
+	return 0;
+}
+
+ssize_t utcp_sendv(struct utcp_connection *c, const struct iovec *iov, int iovcnt) {
+	if(!can_send(c)) {
+		return -1;
+	}
+
+	if(iovcnt < 0 || (iovcnt && !iov)) {
+		errno = EINVAL;
 		return -1;
 	}
 
+	size_t len = 0;
+
+	for(int i = 0; i < iovcnt; i++) {
+		if(iov[i].iov_len && !iov[i].iov_base) {
+			errno = EFAULT;
+			return -1;
+		}
+
+		if(iov[i].iov_len > SSIZE_MAX - len) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		len += iov[i].iov_len;
+	}
+
 	// Exit early if we have nothing to send.
 
 	if(!len) {
 		return 0;
 	}
 
-	if(!data) {
-		errno = EFAULT;
-		return -1;
+	// A message on a framed connection is queued as a whole, preceded by its length.
+
+	if(is_framed(c)) {
+		uint32_t msglen = len;
+
+		if(len > c->msg.max) {
+			errno = EMSGSIZE;
+			return -1;
+		}
+
+		// Until the handshake is done, we don't know whether the peer keeps message boundaries.
+		if(c->state == SYN_SENT) {
+			c->do_poll = true;
+			errno = EWOULDBLOCK;
+			return 0;
+		}
+
+		// Messages up to the maximum size are always accepted, grow the buffer if necessary.
+		if(sizeof(msglen) + len > c->sndbuf.maxsize) {
+			c->sndbuf.maxsize = sizeof(msglen) + len;
+		}
+
+		if(sizeof(msglen) + len > buffer_free(&c->sndbuf)) {
+			errno = EWOULDBLOCK;
+			return 0;
+		}
+
+		if(!buffer_reserve(&c->sndbuf, c->sndbuf.used + sizeof(msglen) + len)) {
+			return sndbuf_exhausted(c);
+		}
+
+		buffer_put(&c->sndbuf, &msglen, sizeof(msglen));
+		buffer_putv(&c->sndbuf, iov, iovcnt);
+		send_queued(c, sizeof(msglen) + len);
+		return len;
 	}
 
 	// Check if we need to be able to buffer all data
@@ -783,50 +1573,73 @@ ssize_t utcp_send(struct utcp_connection *c, const void *data, size_t len) {
 	// Add data to send buffer.
 
 	if(is_reliable(c)) {
-		len = buffer_put(&c->sndbuf, data, len);
+		if(c->flags & UTCP_NO_PARTIAL && !buffer_reserve(&c->sndbuf, c->sndbuf.used + len)) {
+			return sndbuf_exhausted(c);
+		}
+
+		len = buffer_putv(&c->sndbuf, iov, iovcnt);
 	} else if(c->state != SYN_SENT && c->state != SYN_RECEIVED) {
-		if(len > MAX_UNRELIABLE_SIZE || buffer_put(&c->sndbuf, data, len) != (ssize_t)len) {
+		// An unreliable packet is sent as a whole or not at all.
+		if(len > MAX_UNRELIABLE_SIZE || len > buffer_free(&c->sndbuf)) {
 			errno = EMSGSIZE;
 			return -1;
 		}
+
+		if(!buffer_reserve(&c->sndbuf, c->sndbuf.used + len)) {
+			return sndbuf_exhausted(c);
+		}
+
+		buffer_putv(&c->sndbuf, iov, iovcnt);
 	} else {
 		return 0;
 	}
 
-	if(len <= 0) {
-		if(is_reliable(c)) {
-			errno = EWOULDBLOCK;
-			return 0;
-		} else {
-			return len;
-		}
+	if(!len) {
+		// The buffer is full, or no memory could be allocated for it.
+		c->do_poll = true;
+		errno = EWOULDBLOCK;
+		return 0;
 	}
 
-	c->snd.last += len;
+	return send_queued(c, len);
+}
 
-	// Don't send anything yet if the connection has not fully established yet
+ssize_t utcp_send_fd(struct utcp_connection *c, int fd, size_t len) {
+	if(!can_send(c)) {
+		return -1;
+	}
 
-	if(c->state == SYN_SENT || c->state == SYN_RECEIVED) {
-		return len;
+	// Unreliable and framed connections send data as messages, which must be complete before they are queued.
+	if(!is_reliable(c) || is_framed(c)) {
+		errno = EINVAL;
+		return -1;
 	}
 
-	ack(c, false);
+	if(!len) {
+		return 0;
+	}
 
-	if(!is_reliable(c)) {
-		c->snd.una = c->snd.nxt = c->snd.last;
-		buffer_discard(&c->sndbuf, c->sndbuf.used);
+	if(c->flags & UTCP_NO_PARTIAL && len > buffer_free(&c->sndbuf)) {
+		if(len > c->sndbuf.maxsize) {
+			errno = EMSGSIZE;
+			return -1;
+		} else {
+			errno = EWOULDBLOCK;
+			return 0;
+		}
 	}
 
-	if(is_reliable(c) && !timespec_isset(&c->rtrx_timeout)) {
-		start_retransmit_timer(c);
+	ssize_t result = buffer_read(&c->sndbuf, fd, len);
+
+	if(result < 0 && errno == ENOBUFS) {
+		return sndbuf_exhausted(c);
 	}
 
-	if(is_reliable(c) && !timespec_isset(&c->conn_timeout)) {
-		clock_gettime(UTCP_CLOCK, &c->conn_timeout);
-		c->conn_timeout.tv_sec += c->utcp->timeout;
+	if(result <= 0) {
+		return result;
 	}
 
-	return len;
+	return send_queued(c, result);
 }
 
 static void swap_ports(struct hdr *hdr) {
@@ -850,7 +1663,7 @@ static void fast_retransmit(struct utcp_connection *c) {
 
 	pkt->hdr.src = c->src;
 	pkt->hdr.dst = c->dst;
-	pkt->hdr.wnd = c->rcvbuf.maxsize;
+	pkt->hdr.wnd = advertise_window(c);
 	pkt->hdr.aux = 0;
 
 	switch(c->state) {
@@ -872,7 +1685,10 @@ static void fast_retransmit(struct utcp_connection *c) {
 
 		buffer_copy(&c->sndbuf, pkt->data, 0, len);
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + len);
-		utcp->send(utcp, pkt, sizeof(pkt->hdr) + len);
+		send_packet(utcp, pkt, sizeof(pkt->hdr) + len);
+		c->stats.segments_sent++;
+		c->stats.bytes_sent += len;
+		c->stats.retransmits++;
 		break;
 
 	default:
@@ -900,31 +1716,18 @@ static void retransmit(struct utcp_connection *c) {
 
 	pkt->hdr.src = c->src;
 	pkt->hdr.dst = c->dst;
-	pkt->hdr.wnd = c->rcvbuf.maxsize;
+	pkt->hdr.wnd = advertise_window(c);
 	pkt->hdr.aux = 0;
 
 	switch(c->state) {
 	case SYN_SENT:
 		// Send our SYN again
-		pkt->hdr.seq = c->snd.iss;
-		pkt->hdr.ack = 0;
-		pkt->hdr.ctl = SYN;
-		pkt->hdr.aux = 0x0101;
-		pkt->data[0] = 1;
-		pkt->data[1] = 0;
-		pkt->data[2] = 0;
-		pkt->data[3] = c->flags & 0x7;
-		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + 4);
-		utcp->send(utcp, pkt, sizeof(pkt->hdr) + 4);
+		send_syn(c);
 		break;
 
 	case SYN_RECEIVED:
-		// Send SYNACK again
-		pkt->hdr.seq = c->snd.nxt;
-		pkt->hdr.ack = c->rcv.nxt;
-		pkt->hdr.ctl = SYN | ACK;
-		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr));
-		utcp->send(utcp, pkt, sizeof(pkt->hdr));
+		// Send SYNACK again, exactly like the first one, so the peer still learns our features if that one was lost
+		send_synack(c, true);
 		break;
 
 	case ESTABLISHED:
@@ -951,9 +1754,13 @@ static void retransmit(struct utcp_connection *c) {
 
 		buffer_copy(&c->sndbuf, pkt->data, 0, len);
 		print_packet(c, "rtrx", pkt, sizeof(pkt->hdr) + len);
-		utcp->send(utcp, pkt, sizeof(pkt->hdr) + len);
+		send_packet(utcp, pkt, sizeof(pkt->hdr) + len);
+		c->stats.segments_sent++;
+		c->stats.bytes_sent += len;
+		c->stats.retransmits++;
 
 		c->snd.nxt = c->snd.una + len;
+		update_inflight(c);
 		break;
 
 	case CLOSED:
@@ -975,6 +1782,9 @@ static void retransmit(struct utcp_connection *c) {
 		c->rto = MAX_RTO;
 	}
 
+	c->stats.timeouts++;
+	log_event(c, UTCP_EVENT_TIMEOUT);
+
 	c->rtt_start.tv_sec = 0; // invalidate RTT timer
 	c->dupack = 0; // cancel any ongoing fast recovery
 
@@ -982,6 +1792,32 @@ cleanup:
 	return;
 }
 
+// Move the SACK entries after len bytes of the sequence space have been consumed.
+static void sack_shift(struct utcp_connection *c, size_t len) {
+	for(int i = 0; i < NSACKS && c->sacks[i].len;) {
+		if(len < c->sacks[i].offset) {
+			c->sacks[i].offset -= len;
+			i++;
+		} else if(len < c->sacks[i].offset + c->sacks[i].len) {
+			c->sacks[i].len -= len - c->sacks[i].offset;
+			c->sacks[i].offset = 0;
+			i++;
+		} else {
+			if(i < NSACKS - 1) {
+				memmove(&c->sacks[i], &c->sacks[i + 1], (NSACKS - 1 - i) * sizeof(c->sacks)[i]);
+				c->sacks[NSACKS - 1].len = 0;
+			} else {
+				c->sacks[i].len = 0;
+				break;
+			}
+		}
+	}
+
+	for(int i = 0; i < NSACKS && c->sacks[i].len; i++) {
+		debug(c, "SACK[%d] offset %u len %u\n", i, c->sacks[i].offset, c->sacks[i].len);
+	}
+}
+
 /* Update receive buffer and SACK entries after consuming data.
  *
  * Situation:
@@ -1010,35 +1846,13 @@ static void sack_consume(struct utcp_connection *c, size_t len) {
 	}
 
 	buffer_discard(&c->rcvbuf, len);
-
-	for(int i = 0; i < NSACKS && c->sacks[i].len;) {
-		if(len < c->sacks[i].offset) {
-			c->sacks[i].offset -= len;
-			i++;
-		} else if(len < c->sacks[i].offset + c->sacks[i].len) {
-			c->sacks[i].len -= len - c->sacks[i].offset;
-			c->sacks[i].offset = 0;
-			i++;
-		} else {
-			if(i < NSACKS - 1) {
-				memmove(&c->sacks[i], &c->sacks[i + 1], (NSACKS - 1 - i) * sizeof(c->sacks)[i]);
-				c->sacks[NSACKS - 1].len = 0;
-			} else {
-				c->sacks[i].len = 0;
-				break;
-			}
-		}
-	}
-
-	for(int i = 0; i < NSACKS && c->sacks[i].len; i++) {
-		debug(c, "SACK[%d] offset %u len %u\n", i, c->sacks[i].offset, c->sacks[i].len);
-	}
+	sack_shift(c, len);
 }
 
 static void handle_out_of_order(struct utcp_connection *c, uint32_t offset, const void *data, size_t len) {
 	debug(c, "out of order packet, offset %u\n", offset);
-	// Packet loss or reordering occured. Store the data in the buffer.
-	ssize_t rxd = buffer_put_at(&c->rcvbuf, offset, data, len);
+	// Packet loss or reordering occured. Store the data in the buffer, after any incomplete message.
+	ssize_t rxd = buffer_put_at(&c->rcvbuf, c->msg.buffered + offset, data, len);
 
 	if(rxd <= 0) {
 		debug(c, "packet outside receive buffer, dropping\n");
@@ -1090,6 +1904,69 @@ static void handle_out_of_order(struct utcp_connection *c, uint32_t offset, cons
 	}
 }
 
+/* Grow the receive window if the peer sends more than half of it per round trip.
+ * This is a simplified version of dynamic right-sizing as done by Linux.
+ * The RTT is estimated by timing how long it takes to receive one window's worth of data,
+ * which is an upper bound if the peer is limited by our window.
+ * Since in-order data is passed to the application immediately,
+ * memory for the receive buffer is only allocated when out-of-order data actually has to be stored.
+ */
+static void autotune_rcvbuf(struct utcp_connection *c) {
+	if(!c->autotune_rcvbuf || c->rcvbuf.maxsize >= c->max_bufsize) {
+		return;
+	}
+
+	struct timespec now;
+	clock_gettime(UTCP_CLOCK, &now);
+
+	if(timespec_isset(&c->rcv.rtt_start) && seqdiff(c->rcv.nxt, c->rcv.rtt_seq) >= 0) {
+		uint32_t rtt = timespec_diff_usec(&now, &c->rcv.rtt_start);
+
+		if(!c->rcv.rtt || rtt < c->rcv.rtt) {
+			c->rcv.rtt = rtt;
+		} else {
+			c->rcv.rtt = (c->rcv.rtt * 7 + rtt) / 8;
+		}
+
+		timespec_clear(&c->rcv.rtt_start);
+	}
+
+	if(!timespec_isset(&c->rcv.rtt_start)) {
+		c->rcv.rtt_start = now;
+		c->rcv.rtt_seq = c->rcv.nxt + c->rcvbuf.maxsize;
+	}
+
+	uint32_t rtt = c->rcv.rtt;
+
+	if(c->srtt && (!rtt || c->srtt < rtt)) {
+		rtt = c->srtt;
+	}
+
+	if(!timespec_isset(&c->rcv.space_start)) {
+		c->rcv.space_start = now;
+		c->rcv.space_seq = c->rcv.nxt;
+		return;
+	}
+
+	if(!rtt || timespec_diff_usec(&now, &c->rcv.space_start) < (int32_t)rtt) {
+		return;
+	}
+
+	uint32_t copied = seqdiff(c->rcv.nxt, c->rcv.space_seq);
+
+	if(copied > c->rcv.space) {
+		c->rcv.space = copied;
+
+		if(2 * (size_t)copied > c->rcvbuf.maxsize) {
+			c->rcvbuf.maxsize = min(2 * (size_t)copied, c->max_bufsize);
+			debug(c, "rcvbuf grown to %u\n", c->rcvbuf.maxsize);
+		}
+	}
+
+	c->rcv.space_start = now;
+	c->rcv.space_seq = c->rcv.nxt;
+}
+
 static void handle_in_order(struct utcp_connection *c, const void *data, size_t len) {
 	if(c->recv) {
 		ssize_t rxd = c->recv(c, data, len);
@@ -1104,82 +1981,443 @@ static void handle_in_order(struct utcp_connection *c, const void *data, size_t
 	if(c->sacks[0].len && len >= c->sacks[0].offset) {
 		debug(c, "incoming packet len %lu connected with SACK at %u\n", (unsigned long)len, c->sacks[0].offset);
 
-		if(len < c->sacks[0].offset + c->sacks[0].len) {
-			size_t offset = len;
-			len = c->sacks[0].offset + c->sacks[0].len;
-			size_t remainder = len - offset;
+		if(len < c->sacks[0].offset + c->sacks[0].len) {
+			size_t offset = len;
+			len = c->sacks[0].offset + c->sacks[0].len;
+			size_t remainder = len - offset;
+
+			ssize_t rxd = buffer_call(c, &c->rcvbuf, offset, remainder);
+
+			if(rxd != (ssize_t)remainder) {
+				// TODO: handle the application not accepting all data.
+				abort();
+			}
+		}
+	}
+
+	if(c->rcvbuf.used) {
+		sack_consume(c, len);
+	}
+
+	c->rcv.nxt += len;
+
+	autotune_rcvbuf(c);
+}
+
+static bool reset_connection(struct utcp_connection *c);
+
+// Abort the connection if the peer sends a message larger than we accept.
+static bool check_message_size(struct utcp_connection *c, uint32_t msglen) {
+	if(msglen <= c->msg.max) {
+		return true;
+	}
+
+	debug(c, "message of %u bytes exceeds maximum of %u\n", msglen, c->msg.max);
+	utcp_recv_t recv = c->recv;
+	reset_connection(c);
+
+	if(recv) {
+		errno = EMSGSIZE;
+		recv(c, NULL, 0);
+	}
+
+	return false;
+}
+
+// Pass one message to the application, return false if it did not accept all of it.
+static bool deliver_message(struct utcp_connection *c, const void *data, uint32_t len) {
+	if(!c->recv || !len) {
+		return true;
+	}
+
+	return c->recv(c, data, len) == (ssize_t)len;
+}
+
+/* Pass the complete messages in the receive buffer to the application.
+ * If the application does not accept a message, it stays in the receive buffer,
+ * and is offered again when more data arrives or on the next call to utcp_timeout().
+ * Returns false if the connection was aborted.
+ */
+static bool deliver_buffered_messages(struct utcp_connection *c) {
+	uint32_t msglen;
+
+	c->msg.pending = false;
+
+	while(c->msg.buffered >= sizeof(msglen)) {
+		buffer_copy(&c->rcvbuf, &msglen, 0, sizeof(msglen));
+
+		if(!check_message_size(c, msglen)) {
+			return false;
+		}
+
+		// Make sure the whole message fits in the receive buffer.
+		if(sizeof(msglen) + msglen > c->rcvbuf.maxsize) {
+			c->rcvbuf.maxsize = sizeof(msglen) + msglen;
+		}
+
+		if(c->msg.buffered - sizeof(msglen) < msglen) {
+			break;
+		}
+
+		const void *msg = buffer_peek(&c->rcvbuf, sizeof(msglen), msglen);
+		bool accepted;
+
+		if(msg) {
+			accepted = deliver_message(c, msg, msglen);
+		} else {
+			char *copy = malloc(msglen);
+
+			if(!copy) {
+				abort();
+			}
+
+			buffer_copy(&c->rcvbuf, copy, sizeof(msglen), msglen);
+			accepted = deliver_message(c, copy, msglen);
+			free(copy);
+		}
+
+		if(!accepted) {
+			debug(c, "message of %u bytes not accepted, keeping it\n", msglen);
+			c->msg.pending = true;
+			break;
+		}
+
+		buffer_discard(&c->rcvbuf, sizeof(msglen) + msglen);
+		c->msg.buffered -= sizeof(msglen) + msglen;
+	}
+
+	return true;
+}
+
+/* Pass in-order data of a framed connection to the application, one message at a time.
+ * Messages that are completely contained in the packet are passed directly from the packet.
+ * Otherwise, the data is appended to the incomplete message at the start of the receive buffer,
+ * together with any out-of-order data that now connects to it, and complete messages are passed
+ * from there. Only a message that wraps around the end of the receive buffer is copied once more.
+ * A message the application does not accept is kept in the receive buffer as well.
+ * Returns false if the connection was aborted.
+ */
+static bool handle_in_order_framed(struct utcp_connection *c, const uint8_t *data, size_t len) {
+	uint32_t msglen;
+	bool refused = false;
+
+	if(!c->msg.buffered) {
+		size_t done = 0;
+
+		while(len - done >= sizeof(msglen)) {
+			memcpy(&msglen, data + done, sizeof(msglen));
+
+			if(!check_message_size(c, msglen)) {
+				return false;
+			}
+
+			if(len - done - sizeof(msglen) < msglen) {
+				break;
+			}
+
+			if(!deliver_message(c, data + done + sizeof(msglen), msglen)) {
+				debug(c, "message of %u bytes not accepted, keeping it\n", msglen);
+
+				if(sizeof(msglen) + msglen > c->rcvbuf.maxsize) {
+					c->rcvbuf.maxsize = sizeof(msglen) + msglen;
+				}
+
+				c->msg.pending = true;
+				refused = true;
+				break;
+			}
+
+			done += sizeof(msglen) + msglen;
+		}
+
+		if(done) {
+			if(c->rcvbuf.used) {
+				sack_consume(c, done);
+			}
+
+			c->rcv.nxt += done;
+			data += done;
+			len -= done;
+		}
+
+		if(!len) {
+			autotune_rcvbuf(c);
+			return true;
+		}
+	}
+
+	ssize_t rxd = buffer_put_at(&c->rcvbuf, c->msg.buffered, data, len);
+
+	if(rxd <= 0) {
+		debug(c, "no room for incomplete message, dropping\n");
+		return true;
+	}
+
+	len = rxd;
+
+	// Check if we can process out-of-order data now.
+	if(c->sacks[0].len && len >= c->sacks[0].offset && len < c->sacks[0].offset + c->sacks[0].len) {
+		debug(c, "incoming packet len %lu connected with SACK at %u\n", (unsigned long)len, c->sacks[0].offset);
+		len = c->sacks[0].offset + c->sacks[0].len;
+	}
+
+	sack_shift(c, len);
+	c->msg.buffered += len;
+	c->rcv.nxt += len;
+
+	// A message that was just refused is not offered again right away.
+	if(!refused && !deliver_buffered_messages(c)) {
+		return false;
+	}
+
+	autotune_rcvbuf(c);
+	return true;
+}
+
+// Fragmented unreliable frames are reassembled in the receive buffer.
+// All fragments except the last one of a frame have the same length,
+// so they can be tracked in a bitmap and arrive in any order.
+// A single missing fragment in a group can be reconstructed from the group's parity packet.
+// Only one frame is reassembled at a time, a newer fragmented frame replaces an incomplete older one.
+
+static bool frame_select(struct utcp_connection *c, uint32_t seq) {
+	if(c->frame.started) {
+		int32_t diff = seqdiff(seq, c->frame.seq);
+
+		if(diff < 0) {
+			return false;
+		} else if(!diff) {
+			return !c->frame.delivered;
+		}
+
+		if(!c->frame.delivered) {
+			c->fec.lost++;
+		}
+	}
+
+	memset(&c->frame, 0, sizeof(c->frame));
+	c->frame.started = true;
+	c->frame.seq = seq;
+	buffer_clear(&c->rcvbuf);
+	return true;
+}
+
+static bool frame_has(const struct utcp_connection *c, uint32_t index) {
+	return c->frame.map[index / 64] & (UINT64_C(1) << (index % 64));
+}
+
+static void frame_mark(struct utcp_connection *c, uint32_t index) {
+	c->frame.map[index / 64] |= UINT64_C(1) << (index % 64);
+}
+
+static bool frame_set_fraglen(struct utcp_connection *c, uint32_t fraglen) {
+	if(c->frame.fraglen) {
+		return c->frame.fraglen == fraglen;
+	}
+
+	if(!fraglen || (MAX_UNRELIABLE_SIZE + fraglen - 1) / fraglen > MAX_FRAGMENTS) {
+		return false;
+	}
+
+	c->frame.fraglen = fraglen;
+
+	if(c->frame.has_last) {
+		frame_mark(c, (c->frame.len - 1) / fraglen);
+	}
+
+	return true;
+}
+
+static void frame_check(struct utcp_connection *c) {
+	if(!c->frame.len || c->frame.received != c->frame.len) {
+		return;
+	}
+
+	c->frame.delivered = true;
+
+	if(c->frame.recovered) {
+		c->fec.recovered++;
+	}
+
+	buffer_call(c, &c->rcvbuf, 0, c->frame.len);
+}
+
+static void handle_unreliable(struct utcp_connection *c, const struct hdr *hdr, const void *data, size_t len) {
+	if(seqdiff(hdr->seq + len, c->rcv.nxt) > 0) {
+		c->rcv.nxt = hdr->seq + len;
+	}
+
+	// Fast path for unfragmented packets, these do not interrupt the reassembly of a fragmented frame
+	if(!hdr->wnd && !(hdr->ctl & MF)) {
+		if(c->recv) {
+			c->recv(c, data, len);
+		}
+
+		return;
+	}
+
+	// Ensure reassembled packet are not larger than 64 kiB
+	if(hdr->wnd >= MAX_UNRELIABLE_SIZE || hdr->wnd + len > MAX_UNRELIABLE_SIZE) {
+		return;
+	}
+
+	if(!frame_select(c, hdr->seq - hdr->wnd)) {
+		return;
+	}
+
+	if(hdr->ctl & MF) {
+		if(!len || hdr->wnd % len || !frame_set_fraglen(c, len) || frame_has(c, hdr->wnd / len)) {
+			return;
+		}
+
+		frame_mark(c, hdr->wnd / len);
+	} else {
+		if(c->frame.has_last || (c->frame.len && c->frame.len != hdr->wnd + len) || (c->frame.fraglen && (hdr->wnd % c->frame.fraglen || len > c->frame.fraglen))) {
+			return;
+		}
 
-			ssize_t rxd = buffer_call(c, &c->rcvbuf, offset, remainder);
+		c->frame.has_last = true;
+		c->frame.len = hdr->wnd + len;
 
-			if(rxd != (ssize_t)remainder) {
-				// TODO: handle the application not accepting all data.
-				abort();
-			}
+		if(c->frame.fraglen) {
+			frame_mark(c, hdr->wnd / c->frame.fraglen);
 		}
 	}
 
-	if(c->rcvbuf.used) {
-		sack_consume(c, len);
+	if(buffer_put_at(&c->rcvbuf, hdr->wnd, data, len) != (ssize_t)len) {
+		return;
 	}
 
-	c->rcv.nxt += len;
+	c->frame.received += len;
+	frame_check(c);
 }
 
-static void handle_unreliable(struct utcp_connection *c, const struct hdr *hdr, const void *data, size_t len) {
-	// Fast path for unfragmented packets
-	if(!hdr->wnd && !(hdr->ctl & MF)) {
-		if(c->recv) {
-			c->recv(c, data, len);
-		}
+static void handle_parity(struct utcp_connection *c, const struct hdr *hdr, const uint8_t *data, size_t len) {
+	// The sequence number and window are those of the first fragment in the group,
+	// the ack field holds the length of the data covered by this parity packet.
+	uint32_t offset = hdr->wnd;
+	uint32_t grouplen = hdr->ack;
 
-		c->rcv.nxt = hdr->seq + len;
+	if(!len || !grouplen || offset % len || offset >= MAX_UNRELIABLE_SIZE || grouplen > MAX_UNRELIABLE_SIZE - offset) {
 		return;
 	}
 
-	// Ensure reassembled packet are not larger than 64 kiB
-	if(hdr->wnd >= MAX_UNRELIABLE_SIZE || hdr->wnd + len > MAX_UNRELIABLE_SIZE) {
+	if(!frame_select(c, hdr->seq - offset) || !frame_set_fraglen(c, len)) {
 		return;
 	}
 
-	// Don't accept out of order fragments
-	if(hdr->wnd && hdr->seq != c->rcv.nxt) {
+	if(!(hdr->ctl & MF)) {
+		// This is the last group of the frame.
+		if(c->frame.len && c->frame.len != offset + grouplen) {
+			return;
+		}
+
+		c->frame.len = offset + grouplen;
+	}
+
+	uint32_t first = offset / len;
+	uint32_t count = (grouplen + len - 1) / len;
+	uint32_t missing = 0;
+	uint32_t nmissing = 0;
+
+	for(uint32_t i = first; i < first + count; i++) {
+		if(!frame_has(c, i)) {
+			missing = i;
+			nmissing++;
+		}
+	}
+
+	if(nmissing != 1) {
 		return;
 	}
 
-	// Reset the receive buffer for the first fragment
-	if(!hdr->wnd) {
-		buffer_clear(&c->rcvbuf);
+	// XOR all fragments we do have with the parity to get the missing one.
+	uint8_t buf[len];
+	memcpy(buf, data, len);
+
+	for(uint32_t i = first; i < first + count; i++) {
+		if(i == missing) {
+			continue;
+		}
+
+		uint8_t fragment[len];
+		uint32_t fraglen = min(len, offset + grouplen - i * len);
+
+		if(buffer_copy(&c->rcvbuf, fragment, i * len, fraglen) != (ssize_t)fraglen) {
+			return;
+		}
+
+		for(uint32_t j = 0; j < fraglen; j++) {
+			buf[j] ^= fragment[j];
+		}
 	}
 
-	ssize_t rxd = buffer_put_at(&c->rcvbuf, hdr->wnd, data, len);
+	uint32_t missinglen = min(len, offset + grouplen - missing * len);
 
-	if(rxd != (ssize_t)len) {
+	if(buffer_put_at(&c->rcvbuf, missing * len, buf, missinglen) != (ssize_t)missinglen) {
 		return;
 	}
 
-	// Send the packet if it's the final fragment
-	if(!(hdr->ctl & MF)) {
-		buffer_call(c, &c->rcvbuf, 0, hdr->wnd + len);
+	frame_mark(c, missing);
+
+	if(!(hdr->ctl & MF) && missing == first + count - 1) {
+		c->frame.has_last = true;
 	}
 
-	c->rcv.nxt = hdr->seq + len;
+	c->frame.received += missinglen;
+	c->frame.recovered = true;
+	frame_check(c);
 }
 
-static void handle_incoming_data(struct utcp_connection *c, const struct hdr *hdr, const void *data, size_t len) {
+// Returns false if the connection was aborted.
+static bool handle_incoming_data(struct utcp_connection *c, const struct hdr *hdr, const void *data, size_t len) {
 	if(!is_reliable(c)) {
 		handle_unreliable(c, hdr, data, len);
-		return;
+		return true;
 	}
 
 	uint32_t offset = seqdiff(hdr->seq, c->rcv.nxt);
 
 	if(offset) {
 		handle_out_of_order(c, offset, data, len);
+	} else if(is_framed(c)) {
+		return handle_in_order_framed(c, data, len);
 	} else {
 		handle_in_order(c, data, len);
 	}
+
+	return true;
 }
 
+static ssize_t recv_batch(struct utcp *utcp, const uint8_t *ptr, size_t len) {
+	while(len) {
+		uint16_t seglen;
+
+		if(len < sizeof(seglen)) {
+			errno = EBADMSG;
+			return -1;
+		}
+
+		memcpy(&seglen, ptr, sizeof(seglen));
+		ptr += sizeof(seglen);
+		len -= sizeof(seglen);
+
+		// Batches cannot be nested
+		if(seglen > len || (seglen >= BATCH_HDR_SIZE && !memcmp(ptr, "\0\0\0\0", BATCH_HDR_SIZE))) {
+			errno = EBADMSG;
+			return -1;
+		}
+
+		if(utcp_recv(utcp, ptr, seglen) == -1) {
+			return -1;
+		}
+
+		ptr += seglen;
+		len -= seglen;
+	}
+
+	return 0;
+}
 
 ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 	const uint8_t *ptr = data;
@@ -1198,6 +2436,18 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 		return -1;
 	}
 
+	// Split up a batch of coalesced packets
+
+	uint16_t ports[2];
+
+	if(len >= BATCH_HDR_SIZE) {
+		memcpy(ports, ptr, sizeof(ports));
+
+		if(!ports[0] && !ports[1]) {
+			return recv_batch(utcp, ptr + BATCH_HDR_SIZE, len - BATCH_HDR_SIZE);
+		}
+	}
+
 	// Drop packets smaller than the header
 
 	struct hdr hdr;
@@ -1222,6 +2472,21 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 	ptr += sizeof(hdr);
 	len -= sizeof(hdr);
 
+	// Parity packets are handled separately from the rest of the state machine.
+
+	if(hdr.ctl & PAR) {
+		if(hdr.ctl & ~(PAR | MF) || hdr.aux) {
+			errno = EBADMSG;
+			return -1;
+		}
+
+		if(c && !is_reliable(c) && (c->state == ESTABLISHED || c->state == FIN_WAIT_1 || c->state == FIN_WAIT_2)) {
+			handle_parity(c, &hdr, ptr, len);
+		}
+
+		return 0;
+	}
+
 	// Drop packets with an unknown CTL flag
 
 	if(hdr.ctl & ~(SYN | ACK | RST | FIN | MF)) {
@@ -1313,41 +2578,38 @@ ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len) {
 				}
 
 				c->flags = init[3] & 0x7;
+				set_features(c, init[2]);
 			} else {
 				c->flags = UTCP_TCP;
 			}
 
 synack:
 			// Return SYN+ACK, go to SYN_RECEIVED state
+			// Any data sent along with the SYN is acknowledged as well.
 			c->snd.wnd = hdr.wnd;
 			c->rcv.irs = hdr.seq;
-			c->rcv.nxt = c->rcv.irs + 1;
+			c->rcv.nxt = c->rcv.irs + 1 + len;
 			set_state(c, SYN_RECEIVED);
 
-			struct {
-				struct hdr hdr;
-				uint8_t data[4];
-			} pkt;
-
-			pkt.hdr.src = c->src;
-			pkt.hdr.dst = c->dst;
-			pkt.hdr.ack = c->rcv.irs + 1;
-			pkt.hdr.seq = c->snd.iss;
-			pkt.hdr.wnd = c->rcvbuf.maxsize;
-			pkt.hdr.ctl = SYN | ACK;
+			send_synack(c, init);
+
+			if(len) {
+				// The SYN carried data, so hand the connection to the application right away,
+				// so it can start sending before the handshake completes.
+				// Our SYN is considered acknowledged. If the SYN+ACK gets lost, the peer drops our replies
+				// and retransmits its SYN, which is then answered with another SYN+ACK.
+				c->snd.una = c->snd.nxt;
+				utcp->accept(c, c->src, ptr, len);
+
+				if(c->state != ESTABLISHED) {
+					reset_connection(c);
+					c->reapable = true;
+				} else if(c->snd.last != c->snd.nxt) {
+					// Send anything the application queued from within the accept callback.
+					ack(c, false);
+				}
 
-			if(init) {
-				pkt.hdr.aux = 0x0101;
-				pkt.data[0] = 1;
-				pkt.data[1] = 0;
-				pkt.data[2] = 0;
-				pkt.data[3] = c->flags & 0x7;
-				print_packet(c, "send", &pkt, sizeof(hdr) + 4);
-				utcp->send(utcp, &pkt, sizeof(hdr) + 4);
-			} else {
-				pkt.hdr.aux = 0;
-				print_packet(c, "send", &pkt, sizeof(hdr));
-				utcp->send(utcp, &pkt, sizeof(hdr));
+				return 0;
 			}
 
 			start_retransmit_timer(c);
@@ -1372,6 +2634,12 @@ synack:
 
 	// It is for an existing connection.
 
+	// Data sent along with a SYN is only handled when the connection is created.
+
+	if(hdr.ctl & SYN) {
+		len = 0;
+	}
+
 	// 1. Drop invalid packets.
 
 	// 1a. Drop packets that should not happen in our current state.
@@ -1445,6 +2713,13 @@ synack:
 
 	c->snd.wnd = hdr.wnd; // TODO: move below
 
+	// Grow our send buffer to match the peer's receive window.
+	if(is_reliable(c) && c->autotune_sndbuf && c->snd.wnd > c->sndbuf.maxsize && c->sndbuf.maxsize < c->max_bufsize) {
+		c->sndbuf.maxsize = min(c->snd.wnd, c->max_bufsize);
+		c->do_poll = true;
+		debug(c, "sndbuf grown to %u\n", c->sndbuf.maxsize);
+	}
+
 	// 1c. Drop packets with an invalid ACK.
 	// ackno should not roll back, and it should also not be bigger than what we ever could have sent
 	// (= snd.una + c->sndbuf.used).
@@ -1546,6 +2821,14 @@ synack:
 		}
 	}
 
+	// In SYN_SENT, only a SYN+ACK can complete the handshake.
+	// If the peer accepted the data sent along with our SYN right away, its replies can arrive before a lost SYN+ACK.
+	// Drop those without processing their ACK, so our SYN keeps being retransmitted until the peer sends a new SYN+ACK.
+
+	if(c->state == SYN_SENT && !(hdr.ctl & SYN)) {
+		return 0;
+	}
+
 	uint32_t advanced;
 
 	if(!(hdr.ctl & ACK)) {
@@ -1606,11 +2889,13 @@ synack:
 		}
 
 		c->snd.una = hdr.ack;
+		update_inflight(c);
 
 		if(c->dupack) {
 			if(c->dupack >= 3) {
 				debug(c, "fast recovery ended\n");
 				c->snd.cwnd = c->snd.ssthresh;
+				log_event(c, UTCP_EVENT_RECOVERY_END);
 			}
 
 			c->dupack = 0;
@@ -1668,6 +2953,8 @@ synack:
 
 				debug_cwnd(c);
 
+				c->stats.fast_recoveries++;
+				log_event(c, UTCP_EVENT_FAST_RECOVERY);
 				fast_retransmit(c);
 			} else if(c->dupack > 3) {
 				c->snd.cwnd += utcp->mss;
@@ -1713,6 +3000,12 @@ skip_ack:
 
 			c->rcv.irs = hdr.seq;
 			c->rcv.nxt = hdr.seq + 1;
+			set_features(c, init ? init[2] : 0);
+
+			// If the peer did not accept the data sent along with our SYN, send it again.
+			if(seqdiff(c->snd.nxt, c->snd.una) > 0) {
+				c->snd.nxt = c->snd.una;
+			}
 
 			if(c->shut_wr) {
 				c->snd.last++;
@@ -1735,6 +3028,12 @@ skip_ack:
 		case LAST_ACK:
 		case TIME_WAIT:
 			// This could be a retransmission. Ignore the SYN flag, but send an ACK back.
+			// If the connection was accepted as soon as the initial SYN arrived,
+			// the peer might not have received our SYN+ACK, so send that again.
+			if(!(hdr.ctl & ACK) && hdr.seq == c->rcv.irs) {
+				send_synack(c, init);
+			}
+
 			break;
 
 		default:
@@ -1755,7 +3054,7 @@ skip_ack:
 
 		// Are we still LISTENing?
 		if(utcp->accept) {
-			utcp->accept(c, c->src);
+			utcp->accept(c, c->src, NULL, 0);
 		}
 
 		if(c->state != ESTABLISHED) {
@@ -1794,7 +3093,12 @@ skip_ack:
 			return 0;
 		}
 
-		handle_incoming_data(c, &hdr, ptr, len);
+		c->stats.segments_received++;
+		c->stats.bytes_received += len;
+
+		if(!handle_incoming_data(c, &hdr, ptr, len)) {
+			return 0;
+		}
 	}
 
 	// 7. Process FIN stuff
@@ -1875,7 +3179,7 @@ reset:
 	}
 
 	print_packet(c, "send", &hdr, sizeof(hdr));
-	utcp->send(utcp, &hdr, sizeof(hdr));
+	send_packet(utcp, &hdr, sizeof(hdr));
 	return 0;
 
 }
@@ -2002,9 +3306,10 @@ static bool reset_connection(struct utcp_connection *c) {
 	hdr.ack = 0;
 	hdr.wnd = 0;
 	hdr.ctl = RST;
+	hdr.aux = 0;
 
 	print_packet(c, "send", &hdr, sizeof(hdr));
-	c->utcp->send(c->utcp, &hdr, sizeof(hdr));
+	send_packet(c->utcp, &hdr, sizeof(hdr));
 	return true;
 }
 
@@ -2097,7 +3402,7 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 
 		if(timespec_isset(&c->conn_timeout) && timespec_lt(&c->conn_timeout, &now)) {
 			errno = ETIMEDOUT;
-			c->state = CLOSED;
+			set_state(c, CLOSED);
 
 			if(c->recv) {
 				c->recv(c, NULL, 0);
@@ -2115,12 +3420,18 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 			retransmit(c);
 		}
 
+		// Offer messages the application did not accept before again
+		if(c->msg.pending && !deliver_buffered_messages(c)) {
+			continue;
+		}
+
 		if(c->poll) {
 			if((c->state == ESTABLISHED || c->state == CLOSE_WAIT) && c->do_poll) {
-				c->do_poll = false;
-				uint32_t len = buffer_free(&c->sndbuf);
+				// If there is no room yet, keep waiting until other connections return memory to the pool
+				uint32_t len = buffer_room(&c->sndbuf);
 
 				if(len) {
+					c->do_poll = false;
 					c->poll(c, len);
 				}
 			} else if(c->state == CLOSED) {
@@ -2137,6 +3448,25 @@ struct timespec utcp_timeout(struct utcp *utcp) {
 		}
 	}
 
+	// If a receive window was clamped because the memory pool was full, tell the peer when it opens again.
+	// This is done after all connections had a chance to return memory to the pool.
+	for(int i = 0; i < utcp->nconnections; i++) {
+		struct utcp_connection *c = utcp->connections[i];
+
+		if(c->rcv.wnd_clamped && (c->state == ESTABLISHED || c->state == FIN_WAIT_1 || c->state == FIN_WAIT_2) && receive_window(c) > c->rcv.wnd) {
+			debug(c, "receive window opened to %u\n", receive_window(c));
+			ack(c, true);
+		}
+	}
+
+	// Let waiting connections send if anything was freed up in the mean time.
+	if(sched_busy(utcp)) {
+		schedule(utcp, sched_window(utcp, NULL));
+	}
+
+	// Everything that was sent since the last call goes out now.
+	utcp_flush(utcp);
+
 	struct timespec diff;
 
 	timespec_sub(&next, &now, &diff);
@@ -2209,13 +3539,18 @@ void utcp_exit(struct utcp *utcp) {
 			}
 		}
 
+		sched_dequeue(c);
 		buffer_exit(&c->rcvbuf);
 		buffer_exit(&c->sndbuf);
+		free(c->events.ring);
 		free(c);
 	}
 
 	free(utcp->connections);
+	free(utcp->table);
 	free(utcp->pkt);
+	free(utcp->parity);
+	free(utcp->batch.buf);
 	free(utcp);
 }
 
@@ -2236,6 +3571,9 @@ void utcp_set_mtu(struct utcp *utcp, uint16_t mtu) {
 		return;
 	}
 
+	// Pending packets were coalesced for the old MTU
+	utcp_flush(utcp);
+
 	if(mtu > utcp->mtu) {
 		char *new = realloc(utcp->pkt, mtu + sizeof(struct hdr));
 
@@ -2244,6 +3582,16 @@ void utcp_set_mtu(struct utcp *utcp, uint16_t mtu) {
 		}
 
 		utcp->pkt = new;
+
+		if(utcp->batch.buf) {
+			new = realloc(utcp->batch.buf, mtu);
+
+			if(!new) {
+				return;
+			}
+
+			utcp->batch.buf = new;
+		}
 	}
 
 	utcp->mtu = mtu;
@@ -2310,7 +3658,7 @@ size_t utcp_get_sndbuf_free(struct utcp_connection *c) {
 	case SYN_RECEIVED:
 	case ESTABLISHED:
 	case CLOSE_WAIT:
-		return buffer_free(&c->sndbuf);
+		return buffer_room(&c->sndbuf);
 
 	default:
 		return 0;
@@ -2328,6 +3676,8 @@ void utcp_set_sndbuf(struct utcp_connection *c, size_t size) {
 		c->sndbuf.maxsize = -1;
 	}
 
+	c->autotune_sndbuf = false;
+
 	c->do_poll = is_reliable(c) && buffer_free(&c->sndbuf);
 }
 
@@ -2353,6 +3703,24 @@ void utcp_set_rcvbuf(struct utcp_connection *c, size_t size) {
 	if(c->rcvbuf.maxsize != size) {
 		c->rcvbuf.maxsize = -1;
 	}
+
+	c->autotune_rcvbuf = false;
+}
+
+size_t utcp_get_max_bufsize(struct utcp_connection *c) {
+	return c ? c->max_bufsize : 0;
+}
+
+void utcp_set_max_bufsize(struct utcp_connection *c, size_t size) {
+	if(!c) {
+		return;
+	}
+
+	c->max_bufsize = size;
+
+	if(c->max_bufsize != size) {
+		c->max_bufsize = -1;
+	}
 }
 
 size_t utcp_get_sendq(struct utcp_connection *c) {
@@ -2383,6 +3751,143 @@ void utcp_set_keepalive(struct utcp_connection *c, bool keepalive) {
 	}
 }
 
+uint32_t utcp_get_fec(struct utcp_connection *c) {
+	return c ? c->fec.group : 0;
+}
+
+void utcp_set_fec(struct utcp_connection *c, uint32_t group) {
+	if(c) {
+		c->fec.group = group;
+	}
+}
+
+uint32_t utcp_get_fec_recovered(struct utcp_connection *c) {
+	return c ? c->fec.recovered : 0;
+}
+
+uint32_t utcp_get_fec_lost(struct utcp_connection *c) {
+	return c ? c->fec.lost : 0;
+}
+
+uint32_t utcp_get_max_message_size(struct utcp_connection *c) {
+	return c ? c->msg.max : 0;
+}
+
+bool utcp_set_max_message_size(struct utcp_connection *c, uint32_t size) {
+	if(!c || !size || size > UINT32_MAX - sizeof(uint32_t)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	c->msg.max = size;
+	return true;
+}
+
+void utcp_get_stats(struct utcp_connection *c, struct utcp_stats *stats) {
+	memset(stats, 0, sizeof(*stats));
+
+	if(!c) {
+		return;
+	}
+
+	stats->srtt = c->srtt;
+	stats->rttvar = c->rttvar;
+	stats->rto = c->rto;
+	stats->cwnd = c->snd.cwnd;
+	stats->ssthresh = c->snd.ssthresh;
+	stats->flightsize = seqdiff(c->snd.nxt, c->snd.una);
+	stats->dupack = c->dupack;
+
+	for(int i = 0; i < NSACKS; i++) {
+		if(c->sacks[i].len) {
+			stats->sack_holes++;
+		}
+	}
+
+	stats->bytes_sent = c->stats.bytes_sent;
+	stats->bytes_received = c->stats.bytes_received;
+	stats->segments_sent = c->stats.segments_sent;
+	stats->segments_received = c->stats.segments_received;
+	stats->retransmits = c->stats.retransmits;
+	stats->timeouts = c->stats.timeouts;
+	stats->fast_recoveries = c->stats.fast_recoveries;
+}
+
+bool utcp_set_event_log(struct utcp_connection *c, size_t size) {
+	if(!c || size > UINT32_MAX) {
+		errno = EINVAL;
+		return false;
+	}
+
+	struct utcp_event *ring = NULL;
+
+	if(size) {
+		ring = calloc(size, sizeof(*ring));
+
+		if(!ring) {
+			return false;
+		}
+	}
+
+	free(c->events.ring);
+	c->events.ring = ring;
+	c->events.size = size;
+	c->events.count = 0;
+	return true;
+}
+
+size_t utcp_get_events(struct utcp_connection *c, struct utcp_event *events, size_t max) {
+	if(!c || !c->events.ring) {
+		return 0;
+	}
+
+	// Return the most recent events, oldest first
+	uint32_t n = min(c->events.count, c->events.size);
+
+	if(!events) {
+		return n;
+	}
+
+	if(max < n) {
+		n = max;
+	}
+
+	uint32_t first = c->events.count - n;
+
+	for(uint32_t i = 0; i < n; i++) {
+		events[i] = c->events.ring[(first + i) % c->events.size];
+	}
+
+	return n;
+}
+
+int utcp_get_priority(struct utcp_connection *c) {
+	return c ? c->sched.priority : 0;
+}
+
+uint16_t utcp_get_weight(struct utcp_connection *c) {
+	return c ? c->sched.weight : 0;
+}
+
+int utcp_set_priority(struct utcp_connection *c, int priority, uint16_t weight) {
+	if(!c || priority < 0 || priority >= UTCP_PRIORITIES || !weight) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	bool queued = c->sched.queued;
+	sched_dequeue(c);
+
+	c->sched.priority = priority;
+	c->sched.weight = weight;
+
+	if(queued) {
+		sched_enqueue(c);
+	}
+
+	return 0;
+}
+
 size_t utcp_get_outq(struct utcp_connection *c) {
 	return c ? seqdiff(c->snd.nxt, c->snd.una) : 0;
 }
@@ -2461,6 +3966,98 @@ void utcp_set_retransmit_cb(struct utcp *utcp, utcp_retransmit_t cb) {
 	utcp->retransmit = cb;
 }
 
+bool utcp_set_coalesce_cb(struct utcp *utcp, utcp_coalesce_t cb) {
+	if(!utcp) {
+		errno = EFAULT;
+		return false;
+	}
+
+	if(!cb) {
+		utcp_flush(utcp);
+		free(utcp->batch.buf);
+		utcp->batch.buf = NULL;
+	} else if(!utcp->batch.buf) {
+		utcp->batch.buf = malloc(utcp->mtu);
+
+		if(!utcp->batch.buf) {
+			return false;
+		}
+	}
+
+	utcp->batch.cb = cb;
+	return true;
+}
+
+void utcp_flush(struct utcp *utcp) {
+	if(!utcp || !utcp->batch.count) {
+		return;
+	}
+
+	uint16_t len = utcp->batch.len;
+	uint16_t count = utcp->batch.count;
+	utcp->batch.len = 0;
+	utcp->batch.count = 0;
+
+	// A single packet does not need the batch framing
+	if(count == 1) {
+		utcp->send(utcp, utcp->batch.buf + BATCH_HDR_SIZE + sizeof(uint16_t), len - BATCH_HDR_SIZE - sizeof(uint16_t));
+	} else {
+		utcp->send(utcp, utcp->batch.buf, len);
+	}
+}
+
+bool utcp_set_pool(struct utcp *utcp, struct utcp_pool *pool) {
+	if(!utcp) {
+		errno = EFAULT;
+		return false;
+	}
+
+	// Buffers return their memory to the pool they got it from
+	if(utcp->nconnections) {
+		errno = EBUSY;
+		return false;
+	}
+
+	utcp->pool = pool;
+	return true;
+}
+
+struct utcp_pool *utcp_pool_init(void) {
+	return calloc(1, sizeof(struct utcp_pool));
+}
+
+void utcp_pool_exit(struct utcp_pool *pool) {
+	if(!pool) {
+		return;
+	}
+
+	assert(!pool->used);
+
+	for(int class = 0; class < POOL_CLASSES; class++) {
+		while(pool->free[class]) {
+			void *block = pool->free[class];
+			pool->free[class] = *(void **)block;
+			free(block);
+		}
+	}
+
+	free(pool);
+}
+
+size_t utcp_pool_get_limit(const struct utcp_pool *pool) {
+	return pool ? pool->limit : 0;
+}
+
+void utcp_pool_set_limit(struct utcp_pool *pool, size_t limit) {
+	if(pool) {
+		pool->limit = limit;
+	}
+}
+
+size_t utcp_pool_get_used(const struct utcp_pool *pool) {
+	return pool ? pool->used : 0;
+}
+
 void utcp_set_clock_granularity(long granularity) {
 	CLOCK_GRANULARITY = granularity;
 }
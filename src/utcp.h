@@ -25,6 +25,7 @@
 #include <stdbool.h>
 // TODO: Windows
 #include <sys/time.h>
+#include <sys/uio.h>
 
 #ifndef UTCP_INTERNAL
 struct utcp {
@@ -41,6 +42,8 @@ struct utcp;
 struct utcp_connection;
 #endif
 
+struct utcp_pool;
+
 #define UTCP_SHUT_RD 0
 #define UTCP_SHUT_WR 1
 #define UTCP_SHUT_RDWR 2
@@ -54,9 +57,46 @@ struct utcp_connection;
 #define UTCP_TCP 3
 #define UTCP_UDP 0
 
+#define UTCP_PRIORITIES 4
+
+struct utcp_stats {
+	uint32_t srtt; // usec
+	uint32_t rttvar; // usec
+	uint32_t rto; // usec
+	uint32_t cwnd;
+	uint32_t ssthresh;
+	uint32_t flightsize;
+	uint32_t dupack;
+	uint32_t sack_holes; // Number of out-of-order ranges waiting in the receive buffer
+	uint64_t bytes_sent; // Including retransmissions
+	uint64_t bytes_received;
+	uint64_t segments_sent;
+	uint64_t segments_received;
+	uint64_t retransmits;
+	uint32_t timeouts;
+	uint32_t fast_recoveries;
+};
+
+enum utcp_event_type {
+	UTCP_EVENT_TIMEOUT,
+	UTCP_EVENT_FAST_RECOVERY,
+	UTCP_EVENT_RECOVERY_END,
+};
+
+struct utcp_event {
+	struct timespec time; // CLOCK_REALTIME
+	enum utcp_event_type type;
+	uint32_t cwnd;
+	uint32_t ssthresh;
+	uint32_t flightsize;
+	uint32_t srtt; // usec
+	uint32_t rto; // usec
+};
+
 typedef bool (*utcp_pre_accept_t)(struct utcp *utcp, uint16_t port);
-typedef void (*utcp_accept_t)(struct utcp_connection *utcp_connection, uint16_t port);
+typedef void (*utcp_accept_t)(struct utcp_connection *utcp_connection, uint16_t port, const void *data, size_t len);
 typedef void (*utcp_retransmit_t)(struct utcp_connection *connection);
+typedef void (*utcp_coalesce_t)(struct utcp *utcp);
 
 typedef ssize_t (*utcp_send_t)(struct utcp *utcp, const void *data, size_t len);
 typedef ssize_t (*utcp_recv_t)(struct utcp_connection *connection, const void *data, size_t len);
@@ -67,9 +107,12 @@ struct utcp *utcp_init(utcp_accept_t accept, utcp_pre_accept_t pre_accept, utcp_
 void utcp_exit(struct utcp *utcp);
 
 struct utcp_connection *utcp_connect_ex(struct utcp *utcp, uint16_t port, utcp_recv_t recv, void *priv, uint32_t flags);
+struct utcp_connection *utcp_connect_data(struct utcp *utcp, uint16_t port, utcp_recv_t recv, void *priv, uint32_t flags, const void *data, size_t len);
 struct utcp_connection *utcp_connect(struct utcp *utcp, uint16_t port, utcp_recv_t recv, void *priv);
 void utcp_accept(struct utcp_connection *utcp, utcp_recv_t recv, void *priv);
 ssize_t utcp_send(struct utcp_connection *connection, const void *data, size_t len);
+ssize_t utcp_sendv(struct utcp_connection *connection, const struct iovec *iov, int iovcnt);
+ssize_t utcp_send_fd(struct utcp_connection *connection, int fd, size_t len);
 ssize_t utcp_recv(struct utcp *utcp, const void *data, size_t len);
 int utcp_close(struct utcp_connection *connection);
 int utcp_abort(struct utcp_connection *connection);
@@ -95,6 +138,11 @@ void utcp_reset_timers(struct utcp *utcp);
 void utcp_offline(struct utcp *utcp, bool offline);
 void utcp_set_retransmit_cb(struct utcp *utcp, utcp_retransmit_t retransmit);
 
+bool utcp_set_pool(struct utcp *utcp, struct utcp_pool *pool);
+
+bool utcp_set_coalesce_cb(struct utcp *utcp, utcp_coalesce_t coalesce);
+void utcp_flush(struct utcp *utcp);
+
 // Per-socket options
 
 size_t utcp_get_sndbuf(struct utcp_connection *connection);
@@ -105,6 +153,9 @@ size_t utcp_get_rcvbuf(struct utcp_connection *connection);
 void utcp_set_rcvbuf(struct utcp_connection *connection, size_t size);
 size_t utcp_get_rcvbuf_free(struct utcp_connection *connection);
 
+size_t utcp_get_max_bufsize(struct utcp_connection *connection);
+void utcp_set_max_bufsize(struct utcp_connection *connection, size_t size);
+
 size_t utcp_get_sendq(struct utcp_connection *connection);
 size_t utcp_get_recvq(struct utcp_connection *connection);
 
@@ -114,10 +165,34 @@ void utcp_set_nodelay(struct utcp_connection *connection, bool nodelay);
 bool utcp_get_keepalive(struct utcp_connection *connection);
 void utcp_set_keepalive(struct utcp_connection *connection, bool keepalive);
 
+uint32_t utcp_get_fec(struct utcp_connection *connection);
+void utcp_set_fec(struct utcp_connection *connection, uint32_t group);
+uint32_t utcp_get_fec_recovered(struct utcp_connection *connection);
+uint32_t utcp_get_fec_lost(struct utcp_connection *connection);
+
+uint32_t utcp_get_max_message_size(struct utcp_connection *connection);
+bool utcp_set_max_message_size(struct utcp_connection *connection, uint32_t size);
+
+int utcp_get_priority(struct utcp_connection *connection);
+uint16_t utcp_get_weight(struct utcp_connection *connection);
+int utcp_set_priority(struct utcp_connection *connection, int priority, uint16_t weight);
+
 size_t utcp_get_outq(struct utcp_connection *connection);
 
+void utcp_get_stats(struct utcp_connection *connection, struct utcp_stats *stats);
+bool utcp_set_event_log(struct utcp_connection *connection, size_t size);
+size_t utcp_get_events(struct utcp_connection *connection, struct utcp_event *events, size_t max);
+
 void utcp_expect_data(struct utcp_connection *connection, bool expect);
 
+// Buffer memory pools, which can be shared between UTCP instances
+
+struct utcp_pool *utcp_pool_init(void);
+void utcp_pool_exit(struct utcp_pool *pool);
+size_t utcp_pool_get_limit(const struct utcp_pool *pool);
+void utcp_pool_set_limit(struct utcp_pool *pool, size_t limit);
+size_t utcp_pool_get_used(const struct utcp_pool *pool);
+
 // Completely global options
 
 void utcp_set_clock_granularity(long granularity);
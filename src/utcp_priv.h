@@ -30,19 +30,33 @@
 #define FIN 4
 #define RST 8
 #define MF 16
+#define PAR 32 // Parity packet for forward error correction
 
 #define AUX_INIT 1
 #define AUX_FRAME 2
 #define AUX_SAK 3
 #define AUX_TIMESTAMP 4
 
+// Optional features, announced in the third byte of the AUX_INIT header of SYN and SYN+ACK packets.
+// A feature is only used on a connection if both sides announced it.
+#define FEATURE_PARITY 1 // Understands PAR packets
+#define FEATURE_FRAMED 2 // Keeps message boundaries on reliable connections
+#define FEATURE_BATCH 4 // Understands datagrams with several coalesced packets
+#define FEATURES (FEATURE_PARITY | FEATURE_FRAMED | FEATURE_BATCH)
+
 #define NSACKS 4
-#define DEFAULT_SNDBUFSIZE 4096
+#define BATCH_HDR_SIZE 4 // Two zero port numbers, which no segment can have since one side always uses an ephemeral port
 #define DEFAULT_MAXSNDBUFSIZE 131072
-#define DEFAULT_RCVBUFSIZE 0
 #define DEFAULT_MAXRCVBUFSIZE 131072
+#define DEFAULT_MAXBUFSIZE 4194304 // Upper limit for automatically tuned buffers
+
+#define POOL_MIN_BLOCK 4096 // Buffer memory is allocated in power of two blocks between these sizes
+#define POOL_CLASSES 11 // Up to 4 MiB
+#define POOL_MAX_CACHED 8388608 // Free blocks kept for reuse
 
 #define MAX_UNRELIABLE_SIZE 65536
+#define DEFAULT_MAX_MESSAGE_SIZE 65536 // Of framed reliable connections
+#define MAX_FRAGMENTS 1024 // Per unreliable frame, when reassembling
 #define DEFAULT_MTU 1000
 
 #define USEC_PER_SEC 1000000L
@@ -89,8 +103,16 @@ static const char *strstate[] __attribute__((unused)) = {
 	[TIME_WAIT] = "TIME_WAIT"
 };
 
+struct utcp_pool {
+	size_t limit; // Maximum number of bytes in use, 0 if unlimited
+	size_t used; // Bytes in blocks that are held by buffers
+	size_t cached; // Bytes in blocks on the free lists
+	void *free[POOL_CLASSES]; // Singly linked lists of free blocks, one per size
+};
+
 struct buffer {
-	char *data;
+	char *data; // Only allocated while the buffer holds data
+	struct utcp_pool *pool; // Where data is allocated from, NULL to use malloc() directly
 	uint32_t offset;
 	uint32_t used;
 	uint32_t size;
@@ -106,9 +128,11 @@ struct utcp_connection {
 	void *priv;
 	struct utcp *utcp;
 	uint32_t flags;
+	uint8_t features; // Optional features supported by both sides
 
 	bool reapable;
 	bool do_poll;
+	int index; // Position in utcp->connections
 
 	// Callbacks
 
@@ -126,6 +150,7 @@ struct utcp_connection {
 		uint32_t nxt;
 		uint32_t wnd;
 		uint32_t iss;
+		uint32_t syn; // Length of the data carried in the SYN
 
 		uint32_t last;
 		uint32_t cwnd;
@@ -135,6 +160,16 @@ struct utcp_connection {
 	struct {
 		uint32_t nxt;
 		uint32_t irs;
+		uint32_t wnd; // The receive window we last advertised
+		bool wnd_clamped; // Whether that was less than the receive buffer size, because the memory pool was full
+
+		// Receive window auto-tuning
+		uint32_t rtt; // usec
+		uint32_t rtt_seq;
+		struct timespec rtt_start;
+		uint32_t space; // Most data received in one RTT
+		uint32_t space_seq;
+		struct timespec space_start;
 	} rcv;
 
 	int dupack;
@@ -159,16 +194,84 @@ struct utcp_connection {
 	struct buffer rcvbuf;
 	struct sack sacks[NSACKS];
 
+	// Reassembly state of the unreliable frame being received
+
+	struct {
+		uint32_t seq; // Sequence number of the start of the frame
+		uint32_t len; // Length of the frame, 0 if not known yet
+		uint32_t fraglen; // Length of all but the last fragment, 0 if not known yet
+		uint32_t received; // Bytes of the frame received so far
+		bool started;
+		bool delivered;
+		bool has_last; // Whether the last fragment has been received
+		bool recovered; // Whether a fragment was reconstructed from a parity packet
+		uint64_t map[MAX_FRAGMENTS / 64]; // Which fragments have been received
+	} frame;
+
+	// Message boundaries of framed reliable connections.
+	// Each message is preceded by its length in the stream.
+	// An incomplete message, or one the application did not accept yet, is kept at the start of the receive buffer,
+	// out-of-order data is stored after it.
+
+	struct {
+		uint32_t max; // Maximum size of a message
+		uint32_t buffered; // In-order bytes of the incomplete or not yet accepted message in the receive buffer
+		bool pending; // The application did not accept the first complete message yet
+	} msg;
+
+	// Forward error correction for unreliable connections
+
+	struct {
+		uint32_t group; // Number of fragments covered by each parity packet, 0 if disabled
+		uint32_t recovered; // Frames that were only complete after reconstructing a fragment
+		uint32_t lost; // Partially received frames that could not be completed
+	} fec;
+
 	// Per-socket options
 
 	bool nodelay;
 	bool keepalive;
 	bool shut_wr;
+	bool autotune_sndbuf;
+	bool autotune_rcvbuf;
+	uint32_t max_bufsize;
 
 	// Congestion avoidance state
 
 	struct timespec tlast;
 	uint64_t bandwidth;
+
+	// Scheduling between connections sharing the path
+
+	struct {
+		struct utcp_connection *next; // Next connection waiting in the same priority class
+		uint32_t inflight; // Bytes in flight accounted for in utcp->sched.inflight
+		uint32_t deficit; // Bytes this connection may still send in its current round
+		uint16_t weight;
+		uint8_t priority;
+		bool queued;
+		bool turn; // Whether the deficit has been topped up for the current round
+	} sched;
+
+	// Cumulative statistics
+
+	struct {
+		uint64_t bytes_sent; // Including retransmissions
+		uint64_t bytes_received;
+		uint64_t segments_sent;
+		uint64_t segments_received;
+		uint64_t retransmits;
+		uint32_t timeouts;
+		uint32_t fast_recoveries;
+	} stats;
+
+	// Optional ring buffer of congestion events
+
+	struct {
+		struct utcp_event *ring; // NULL if disabled
+		uint32_t size;
+		uint32_t count; // Total number of events logged, the oldest ones are overwritten
+	} events;
 };
 
 struct utcp {
@@ -184,6 +287,8 @@ struct utcp {
 	// Packet buffer
 
 	void *pkt;
+	void *parity; // Only allocated when forward error correction is used
+	uint16_t parity_size;
 
 	// Global socket options
 
@@ -191,11 +296,34 @@ struct utcp {
 	uint16_t mss; // The maximum size of the payload of a UTCP packet.
 	int timeout; // sec
 
+	struct utcp_pool *pool; // Shared by the buffers of all connections, NULL if not used
+
+	// Small segments waiting to be sent together in one datagram
+
+	struct {
+		utcp_coalesce_t cb; // NULL if coalescing is disabled
+		char *buf; // Allocated with the size of the MTU
+		uint16_t len; // Bytes used in buf, including the batch header
+		uint16_t count; // Number of segments in buf
+		bool peer; // The peer announced FEATURE_BATCH in its most recent handshake
+	} batch;
+
 	// Connection management
 
-	struct utcp_connection **connections;
+	struct utcp_connection **connections; // Dense array, used for iteration
 	int nconnections;
 	int nallocated;
+
+	struct utcp_connection **table; // Open addressing hash table, keyed on (src, dst)
+	uint32_t tablesize; // Always zero or a power of two
+
+	// Deficit round robin scheduler, one queue per priority class
+
+	struct {
+		uint32_t inflight; // Total bytes in flight over all reliable connections
+		struct utcp_connection *head[UTCP_PRIORITIES];
+		struct utcp_connection *tail[UTCP_PRIORITIES];
+	} sched;
 };
 
 #endif
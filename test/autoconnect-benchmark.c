@@ -0,0 +1,262 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/meshlink_internal.h"
+#include "../src/connection.h"
+#include "../src/list.h"
+#include "../src/net.h"
+#include "../src/node.h"
+#include "../src/xalloc.h"
+
+// Measure the cost of one autoconnect tick against the number of known nodes.
+// All nodes are unreachable and their public keys are unknown, so autoconnect picks a node every tick,
+// but never actually starts a connection to it. Simulated time advances by five seconds every tick.
+// With fewer than the minimum number of connections, this looks for a node for an initial connect.
+// With exactly the minimum number of connections, this looks for better nodes and tries to heal partitions.
+// The picked nodes are first checked against a selection that builds sorted trees of all nodes every tick,
+// while the state of random nodes changes between ticks.
+// Usage: autoconnect-benchmark [maximum number of nodes [ticks]]
+
+static meshlink_handle_t *generate(dev_class_t devclass, int nnodes, int nconnections) {
+	meshlink_handle_t *mesh = meshlink_open_ephemeral("self", "autoconnect-benchmark", devclass);
+	assert(mesh);
+
+	init_outgoings(mesh);
+	mesh->loop.now.tv_sec = 1000000;
+	srand(1);
+
+	for(int i = 0; i < nnodes; i++) {
+		node_t *n = new_node();
+		xasprintf(&n->name, "node%d", i);
+		n->devclass = i < nconnections ? DEV_CLASS_BACKBONE : rand() % DEV_CLASS_UNKNOWN;
+		n->last_successfull_connection = rand() % 2 ? mesh->loop.now.tv_sec - rand() % 86400 : 0;
+
+		if(i < nconnections) {
+			connection_t *c = new_connection();
+			c->name = xstrdup(n->name);
+			c->node = n;
+			n->connection = c;
+			n->status.reachable = true;
+			connection_add(mesh, c);
+			connection_activate(mesh, c);
+		}
+
+		node_add(mesh, n);
+	}
+
+	return mesh;
+}
+
+static void destroy(meshlink_handle_t *mesh) {
+	for(list_node_t *node = mesh->connections->head, *next; node; node = next) {
+		next = node->next;
+		connection_t *c = node->data;
+		connection_deactivate(mesh, c);
+		c->node->connection = NULL;
+		list_delete_node(mesh->connections, node);
+	}
+
+	exit_outgoings(mesh);
+	meshlink_close(mesh);
+}
+
+// devclass asc, last successful connection desc with never connected nodes last, name asc
+static int compare_devclass_lsc(const void *a, const void *b) {
+	const node_t *na = a, *nb = b;
+
+	if(na->devclass != nb->devclass) {
+		return na->devclass < nb->devclass ? -1 : 1;
+	}
+
+	if(na->last_successfull_connection != nb->last_successfull_connection) {
+		return na->last_successfull_connection > nb->last_successfull_connection ? -1 : 1;
+	}
+
+	return strcmp(na->name, nb->name);
+}
+
+static bool may_try(meshlink_handle_t *mesh, node_t *n, int retry_timeout) {
+	return n != mesh->self && !n->status.blacklisted && (n->last_connect_try == 0 || (mesh->loop.now.tv_sec - n->last_connect_try) > retry_timeout);
+}
+
+// The node autoconnect should try next, found by sorting all candidates every time.
+static node_t *reference_candidate(meshlink_handle_t *mesh) {
+	int retry_timeout = mesh->nodes->count * 5 < 60 ? mesh->nodes->count * 5 : 60;
+	unsigned int min_connects = mesh->dev_class_traits[mesh->devclass].min_connects;
+	unsigned int max_connects = mesh->dev_class_traits[mesh->devclass].max_connects;
+	unsigned int cur_connects = 0;
+
+	for list_each(connection_t, c, mesh->connections) {
+		cur_connects += c->status.active;
+	}
+
+	node_t *result = NULL;
+	splay_tree_t *nodes = splay_alloc_tree(compare_devclass_lsc, NULL);
+
+	// Initial connect
+	if(cur_connects < min_connects) {
+		for splay_each(node_t, n, mesh->nodes) {
+			if(n->devclass <= mesh->devclass && !n->connection && may_try(mesh, n, retry_timeout)) {
+				splay_insert(nodes, n);
+			}
+		}
+	}
+
+	// Better nodes, per devclass while there are not enough connections to that and better devclasses
+	if(min_connects <= cur_connects && cur_connects < max_connects) {
+		unsigned int connects = 0;
+
+		for(dev_class_t devclass = 0; devclass <= mesh->devclass && !nodes->head; ++devclass) {
+			for list_each(connection_t, c, mesh->connections) {
+				connects += c->status.active && c->node && c->node->devclass == devclass;
+			}
+
+			if(connects >= min_connects) {
+				break;
+			}
+
+			for splay_each(node_t, n, mesh->nodes) {
+				if(n->devclass == devclass && !n->connection && may_try(mesh, n, retry_timeout)) {
+					splay_insert(nodes, n);
+				}
+			}
+		}
+
+		// Partition healing
+		if(!nodes->head) {
+			for splay_each(node_t, n, mesh->nodes) {
+				if(n->devclass <= mesh->devclass && !n->status.reachable && may_try(mesh, n, retry_timeout)) {
+					splay_insert(nodes, n);
+				}
+			}
+		}
+	}
+
+	if(nodes->head) {
+		result = nodes->head->data;
+	}
+
+	splay_delete_tree(nodes);
+	return result;
+}
+
+// Change the state of a random node that we have no connection with.
+static void change_random_node(meshlink_handle_t *mesh, int nnodes) {
+	node_t *n;
+
+	do {
+		char name[16];
+		snprintf(name, sizeof(name), "node%d", rand() % nnodes);
+		n = lookup_node(mesh, name);
+	} while(n->connection);
+
+	switch(rand() % 4) {
+	case 0:
+		n->status.reachable = !n->status.reachable;
+		break;
+
+	case 1:
+		n->status.blacklisted = !n->status.blacklisted;
+		break;
+
+	case 2:
+		n->devclass = rand() % DEV_CLASS_UNKNOWN;
+		break;
+
+	default:
+		n->last_successfull_connection = rand() % 2 ? mesh->loop.now.tv_sec - rand() % 86400 : 0;
+		break;
+	}
+
+	node_autoconnect_changed(mesh, n);
+}
+
+static void check(int nnodes, int nconnections, int nticks) {
+	meshlink_handle_t *mesh = generate(DEV_CLASS_STATIONARY, nnodes, nconnections);
+
+	// With one connection to a worse devclass, autoconnect also looks for better nodes.
+	if(nconnections) {
+		node_t *n = lookup_node(mesh, "node0");
+		n->devclass = DEV_CLASS_STATIONARY;
+		node_autoconnect_changed(mesh, n);
+	}
+
+	for(int i = 0; i < nticks; i++) {
+		change_random_node(mesh, nnodes);
+		node_t *expected = reference_candidate(mesh);
+
+		autoconnect(mesh);
+
+		node_t *tried = NULL;
+
+		for splay_each(node_t, n, mesh->nodes) {
+			if(n->last_connect_try == mesh->loop.now.tv_sec) {
+				assert(!tried);
+				tried = n;
+			}
+		}
+
+		assert(tried == expected);
+		mesh->loop.now.tv_sec += 5;
+	}
+
+	destroy(mesh);
+}
+
+static double run(int nnodes, int nconnections, int nticks) {
+	meshlink_handle_t *mesh = generate(DEV_CLASS_BACKBONE, nnodes, nconnections);
+
+	// The first tick after adding all the nodes is not representative, so leave it out.
+
+	autoconnect(mesh);
+	mesh->loop.now.tv_sec += 5;
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < nticks; i++) {
+		autoconnect(mesh);
+		mesh->loop.now.tv_sec += 5;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	// No connection attempts should have been made, but nodes should have been tried.
+
+	assert(!mesh->outgoings->count);
+	int tried = 0;
+
+	for splay_each(node_t, n, mesh->nodes) {
+		tried += n->last_connect_try != 0;
+	}
+
+	assert(tried > 0);
+
+	destroy(mesh);
+	return elapsed * 1e6 / nticks;
+}
+
+int main(int argc, char *argv[]) {
+	int max_nodes = argc > 1 ? atoi(argv[1]) : 10000;
+	int nticks = argc > 2 ? atoi(argv[2]) : 100;
+	assert(max_nodes >= 10 && nticks > 0);
+
+	check(100, 0, 1000);
+	check(100, 3, 1000);
+
+	for(int nnodes = 10; nnodes <= max_nodes; nnodes *= 10) {
+		double initial = run(nnodes, 0, nticks);
+		double healing = run(nnodes, 3, nticks);
+		fprintf(stderr, "%6d nodes: %8.1f us/tick for initial connects, %8.1f us/tick for partition healing\n", nnodes, initial, healing);
+	}
+}
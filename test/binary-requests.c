@@ -0,0 +1,119 @@
+#define _GNU_SOURCE
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Check that nodes using binary requests interoperate with nodes that only use text requests.
+// The hub and the first leaf use binary requests, the second leaf only text requests,
+// so requests between the leaves have to be converted by the hub.
+
+static struct sync_flag received[3];
+static struct sync_flag learned[3];
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_node_t *source, const void *data, size_t len) {
+	(void)source;
+
+	if(len == 5 && !memcmp(data, "Hello", 5)) {
+		set_sync_flag(&received[*(int *)mesh->priv], true);
+	}
+}
+
+static void status_cb(meshlink_handle_t *mesh, meshlink_node_t *node, bool reachable) {
+	if(reachable && node != meshlink_get_self(mesh) && strcmp(node->name, "hub")) {
+		set_sync_flag(&learned[*(int *)mesh->priv], true);
+	}
+}
+
+static void send_hello(meshlink_handle_t *from, meshlink_handle_t *to, int index) {
+	meshlink_node_t *dest = meshlink_get_node(from, meshlink_get_self(to)->name);
+	assert(dest);
+
+	for(int j = 0; j < 15; j++) {
+		assert(meshlink_send(from, dest, "Hello", 5));
+
+		if(wait_sync_flag(&received[index], 1)) {
+			break;
+		}
+	}
+
+	assert(wait_sync_flag(&received[index], 15));
+}
+
+int main(void) {
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Create three instances.
+
+	const char *name[3] = {"hub", "binary", "text"};
+	int index[3] = {0, 1, 2};
+	meshlink_handle_t *mesh[3];
+	char *data[3];
+
+	for(int i = 0; i < 3; i++) {
+		init_sync_flag(&received[i]);
+		init_sync_flag(&learned[i]);
+
+		char *path = NULL;
+		assert(asprintf(&path, "binary_requests_conf.%d", i) != -1 && path);
+
+		assert(meshlink_destroy(path));
+		mesh[i] = meshlink_open(path, name[i], "binary-requests", DEV_CLASS_BACKBONE);
+		assert(mesh[i]);
+		free(path);
+
+		mesh[i]->priv = &index[i];
+		assert(meshlink_set_canonical_address(mesh[i], meshlink_get_self(mesh[i]), "localhost", NULL));
+		meshlink_enable_discovery(mesh[i], false);
+
+		data[i] = meshlink_export(mesh[i]);
+		assert(data[i]);
+	}
+
+	devtool_force_text_requests(mesh[2], true);
+
+	// The hub knows the two leaves, the leaves only know the hub.
+
+	for(int i = 1; i < 3; i++) {
+		assert(meshlink_import(mesh[i], data[0]));
+		assert(meshlink_import(mesh[0], data[i]));
+	}
+
+	for(int i = 0; i < 3; i++) {
+		free(data[i]);
+		meshlink_set_node_status_cb(mesh[i], status_cb);
+		meshlink_set_receive_cb(mesh[i], receive_cb);
+		assert(meshlink_start(mesh[i]));
+	}
+
+	// The leaves should learn about each other via the hub.
+
+	assert(wait_sync_flag(&learned[1], 15));
+	assert(wait_sync_flag(&learned[2], 15));
+
+	// Packets should arrive in both directions, which requires the key exchange to go through the hub.
+
+	send_hello(mesh[1], mesh[2], 2);
+	send_hello(mesh[2], mesh[1], 1);
+
+	// The leaves should also be able to reach the hub.
+
+	send_hello(mesh[1], mesh[0], 0);
+	set_sync_flag(&received[0], false);
+	send_hello(mesh[2], mesh[0], 0);
+
+	// Clean up.
+
+	for(int i = 0; i < 3; i++) {
+		meshlink_close(mesh[i]);
+	}
+}
@@ -0,0 +1,204 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Check that AIO requests submitted to a completion queue transfer data intact,
+// and that their completions can be reaped from the application's own thread.
+
+static const size_t size = 2000000; // size of data to transfer per channel
+#define NCHANNELS 4 // number of simultaneous channels
+
+static char *indata[NCHANNELS];
+static meshlink_completion_queue_t *cq_b;
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port && port <= NCHANNELS);
+	size_t i = port - 1;
+
+	// Receive each channel's data into two buffers.
+
+	meshlink_aio_request_t requests[2] = {
+		{channel, MESHLINK_AIO_RECEIVE, indata[i], -1, size / 4, (void *)(2 * i)},
+		{channel, MESHLINK_AIO_RECEIVE, indata[i] + size / 4, -1, size - size / 4, (void *)(2 * i + 1)},
+	};
+
+	assert(meshlink_completion_queue_submit(mesh, cq_b, requests, 2));
+	return true;
+}
+
+int main(void) {
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Prepare data buffers, and a file containing the same data.
+
+	char *outdata = malloc(size);
+	assert(outdata);
+
+	for(size_t i = 0; i < size; i++) {
+		outdata[i] = i;
+	}
+
+	for(size_t i = 0; i < NCHANNELS; i++) {
+		indata[i] = malloc(size);
+		assert(indata[i]);
+	}
+
+	FILE *file = tmpfile();
+	assert(file);
+	assert(fwrite(outdata, size, 1, file) == 1);
+	assert(fflush(file) == 0);
+	int fd = fileno(file);
+	assert(lseek(fd, size / 3, SEEK_SET) == (off_t)(size / 3));
+
+	// Open two new meshlink instances, each with a completion queue.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_aio_cq");
+
+	meshlink_completion_queue_t *cq_a = meshlink_completion_queue_open(mesh_a);
+	assert(cq_a);
+	cq_b = meshlink_completion_queue_open(mesh_b);
+	assert(cq_b);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channels[NCHANNELS];
+
+	for(size_t i = 0; i < NCHANNELS; i++) {
+		channels[i] = meshlink_channel_open(mesh_a, b, i + 1, NULL, NULL, 0);
+		assert(channels[i]);
+	}
+
+	// Invalid requests are rejected, and nothing is submitted.
+
+	meshlink_aio_request_t requests[2 * NCHANNELS];
+	memset(requests, 0, sizeof(requests));
+	requests[0] = (meshlink_aio_request_t) {channels[0], MESHLINK_AIO_SEND, outdata, -1, size, NULL};
+	requests[1] = (meshlink_aio_request_t) {channels[0], MESHLINK_AIO_SEND, NULL, -1, size, NULL};
+	assert(!meshlink_completion_queue_submit(mesh_a, cq_a, requests, 2));
+
+	// Submit all sends at once, the last part of the first channel comes from the file.
+
+	for(size_t i = 0; i < NCHANNELS; i++) {
+		requests[2 * i] = (meshlink_aio_request_t) {channels[i], MESHLINK_AIO_SEND, outdata, -1, size / 3, (void *)(2 * i)};
+		requests[2 * i + 1] = (meshlink_aio_request_t) {channels[i], MESHLINK_AIO_SEND, outdata + size / 3, -1, size - size / 3, (void *)(2 * i + 1)};
+	}
+
+	requests[1].data = NULL;
+	requests[1].fd = fd;
+
+	assert(meshlink_completion_queue_submit(mesh_a, cq_a, requests, 2 * NCHANNELS));
+
+	// Reap the send completions by polling the queue's filedescriptor.
+
+	bool seen[2 * NCHANNELS];
+	memset(seen, 0, sizeof(seen));
+
+	for(size_t reaped = 0; reaped < 2 * NCHANNELS;) {
+		struct pollfd pfd = {meshlink_completion_queue_get_fd(mesh_a, cq_a), POLLIN, 0};
+		assert(poll(&pfd, 1, 10000) == 1);
+
+		meshlink_aio_completion_t completions[3];
+		size_t count = meshlink_completion_queue_reap(mesh_a, cq_a, completions, 3);
+		assert(count);
+
+		for(size_t j = 0; j < count; j++) {
+			size_t k = (size_t)completions[j].priv;
+			assert(k < 2 * NCHANNELS && !seen[k]);
+			assert(k % 2 || !seen[k + 1]);
+			seen[k] = true;
+
+			assert(completions[j].op == MESHLINK_AIO_SEND);
+			assert(completions[j].channel == channels[k / 2]);
+			assert(completions[j].len == (k % 2 ? size - size / 3 : size / 3));
+
+			if(k == 1) {
+				assert(!completions[j].data && completions[j].fd == fd);
+			} else {
+				assert(completions[j].data == requests[k].data && completions[j].fd == -1);
+			}
+		}
+
+		reaped += count;
+	}
+
+	// Once the queue is empty, the filedescriptor is no longer readable.
+
+	struct pollfd pfd = {meshlink_completion_queue_get_fd(mesh_a, cq_a), POLLIN, 0};
+	assert(poll(&pfd, 1, 0) == 0);
+
+	meshlink_aio_completion_t completion;
+	assert(meshlink_completion_queue_reap(mesh_a, cq_a, &completion, 1) == 0);
+
+	// Wait for the receive completions on the other side.
+
+	memset(seen, 0, sizeof(seen));
+
+	for(size_t reaped = 0; reaped < 2 * NCHANNELS; reaped++) {
+		assert(meshlink_completion_queue_wait(mesh_b, cq_b, &completion, 1, 10000) == 1);
+
+		size_t k = (size_t)completion.priv;
+		assert(k < 2 * NCHANNELS && !seen[k]);
+		assert(k % 2 || !seen[k + 1]);
+		seen[k] = true;
+
+		assert(completion.op == MESHLINK_AIO_RECEIVE);
+		assert(completion.len == (k % 2 ? size - size / 4 : size / 4));
+	}
+
+	for(size_t i = 0; i < NCHANNELS; i++) {
+		assert(!memcmp(indata[i], outdata, size));
+	}
+
+	assert(meshlink_completion_queue_wait(mesh_b, cq_b, &completion, 1, 10) == 0);
+
+	// A queue with outstanding requests cannot be closed, closing their channel completes them.
+
+	char buf[100];
+	meshlink_aio_request_t request = {channels[0], MESHLINK_AIO_RECEIVE, buf, -1, sizeof(buf), buf};
+	assert(meshlink_completion_queue_submit(mesh_a, cq_a, &request, 1));
+
+	meshlink_errno = MESHLINK_OK;
+	assert(!meshlink_completion_queue_close(mesh_a, cq_a));
+	assert(meshlink_errno == MESHLINK_EINVAL);
+
+	meshlink_channel_close(mesh_a, channels[0]);
+
+	assert(meshlink_completion_queue_reap(mesh_a, cq_a, &completion, 1) == 1);
+	assert(completion.op == MESHLINK_AIO_RECEIVE);
+	assert(completion.priv == buf && completion.len == 0);
+
+	// Clean up.
+
+	for(size_t i = 1; i < NCHANNELS; i++) {
+		meshlink_channel_close(mesh_a, channels[i]);
+	}
+
+	assert(meshlink_completion_queue_close(mesh_a, cq_a));
+	assert(meshlink_completion_queue_close(mesh_b, cq_b));
+	close_meshlink_pair(mesh_a, mesh_b);
+
+	for(size_t i = 0; i < NCHANNELS; i++) {
+		free(indata[i]);
+	}
+
+	fclose(file);
+	free(outdata);
+}
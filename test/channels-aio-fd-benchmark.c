@@ -0,0 +1,129 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Measure the throughput of sending a file from one fd to another over a channel.
+// Usage: channels-aio-fd-benchmark [size in MiB]
+
+struct aio_info {
+	size_t size;
+	struct timespec ts;
+	struct sync_flag flag;
+};
+
+static size_t size;
+static FILE *outfile;
+static struct aio_info in_info;
+static struct aio_info out_info;
+
+static void aio_fd_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, int fd, size_t len, void *priv) {
+	(void)mesh;
+	(void)channel;
+	(void)fd;
+
+	struct aio_info *info = priv;
+	clock_gettime(CLOCK_MONOTONIC, &info->ts);
+	info->size = len;
+	set_sync_flag(&info->flag, true);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 1);
+	assert(meshlink_channel_aio_fd_receive(mesh, channel, fileno(outfile), size, aio_fd_cb, &in_info));
+
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	size = (argc > 1 ? atol(argv[1]) : 1024) * 1024 * 1024;
+	assert(size);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Prepare the input file
+
+	static char buf[1024 * 1024];
+
+	for(size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = rand();
+	}
+
+	FILE *infile = fopen("channels_aio_fd_benchmark.in", "w");
+	assert(infile);
+
+	for(size_t done = 0; done < size; done += sizeof(buf)) {
+		size_t todo = size - done < sizeof(buf) ? size - done : sizeof(buf);
+		buf[0] = done / sizeof(buf);
+		assert(fwrite(buf, todo, 1, infile) == 1);
+	}
+
+	assert(fclose(infile) == 0);
+
+	infile = fopen("channels_aio_fd_benchmark.in", "r");
+	assert(infile);
+	outfile = fopen("channels_aio_fd_benchmark.out", "w");
+	assert(outfile);
+
+	init_sync_flag(&in_info.flag);
+	init_sync_flag(&out_info.flag);
+
+	// Open two new meshlink instances.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_aio_fd_benchmark");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	// Send the file from a to b.
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	struct timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 1, NULL, NULL, 0);
+	assert(channel);
+	assert(meshlink_channel_aio_fd_send(mesh_a, channel, fileno(infile), size, aio_fd_cb, &out_info));
+
+	assert(wait_sync_flag(&out_info.flag, 600));
+	assert(wait_sync_flag(&in_info.flag, 600));
+
+	assert(out_info.size == size);
+	assert(in_info.size == size);
+
+	double elapsed = in_info.ts.tv_sec - start.tv_sec + (in_info.ts.tv_nsec - start.tv_nsec) * 1e-9;
+	fprintf(stderr, "%lu bytes in %.3f s, %.3f MB/s\n", (unsigned long)size, elapsed, size / elapsed / 1e6);
+
+	// Check that the file arrived intact.
+
+	assert(fclose(infile) == 0);
+	assert(fclose(outfile) == 0);
+	assert(system("cmp channels_aio_fd_benchmark.in channels_aio_fd_benchmark.out") == 0);
+
+	// Clean up.
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+
+	unlink("channels_aio_fd_benchmark.in");
+	unlink("channels_aio_fd_benchmark.out");
+}
@@ -0,0 +1,170 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+#include "../src/devtools.h"
+
+// Check that small messages on many channels to the same node arrive intact when they are coalesced,
+// and that they share datagrams.
+
+#define NCHANNELS 32
+#define NROUNDS 50
+#define MSGSIZE 16
+
+static struct sync_flag accept_flag;
+static struct sync_flag done_flag;
+static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int accepted;
+static size_t received[NCHANNELS];
+static size_t total;
+static size_t udp_received;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+
+	const unsigned char *p = data;
+	size_t i = (size_t)channel->priv;
+
+	pthread_mutex_lock(&count_mutex);
+
+	// Every byte contains the index of the channel
+	for(size_t j = 0; j < len; j++) {
+		assert(p[j] == i);
+	}
+
+	received[i] += len;
+	total += len;
+
+	if(total == NCHANNELS * NROUNDS * MSGSIZE) {
+		set_sync_flag(&done_flag, true);
+	}
+
+	pthread_mutex_unlock(&count_mutex);
+}
+
+static void udp_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+
+	if(len) {
+		pthread_mutex_lock(&count_mutex);
+		udp_received++;
+		pthread_mutex_unlock(&count_mutex);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	if(port == NCHANNELS + 1) {
+		meshlink_set_channel_receive_cb(mesh, channel, udp_receive_cb);
+		return true;
+	}
+
+	assert(port >= 1 && port <= NCHANNELS);
+	channel->priv = (void *)(size_t)(port - 1);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+
+	pthread_mutex_lock(&count_mutex);
+
+	if(++accepted == NCHANNELS) {
+		set_sync_flag(&accept_flag, true);
+	}
+
+	pthread_mutex_unlock(&count_mutex);
+	return true;
+}
+
+int main(void) {
+	init_sync_flag(&accept_flag);
+	init_sync_flag(&done_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open two new meshlink instances that both coalesce channel packets.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_coalescing");
+	meshlink_set_channel_coalescing(mesh_a, true);
+	meshlink_set_channel_coalescing(mesh_b, true);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	// Open many channels, and wait until they are all connected.
+
+	meshlink_channel_t *channels[NCHANNELS];
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		channels[i] = meshlink_channel_open(mesh_a, b, i + 1, NULL, NULL, 0);
+		assert(channels[i]);
+	}
+
+	assert(wait_sync_flag(&accept_flag, 10));
+
+	// Send one small message on every channel per round.
+
+	devtool_node_status_t before, after;
+	devtool_get_node_status(mesh_a, b, &before);
+
+	char buf[NCHANNELS][MSGSIZE];
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		memset(buf[i], i, MSGSIZE);
+	}
+
+	for(int round = 0; round < NROUNDS; round++) {
+		for(int i = 0; i < NCHANNELS; i++) {
+			assert(meshlink_channel_send(mesh_a, channels[i], buf[i], MSGSIZE) == MSGSIZE);
+		}
+	}
+
+	assert(wait_sync_flag(&done_flag, 20));
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		assert(received[i] == NROUNDS * MSGSIZE);
+	}
+
+	// Without coalescing, every message would have needed its own datagram.
+
+	devtool_get_node_status(mesh_a, b, &after);
+	fprintf(stderr, "%d messages in %lu datagrams\n", NCHANNELS * NROUNDS, (unsigned long)(after.out_packets - before.out_packets));
+	assert(after.out_packets - before.out_packets < NCHANNELS * NROUNDS / 2);
+
+	// Packets sent from an application thread on unreliable channels are flushed without waiting for other events.
+
+	meshlink_channel_t *udp = meshlink_channel_open_ex(mesh_a, b, NCHANNELS + 1, NULL, NULL, 0, MESHLINK_CHANNEL_UDP);
+	assert(udp);
+
+	for(int i = 0; i < 100 && !udp_received; i++) {
+		assert(meshlink_channel_send(mesh_a, udp, buf[0], MSGSIZE) >= 0);
+		const struct timespec req = {0, 10000000};
+		nanosleep(&req, NULL);
+	}
+
+	assert(udp_received);
+
+	// Clean up.
+
+	meshlink_channel_close(mesh_a, udp);
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		meshlink_channel_close(mesh_a, channels[i]);
+	}
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,106 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <cstring>
+
+#include "coroutines.h"
+
+// Check that channel operations can be awaited from coroutines,
+// and that those coroutines are always resumed on their executor.
+
+#define NROUNDS 1000
+#define MSGSIZE 1000
+
+static completion_flag echo_done;
+static completion_flag client_done;
+
+// Echo everything back, double-buffered so there is always a receive outstanding.
+static task echo(meshlink::async_channel ch, thread_executor &exec) {
+	char buf[2][MSGSIZE];
+	int current = 0;
+	ssize_t len = co_await ch.receive(buf[current], MSGSIZE);
+
+	while(len == MSGSIZE) {
+		assert(exec.in_thread());
+		meshlink::receive_operation next = ch.receive(buf[!current], MSGSIZE);
+		assert(co_await ch.send(buf[current], len) == len);
+		current = !current;
+		len = co_await next;
+	}
+
+	// The client closed its side.
+	assert(exec.in_thread());
+	assert(len == 0);
+	ch.close();
+	echo_done.set();
+}
+
+class server_mesh: public peer_mesh {
+public:
+	thread_executor *exec;
+
+	bool channel_accept(meshlink::channel *channel, uint16_t port, const void *data, size_t len) override {
+		(void)data;
+		(void)len;
+
+		assert(port == 1);
+		echo(get_async_channel(channel, *exec), *exec);
+		return true;
+	}
+};
+
+static task client(peer_mesh &mesh, meshlink::node *peer, thread_executor &exec) {
+	co_await switch_to{exec};
+
+	// Invalid arguments result in an empty channel.
+
+	meshlink::async_channel invalid = co_await mesh.open_channel(NULL, 1, exec);
+	assert(!invalid);
+
+	meshlink::async_channel ch = co_await mesh.open_channel(peer, 1, exec);
+	assert(ch);
+	assert(exec.in_thread());
+
+	char out[MSGSIZE];
+	char in[MSGSIZE];
+
+	for(int i = 0; i < NROUNDS; i++) {
+		memset(out, i, sizeof(out));
+
+		// Start receiving before sending, so the reply cannot arrive before there is a buffer for it.
+		meshlink::receive_operation reply = ch.receive(std::span(in));
+		assert(co_await ch.send(std::span(out)) == MSGSIZE);
+		assert(exec.in_thread());
+		assert(co_await reply == MSGSIZE);
+		assert(exec.in_thread());
+		assert(!memcmp(in, out, MSGSIZE));
+	}
+
+	ch.close();
+	client_done.set();
+}
+
+int main(void) {
+	// The executors must outlive the meshes.
+
+	thread_executor client_exec;
+	thread_executor server_exec;
+
+	peer_mesh mesh_a;
+	server_mesh mesh_b;
+	mesh_b.exec = &server_exec;
+	open_mesh_pair(mesh_a, mesh_b, "channels_coroutines");
+
+	meshlink::node *b = mesh_a.get_node("b");
+	assert(b);
+
+	client(mesh_a, b, client_exec);
+
+	assert(client_done.wait(60));
+	assert(echo_done.wait(10));
+
+	mesh_a.close();
+	mesh_b.close();
+}
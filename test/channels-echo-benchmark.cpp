@@ -0,0 +1,159 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "coroutines.h"
+
+// Compare the round trip rate of an echo service written with callbacks and one written with coroutines.
+// Usage: channels-echo-benchmark [rounds [message size]]
+
+static int nrounds;
+static size_t msgsize;
+
+static completion_flag callback_done;
+static completion_flag coroutine_done;
+
+static task echo(meshlink::async_channel ch) {
+	std::vector<char> buf[2] = {std::vector<char>(msgsize), std::vector<char>(msgsize)};
+	int current = 0;
+	ssize_t len = co_await ch.receive(buf[current].data(), msgsize);
+
+	while(len == (ssize_t)msgsize) {
+		meshlink::receive_operation next = ch.receive(buf[!current].data(), msgsize);
+		co_await ch.send(buf[current].data(), len);
+		current = !current;
+		len = co_await next;
+	}
+
+	ch.close();
+}
+
+// The server echoes with callbacks on port 1, and with coroutines on port 2.
+class server_mesh: public peer_mesh {
+public:
+	thread_executor *exec;
+
+	bool channel_accept(meshlink::channel *channel, uint16_t port, const void *data, size_t len) override {
+		(void)data;
+		(void)len;
+
+		if(port == 2) {
+			// Mark the channel as owned by the coroutine.
+			channel->priv = this;
+			echo(get_async_channel(channel, *exec));
+		}
+
+		return true;
+	}
+
+	void channel_receive(meshlink::channel *channel, const void *data, size_t len) override {
+		if(!len) {
+			if(!channel->priv) {
+				channel_close(channel);
+			}
+
+			return;
+		}
+
+		assert(channel_send(channel, (void *)data, len) == (ssize_t)len);
+	}
+};
+
+// The callback client sends the next message whenever the previous one has been echoed completely.
+class client_mesh: public peer_mesh {
+public:
+	std::vector<char> message;
+	size_t received = 0;
+	int rounds = 0;
+
+	void channel_receive(meshlink::channel *channel, const void *data, size_t len) override {
+		(void)data;
+
+		if(!len) {
+			return;
+		}
+
+		received += len;
+
+		if(received < msgsize) {
+			return;
+		}
+
+		assert(received == msgsize);
+		received = 0;
+
+		if(++rounds < nrounds) {
+			assert(channel_send(channel, message.data(), msgsize) == (ssize_t)msgsize);
+		} else {
+			callback_done.set();
+		}
+	}
+};
+
+static task coroutine_client(client_mesh &mesh, meshlink::node *peer, thread_executor &exec) {
+	co_await switch_to{exec};
+
+	meshlink::async_channel ch = co_await mesh.open_channel(peer, 2, exec);
+	assert(ch);
+
+	std::vector<char> in(msgsize);
+
+	for(int i = 0; i < nrounds; i++) {
+		meshlink::receive_operation reply = ch.receive(in.data(), msgsize);
+		co_await ch.send(mesh.message.data(), msgsize);
+		assert(co_await reply == (ssize_t)msgsize);
+	}
+
+	ch.close();
+	coroutine_done.set();
+}
+
+static void report(const char *style, std::chrono::steady_clock::time_point start) {
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	fprintf(stderr, "%-10s %d round trips of %lu bytes in %.3f s, %.0f round trips/s\n", style, nrounds, (unsigned long)msgsize, elapsed, nrounds / elapsed);
+}
+
+int main(int argc, char *argv[]) {
+	nrounds = argc > 1 ? atoi(argv[1]) : 10000;
+	msgsize = argc > 2 ? atol(argv[2]) : 100;
+	assert(nrounds > 0 && msgsize);
+
+	thread_executor client_exec;
+	thread_executor server_exec;
+
+	client_mesh mesh_a;
+	server_mesh mesh_b;
+	mesh_a.message.resize(msgsize);
+	mesh_b.exec = &server_exec;
+	open_mesh_pair(mesh_a, mesh_b, "channels_echo_benchmark");
+
+	meshlink::node *b = mesh_a.get_node("b");
+	assert(b);
+
+	// Callbacks
+
+	auto start = std::chrono::steady_clock::now();
+	meshlink::channel *channel = mesh_a.channel_open(b, 1, NULL, 0);
+	assert(channel);
+	assert(mesh_a.channel_send(channel, mesh_a.message.data(), msgsize) == (ssize_t)msgsize);
+	assert(callback_done.wait(600));
+	report("callbacks", start);
+	mesh_a.channel_close(channel);
+
+	// Coroutines
+
+	start = std::chrono::steady_clock::now();
+	coroutine_client(mesh_a, b, client_exec);
+	assert(coroutine_done.wait(600));
+	report("coroutines", start);
+
+	mesh_a.close();
+	mesh_b.close();
+}
@@ -0,0 +1,149 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Check that reliable framed channels deliver each message exactly once and in one piece,
+// including messages that span many packets.
+
+#define NMESSAGES 200
+#define BIG_MESSAGE 200000
+
+static const size_t sizes[] = {1, 4, 100, 1000, 1500, 3000, 10000, 65536};
+#define NSIZES (sizeof(sizes) / sizeof(*sizes))
+
+static struct sync_flag poll_flag;
+static struct sync_flag done_flag;
+static struct sync_flag closed_flag;
+static size_t received;
+
+static size_t message_size(size_t i) {
+	return i == NMESSAGES ? BIG_MESSAGE : sizes[i % NSIZES];
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	const unsigned char *p = data;
+
+	// The channel is closed by the sender after the last message.
+	if(!len) {
+		assert(received == NMESSAGES + 1);
+		return;
+	}
+
+	assert(received <= NMESSAGES);
+	assert(len == message_size(received));
+	assert(p[0] == (received & 0xff) && p[len - 1] == (received & 0xff));
+
+	if(++received == NMESSAGES + 1) {
+		set_sync_flag(&done_flag, true);
+	}
+}
+
+static void oversized_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)data;
+
+	// The message is too big for the receiver, so the channel is closed instead.
+	assert(!len);
+	meshlink_channel_close(mesh, channel);
+	set_sync_flag(&closed_flag, true);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	if(port == 1) {
+		meshlink_set_channel_max_message_size(mesh, channel, BIG_MESSAGE);
+		meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	} else {
+		meshlink_set_channel_receive_cb(mesh, channel, oversized_receive_cb);
+	}
+
+	return true;
+}
+
+static void poll_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)len;
+
+	set_sync_flag(&poll_flag, true);
+}
+
+static void send_message(meshlink_handle_t *mesh, meshlink_channel_t *channel, const char *buf, size_t len) {
+	ssize_t sent;
+
+	while(!(sent = meshlink_channel_send(mesh, channel, buf, len))) {
+		assert(wait_sync_flag(&poll_flag, 10));
+		set_sync_flag(&poll_flag, false);
+	}
+
+	assert(sent == (ssize_t)len);
+}
+
+int main(void) {
+	init_sync_flag(&poll_flag);
+	init_sync_flag(&done_flag);
+	init_sync_flag(&closed_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open two new meshlink instances.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_framed");
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open_ex(mesh_a, b, 1, NULL, NULL, 0, MESHLINK_CHANNEL_TCP | MESHLINK_CHANNEL_FRAMED);
+	assert(channel);
+	meshlink_set_channel_poll_cb(mesh_a, channel, poll_cb);
+
+	// Messages must be sent as a whole, and framed channels cannot use AIO.
+
+	static char buf[BIG_MESSAGE];
+	assert(meshlink_channel_send(mesh_a, channel, buf, 65537) == -1);
+	assert(!meshlink_channel_aio_send(mesh_a, channel, buf, 100, NULL, NULL));
+	meshlink_set_channel_max_message_size(mesh_a, channel, BIG_MESSAGE);
+
+	// Send messages of various sizes, each filled with its sequence number.
+
+	for(size_t i = 0; i <= NMESSAGES; i++) {
+		size_t len = message_size(i);
+		memset(buf, i & 0xff, len);
+		send_message(mesh_a, channel, buf, len);
+	}
+
+	assert(wait_sync_flag(&done_flag, 60));
+	assert(received == NMESSAGES + 1);
+
+	// A message larger than the peer accepts closes the channel.
+
+	meshlink_channel_t *oversized = meshlink_channel_open_ex(mesh_a, b, 2, NULL, NULL, 0, MESHLINK_CHANNEL_TCP | MESHLINK_CHANNEL_FRAMED);
+	assert(oversized);
+	meshlink_set_channel_poll_cb(mesh_a, oversized, poll_cb);
+	meshlink_set_channel_max_message_size(mesh_a, oversized, BIG_MESSAGE);
+	set_sync_flag(&poll_flag, false);
+	send_message(mesh_a, oversized, buf, 100000);
+	assert(wait_sync_flag(&closed_flag, 20));
+
+	// Clean up.
+
+	meshlink_channel_close(mesh_a, oversized);
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+}
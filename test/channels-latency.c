@@ -0,0 +1,124 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Measure the latency of opening a channel, sending a request and receiving the response,
+// with the request sent after opening the channel and with the request sent along with it.
+
+#define ROUNDS 100
+
+static struct sync_flag response_flag;
+static int accepted_with_data;
+
+static const char request[] = "request";
+
+static void a_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	if(len == sizeof(request) && !memcmp(data, request, len)) {
+		set_sync_flag(&response_flag, true);
+	}
+}
+
+static void b_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	if(!len) {
+		meshlink_channel_close(mesh, channel);
+		return;
+	}
+
+	// Echo the request back.
+	assert(meshlink_channel_send(mesh, channel, data, len) == (ssize_t)len);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	assert(port == 7);
+
+	meshlink_set_channel_receive_cb(mesh, channel, b_receive_cb);
+
+	if(data) {
+		assert(len == sizeof(request) && !memcmp(data, request, len));
+		accepted_with_data++;
+		b_receive_cb(mesh, channel, data, len);
+	}
+
+	return true;
+}
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double measure(meshlink_handle_t *mesh, meshlink_node_t *peer, bool with_data) {
+	double total = 0;
+
+	for(int i = 0; i < ROUNDS; i++) {
+		set_sync_flag(&response_flag, false);
+		double start = now();
+
+		meshlink_channel_t *channel;
+
+		if(with_data) {
+			channel = meshlink_channel_open(mesh, peer, 7, a_receive_cb, request, sizeof(request));
+			assert(channel);
+		} else {
+			channel = meshlink_channel_open(mesh, peer, 7, a_receive_cb, NULL, 0);
+			assert(channel);
+			assert(meshlink_channel_send(mesh, channel, request, sizeof(request)) == sizeof(request));
+		}
+
+		assert(wait_sync_flag(&response_flag, 5));
+		total += now() - start;
+
+		meshlink_channel_close(mesh, channel);
+	}
+
+	return total / ROUNDS;
+}
+
+int main(void) {
+	init_sync_flag(&response_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open two new meshlink instances.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_latency");
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	// Warm up, so UDP communication is established.
+
+	measure(mesh_a, b, false);
+
+	double after_open = measure(mesh_a, b, false);
+
+	accepted_with_data = 0;
+	double with_open = measure(mesh_a, b, true);
+	assert(accepted_with_data == ROUNDS);
+
+	fprintf(stderr, "open + request + response, request sent after opening: %.3f ms\n", after_open * 1e3);
+	fprintf(stderr, "open + request + response, request sent while opening: %.3f ms\n", with_open * 1e3);
+
+	// Clean up.
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,172 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Measure the memory used by many mostly idle channels, before, during and after a burst of data on each of them.
+// Usage: channels-memory-benchmark [channels [burst size per channel [memory limit in KiB]]]
+
+static int nchannels;
+static size_t burst;
+
+static struct sync_flag done_flag;
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t received;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static double rss(void) {
+	FILE *f = fopen("/proc/self/statm", "r");
+
+	if(!f) {
+		return 0;
+	}
+
+	unsigned long size = 0, resident = 0;
+
+	if(fscanf(f, "%lu %lu", &size, &resident) != 2) {
+		resident = 0;
+	}
+
+	fclose(f);
+	return resident * sysconf(_SC_PAGESIZE) / 1048576.0;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+
+	pthread_mutex_lock(&received_mutex);
+	received += len;
+
+	if(received == burst * nchannels) {
+		set_sync_flag(&done_flag, true);
+	}
+
+	pthread_mutex_unlock(&received_mutex);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 1);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	nchannels = argc > 1 ? atoi(argv[1]) : 10000;
+	burst = argc > 2 ? atol(argv[2]) : 4096;
+	size_t limit = (argc > 3 ? atol(argv[3]) : 0) * 1024;
+	assert(nchannels > 0 && burst);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&done_flag);
+
+	// Open two new meshlink instances.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_memory_benchmark");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	meshlink_set_channel_memory_limit(mesh_a, limit);
+	meshlink_set_channel_memory_limit(mesh_b, limit);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	fprintf(stderr, "Before opening channels: %.1f MiB\n", rss());
+
+	// Open all channels.
+
+	meshlink_channel_t **channels = calloc(nchannels, sizeof(*channels));
+	size_t *sent = calloc(nchannels, sizeof(*sent));
+	assert(channels && sent);
+
+	for(int i = 0; i < nchannels; i++) {
+		channels[i] = meshlink_channel_open(mesh_a, b, 1, NULL, NULL, 0);
+		assert(channels[i]);
+	}
+
+	fprintf(stderr, "%d idle channels: %.1f MiB\n", nchannels, rss());
+
+	// Send a burst of data on every channel, retrying whenever the send buffers or the memory pool are full.
+
+	char *buf = calloc(1, burst);
+	assert(buf);
+
+	double start = now();
+	double peak = 0;
+
+	for(int done = 0; done < nchannels;) {
+		done = 0;
+
+		for(int i = 0; i < nchannels; i++) {
+			if(sent[i] < burst) {
+				ssize_t result = meshlink_channel_send(mesh_a, channels[i], buf + sent[i], burst - sent[i]);
+				assert(result >= 0);
+				sent[i] += result;
+			}
+
+			if(sent[i] == burst) {
+				done++;
+			}
+		}
+
+		double current = rss();
+
+		if(current > peak) {
+			peak = current;
+		}
+
+		if(done < nchannels) {
+			const struct timespec req = {0, 1000000};
+			nanosleep(&req, NULL);
+		}
+	}
+
+	assert(wait_sync_flag(&done_flag, 600));
+
+	double elapsed = now() - start;
+
+	fprintf(stderr, "%lu bytes in %.3f s, %.3f MB/s, peak while sending: %.1f MiB\n", (unsigned long)(burst * nchannels), elapsed, burst * nchannels / elapsed / 1e6, peak);
+
+	// Give the buffers time to drain completely.
+
+	sleep(1);
+
+	fprintf(stderr, "%d idle channels after the burst: %.1f MiB\n", nchannels, rss());
+
+	// Clean up.
+
+	for(int i = 0; i < nchannels; i++) {
+		meshlink_channel_close(mesh_a, channels[i]);
+	}
+
+	free(buf);
+	free(sent);
+	free(channels);
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
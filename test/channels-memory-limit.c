@@ -0,0 +1,122 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Check that channels still deliver all data when their buffers share a small memory limit.
+
+#define NCHANNELS 8
+#define SIZE 262144
+#define LIMIT 65536
+
+static struct sync_flag done_flag;
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t received[NCHANNELS];
+static size_t total;
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+
+	const unsigned char *p = data;
+	size_t i = (size_t)channel->priv;
+
+	pthread_mutex_lock(&received_mutex);
+
+	for(size_t j = 0; j < len; j++) {
+		assert(p[j] == ((received[i] + j) & 0xff));
+	}
+
+	received[i] += len;
+	total += len;
+
+	if(total == NCHANNELS * SIZE) {
+		set_sync_flag(&done_flag, true);
+	}
+
+	pthread_mutex_unlock(&received_mutex);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port >= 1 && port <= NCHANNELS);
+	channel->priv = (void *)(size_t)(port - 1);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+int main(void) {
+	init_sync_flag(&done_flag);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Open two new meshlink instances, with a memory limit for channel buffers much smaller than all data in flight.
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_memory_limit");
+	meshlink_set_channel_memory_limit(mesh_a, LIMIT);
+	meshlink_set_channel_memory_limit(mesh_b, LIMIT);
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channels[NCHANNELS];
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		channels[i] = meshlink_channel_open(mesh_a, b, i + 1, NULL, NULL, 0);
+		assert(channels[i]);
+	}
+
+	// Send on all channels at once. A full memory pool just makes sends return 0, the data must still arrive intact.
+
+	static unsigned char buf[SIZE];
+
+	for(size_t i = 0; i < SIZE; i++) {
+		buf[i] = i & 0xff;
+	}
+
+	size_t sent[NCHANNELS] = {0};
+
+	for(int done = 0; done < NCHANNELS;) {
+		done = 0;
+
+		for(int i = 0; i < NCHANNELS; i++) {
+			ssize_t result = meshlink_channel_send(mesh_a, channels[i], buf + sent[i], SIZE - sent[i]);
+			assert(result >= 0);
+			sent[i] += result;
+			done += sent[i] == SIZE;
+		}
+
+		if(done < NCHANNELS) {
+			const struct timespec req = {0, 1000000};
+			nanosleep(&req, NULL);
+		}
+	}
+
+	assert(wait_sync_flag(&done_flag, 60));
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		assert(received[i] == SIZE);
+	}
+
+	// Clean up.
+
+	for(int i = 0; i < NCHANNELS; i++) {
+		meshlink_channel_close(mesh_a, channels[i]);
+	}
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
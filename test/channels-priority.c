@@ -0,0 +1,170 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+#include "utcp-utils.h"
+
+// Check that channels with a higher priority are served first when they share a constrained link,
+// and that channels in the same priority class share it in proportion to their weights.
+// The link is modelled by a queue that holds a limited number of data packets, more are dropped.
+
+#define TOTAL 1048576 // Bytes sent on each connection
+#define LINK_PACKETS 32
+#define BUFSIZE TOTAL // Queue everything up front, so the senders never run dry between polls
+
+static struct flow {
+	struct utcp_connection *c;
+	size_t sent;
+	size_t received;
+} flows[2];
+
+// How much the other connection had received when the first one completed
+static size_t other_received;
+static int first_done;
+
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	(void)data;
+
+	return from != utcp_a || len == sizeof(*hdr) || queued_utcp_packets(utcp_b) < LINK_PACKETS;
+}
+
+static void poll_cb(struct utcp_connection *c, size_t len) {
+	static char buf[65536];
+	struct flow *flow = c->priv;
+
+	while(len && flow->sent < TOTAL) {
+		size_t todo = len;
+
+		if(todo > sizeof(buf)) {
+			todo = sizeof(buf);
+		}
+
+		if(todo > TOTAL - flow->sent) {
+			todo = TOTAL - flow->sent;
+		}
+
+		ssize_t sent = utcp_send(c, buf, todo);
+		assert(sent >= 0);
+
+		if(!sent) {
+			break;
+		}
+
+		flow->sent += sent;
+		len -= sent;
+	}
+}
+
+static ssize_t recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	if(!data) {
+		return 0;
+	}
+
+	int i = c->src - 1;
+	flows[i].received += len;
+
+	if(flows[i].received == TOTAL && !first_done) {
+		first_done = i + 1;
+		other_received = flows[!i].received;
+	}
+
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	utcp_accept(c, recv_cb, NULL);
+	utcp_set_rcvbuf(c, BUFSIZE);
+}
+
+static bool both_done(void) {
+	return flows[0].received == TOTAL && flows[1].received == TOTAL;
+}
+
+static void run(int priority0, int weight0, int priority1, int weight1) {
+	memset(flows, 0, sizeof(flows));
+	first_done = 0;
+	other_received = 0;
+
+	open_utcp_pair(accept_cb, filter);
+
+	for(int i = 0; i < 2; i++) {
+		flows[i].c = utcp_connect_ex(utcp_a, i + 1, NULL, &flows[i], UTCP_TCP);
+		assert(flows[i].c);
+		utcp_set_sndbuf(flows[i].c, BUFSIZE);
+	}
+
+	deliver_utcp_packets();
+
+	assert(utcp_set_priority(flows[0].c, priority0, weight0) == 0);
+	assert(utcp_set_priority(flows[1].c, priority1, weight1) == 0);
+
+	for(int i = 0; i < 2; i++) {
+		assert(flows[i].c->state == ESTABLISHED);
+		utcp_set_poll_cb(flows[i].c, poll_cb);
+		poll_cb(flows[i].c, TOTAL);
+	}
+
+	assert(run_utcp_pair(both_done, 60));
+	close_utcp_pair();
+
+	fprintf(stderr, "Priorities %d/%d, weights %d/%d: connection %d finished first, the other had received %zu bytes\n", priority0, priority1, weight0, weight1, first_done, other_received);
+}
+
+int main(void) {
+	// Invalid priorities and weights should be rejected
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_priority");
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	meshlink_errno = MESHLINK_OK;
+	meshlink_set_channel_priority(mesh_a, channel, MESHLINK_CHANNEL_PRIORITIES, 1);
+	assert(meshlink_errno == MESHLINK_EINVAL);
+	meshlink_errno = MESHLINK_OK;
+	meshlink_set_channel_priority(mesh_a, channel, 1, 0);
+	assert(meshlink_errno == MESHLINK_EINVAL);
+	meshlink_errno = MESHLINK_OK;
+	meshlink_set_channel_priority(mesh_a, channel, 1, 65536);
+	assert(meshlink_errno == MESHLINK_EINVAL);
+	meshlink_errno = MESHLINK_OK;
+	meshlink_set_channel_priority(mesh_a, channel, 1, 2);
+	assert(meshlink_errno == MESHLINK_OK);
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+
+	// The connection with the higher priority should finish first, and get most of the link.
+	// It does not get all of it, since the other connection may still use what it cannot use itself,
+	// for example while it recovers from packet loss.
+
+	run(1, 1, 0, 1);
+	assert(first_done == 1);
+	assert(other_received < TOTAL / 4);
+
+	run(0, 1, 2, 1);
+	assert(first_done == 2);
+	assert(other_received < TOTAL / 4);
+
+	// With equal priorities, the connection with the higher weight should get a larger share of the link.
+
+	run(0, 3, 0, 1);
+	assert(first_done == 1);
+	assert(other_received < TOTAL / 2);
+}
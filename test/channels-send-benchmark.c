@@ -0,0 +1,187 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "meshlink.h"
+#include "utils.h"
+
+// Measure the throughput of several application threads, each sending small chunks on its own channel,
+// and how long the calls to meshlink_channel_send() take while the library thread is busy.
+// Usage: channels-send-benchmark [threads [size in MiB per thread [chunk size]]]
+
+#define MAX_THREADS 64
+
+struct sender {
+	pthread_t thread;
+	meshlink_channel_t *channel;
+	struct sync_flag poll_flag;
+	double total_wait;
+	double max_wait;
+	size_t calls;
+};
+
+static meshlink_handle_t *mesh_a;
+static meshlink_node_t *b;
+static int nthreads;
+static size_t size;
+static size_t chunk;
+
+static struct sender senders[MAX_THREADS];
+static struct sync_flag done_flag;
+static pthread_mutex_t received_mutex = PTHREAD_MUTEX_INITIALIZER;
+static size_t received;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+
+	pthread_mutex_lock(&received_mutex);
+	received += len;
+
+	if(received == size * nthreads) {
+		set_sync_flag(&done_flag, true);
+	}
+
+	pthread_mutex_unlock(&received_mutex);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 1);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static void poll_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t len) {
+	(void)mesh;
+	(void)len;
+
+	struct sender *sender = channel->priv;
+	set_sync_flag(&sender->poll_flag, true);
+}
+
+static void *send_thread(void *arg) {
+	struct sender *sender = arg;
+	char buf[chunk];
+	memset(buf, 0, chunk);
+
+	for(size_t done = 0; done < size;) {
+		size_t todo = size - done < chunk ? size - done : chunk;
+
+		set_sync_flag(&sender->poll_flag, false);
+
+		double start = now();
+		ssize_t sent = meshlink_channel_send(mesh_a, sender->channel, buf, todo);
+		double elapsed = now() - start;
+
+		assert(sent >= 0);
+
+		sender->calls++;
+		sender->total_wait += elapsed;
+
+		if(elapsed > sender->max_wait) {
+			sender->max_wait = elapsed;
+		}
+
+		done += sent;
+
+		if((size_t)sent < todo) {
+			wait_sync_flag(&sender->poll_flag, 1);
+		}
+	}
+
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	nthreads = argc > 1 ? atoi(argv[1]) : 4;
+	size = (argc > 2 ? atol(argv[2]) : 64) * 1024 * 1024;
+	chunk = argc > 3 ? atol(argv[3]) : 1024;
+	assert(nthreads > 0 && nthreads <= MAX_THREADS);
+	assert(size && chunk);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&done_flag);
+
+	// Open two new meshlink instances.
+
+	meshlink_handle_t *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels_send_benchmark");
+
+	meshlink_enable_discovery(mesh_a, false);
+	meshlink_enable_discovery(mesh_b, false);
+
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	// Open one channel per thread.
+
+	for(int i = 0; i < nthreads; i++) {
+		struct sender *sender = &senders[i];
+		init_sync_flag(&sender->poll_flag);
+		sender->channel = meshlink_channel_open(mesh_a, b, 1, NULL, NULL, 0);
+		assert(sender->channel);
+		sender->channel->priv = sender;
+		meshlink_set_channel_poll_cb(mesh_a, sender->channel, poll_cb);
+	}
+
+	// Send from all threads at once.
+
+	double start = now();
+
+	for(int i = 0; i < nthreads; i++) {
+		assert(pthread_create(&senders[i].thread, NULL, send_thread, &senders[i]) == 0);
+	}
+
+	for(int i = 0; i < nthreads; i++) {
+		assert(pthread_join(senders[i].thread, NULL) == 0);
+	}
+
+	assert(wait_sync_flag(&done_flag, 600));
+
+	double elapsed = now() - start;
+	double total_wait = 0;
+	double max_wait = 0;
+	size_t calls = 0;
+
+	for(int i = 0; i < nthreads; i++) {
+		total_wait += senders[i].total_wait;
+		calls += senders[i].calls;
+
+		if(senders[i].max_wait > max_wait) {
+			max_wait = senders[i].max_wait;
+		}
+	}
+
+	fprintf(stderr, "%d threads, %lu bytes in %.3f s, %.3f MB/s\n", nthreads, (unsigned long)(size * nthreads), elapsed, size * nthreads / elapsed / 1e6);
+	fprintf(stderr, "%lu calls to meshlink_channel_send(), average %.3f us, maximum %.3f ms\n", (unsigned long)calls, total_wait / calls * 1e6, max_wait * 1e3);
+
+	// Clean up.
+
+	for(int i = 0; i < nthreads; i++) {
+		meshlink_channel_close(mesh_a, senders[i].channel);
+	}
+
+	close_meshlink_pair(mesh_a, mesh_b);
+}
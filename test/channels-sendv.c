@@ -0,0 +1,86 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Check that data gathered from multiple buffers arrives as if it was sent in one piece.
+
+static struct sync_flag b_received;
+static char received[64];
+static size_t received_len;
+
+static void b_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	assert(received_len + len <= sizeof(received));
+	memcpy(received + received_len, data, len);
+	received_len += len;
+
+	if(received_len == 11) {
+		set_sync_flag(&b_received, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, b_receive_cb);
+
+	if(data) {
+		b_receive_cb(mesh, channel, data, len);
+	}
+
+	return true;
+}
+
+static void poll_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t len) {
+	(void)len;
+
+	meshlink_set_channel_poll_cb(mesh, channel, NULL);
+
+	// Empty buffers in between should be skipped.
+	const struct iovec iov[4] = {
+		{.iov_base = (void *)"Hel", .iov_len = 3},
+		{.iov_base = NULL, .iov_len = 0},
+		{.iov_base = (void *)"lo ", .iov_len = 3},
+		{.iov_base = (void *)"world", .iov_len = 5},
+	};
+
+	assert(meshlink_channel_sendv(mesh, channel, iov, 4) == 11);
+	assert(meshlink_channel_sendv(mesh, channel, iov, 0) == 0);
+
+	// Invalid vectors should be rejected.
+	assert(meshlink_channel_sendv(mesh, channel, NULL, 1) == -1);
+	assert(meshlink_channel_sendv(mesh, channel, iov, -1) == -1);
+}
+
+int main(void) {
+	init_sync_flag(&b_received);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels-sendv");
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, NULL, NULL, 0);
+	assert(channel);
+
+	meshlink_set_channel_poll_cb(mesh_a, channel, poll_cb);
+	assert(wait_sync_flag(&b_received, 20));
+	assert(!memcmp(received, "Hello world", 11));
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,142 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+
+// Check that data sent while the library thread is busy, which is staged instead of sent right away,
+// arrives in the same order as data sent while the library thread is idle.
+
+#define ROUNDS 20
+#define CHUNK 1000
+#define TOTAL (CHUNK * (2 * ROUNDS + 1))
+
+static struct sync_flag b_connected;
+static struct sync_flag b_done;
+static struct sync_flag a_blocked;
+static struct sync_flag a_resume;
+static struct sync_flag a_sent;
+
+static meshlink_channel_t *b_channel;
+static size_t sent;
+static size_t received;
+
+static uint8_t pattern(size_t offset) {
+	return offset % 251;
+}
+
+static void send_chunk(meshlink_handle_t *mesh, meshlink_channel_t *channel) {
+	uint8_t buf[CHUNK];
+
+	for(size_t i = 0; i < sizeof(buf); i++) {
+		buf[i] = pattern(sent + i);
+	}
+
+	assert(meshlink_channel_send(mesh, channel, buf, sizeof(buf)) == sizeof(buf));
+	sent += sizeof(buf);
+}
+
+static void b_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	const uint8_t *p = data;
+
+	for(size_t i = 0; i < len; i++) {
+		assert(p[i] == pattern(received + i));
+	}
+
+	received += len;
+
+	if(received == TOTAL) {
+		set_sync_flag(&b_done, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	assert(port == 7);
+	assert(!len);
+	(void)data;
+
+	meshlink_set_channel_receive_cb(mesh, channel, b_receive_cb);
+	b_channel = channel;
+	set_sync_flag(&b_connected, true);
+	return true;
+}
+
+// Keep the library thread of a busy, with the mesh locked, until the main thread has staged its data.
+// Then send more from here, which does not need to wait for the lock, so it is sent directly.
+static void a_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)data;
+
+	if(!len) {
+		return;
+	}
+
+	set_sync_flag(&a_blocked, true);
+	assert(wait_sync_flag(&a_resume, 10));
+	set_sync_flag(&a_resume, false);
+
+	send_chunk(mesh, channel);
+	set_sync_flag(&a_sent, true);
+}
+
+int main(void) {
+	init_sync_flag(&b_connected);
+	init_sync_flag(&b_done);
+	init_sync_flag(&a_blocked);
+	init_sync_flag(&a_resume);
+	init_sync_flag(&a_sent);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels-stage");
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, a_receive_cb, NULL, 0);
+	assert(channel);
+
+	send_chunk(mesh_a, channel);
+	assert(wait_sync_flag(&b_connected, 20));
+
+	for(int i = 0; i < ROUNDS; i++) {
+		// Wait until everything sent so far has been acknowledged
+		for(int j = 0; meshlink_channel_get_sendq(mesh_a, channel); j++) {
+			assert(j < 10000);
+			nanosleep(&(struct timespec) {
+				.tv_nsec = 1000000
+			}, NULL);
+		}
+
+		// Let b wake up the library thread of a, and keep it busy
+		set_sync_flag(&a_blocked, false);
+		set_sync_flag(&a_sent, false);
+		assert(meshlink_channel_send(mesh_b, b_channel, "x", 1) == 1);
+		assert(wait_sync_flag(&a_blocked, 10));
+
+		// This cannot take the mesh lock, so it is staged, and it still counts as queued for sending
+		send_chunk(mesh_a, channel);
+		assert(meshlink_channel_get_sendq(mesh_a, channel) == CHUNK);
+
+		// The library thread now sends directly, that data must go after the staged data
+		set_sync_flag(&a_resume, true);
+		assert(wait_sync_flag(&a_sent, 10));
+	}
+
+	assert(wait_sync_flag(&b_done, 20));
+	assert(sent == TOTAL);
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,106 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "utils.h"
+#include "../src/meshlink.h"
+#include "../src/devtools.h"
+
+// Check the channel statistics and the export of the congestion event log.
+
+static struct sync_flag b_responded;
+
+static void a_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+
+	if(len == 5 && !memcmp(data, "Hello", 5)) {
+		set_sync_flag(&b_responded, true);
+	}
+}
+
+static void b_receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	// Echo the data back.
+	assert(meshlink_channel_send(mesh, channel, data, len) == (ssize_t)len);
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	assert(port == 7);
+	meshlink_set_channel_receive_cb(mesh, channel, b_receive_cb);
+
+	if(data) {
+		b_receive_cb(mesh, channel, data, len);
+	}
+
+	return true;
+}
+
+static void poll_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, size_t len) {
+	(void)len;
+
+	meshlink_set_channel_poll_cb(mesh, channel, NULL);
+
+	assert(meshlink_channel_send(mesh, channel, "Hello", 5) == 5);
+}
+
+int main(void) {
+	init_sync_flag(&b_responded);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	meshlink_handle_t *mesh_a, *mesh_b;
+	open_meshlink_pair(&mesh_a, &mesh_b, "channels-stats");
+	meshlink_set_channel_accept_cb(mesh_b, accept_cb);
+	start_meshlink_pair(mesh_a, mesh_b);
+
+	meshlink_node_t *b = meshlink_get_node(mesh_a, "b");
+	assert(b);
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh_a, b, 7, a_receive_cb, NULL, 0);
+	assert(channel);
+
+	meshlink_set_channel_poll_cb(mesh_a, channel, poll_cb);
+	assert(wait_sync_flag(&b_responded, 20));
+
+	// Check the channel statistics, an unknown version should be rejected.
+
+	meshlink_channel_stats_t stats = {.version = MESHLINK_CHANNEL_STATS_VERSION + 1};
+	assert(!meshlink_channel_get_stats(mesh_a, channel, &stats));
+	assert(meshlink_errno == MESHLINK_EINVAL);
+	stats.version = MESHLINK_CHANNEL_STATS_VERSION;
+	assert(meshlink_channel_get_stats(mesh_a, channel, &stats));
+	assert(stats.bytes_sent >= 5 && stats.segments_sent >= 1);
+	assert(stats.bytes_received >= 5 && stats.segments_received >= 1);
+
+	// Export the congestion event log.
+
+	assert(devtool_set_channel_event_log(mesh_a, channel, 16));
+
+	char buf[16] = "";
+	FILE *stream = tmpfile();
+	assert(stream);
+	assert(devtool_export_csv_channel_events(mesh_a, channel, stream));
+	rewind(stream);
+	assert(fread(buf, 10, 1, stream) == 1);
+	assert(!strncmp(buf, "time,type,", 10));
+	assert(fclose(stream) == 0);
+
+	stream = tmpfile();
+	assert(stream);
+	assert(devtool_export_json_channel_events(mesh_a, channel, stream));
+	rewind(stream);
+	assert(fread(buf, 1, 1, stream) == 1);
+	assert(buf[0] == '[');
+	assert(fclose(stream) == 0);
+
+	assert(devtool_set_channel_event_log(mesh_a, channel, 0));
+
+	// Clean up.
+
+	meshlink_channel_close(mesh_a, channel);
+	close_meshlink_pair(mesh_a, mesh_b);
+}
@@ -0,0 +1,181 @@
+#ifndef MESHLINK_TEST_COROUTINES_H
+#define MESHLINK_TEST_COROUTINES_H
+
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "../src/meshlink++.h"
+
+// An executor that resumes coroutines one by one on its own thread.
+class thread_executor: public meshlink::executor {
+public:
+	thread_executor() : thread([this] {
+		run();
+	}) {}
+
+	~thread_executor() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+
+		cond.notify_one();
+		thread.join();
+	}
+
+	void post(std::coroutine_handle<> coroutine) override {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back(coroutine);
+		}
+
+		cond.notify_one();
+	}
+
+	bool in_thread() const {
+		return std::this_thread::get_id() == thread.get_id();
+	}
+
+private:
+	void run() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		while(true) {
+			cond.wait(lock, [this] {
+				return stopped || !queue.empty();
+			});
+
+			if(queue.empty()) {
+				return;
+			}
+
+			std::coroutine_handle<> coroutine = queue.front();
+			queue.pop_front();
+
+			lock.unlock();
+			coroutine.resume();
+			lock.lock();
+		}
+	}
+
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::deque<std::coroutine_handle<>> queue;
+	bool stopped = false;
+	std::thread thread;
+};
+
+// A coroutine that starts immediately and cleans up after itself.
+struct task {
+	struct promise_type {
+		task get_return_object() {
+			return {};
+		}
+
+		std::suspend_never initial_suspend() noexcept {
+			return {};
+		}
+
+		std::suspend_never final_suspend() noexcept {
+			return {};
+		}
+
+		void return_void() {}
+
+		void unhandled_exception() {
+			std::abort();
+		}
+	};
+};
+
+// Continue the current coroutine on the given executor.
+struct switch_to {
+	meshlink::executor &exec;
+
+	bool await_ready() const noexcept {
+		return false;
+	}
+
+	void await_suspend(std::coroutine_handle<> coroutine) {
+		exec.post(coroutine);
+	}
+
+	void await_resume() const noexcept {}
+};
+
+// A simple flag to wait for from the main thread.
+class completion_flag {
+public:
+	void set() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			flag = true;
+		}
+
+		cond.notify_all();
+	}
+
+	bool wait(int seconds) {
+		std::unique_lock<std::mutex> lock(mutex);
+		return cond.wait_for(lock, std::chrono::seconds(seconds), [this] {
+			return flag;
+		});
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable cond;
+	bool flag = false;
+};
+
+// A mesh that signals when its peer becomes reachable.
+class peer_mesh: public meshlink::mesh {
+public:
+	completion_flag reachable;
+
+	void node_status(meshlink::node *peer, bool status) override {
+		(void)peer;
+
+		if(status) {
+			reachable.set();
+		}
+	}
+};
+
+// Open, link and start two meshes named "a" and "b".
+static inline void open_mesh_pair(peer_mesh &a, peer_mesh &b, const char *prefix) {
+	std::string a_name = std::string(prefix) + "_conf.1";
+	std::string b_name = std::string(prefix) + "_conf.2";
+
+	assert(meshlink::destroy(a_name.c_str()));
+	assert(meshlink::destroy(b_name.c_str()));
+	assert(a.open(a_name.c_str(), "a", prefix, DEV_CLASS_BACKBONE));
+	assert(b.open(b_name.c_str(), "b", prefix, DEV_CLASS_BACKBONE));
+
+	a.enable_discovery(false);
+	b.enable_discovery(false);
+	assert(a.set_canonical_address(a.get_self(), "localhost"));
+	assert(b.set_canonical_address(b.get_self(), "localhost"));
+
+	char *data = a.export_key();
+	assert(data);
+	assert(b.import_key(data));
+	free(data);
+
+	data = b.export_key();
+	assert(data);
+	assert(a.import_key(data));
+	free(data);
+
+	assert(a.start());
+	assert(b.start());
+	assert(a.reachable.wait(10));
+}
+
+#endif
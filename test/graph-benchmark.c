@@ -0,0 +1,173 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/meshlink_internal.h"
+#include "../src/devtools.h"
+#include "../src/edge.h"
+#include "../src/graph.h"
+#include "../src/node.h"
+#include "../src/xalloc.h"
+
+// Replay a storm of edge changes on a generated topology, and compare the time it takes to update
+// the routing graph incrementally with the time it takes to do a full search after every change.
+// The incremental updates are first checked against the full search.
+// Finally, the time of a full search on an unchanging topology is measured.
+// Usage: graph-benchmark [nodes [links per node [events]]]
+
+static int nnodes;
+static int degree;
+static int nevents;
+
+typedef struct link {
+	int a;
+	int b;
+	int weight;
+	bool present;
+} link_t;
+
+static node_t **nodes;
+static link_t *links;
+static int nlinks;
+
+static void add_link(meshlink_handle_t *mesh, link_t *link) {
+	// Add the edges one by one, like add_edge_h() would.
+	for(int i = 0; i < 2; i++) {
+		edge_t *e = new_edge();
+		e->from = nodes[i ? link->b : link->a];
+		e->to = nodes[i ? link->a : link->b];
+		e->weight = link->weight;
+
+		// Every node gets its own address.
+		e->address.in.sin_family = AF_INET;
+		e->address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		e->address.in.sin_port = htons(1024 + (i ? link->a : link->b));
+
+		edge_add(mesh, e);
+	}
+
+	link->present = true;
+}
+
+static void del_link(meshlink_handle_t *mesh, link_t *link) {
+	edge_del(mesh, lookup_edge(nodes[link->a], nodes[link->b]));
+	edge_del(mesh, lookup_edge(nodes[link->b], nodes[link->a]));
+	link->present = false;
+}
+
+// Weights are chosen from a small set, so there are many equally good paths.
+static int random_weight(void) {
+	return 1 + rand() % 4;
+}
+
+static meshlink_handle_t *generate(bool verify) {
+	srand(1);
+
+	meshlink_handle_t *mesh = meshlink_open_ephemeral("node0", "graph-benchmark", DEV_CLASS_BACKBONE);
+	assert(mesh);
+	devtool_set_graph_verification(mesh, verify);
+
+	// Generate a connected topology, where each node links to a few random nodes that were created before it.
+
+	nodes[0] = mesh->self;
+
+	for(int i = 1; i < nnodes; i++) {
+		nodes[i] = new_node();
+		xasprintf(&nodes[i]->name, "node%d", i);
+		node_add(mesh, nodes[i]);
+	}
+
+	nlinks = 0;
+
+	for(int i = 1; i < nnodes; i++) {
+		for(int j = 0; j < degree; j++) {
+			int peer = rand() % i;
+
+			if(!lookup_edge(nodes[i], nodes[peer])) {
+				links[nlinks] = (link_t) {i, peer, random_weight(), false};
+				add_link(mesh, &links[nlinks++]);
+			}
+		}
+	}
+
+	graph(mesh);
+	return mesh;
+}
+
+static void run(const char *style, bool incremental, bool verify) {
+	meshlink_handle_t *mesh = generate(verify);
+
+	// Toggle random links, updating the graph after each change.
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < nevents; i++) {
+		if(!incremental) {
+			mesh->sssp_valid = false;
+		}
+
+		link_t *link = &links[rand() % nlinks];
+
+		if(link->present) {
+			del_link(mesh, link);
+		} else {
+			link->weight = random_weight();
+			add_link(mesh, link);
+		}
+
+		graph(mesh);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	fprintf(stderr, "%-12s %d events on %d nodes with %d links in %.3f s, %.0f events/s\n", style, nevents, nnodes, nlinks, elapsed, nevents / elapsed);
+
+	meshlink_close(mesh);
+}
+
+static void search(int count) {
+	meshlink_handle_t *mesh = generate(false);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < count; i++) {
+		mesh->sssp_valid = false;
+		graph(mesh);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	fprintf(stderr, "%-12s %d searches on %d nodes with %d links in %.3f s, %.3f ms/search\n", "search", count, nnodes, nlinks, elapsed, elapsed * 1e3 / count);
+
+	meshlink_close(mesh);
+}
+
+int main(int argc, char *argv[]) {
+	nnodes = argc > 1 ? atoi(argv[1]) : 1000;
+	degree = argc > 2 ? atoi(argv[2]) : 2;
+	nevents = argc > 3 ? atoi(argv[3]) : 10000;
+	assert(nnodes > 1 && degree > 0 && nevents > 0);
+
+	nodes = calloc(nnodes, sizeof(*nodes));
+	links = calloc(nnodes * degree, sizeof(*links));
+	assert(nodes && links);
+
+	run("verified", true, true);
+	run("incremental", true, false);
+	run("full", false, false);
+	search(nevents / 100 + 1);
+
+	free(links);
+	free(nodes);
+}
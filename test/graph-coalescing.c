@@ -0,0 +1,107 @@
+#define _GNU_SOURCE
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Check that a node joining an existing mesh handles the burst of edges it is sent
+// with fewer graph updates than edges, and still learns about every node.
+
+#define NLEAVES 4
+
+static struct sync_flag all_reachable;
+static pthread_mutex_t count_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int reachable;
+
+static void status_cb(meshlink_handle_t *mesh, meshlink_node_t *node, bool status) {
+	(void)mesh;
+	(void)node;
+
+	pthread_mutex_lock(&count_mutex);
+	reachable += status ? 1 : -1;
+
+	if(reachable == NLEAVES) {
+		set_sync_flag(&all_reachable, true);
+	}
+
+	pthread_mutex_unlock(&count_mutex);
+}
+
+int main(void) {
+	init_sync_flag(&all_reachable);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Create a hub and a few leaves that only know the hub.
+
+	meshlink_handle_t *mesh[NLEAVES + 1];
+	char *data[NLEAVES + 1];
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		char *path = NULL;
+		char name[16];
+		assert(asprintf(&path, "graph_coalescing_conf.%d", i) != -1 && path);
+		snprintf(name, sizeof(name), "node%d", i);
+
+		assert(meshlink_destroy(path));
+		mesh[i] = meshlink_open(path, name, "graph-coalescing", DEV_CLASS_BACKBONE);
+		assert(mesh[i]);
+		free(path);
+
+		assert(meshlink_set_canonical_address(mesh[i], meshlink_get_self(mesh[i]), "localhost", NULL));
+		meshlink_enable_discovery(mesh[i], false);
+
+		data[i] = meshlink_export(mesh[i]);
+		assert(data[i]);
+	}
+
+	for(int i = 1; i <= NLEAVES; i++) {
+		assert(meshlink_import(mesh[i], data[0]));
+		assert(meshlink_import(mesh[0], data[i]));
+	}
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		free(data[i]);
+	}
+
+	// Start all but the last leaf, and wait until the hub can reach them.
+
+	for(int i = 0; i < NLEAVES; i++) {
+		assert(meshlink_start(mesh[i]));
+	}
+
+	for(int j = 1; j < NLEAVES; j++) {
+		meshlink_node_t *leaf = meshlink_get_node(mesh[0], meshlink_get_self(mesh[j])->name);
+		assert(leaf);
+		assert_after(meshlink_get_node_reachability(mesh[0], leaf, NULL, NULL), 15);
+	}
+
+	// Start the last leaf, it should learn about all other nodes from the hub.
+
+	meshlink_set_node_status_cb(mesh[NLEAVES], status_cb);
+	assert(meshlink_start(mesh[NLEAVES]));
+	assert(wait_sync_flag(&all_reachable, 15));
+
+	devtool_graph_stats_t stats;
+	devtool_get_graph_stats(mesh[NLEAVES], &stats);
+	fprintf(stderr, "%lu edge updates, %lu graph runs, at most %u edge updates per run\n", (unsigned long)stats.edge_updates, (unsigned long)stats.runs, stats.max_coalesced);
+
+	assert(stats.edge_updates >= 2 * (NLEAVES - 1));
+	assert(stats.max_coalesced > 1);
+
+	// Clean up.
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		meshlink_close(mesh[i]);
+	}
+}
@@ -0,0 +1,149 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/meshlink_internal.h"
+#include "../src/conf.h"
+#include "../src/persist.h"
+
+// Check that host config files written in the background are on disk after persist_sync(),
+// that repeated writes of the same file while a batch is in progress are coalesced,
+// and that a failed write is reported by the next persist_sync().
+// The persist thread itself must never log anything.
+
+static pthread_t main_thread;
+static bool write_failure_logged;
+
+static void log_cb(meshlink_handle_t *mesh, meshlink_log_level_t level, const char *text) {
+	(void)mesh;
+	assert(pthread_equal(pthread_self(), main_thread));
+
+	if(!strcmp(text, "Could not write host config files: Is a directory")) {
+		write_failure_logged = true;
+	}
+
+	if(level >= MESHLINK_WARNING) {
+		fprintf(stderr, "%s\n", text);
+	}
+}
+
+static void queue(meshlink_handle_t *mesh, const char *name, const char *data) {
+	config_t config = {(const uint8_t *)data, strlen(data)};
+	persist_queue(mesh, name, &config);
+}
+
+static void check(meshlink_handle_t *mesh, const char *name, const char *data) {
+	config_t config;
+	assert(config_read(mesh, "current", name, &config, mesh->config_key));
+	assert(config.len == strlen(data) && !memcmp(config.buf, data, config.len));
+	config_free(&config);
+}
+
+int main(void) {
+	main_thread = pthread_self();
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	assert(meshlink_destroy("persist_conf"));
+	meshlink_handle_t *mesh = meshlink_open("persist_conf", "foo", "persist", DEV_CLASS_BACKBONE);
+	assert(mesh);
+	meshlink_set_log_cb(mesh, MESHLINK_DEBUG, log_cb);
+
+	// All queued files are on disk after the barrier
+
+	char name[16];
+	char data[16];
+
+	for(int i = 0; i < 10; i++) {
+		snprintf(name, sizeof(name), "node%d", i);
+		snprintf(data, sizeof(data), "data%d", i);
+		queue(mesh, name, data);
+	}
+
+	assert(persist_sync(mesh));
+
+	for(int i = 0; i < 10; i++) {
+		snprintf(name, sizeof(name), "node%d", i);
+		snprintf(data, sizeof(data), "data%d", i);
+		check(mesh, name, data);
+	}
+
+	// Writes queued while a batch is in progress are coalesced into the next batch.
+	// The batch in progress is held up by writing a file into a pipe that is only read from later.
+
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "%s/current/hosts/node0.tmp", mesh->confbase);
+	assert(mkfifo(path, 0600) == 0);
+
+	static char large[262144];
+	memset(large, 'x', sizeof(large));
+	config_t config = {(const uint8_t *)large, sizeof(large)};
+	persist_queue(mesh, "node0", &config);
+
+	// This returns once the persist thread has opened the pipe
+	int fd = open(path, O_RDONLY);
+	assert(fd != -1);
+
+	queue(mesh, "node1", "old");
+	queue(mesh, "node1", "older");
+	queue(mesh, "node1", "new");
+	queue(mesh, "node2", "new");
+
+	pthread_mutex_lock(&mesh->persist_mutex);
+	assert(mesh->persist_busy);
+	assert(mesh->persist_pending->count == 2);
+	pthread_mutex_unlock(&mesh->persist_mutex);
+
+	char buf[4096];
+	size_t total = 0;
+	ssize_t len;
+
+	while((len = read(fd, buf, sizeof(buf))) > 0) {
+		total += len;
+	}
+
+	assert(len == 0 && total == sizeof(large));
+	close(fd);
+
+	assert(persist_sync(mesh));
+	check(mesh, "node1", "new");
+	check(mesh, "node2", "new");
+
+	// The pipe has been renamed into place
+	snprintf(path, sizeof(path), "%s/current/hosts/node0", mesh->confbase);
+	assert(unlink(path) == 0);
+
+	// A file that cannot be written is reported, but does not prevent the rest of the batch from being written
+
+	snprintf(path, sizeof(path), "%s/current/hosts/node3.tmp", mesh->confbase);
+	assert(mkdir(path, 0700) == 0);
+
+	queue(mesh, "node3", "bad");
+	queue(mesh, "node4", "good");
+
+	meshlink_errno = MESHLINK_OK;
+	assert(!persist_sync(mesh));
+	assert(meshlink_errno == MESHLINK_ESTORAGE);
+	assert(write_failure_logged);
+	check(mesh, "node3", "data3");
+	check(mesh, "node4", "good");
+
+	// The failure is only reported once
+
+	assert(persist_sync(mesh));
+
+	assert(rmdir(path) == 0);
+	queue(mesh, "node3", "good");
+	assert(persist_sync(mesh));
+	check(mesh, "node3", "good");
+
+	meshlink_close(mesh);
+	assert(meshlink_destroy("persist_conf"));
+}
@@ -0,0 +1,178 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Measure the throughput of a channel between two nodes that cannot send UDP packets to each other,
+// but which both have working UDP with a third node in the middle.
+// The packets go either through the meta connections, or through the node in the middle as relayed UDP packets.
+// The network namespaces have to be set up beforehand, see relay-benchmark.
+// Usage: relay-throughput [size in MiB [relay (0 or 1)]]
+
+static const char *const names[3] = {"left", "middle", "right"};
+static const char *const addresses[3] = {"10.1.1.2", "10.1.1.1", "10.1.2.2"};
+static const char *const right_address_of_middle = "10.1.2.1";
+
+static struct sync_flag done_flag;
+static size_t size;
+static size_t received;
+
+static double now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void receive_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, const void *data, size_t len) {
+	(void)mesh;
+	(void)channel;
+	(void)data;
+
+	received += len;
+
+	if(received == size) {
+		set_sync_flag(&done_flag, true);
+	}
+}
+
+static bool accept_cb(meshlink_handle_t *mesh, meshlink_channel_t *channel, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	assert(port == 1);
+	meshlink_set_channel_receive_cb(mesh, channel, receive_cb);
+	return true;
+}
+
+static int udp_status(meshlink_handle_t *mesh, const char *name) {
+	meshlink_node_t *node = meshlink_get_node(mesh, name);
+	assert(node);
+
+	devtool_node_status_t status;
+	devtool_get_node_status(mesh, node, &status);
+	return status.udp_status;
+}
+
+static void import_middle(meshlink_handle_t *middle, meshlink_handle_t *mesh, const char *address) {
+	char *port;
+	assert(asprintf(&port, "%d", meshlink_get_port(middle)) > 0);
+	assert(meshlink_set_canonical_address(middle, meshlink_get_self(middle), address, port));
+	free(port);
+
+	char *data = meshlink_export(middle);
+	assert(data);
+	assert(meshlink_import(mesh, data));
+	free(data);
+}
+
+static double run(bool relay) {
+	meshlink_handle_t *mesh[3];
+
+	for(int i = 0; i < 3; i++) {
+		char *netns_path, *confbase;
+		assert(asprintf(&netns_path, "/run/netns/relay-%s", names[i]) > 0);
+		assert(asprintf(&confbase, "relay_throughput_conf.%d", i + 1) > 0);
+
+		int netns = open(netns_path, O_RDONLY);
+		assert(netns != -1);
+		assert(meshlink_destroy(confbase));
+		mesh[i] = devtool_open_in_netns(confbase, names[i], "relay-throughput", DEV_CLASS_BACKBONE, netns);
+		assert(mesh[i]);
+		close(netns);
+		free(netns_path);
+		free(confbase);
+
+		meshlink_enable_discovery(mesh[i], false);
+		devtool_set_udp_relaying(mesh[i], relay);
+	}
+
+	// The outer nodes know each other, but can only reach the node in the middle.
+
+	assert(meshlink_set_canonical_address(mesh[0], meshlink_get_self(mesh[0]), addresses[0], NULL));
+	assert(meshlink_set_canonical_address(mesh[2], meshlink_get_self(mesh[2]), addresses[2], NULL));
+
+	for(int i = 0; i < 3; i += 2) {
+		char *data = meshlink_export(mesh[i]);
+		assert(data);
+		assert(meshlink_import(mesh[2 - i], data));
+		assert(meshlink_import(mesh[1], data));
+		free(data);
+	}
+
+	import_middle(mesh[1], mesh[0], addresses[1]);
+	import_middle(mesh[1], mesh[2], right_address_of_middle);
+
+	meshlink_set_channel_accept_cb(mesh[2], accept_cb);
+
+	for(int i = 0; i < 3; i++) {
+		assert(meshlink_start(mesh[i]));
+	}
+
+	meshlink_node_t *right = meshlink_get_node(mesh[0], names[2]);
+	assert(right);
+	assert_after(meshlink_get_node_reachability(mesh[0], right, NULL, NULL), 15);
+
+	// Open the channel, and with relaying enabled, wait until both sides use it.
+
+	meshlink_channel_t *channel = meshlink_channel_open(mesh[0], right, 1, NULL, NULL, 0);
+	assert(channel);
+
+	if(relay) {
+		assert_after(udp_status(mesh[0], names[2]) == DEVTOOL_UDP_RELAYED && udp_status(mesh[2], names[0]) == DEVTOOL_UDP_RELAYED, 15);
+	}
+
+	assert(udp_status(mesh[0], names[2]) != DEVTOOL_UDP_WORKING);
+
+	char *buf = calloc(1, size);
+	assert(buf);
+	received = 0;
+	set_sync_flag(&done_flag, false);
+
+	double start = now();
+	assert(meshlink_channel_aio_send(mesh[0], channel, buf, size, NULL, NULL));
+	assert(wait_sync_flag(&done_flag, 600));
+	double elapsed = now() - start;
+
+	// Clean up.
+
+	meshlink_channel_close(mesh[0], channel);
+
+	for(int i = 0; i < 3; i++) {
+		meshlink_close(mesh[i]);
+	}
+
+	free(buf);
+	return elapsed;
+}
+
+int main(int argc, char *argv[]) {
+	size = (argc > 1 ? atol(argv[1]) : 10) * 1024 * 1024;
+	int which = argc > 2 ? atoi(argv[2]) : -1;
+	assert(size);
+
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+	init_sync_flag(&done_flag);
+
+	for(int relay = 0; relay < 2; relay++) {
+		if(which != -1 && which != relay) {
+			continue;
+		}
+
+		double elapsed = run(relay);
+		fprintf(stderr, "%-16s %lu bytes in %.3f s, %.3f MB/s\n", relay ? "Relayed UDP:" : "Meta connections:", (unsigned long)size, elapsed, size / elapsed / 1e6);
+	}
+}
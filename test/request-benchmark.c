@@ -0,0 +1,195 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sptps-peer.h"
+#include "../src/meshlink_internal.h"
+#include "../src/connection.h"
+#include "../src/edge.h"
+#include "../src/list.h"
+#include "../src/node.h"
+#include "../src/protocol.h"
+#include "../src/sptps.h"
+#include "../src/xalloc.h"
+
+// Compare the throughput of text and binary ADD_EDGE requests.
+// First, a node encodes and sends ADD_EDGE requests for a set of edges to a peer.
+// Then, another node parses those requests, and forwards them to a third node.
+// The requests are sent over real SPTPS sessions, but without any sockets or event loop.
+// Usage: request-benchmark [requests]
+
+static int nrequests;
+
+// A peer at the other end of a meta connection, which decrypts everything sent to it.
+
+typedef struct record {
+	uint8_t type;
+	uint16_t len;
+	char *data;
+} record_t;
+
+typedef struct peer {
+	sptps_peer_t session;
+	connection_t *c;
+	record_t *records;
+	int nrecords;
+	size_t bytes;
+} peer_t;
+
+static bool peer_decrypt(sptps_peer_t *session, const void *data, size_t len) {
+	peer_t *peer = session->priv;
+	peer->bytes += len;
+	return sptps_receive_data(&session->sptps, data, len);
+}
+
+static bool peer_record(sptps_peer_t *session, uint8_t type, const void *data, uint16_t len) {
+	peer_t *peer = session->priv;
+
+	if(!peer->records) {
+		return true;
+	}
+
+	record_t *record = &peer->records[peer->nrecords++];
+	record->type = type;
+	record->len = len;
+	record->data = xmalloc(len + 1);
+	memcpy(record->data, data, len);
+	record->data[len] = 0;
+	return true;
+}
+
+// Create an active connection with a completed SPTPS handshake to a new peer.
+
+static connection_t *connect_peer(meshlink_handle_t *mesh, peer_t *peer, const char *name, bool binary) {
+	connection_t *c = new_connection();
+	c->name = xstrdup(name);
+	c->node = new_node();
+	c->node->name = xstrdup(name);
+	node_add(mesh, c->node);
+	c->allow_request = ALL;
+	c->status.active = true;
+	c->status.binary = binary;
+	connection_add(mesh, c);
+
+	memset(peer, 0, sizeof(*peer));
+	peer->c = c;
+	start_sptps_peer(mesh, &c->sptps, &peer->session, "request-benchmark", peer_decrypt, peer_record);
+	peer->session.priv = peer;
+	return c;
+}
+
+static void disconnect_peer(meshlink_handle_t *mesh, peer_t *peer) {
+	stop_sptps_peer(&peer->session);
+	list_delete(mesh->connections, peer->c);
+}
+
+static double elapsed_since(const struct timespec *start) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void run(bool binary) {
+	const char *style = binary ? "binary" : "text";
+	peer_t peer;
+	struct timespec start;
+
+	// Encode requests for edges between nodes that only the sender knows about.
+
+	meshlink_handle_t *sender = meshlink_open_ephemeral("sender", "request-benchmark", DEV_CLASS_BACKBONE);
+	assert(sender);
+
+	node_t *nodes[2];
+	edge_t *edges[nrequests];
+
+	for(int i = 0; i < 2; i++) {
+		nodes[i] = new_node();
+		xasprintf(&nodes[i]->name, "node%d", i);
+	}
+
+	for(int i = 0; i < nrequests; i++) {
+		edges[i] = new_edge();
+		edges[i]->from = nodes[i & 1];
+		edges[i]->to = nodes[!(i & 1)];
+		edges[i]->weight = i;
+		edges[i]->address.in.sin_family = AF_INET;
+		edges[i]->address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		edges[i]->address.in.sin_port = htons(1024 + i % 60000);
+	}
+
+	connect_peer(sender, &peer, "receiver", binary);
+	peer.records = xzalloc(nrequests * sizeof(*peer.records));
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < nrequests; i++) {
+		assert(send_add_edge(sender, sender->everyone, edges[i], 0));
+	}
+
+	double elapsed = elapsed_since(&start);
+	assert(peer.nrecords == nrequests);
+	fprintf(stderr, "%-6s encode  %d requests in %.3f s, %.0f requests/s, %.1f bytes/request\n", style, nrequests, elapsed, nrequests / elapsed, (double)peer.bytes / nrequests);
+
+	record_t *records = peer.records;
+	disconnect_peer(sender, &peer);
+
+	for(int i = 0; i < nrequests; i++) {
+		free_edge(edges[i]);
+	}
+
+	for(int i = 0; i < 2; i++) {
+		free_node(nodes[i]);
+	}
+
+	meshlink_close(sender);
+
+	// Parse the requests on another node, which forwards them to a third node.
+
+	meshlink_handle_t *relay = meshlink_open_ephemeral("relay", "request-benchmark", DEV_CLASS_BACKBONE);
+	assert(relay);
+
+	peer_t inpeer;
+	connection_t *in = connect_peer(relay, &inpeer, "sender", binary);
+	connect_peer(relay, &peer, "receiver", binary);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < nrequests; i++) {
+		if(records[i].type == SPTPS_BINARY_REQUEST) {
+			assert(receive_binary_request(relay, in, (uint8_t *)records[i].data, records[i].len));
+		} else {
+			records[i].data[records[i].len - 1] = 0;
+			assert(receive_request(relay, in, records[i].data));
+		}
+	}
+
+	elapsed = elapsed_since(&start);
+	assert(lookup_edge(lookup_node(relay, "node0"), lookup_node(relay, "node1")));
+	fprintf(stderr, "%-6s forward %d requests in %.3f s, %.0f requests/s, %.1f bytes/request\n", style, nrequests, elapsed, nrequests / elapsed, (double)peer.bytes / nrequests);
+
+	for(int i = 0; i < nrequests; i++) {
+		free(records[i].data);
+	}
+
+	free(records);
+
+	disconnect_peer(relay, &peer);
+	disconnect_peer(relay, &inpeer);
+	meshlink_close(relay);
+}
+
+int main(int argc, char *argv[]) {
+	nrequests = argc > 1 ? atoi(argv[1]) : 10000;
+	assert(nrequests > 0);
+
+	run(false);
+	run(true);
+}
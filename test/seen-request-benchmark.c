@@ -0,0 +1,83 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/meshlink_internal.h"
+#include "../src/protocol.h"
+
+// Simulate the duplicate detection of a node that receives a steady flood of broadcast requests.
+// Every request is received three times: once when it is new, once shortly after from another peer,
+// and once more about half a minute later. Simulated time advances by ten seconds every sixth of a minute,
+// and past requests are aged at the same time, like the event loop would do.
+// Usage: seen-request-benchmark [requests per minute [minutes]]
+
+#define REQUEST_SIZE 96
+
+int main(int argc, char *argv[]) {
+	int rate = argc > 1 ? atoi(argv[1]) : 100000;
+	int minutes = argc > 2 ? atoi(argv[2]) : 3;
+	assert(rate >= 6 && minutes > 0);
+
+	int interval = rate / 6;
+	int nintervals = minutes * 6;
+	int nrequests = interval * nintervals;
+
+	// Generate requests that look like ADD_EDGE requests.
+
+	char (*requests)[REQUEST_SIZE] = calloc(nrequests, REQUEST_SIZE);
+	int *lengths = calloc(nrequests, sizeof(*lengths));
+	assert(requests && lengths);
+
+	srand(1);
+
+	for(int i = 0; i < nrequests; i++) {
+		int from = rand() % 1000;
+		int to = rand() % 1000;
+		lengths[i] = snprintf(requests[i], REQUEST_SIZE, "%d %x node%d 0 . node%d 10.0.%d.%d 655 0 . c %d 0 %x", ADD_EDGE, rand(), from, to, to / 256, to % 256, 1 + rand() % 4, rand());
+		assert(lengths[i] < REQUEST_SIZE);
+	}
+
+	meshlink_handle_t *mesh = meshlink_open_ephemeral("node0", "seen-request-benchmark", DEV_CLASS_BACKBONE);
+	assert(mesh);
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int j = 0; j < nintervals; j++) {
+		for(int k = j * interval; k < (j + 1) * interval; k++) {
+			assert(!seen_request(mesh, requests[k], lengths[k]));
+
+			if(k >= 50) {
+				assert(seen_request(mesh, requests[k - 50], lengths[k - 50]));
+			}
+
+			if(k >= 3 * interval) {
+				assert(seen_request(mesh, requests[k - 3 * interval], lengths[k - 3 * interval]));
+			}
+		}
+
+		mesh->loop.now.tv_sec += 10;
+		mesh->past_request_timeout.cb(&mesh->loop, mesh->past_request_timeout.data);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+	int nlookups = nrequests * 3 - 50 - 3 * interval;
+
+	fprintf(stderr, "%d requests/minute for %d minutes: %d lookups in %.3f s, %.0f ns/lookup\n", rate, minutes, nlookups, elapsed, elapsed * 1e9 / nlookups);
+
+	// Requests older than the request timeout should have been forgotten.
+
+	assert(!seen_request(mesh, requests[nrequests - 8 * interval], lengths[nrequests - 8 * interval]));
+
+	meshlink_close(mesh);
+	free(lengths);
+	free(requests);
+}
@@ -0,0 +1,96 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sptps-peer.h"
+#include "../src/ecdsa.h"
+#include "../src/ecdsagen.h"
+
+static bool queue_data(sptps_peer_t *peer, int direction, const void *data, size_t len) {
+	assert(peer->queued[direction] + len <= sizeof(peer->queue[direction]));
+	memcpy(peer->queue[direction] + peer->queued[direction], data, len);
+	peer->queued[direction] += len;
+	return true;
+}
+
+static bool local_send(void *handle, uint8_t type, const void *data, size_t len) {
+	(void)type;
+	sptps_peer_t *peer = handle;
+
+	if(!peer->established) {
+		return queue_data(peer, 0, data, len);
+	}
+
+	if(peer->send) {
+		return peer->send(peer, data, len);
+	}
+
+	return sptps_receive_data(&peer->sptps, data, len);
+}
+
+static bool local_receive(void *handle, uint8_t type, const void *data, uint16_t len) {
+	(void)handle;
+	(void)type;
+	(void)data;
+	(void)len;
+	return true;
+}
+
+static bool peer_send(void *handle, uint8_t type, const void *data, size_t len) {
+	(void)type;
+	return queue_data(handle, 1, data, len);
+}
+
+static bool peer_receive(void *handle, uint8_t type, const void *data, uint16_t len) {
+	sptps_peer_t *peer = handle;
+
+	if(type == SPTPS_HANDSHAKE || !peer->receive) {
+		return true;
+	}
+
+	return peer->receive(peer, type, data, len);
+}
+
+void start_sptps_peer(meshlink_handle_t *mesh, sptps_t *sptps, sptps_peer_t *peer, const char *label, sptps_peer_send_t send, sptps_peer_receive_t receive) {
+	ecdsa_t *key = ecdsa_generate();
+	char *pubkey = ecdsa_get_base64_public_key(mesh->private_key);
+	ecdsa_t *mykey = ecdsa_set_base64_public_key(pubkey);
+	free(pubkey);
+	assert(key && mykey);
+
+	memset(peer, 0, sizeof(*peer));
+	peer->send = send;
+	peer->receive = receive;
+
+	size_t labellen = strlen(label) + 1;
+	assert(sptps_start(sptps, peer, true, false, mesh->private_key, key, label, labellen, local_send, local_receive));
+	assert(sptps_start(&peer->sptps, peer, false, false, key, mykey, label, labellen, peer_send, peer_receive));
+
+	while(peer->queued[0] || peer->queued[1]) {
+		uint8_t buf[4096];
+
+		for(int i = 0; i < 2; i++) {
+			size_t len = peer->queued[i];
+			memcpy(buf, peer->queue[i], len);
+			peer->queued[i] = 0;
+
+			if(len) {
+				assert(sptps_receive_data(i ? sptps : &peer->sptps, buf, len));
+			}
+		}
+	}
+
+	assert(sptps->outstate && peer->sptps.outstate);
+	peer->established = true;
+
+	ecdsa_free(key);
+	ecdsa_free(mykey);
+}
+
+void stop_sptps_peer(sptps_peer_t *peer) {
+	sptps_stop(&peer->sptps);
+}
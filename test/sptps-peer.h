@@ -0,0 +1,36 @@
+#ifndef MESHLINK_TEST_SPTPS_PEER_H
+#define MESHLINK_TEST_SPTPS_PEER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../src/meshlink_internal.h"
+#include "../src/sptps.h"
+
+// The other end of an SPTPS session, without any sockets or event loop.
+// During the handshake, both ends exchange data through a queue in memory.
+// Afterwards, everything we send goes to the send callback if there is one, otherwise the peer decrypts it,
+// and passes every record to the receive callback.
+typedef struct sptps_peer sptps_peer_t;
+typedef bool (*sptps_peer_send_t)(sptps_peer_t *peer, const void *data, size_t len);
+typedef bool (*sptps_peer_receive_t)(sptps_peer_t *peer, uint8_t type, const void *data, uint16_t len);
+
+struct sptps_peer {
+	sptps_t sptps;
+	bool established;
+	uint8_t queue[2][4096];
+	size_t queued[2];
+	sptps_peer_send_t send;
+	sptps_peer_receive_t receive;
+	void *priv;
+};
+
+/// Start a session between the mesh and a new peer, and complete the handshake.
+/// The handle of our end of the session is the peer, so copies of the session all send to the same peer.
+extern void start_sptps_peer(meshlink_handle_t *mesh, sptps_t *sptps, sptps_peer_t *peer, const char *label, sptps_peer_send_t send, sptps_peer_receive_t receive);
+
+/// Stop the peer's end of the session.
+extern void stop_sptps_peer(sptps_peer_t *peer);
+
+#endif
@@ -0,0 +1,145 @@
+#define _GNU_SOURCE 1
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sptps-peer.h"
+#include "../src/meshlink_internal.h"
+#include "../src/connection.h"
+#include "../src/edge.h"
+#include "../src/list.h"
+#include "../src/node.h"
+#include "../src/protocol.h"
+#include "../src/sptps.h"
+#include "../src/submesh.h"
+#include "../src/xalloc.h"
+
+// Measure the cost of flooding ADD_EDGE requests for edges inside a submesh,
+// on a node with many active connections spread over many submeshes.
+// Nodes are divided evenly over the submeshes and the core mesh, and we have a connection to every fifth node.
+// Only the connections to nodes in the core mesh and in the edge's submesh should get the request.
+// The connections share one completed SPTPS session, but without any sockets or event loop.
+// Usage: submesh-broadcast-benchmark [submeshes [nodes [broadcasts]]]
+
+static uint64_t records;
+
+static bool count_record(sptps_peer_t *peer, const void *data, size_t len) {
+	(void)peer;
+	(void)data;
+	(void)len;
+	records++;
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	int nsubmeshes = argc > 1 ? atoi(argv[1]) : 200;
+	int nnodes = argc > 2 ? atoi(argv[2]) : 5000;
+	int nbroadcasts = argc > 3 ? atoi(argv[3]) : 100000;
+	int ngroups = nsubmeshes + 1;
+	assert(nsubmeshes > 0 && nnodes >= 2 * ngroups && nbroadcasts > 0);
+
+	meshlink_handle_t *mesh = meshlink_open_ephemeral("hub", "submesh-broadcast-benchmark", DEV_CLASS_BACKBONE);
+	assert(mesh);
+
+	sptps_t session;
+	sptps_peer_t peer;
+	start_sptps_peer(mesh, &session, &peer, "submesh-broadcast-benchmark", count_record, NULL);
+
+	// Create the submeshes and nodes, the last group of nodes is in the core mesh.
+
+	submesh_t **submeshes = xzalloc(ngroups * sizeof(*submeshes));
+
+	for(int i = 0; i < nsubmeshes; i++) {
+		char name[32];
+		snprintf(name, sizeof(name), "submesh%d", i);
+		submeshes[i] = lookup_or_create_submesh(mesh, name);
+		assert(submeshes[i]);
+	}
+
+	node_t **nodes = xzalloc(nnodes * sizeof(*nodes));
+	int *recipients = xzalloc(ngroups * sizeof(*recipients));
+	int nconnections = 0;
+
+	for(int i = 0; i < nnodes; i++) {
+		nodes[i] = new_node();
+		xasprintf(&nodes[i]->name, "node%d", i);
+		nodes[i]->submesh = submeshes[i % ngroups];
+		node_add(mesh, nodes[i]);
+
+		if(i % 5) {
+			continue;
+		}
+
+		connection_t *c = new_connection();
+		c->name = xstrdup(nodes[i]->name);
+		c->node = nodes[i];
+		c->allow_request = ALL;
+		c->status.binary = true;
+		c->sptps = session;
+		connection_add(mesh, c);
+		connection_activate(mesh, c);
+
+		recipients[i % ngroups]++;
+		nconnections++;
+	}
+
+	// Every submesh gets an edge between two of its nodes.
+
+	edge_t **edges = xzalloc(nsubmeshes * sizeof(*edges));
+
+	for(int i = 0; i < nsubmeshes; i++) {
+		edges[i] = new_edge();
+		edges[i]->from = nodes[i];
+		edges[i]->to = nodes[i + ngroups];
+		edges[i]->weight = 1;
+		edges[i]->address.in.sin_family = AF_INET;
+		edges[i]->address.in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		edges[i]->address.in.sin_port = htons(655);
+	}
+
+	struct timespec start, end;
+	uint64_t expected = 0;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	for(int i = 0; i < nbroadcasts; i++) {
+		int j = i % nsubmeshes;
+		assert(send_add_edge(mesh, mesh->everyone, edges[j], 0));
+		expected += recipients[j] + recipients[nsubmeshes];
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+
+	fprintf(stderr, "%d submeshes, %d nodes, %d connections: %d broadcasts in %.3f s, %.0f ns/broadcast, %.1f requests/broadcast\n", nsubmeshes, nnodes, nconnections, nbroadcasts, elapsed, elapsed * 1e9 / nbroadcasts, (double)records / nbroadcasts);
+
+	assert(records == expected);
+
+	// Clean up. The connections share the SPTPS session, so it may only be stopped once.
+
+	for(list_node_t *node = mesh->connections->head, *next; node; node = next) {
+		next = node->next;
+		connection_t *c = node->data;
+		connection_deactivate(mesh, c);
+		memset(&c->sptps, 0, sizeof(c->sptps));
+		list_delete_node(mesh->connections, node);
+	}
+
+	for(int i = 0; i < nsubmeshes; i++) {
+		free_edge(edges[i]);
+	}
+
+	sptps_stop(&session);
+	stop_sptps_peer(&peer);
+	meshlink_close(mesh);
+	free(edges);
+	free(recipients);
+	free(nodes);
+	free(submeshes);
+}
@@ -0,0 +1,116 @@
+#define _GNU_SOURCE
+
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "meshlink.h"
+#include "devtools.h"
+#include "utils.h"
+
+// Check that a node that reconnects to a mesh only exchanges the edges that changed while it was away,
+// and still ends up with the same view of the topology as the rest of the mesh.
+
+#define NLEAVES 6
+
+static meshlink_handle_t *mesh[NLEAVES + 1];
+
+static bool all_reachable(meshlink_handle_t *from) {
+	for(int i = 0; i <= NLEAVES; i++) {
+		meshlink_node_t *node = meshlink_get_node(from, meshlink_get_self(mesh[i])->name);
+
+		if(!node || !meshlink_get_node_reachability(from, node, NULL, NULL)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static size_t count_edges(meshlink_handle_t *from) {
+	size_t nedges = 0;
+	devtool_edge_t *edges = devtool_get_all_edges(from, NULL, &nedges);
+	free(edges);
+	return nedges;
+}
+
+static bool same_topology(meshlink_handle_t *a, meshlink_handle_t *b) {
+	return all_reachable(a) && all_reachable(b) && count_edges(a) == count_edges(b);
+}
+
+int main(void) {
+	meshlink_set_log_cb(NULL, MESHLINK_WARNING, log_cb);
+
+	// Create a hub and a few leaves that only know the hub.
+
+	char *data[NLEAVES + 1];
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		char *path = NULL;
+		char name[16];
+		assert(asprintf(&path, "topology_sync_conf.%d", i) != -1 && path);
+		snprintf(name, sizeof(name), "node%d", i);
+
+		assert(meshlink_destroy(path));
+		mesh[i] = meshlink_open(path, name, "topology-sync", DEV_CLASS_BACKBONE);
+		assert(mesh[i]);
+		free(path);
+
+		assert(meshlink_set_canonical_address(mesh[i], meshlink_get_self(mesh[i]), "localhost", NULL));
+		meshlink_enable_discovery(mesh[i], false);
+
+		data[i] = meshlink_export(mesh[i]);
+		assert(data[i]);
+	}
+
+	for(int i = 1; i <= NLEAVES; i++) {
+		assert(meshlink_import(mesh[i], data[0]));
+		assert(meshlink_import(mesh[0], data[i]));
+	}
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		free(data[i]);
+		assert(meshlink_start(mesh[i]));
+	}
+
+	meshlink_handle_t *hub = mesh[0];
+	meshlink_handle_t *leaf = mesh[NLEAVES];
+
+	assert_after(same_topology(hub, leaf), 30);
+
+	// Let the last leaf go away and come back.
+
+	devtool_topology_sync_stats_t before, after;
+	devtool_get_topology_sync_stats(hub, &before);
+
+	meshlink_stop(leaf);
+	meshlink_node_t *leaf_node = meshlink_get_node(hub, meshlink_get_self(leaf)->name);
+	assert(leaf_node);
+	assert_after(!meshlink_get_node_reachability(hub, leaf_node, NULL, NULL), 15);
+
+	assert(meshlink_start(leaf));
+	assert_after(same_topology(hub, leaf), 30);
+
+	// The hub should not have sent most of the edges again.
+
+	devtool_get_topology_sync_stats(hub, &after);
+	uint64_t sent = after.bytes_sent - before.bytes_sent;
+	uint64_t full = after.bytes_full - before.bytes_full;
+	fprintf(stderr, "%lu syncs, %lu edges sent, %lu edges skipped, %lu of %lu bytes sent\n",
+	        (unsigned long)(after.syncs - before.syncs), (unsigned long)(after.edges_sent - before.edges_sent),
+	        (unsigned long)(after.edges_skipped - before.edges_skipped), (unsigned long)sent, (unsigned long)full);
+
+	assert(after.syncs > before.syncs);
+	assert(after.edges_skipped > before.edges_skipped);
+	assert(sent < full);
+
+	// Clean up.
+
+	for(int i = 0; i <= NLEAVES; i++) {
+		meshlink_close(mesh[i]);
+	}
+}
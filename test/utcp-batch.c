@@ -0,0 +1,178 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+// Check that a malformed segment in a batch of coalesced packets is reported,
+// and that the segments after it are not processed.
+// Also check that packets are only coalesced for peers that announce support for batches.
+
+#define OLD_PORT 2 // Used by a hand-crafted peer that does not announce any features
+
+static bool capture;
+static uint8_t captured[2][64];
+static uint16_t captured_len[2];
+static int ncaptured;
+
+static int batches; // Datagrams sent by utcp_a that hold several packets
+static int old_packets; // Datagrams sent by utcp_a to the hand-crafted peer
+static struct hdr old_last;
+
+static char received[16];
+static size_t received_len;
+
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	if(from == utcp_a && !hdr->src && !hdr->dst) {
+		batches++;
+	}
+
+	// Packets for the hand-crafted peer are inspected, but not delivered
+	if(hdr->dst == OLD_PORT) {
+		old_packets++;
+		old_last = *hdr;
+		return false;
+	}
+
+	if(!capture || from != utcp_a) {
+		return true;
+	}
+
+	assert(ncaptured < 2);
+	assert(len <= sizeof(captured[0]));
+	memcpy(captured[ncaptured], data, len);
+	captured_len[ncaptured++] = len;
+	return false;
+}
+
+static ssize_t recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(data) {
+		assert(received_len + len <= sizeof(received));
+		memcpy(received + received_len, data, len);
+		received_len += len;
+	}
+
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	utcp_accept(c, recv_cb, NULL);
+}
+
+static void coalesce_cb(struct utcp *utcp) {
+	(void)utcp;
+}
+
+// Complete the handshake of a connection to the hand-crafted peer
+static void inject_synack(struct utcp_connection *c, uint32_t ack) {
+	struct {
+		struct hdr hdr;
+		uint8_t init[4];
+	} pkt = {
+		.hdr = {
+			.src = OLD_PORT,
+			.dst = c->src,
+			.seq = 5000,
+			.ack = ack,
+			.wnd = 65536,
+			.ctl = SYN | ACK,
+			.aux = 0x0101,
+		},
+		.init = {1, 0, 0, UTCP_TCP},
+	};
+
+	assert(utcp_recv(c->utcp, &pkt, sizeof(pkt)) != -1);
+}
+
+static size_t add_segment(uint8_t *batch, size_t len, const void *data, uint16_t seglen) {
+	memcpy(batch + len, &seglen, sizeof(seglen));
+	memcpy(batch + len + sizeof(seglen), data, seglen);
+	return len + sizeof(seglen) + seglen;
+}
+
+int main(void) {
+	open_utcp_pair(accept_cb, filter);
+
+	struct utcp_connection *c = utcp_connect_ex(utcp_a, 1, NULL, NULL, UTCP_TCP);
+	assert(c);
+	deliver_utcp_packets();
+	assert(c->state == ESTABLISHED);
+
+	// Capture two data packets instead of delivering them
+
+	capture = true;
+	assert(utcp_send(c, "a", 1) == 1);
+	assert(utcp_send(c, "b", 1) == 1);
+	utcp_flush(utcp_a);
+	assert(ncaptured == 2);
+	capture = false;
+
+	// A batch with a segment that is too short for a header in between the two packets
+
+	uint8_t batch[256] = {0};
+	size_t len = BATCH_HDR_SIZE;
+	len = add_segment(batch, len, captured[0], captured_len[0]);
+	len = add_segment(batch, len, "xyz", 3);
+	len = add_segment(batch, len, captured[1], captured_len[1]);
+
+	errno = 0;
+	assert(utcp_recv(utcp_b, batch, len) == -1);
+	assert(errno == EBADMSG);
+	assert(received_len == 1 && received[0] == 'a');
+
+	// A well-formed batch is processed completely
+
+	len = BATCH_HDR_SIZE;
+	len = add_segment(batch, len, captured[1], captured_len[1]);
+	assert(utcp_recv(utcp_b, batch, len) == 0);
+	assert(received_len == 2 && !memcmp(received, "ab", 2));
+
+	// With coalescing enabled, small packets to a peer that announced support share a datagram
+
+	assert(c->features & FEATURE_BATCH);
+	assert(utcp_set_coalesce_cb(utcp_a, coalesce_cb));
+	batches = 0;
+	assert(utcp_send(c, "c", 1) == 1);
+	assert(utcp_send(c, "d", 1) == 1);
+	utcp_flush(utcp_a);
+	assert(batches == 1);
+	deliver_utcp_packets();
+	assert(received_len == 4 && !memcmp(received, "abcd", 4));
+
+	close_utcp_pair();
+
+	// A peer that does not announce support gets every packet in its own datagram
+
+	open_utcp_pair(accept_cb, filter);
+	assert(utcp_set_coalesce_cb(utcp_a, coalesce_cb));
+
+	c = utcp_connect_ex(utcp_a, OLD_PORT, NULL, NULL, UTCP_TCP);
+	assert(c);
+	utcp_flush(utcp_a);
+	assert(old_last.ctl == SYN);
+	inject_synack(c, old_last.seq + 1);
+	utcp_flush(utcp_a);
+	assert(c->state == ESTABLISHED);
+	assert(!(c->features & FEATURE_BATCH));
+
+	batches = 0;
+	old_packets = 0;
+	assert(utcp_send(c, "e", 1) == 1);
+	assert(utcp_send(c, "f", 1) == 1);
+	utcp_flush(utcp_a);
+	assert(old_packets == 2);
+	assert(batches == 0);
+
+	close_utcp_pair();
+}
@@ -0,0 +1,156 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+// Check that a fragment lost on an unreliable connection is rebuilt from the parity packet,
+// and that parity packets are only sent to peers that announced they understand them.
+
+#define PORT 1
+#define OLD_PORT 2 // Used by a hand-crafted peer that does not announce any features
+#define MSGSIZE 4000
+
+static struct utcp_connection *accepted;
+
+static int fragments_sent;
+static int drop_fragment = -1;
+static int dropped;
+static int parity_sent;
+
+static struct {
+	struct hdr hdr;
+	uint8_t init[4];
+} old_synack;
+static int old_parity;
+
+static uint8_t received[MSGSIZE];
+static size_t received_len;
+
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	if(hdr->ctl & PAR) {
+		parity_sent++;
+	}
+
+	// Packets for the hand-crafted peer are inspected, but not delivered.
+	if(from == utcp_b && hdr->dst == OLD_PORT) {
+		if(hdr->ctl == (SYN | ACK)) {
+			assert(len <= sizeof(old_synack));
+			memcpy(&old_synack, data, len);
+		}
+
+		if(hdr->ctl & PAR) {
+			old_parity++;
+		}
+
+		return false;
+	}
+
+	if(from == utcp_a && !(hdr->ctl & (SYN | PAR)) && len > sizeof(*hdr)) {
+		if(fragments_sent++ == drop_fragment) {
+			dropped++;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static ssize_t recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(data) {
+		assert(received_len + len <= sizeof(received));
+		memcpy(received + received_len, data, len);
+		received_len += len;
+	}
+
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	utcp_accept(c, recv_cb, NULL);
+	accepted = c;
+}
+
+static void inject(uint16_t ctl, uint32_t seq, uint32_t ack) {
+	struct {
+		struct hdr hdr;
+		uint8_t init[4];
+	} pkt = {
+		.hdr = {
+			.src = OLD_PORT,
+			.dst = PORT,
+			.seq = seq,
+			.ack = ack,
+			.wnd = 65536,
+			.ctl = ctl,
+			.aux = ctl & SYN ? 0x0101 : 0,
+		},
+		.init = {1, 0, 0, UTCP_UDP},
+	};
+
+	assert(utcp_recv(utcp_b, &pkt, ctl & SYN ? sizeof(pkt) : sizeof(pkt.hdr)) != -1);
+}
+
+int main(void) {
+	uint8_t msg[MSGSIZE];
+
+	for(size_t i = 0; i < sizeof(msg); i++) {
+		msg[i] = i * 7;
+	}
+
+	open_utcp_pair(accept_cb, filter);
+	assert(MSGSIZE > 3 * utcp_get_mss(utcp_a));
+
+	// Both sides announce parity support during the handshake
+
+	struct utcp_connection *c = utcp_connect_ex(utcp_a, PORT, recv_cb, NULL, UTCP_UDP);
+	assert(c);
+	deliver_utcp_packets();
+	assert(accepted);
+	assert(c->state == ESTABLISHED && accepted->state == ESTABLISHED);
+	assert(c->features & FEATURE_PARITY);
+	assert(accepted->features & FEATURE_PARITY);
+
+	// Drop the second fragment of a message, it should be rebuilt from the parity
+
+	utcp_set_fec(c, 4);
+	drop_fragment = 1;
+	assert(utcp_send(c, msg, sizeof(msg)) == sizeof(msg));
+	deliver_utcp_packets();
+
+	assert(dropped == 1);
+	assert(parity_sent);
+	assert(received_len == sizeof(msg));
+	assert(!memcmp(received, msg, sizeof(msg)));
+	assert(utcp_get_fec_recovered(accepted) == 1);
+	assert(utcp_get_fec_lost(accepted) == 0);
+
+	// A peer that does not announce parity support never gets parity packets
+
+	accepted = NULL;
+	inject(SYN, 1000, 0);
+	assert(accepted == NULL);
+	assert(old_synack.hdr.ctl == (SYN | ACK));
+	assert(old_synack.hdr.aux == 0x0101);
+	assert(old_synack.init[2] == 0);
+
+	inject(ACK, 1001, old_synack.hdr.seq + 1);
+	assert(accepted);
+	assert(!(accepted->features & FEATURE_PARITY));
+
+	utcp_set_fec(accepted, 4);
+	assert(utcp_send(accepted, msg, sizeof(msg)) == sizeof(msg));
+	assert(old_parity == 0);
+
+	close_utcp_pair();
+}
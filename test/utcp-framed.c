@@ -0,0 +1,174 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+// Check that a message on a framed reliable connection that the application does not accept
+// is kept and offered again later, without losing or reordering any messages.
+// Also check that framed reliable connections with peers that do not announce support for them carry a plain byte stream.
+
+#define PORT 1
+#define OLD_PORT 2 // Used by a hand-crafted peer that does not announce any features
+
+static const size_t sizes[] = {10, 20000, 30};
+#define NMESSAGES (sizeof(sizes) / sizeof(*sizes))
+
+static bool refuse;
+static int offers;
+static size_t delivered;
+
+static struct utcp_connection *accepted;
+
+// Packets sent to the hand-crafted peer
+static struct {
+	struct hdr hdr;
+	uint8_t data[16];
+} old_last;
+static size_t old_last_len;
+
+static uint8_t pattern(size_t message, size_t offset) {
+	return message * 31 + offset;
+}
+
+static ssize_t recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(!data) {
+		return 0;
+	}
+
+	assert(delivered < NMESSAGES);
+	assert(len == sizes[delivered]);
+	offers++;
+
+	if(refuse) {
+		// Accepting only part of a message counts as not accepting it
+		return len / 2;
+	}
+
+	const uint8_t *p = data;
+
+	for(size_t i = 0; i < len; i++) {
+		assert(p[i] == pattern(delivered, i));
+	}
+
+	delivered++;
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)port;
+	(void)data;
+	(void)len;
+
+	utcp_accept(c, recv_cb, NULL);
+	accepted = c;
+}
+
+// Packets for the hand-crafted peer are inspected, but not delivered.
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	(void)from;
+
+	if(hdr->dst != OLD_PORT) {
+		return true;
+	}
+
+	assert(len <= sizeof(old_last));
+	memcpy(&old_last, data, len);
+	old_last_len = len;
+	return false;
+}
+
+static void inject(struct utcp *to, uint16_t src, uint16_t dst, uint16_t ctl, uint32_t seq, uint32_t ack, uint8_t flags) {
+	struct {
+		struct hdr hdr;
+		uint8_t init[4];
+	} pkt = {
+		.hdr = {
+			.src = src,
+			.dst = dst,
+			.seq = seq,
+			.ack = ack,
+			.wnd = 65536,
+			.ctl = ctl,
+			.aux = ctl & SYN ? 0x0101 : 0,
+		},
+		.init = {1, 0, 0, flags},
+	};
+
+	assert(utcp_recv(to, &pkt, ctl & SYN ? sizeof(pkt) : sizeof(pkt.hdr)) != -1);
+}
+
+// Check that the last packet sent to the hand-crafted peer carries just the data, without a length in front.
+static void check_unframed(struct utcp_connection *c) {
+	assert(!(c->flags & UTCP_FRAMED));
+	assert(!(c->features & FEATURE_FRAMED));
+	assert(utcp_send(c, "abc", 3) == 3);
+	assert(old_last_len == sizeof(old_last.hdr) + 3);
+	assert(!memcmp(old_last.data, "abc", 3));
+}
+
+int main(void) {
+	open_utcp_pair(accept_cb, filter);
+
+	// Both sides announce support for framed reliable connections during the handshake
+
+	struct utcp_connection *c = utcp_connect_ex(utcp_a, PORT, NULL, NULL, UTCP_TCP | UTCP_FRAMED);
+	assert(c);
+	assert(utcp_send(c, "abc", 3) == 0);
+	deliver_utcp_packets();
+	assert(c->state == ESTABLISHED);
+	assert(c->flags & UTCP_FRAMED && c->features & FEATURE_FRAMED);
+	assert(accepted->flags & UTCP_FRAMED && accepted->features & FEATURE_FRAMED);
+
+	// The first message is refused, the others arrive behind it
+
+	refuse = true;
+
+	for(size_t i = 0; i < NMESSAGES; i++) {
+		uint8_t buf[sizes[i]];
+
+		for(size_t j = 0; j < sizes[i]; j++) {
+			buf[j] = pattern(i, j);
+		}
+
+		assert(utcp_send(c, buf, sizes[i]) == (ssize_t)sizes[i]);
+	}
+
+	deliver_utcp_packets();
+	assert(offers >= 1);
+	assert(delivered == 0);
+
+	// Once the application accepts messages again, all of them are delivered in order
+
+	refuse = false;
+	offers = 0;
+	utcp_timeout(utcp_b);
+	assert(delivered == NMESSAGES);
+	assert(offers == NMESSAGES);
+
+	// A connection from a peer that does not announce support is accepted as a byte stream
+
+	accepted = NULL;
+	inject(utcp_b, OLD_PORT, PORT, SYN, 1000, 0, UTCP_TCP | UTCP_FRAMED);
+	assert(old_last.hdr.ctl == (SYN | ACK));
+	inject(utcp_b, OLD_PORT, PORT, ACK, 1001, old_last.hdr.seq + 1, 0);
+	assert(accepted && accepted->state == ESTABLISHED);
+	check_unframed(accepted);
+
+	// A connection to such a peer becomes a byte stream once the handshake is done
+
+	c = utcp_connect_ex(utcp_a, OLD_PORT, NULL, NULL, UTCP_TCP | UTCP_FRAMED);
+	assert(c);
+	assert(old_last.hdr.ctl == SYN);
+	inject(utcp_a, OLD_PORT, c->src, SYN | ACK, 5000, old_last.hdr.seq + 1, UTCP_TCP | UTCP_FRAMED);
+	assert(c->state == ESTABLISHED);
+	check_unframed(c);
+
+	close_utcp_pair();
+}
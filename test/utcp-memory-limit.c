@@ -0,0 +1,115 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+// Check that the receive window is limited to what the memory pool can still provide,
+// and that the peer is told when it opens again.
+
+#define MSG_PORT 1 // Framed connection with a message the application does not accept yet
+#define IDLE_PORT 2 // Connection whose receive window is watched
+#define LIMIT 65536
+#define MSGSIZE 30000
+
+static bool refuse = true;
+static size_t delivered;
+
+static uint32_t idle_wnd;
+static int idle_packets;
+
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	if(from == utcp_b && hdr->src == IDLE_PORT) {
+		idle_wnd = hdr->wnd;
+		idle_packets++;
+	}
+
+	return true;
+}
+
+static ssize_t recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(!data || refuse) {
+		return 0;
+	}
+
+	delivered += len;
+	return len;
+}
+
+static ssize_t idle_recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+	(void)data;
+
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	utcp_accept(c, port == IDLE_PORT ? idle_recv_cb : recv_cb, NULL);
+}
+
+int main(void) {
+	static uint8_t msg[MSGSIZE];
+
+	open_utcp_pair(accept_cb, filter);
+
+	struct utcp_pool *pool = utcp_pool_init();
+	assert(pool);
+	utcp_pool_set_limit(pool, LIMIT);
+	assert(utcp_set_pool(utcp_b, pool));
+
+	struct utcp_connection *idle = utcp_connect_ex(utcp_a, IDLE_PORT, NULL, NULL, UTCP_TCP);
+	struct utcp_connection *c = utcp_connect_ex(utcp_a, MSG_PORT, NULL, NULL, UTCP_TCP | UTCP_FRAMED);
+	assert(idle && c);
+	deliver_utcp_packets();
+	assert(idle->state == ESTABLISHED && c->state == ESTABLISHED);
+
+	// The receive buffer can never grow beyond the limit of the pool
+
+	assert(LIMIT < DEFAULT_MAXRCVBUFSIZE);
+	assert(idle_wnd == LIMIT);
+
+	// A message that is not accepted holds on to memory of the pool, so less is advertised
+
+	assert(utcp_send(c, msg, sizeof(msg)) == sizeof(msg));
+	deliver_utcp_packets();
+	assert(delivered == 0);
+	assert(utcp_pool_get_used(pool) >= MSGSIZE);
+
+	idle_packets = 0;
+	assert(utcp_send(idle, "x", 1) == 1);
+	deliver_utcp_packets();
+	assert(idle_packets == 1);
+	assert(idle_wnd < LIMIT);
+	uint32_t clamped = idle_wnd;
+
+	// Once the message is accepted, its memory is freed, and the larger window is announced without waiting for new data
+
+	refuse = false;
+	idle_packets = 0;
+	utcp_timeout(utcp_b);
+	assert(delivered == MSGSIZE);
+	assert(utcp_pool_get_used(pool) == 0);
+	assert(idle_packets == 1);
+	assert(idle_wnd > clamped);
+	assert(idle_wnd == LIMIT);
+
+	// Nothing more is sent when the window has not changed
+
+	utcp_timeout(utcp_b);
+	assert(idle_packets == 1);
+
+	close_utcp_pair();
+	utcp_pool_exit(pool);
+}
@@ -0,0 +1,124 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+// Check that a connection that carried data in its SYN still gets established if the SYN+ACK is lost,
+// even though the peer already sent its reply.
+// Also check that a retransmitted SYN+ACK still tells the peer which features we support.
+
+#define PORT 1
+#define PLAIN_PORT 2 // Used for a connection without data in its SYN
+
+static int accepted;
+static struct utcp_connection *plain_accepted;
+static int synacks_dropped;
+
+static char a_received[16];
+static size_t a_received_len;
+static char b_received[16];
+static size_t b_received_len;
+
+static bool filter(struct utcp *from, const struct hdr *hdr, const void *data, size_t len) {
+	(void)data;
+	(void)len;
+
+	if(from == utcp_b && hdr->ctl & SYN && !synacks_dropped) {
+		synacks_dropped++;
+		return false;
+	}
+
+	return true;
+}
+
+static ssize_t a_recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(data) {
+		assert(a_received_len + len <= sizeof(a_received));
+		memcpy(a_received + a_received_len, data, len);
+		a_received_len += len;
+	}
+
+	return len;
+}
+
+static ssize_t b_recv_cb(struct utcp_connection *c, const void *data, size_t len) {
+	(void)c;
+
+	if(data) {
+		assert(b_received_len + len <= sizeof(b_received));
+		memcpy(b_received + b_received_len, data, len);
+		b_received_len += len;
+	}
+
+	return len;
+}
+
+static void accept_cb(struct utcp_connection *c, uint16_t port, const void *data, size_t len) {
+	if(port == PLAIN_PORT) {
+		assert(!len);
+		utcp_accept(c, b_recv_cb, NULL);
+		plain_accepted = c;
+		return;
+	}
+
+	assert(port == PORT);
+	assert(len == 4 && !memcmp(data, "ping", 4));
+
+	accepted++;
+	utcp_accept(c, b_recv_cb, NULL);
+	assert(utcp_send(c, "pong", 4) == 4);
+}
+
+static struct utcp_connection *c;
+
+static bool reply_received(void) {
+	return c->state == ESTABLISHED && a_received_len == 4;
+}
+
+static bool data_received(void) {
+	return b_received_len == 5;
+}
+
+static bool plain_established(void) {
+	return c->state == ESTABLISHED && plain_accepted && plain_accepted->state == ESTABLISHED;
+}
+
+int main(void) {
+	open_utcp_pair(accept_cb, filter);
+
+	// The first SYN+ACK is dropped, the reply sent right after it must not be mistaken for it
+
+	c = utcp_connect_data(utcp_a, PORT, a_recv_cb, NULL, UTCP_TCP, "ping", 4);
+	assert(c);
+
+	assert(run_utcp_pair(reply_received, 10));
+	assert(synacks_dropped == 1);
+	assert(accepted == 1);
+	assert(!memcmp(a_received, "pong", 4));
+
+	// The connection works normally afterwards
+
+	assert(utcp_send(c, "hello", 5) == 5);
+	assert(run_utcp_pair(data_received, 10));
+	assert(!memcmp(b_received, "hello", 5));
+
+	// Without data in the SYN, the peer waits in SYN_RECEIVED and retransmits the lost SYN+ACK itself
+
+	synacks_dropped = 0;
+	c = utcp_connect_ex(utcp_a, PLAIN_PORT, a_recv_cb, NULL, UTCP_TCP);
+	assert(c);
+
+	assert(run_utcp_pair(plain_established, 10));
+	assert(synacks_dropped == 1);
+	assert(c->features == FEATURES);
+	assert(plain_accepted->features == FEATURES);
+
+	close_utcp_pair();
+}
@@ -0,0 +1,132 @@
+#ifdef NDEBUG
+#undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utcp-utils.h"
+
+struct utcp *utcp_a;
+struct utcp *utcp_b;
+
+static utcp_filter_t filter;
+
+struct packet {
+	struct utcp *to;
+	size_t len;
+	uint8_t data[];
+};
+
+// Packets in flight, in the order they were sent
+static struct packet *queue[4096];
+static unsigned int head;
+static unsigned int tail;
+static int queued_for_a;
+static int queued_for_b;
+
+static ssize_t send_cb(struct utcp *utcp, const void *data, size_t len) {
+	struct hdr hdr;
+	assert(len >= sizeof(hdr));
+	memcpy(&hdr, data, sizeof(hdr));
+
+	if(filter && !filter(utcp, &hdr, data, len)) {
+		return len;
+	}
+
+	assert(tail - head < sizeof(queue) / sizeof(*queue));
+	struct packet *packet = malloc(sizeof(*packet) + len);
+	assert(packet);
+	packet->len = len;
+	memcpy(packet->data, data, len);
+
+	if(utcp == utcp_a) {
+		packet->to = utcp_b;
+		queued_for_b++;
+	} else {
+		packet->to = utcp_a;
+		queued_for_a++;
+	}
+
+	queue[tail++ % (sizeof(queue) / sizeof(*queue))] = packet;
+	return len;
+}
+
+void open_utcp_pair(utcp_accept_t accept, utcp_filter_t packet_filter) {
+	filter = packet_filter;
+	utcp_a = utcp_init(NULL, NULL, send_cb, NULL);
+	utcp_b = utcp_init(accept, NULL, send_cb, NULL);
+	assert(utcp_a && utcp_b);
+}
+
+int queued_utcp_packets(struct utcp *to) {
+	return to == utcp_a ? queued_for_a : queued_for_b;
+}
+
+static struct packet *dequeue(void) {
+	if(head == tail) {
+		return NULL;
+	}
+
+	struct packet *packet = queue[head++ % (sizeof(queue) / sizeof(*queue))];
+
+	if(packet->to == utcp_a) {
+		queued_for_a--;
+	} else {
+		queued_for_b--;
+	}
+
+	return packet;
+}
+
+void deliver_utcp_packets(void) {
+	// Packets sent while delivering are appended to the queue, and delivered in the same loop.
+	struct packet *packet;
+
+	while((packet = dequeue())) {
+		assert(utcp_recv(packet->to, packet->data, packet->len) != -1);
+		free(packet);
+	}
+}
+
+bool run_utcp_pair(bool (*cond)(void), int timeout) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	end.tv_sec += timeout;
+
+	while(true) {
+		deliver_utcp_packets();
+
+		if(cond()) {
+			return true;
+		}
+
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		if(now.tv_sec > end.tv_sec || (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec)) {
+			return false;
+		}
+
+		nanosleep(&(struct timespec) {
+			.tv_nsec = 10000000
+		}, NULL);
+		utcp_timeout(utcp_a);
+		utcp_timeout(utcp_b);
+	}
+}
+
+void close_utcp_pair(void) {
+	struct packet *packet;
+
+	while((packet = dequeue())) {
+		free(packet);
+	}
+
+	utcp_exit(utcp_a);
+	utcp_exit(utcp_b);
+	utcp_a = NULL;
+	utcp_b = NULL;
+}
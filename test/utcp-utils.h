@@ -0,0 +1,32 @@
+#ifndef MESHLINK_TEST_UTCP_UTILS_H
+#define MESHLINK_TEST_UTCP_UTILS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "../src/utcp_priv.h"
+
+// Two UTCP instances that exchange packets through a queue in memory.
+// Every packet is first passed to the filter, which can inspect it and decide whether it gets delivered.
+typedef bool (*utcp_filter_t)(struct utcp *from, const struct hdr *hdr, const void *data, size_t len);
+
+extern struct utcp *utcp_a;
+extern struct utcp *utcp_b;
+
+/// Create a pair of UTCP instances, only the second one accepts connections.
+extern void open_utcp_pair(utcp_accept_t accept, utcp_filter_t filter);
+
+/// Number of packets queued for delivery to the given instance.
+extern int queued_utcp_packets(struct utcp *to);
+
+/// Deliver queued packets, including those sent in response, until none are left.
+extern void deliver_utcp_packets(void);
+
+/// Deliver packets and run the timers of both instances until the condition is true, or the timeout in seconds has passed.
+extern bool run_utcp_pair(bool (*cond)(void), int timeout);
+
+/// Free both instances and any undelivered packets.
+extern void close_utcp_pair(void);
+
+#endif